@@ -0,0 +1,268 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <map>
+#include <new>
+
+#include <curl/curl.h>
+
+#include "bench_util.h"
+
+#if __cplusplus >= 201103L
+#define BENCH_THROW_BAD_ALLOC
+#define BENCH_NOTHROW noexcept
+#else
+#define BENCH_THROW_BAD_ALLOC throw(std::bad_alloc)
+#define BENCH_NOTHROW throw()
+#endif
+
+static uint64_t s_alloc_count = 0;
+static uint64_t s_alloc_bytes = 0;
+static uint64_t s_curl_alloc_count = 0;
+static __thread uint64_t s_thread_alloc_count = 0;
+static __thread uint64_t s_thread_alloc_bytes = 0;
+static __thread uint64_t s_thread_curl_alloc_count = 0;
+
+static inline void count_alloc(size_t size)
+{
+    __atomic_fetch_add(&s_alloc_count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&s_alloc_bytes, size, __ATOMIC_RELAXED);
+    ++s_thread_alloc_count;
+    s_thread_alloc_bytes += size;
+}
+
+static inline void count_curl_alloc(size_t size)
+{
+    count_alloc(size);
+    __atomic_fetch_add(&s_curl_alloc_count, 1, __ATOMIC_RELAXED);
+    ++s_thread_curl_alloc_count;
+}
+
+static void * counting_malloc(size_t size)
+{
+    count_curl_alloc(size);
+    return malloc(size);
+}
+
+static void counting_free(void *p)
+{
+    free(p);
+}
+
+// a realloc may move the block, it is counted like a new one
+static void * counting_realloc(void *p, size_t size)
+{
+    count_curl_alloc(size);
+    return realloc(p, size);
+}
+
+static char * counting_strdup(const char *str)
+{
+    count_curl_alloc(strlen(str) + 1);
+    return strdup(str);
+}
+
+static void * counting_calloc(size_t nmemb, size_t size)
+{
+    count_curl_alloc(nmemb * size);
+    return calloc(nmemb, size);
+}
+
+void * operator new(size_t size) BENCH_THROW_BAD_ALLOC
+{
+    count_alloc(size);
+    void *p = malloc(size == 0 ? 1 : size);
+    if (p == NULL) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void * operator new[](size_t size) BENCH_THROW_BAD_ALLOC
+{
+    return operator new(size);
+}
+
+void operator delete(void *p) BENCH_NOTHROW
+{
+    free(p);
+}
+
+void operator delete[](void *p) BENCH_NOTHROW
+{
+    free(p);
+}
+
+#ifdef __cpp_sized_deallocation
+void operator delete(void *p, size_t) BENCH_NOTHROW
+{
+    free(p);
+}
+
+void operator delete[](void *p, size_t) BENCH_NOTHROW
+{
+    free(p);
+}
+#endif
+
+BEGIN_NAMESPACE
+
+AllocStat bench_alloc_stat()
+{
+    AllocStat stat;
+    stat.count = __atomic_load_n(&s_alloc_count, __ATOMIC_RELAXED);
+    stat.bytes = __atomic_load_n(&s_alloc_bytes, __ATOMIC_RELAXED);
+    stat.curl_count = __atomic_load_n(&s_curl_alloc_count, __ATOMIC_RELAXED);
+    return stat;
+}
+
+AllocStat bench_thread_alloc_stat()
+{
+    AllocStat stat;
+    stat.count = s_thread_alloc_count;
+    stat.bytes = s_thread_alloc_bytes;
+    stat.curl_count = s_thread_curl_alloc_count;
+    return stat;
+}
+
+int bench_curl_global_init()
+{
+    // the first global init decides the allocators, later ones only count
+    return curl_global_init_mem(CURL_GLOBAL_ALL, counting_malloc, counting_free, counting_realloc,
+            counting_strdup, counting_calloc);
+}
+
+int64_t bench_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+void BenchReporter::add(const BenchResult &result)
+{
+    _results.push_back(result);
+    printf("%-48s %12llu iters %12.1f ns/op %8.2f allocs/op %10.1f bytes/op",
+            result.name.c_str(), static_cast<unsigned long long>(result.iterations),
+            result.ns_per_op, result.allocs_per_op, result.bytes_per_op);
+    for (size_t i = 0; i < result.extras.size(); ++i) {
+        printf(" %.1f %s", result.extras[i].second, result.extras[i].first.c_str());
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+void BenchReporter::print_json(const std::string &file_name) const
+{
+    FILE *fp = file_name == "-" ? stdout : fopen(file_name.c_str(), "w");
+    if (fp == NULL) {
+        fprintf(stderr, "open %s failed\n", file_name.c_str());
+        return;
+    }
+    fprintf(fp, "[\n");
+    for (size_t i = 0; i < _results.size(); ++i) {
+        const BenchResult &r = _results[i];
+        fprintf(fp, "  {\"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.2f, "
+                "\"allocs_per_op\": %.3f, \"bytes_per_op\": %.1f",
+                r.name.c_str(), static_cast<unsigned long long>(r.iterations), r.ns_per_op,
+                r.allocs_per_op, r.bytes_per_op);
+        for (size_t j = 0; j < r.extras.size(); ++j) {
+            fprintf(fp, ", \"%s\": %.3f", r.extras[j].first.c_str(), r.extras[j].second);
+        }
+        fprintf(fp, "}%s\n", i + 1 == _results.size() ? "" : ",");
+    }
+    fprintf(fp, "]\n");
+    if (fp != stdout) {
+        fclose(fp);
+    }
+}
+
+int BenchReporter::compare(const std::string &baseline_file, double tolerance_pct) const
+{
+    FILE *fp = fopen(baseline_file.c_str(), "r");
+    if (fp == NULL) {
+        fprintf(stderr, "open %s failed\n", baseline_file.c_str());
+        return -1;
+    }
+    // print_json writes one result per line
+    std::map<std::string, double> baseline;
+    char line[4096];
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        const char *name = strstr(line, "\"name\": \"");
+        const char *ns = strstr(line, "\"ns_per_op\": ");
+        if (name == NULL || ns == NULL) {
+            continue;
+        }
+        name += strlen("\"name\": \"");
+        const char *end = strchr(name, '"');
+        if (end == NULL) {
+            continue;
+        }
+        baseline[std::string(name, end - name)] = atof(ns + strlen("\"ns_per_op\": "));
+    }
+    fclose(fp);
+
+    int regressions = 0;
+    for (size_t i = 0; i < _results.size(); ++i) {
+        const BenchResult &r = _results[i];
+        std::map<std::string, double>::const_iterator it = baseline.find(r.name);
+        if (it == baseline.end() || it->second <= 0) {
+            continue;
+        }
+        double change = (r.ns_per_op - it->second) * 100 / it->second;
+        if (change > tolerance_pct) {
+            printf("REGRESSION %-48s %12.1f -> %12.1f ns/op (+%.1f%%)\n", r.name.c_str(),
+                    it->second, r.ns_per_op, change);
+            ++regressions;
+        }
+    }
+    printf("%d of %zu results regressed more than %.1f%% against %s\n", regressions,
+            _results.size(), tolerance_pct, baseline_file.c_str());
+    return regressions;
+}
+
+BenchResult bench_run(const std::string &name, void (*op)(void *), void *arg, int64_t min_ms)
+{
+    // warm up caches and lazily created state
+    for (int i = 0; i < 16; ++i) {
+        op(arg);
+    }
+
+    uint64_t iterations = 0;
+    uint64_t batch = 1;
+    AllocStat alloc_start = bench_alloc_stat();
+    int64_t start = bench_now_ns();
+    int64_t elapsed = 0;
+    while (elapsed < min_ms * 1000000) {
+        for (uint64_t i = 0; i < batch; ++i) {
+            op(arg);
+        }
+        iterations += batch;
+        if (batch < (1ULL << 20)) {
+            batch *= 2;
+        }
+        elapsed = bench_now_ns() - start;
+    }
+    AllocStat alloc_end = bench_alloc_stat();
+
+    BenchResult result;
+    result.name = name;
+    result.iterations = iterations;
+    result.ns_per_op = static_cast<double>(elapsed) / iterations;
+    result.allocs_per_op = static_cast<double>(alloc_end.count - alloc_start.count) / iterations;
+    result.bytes_per_op = static_cast<double>(alloc_end.bytes - alloc_start.bytes) / iterations;
+    return result;
+}
+
+END_NAMESPACE
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,66 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#ifndef HTTP4CPP_BENCH_BENCH_UTIL_H
+#define HTTP4CPP_BENCH_BENCH_UTIL_H
+
+#include <stdint.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "common/common.h"
+
+BEGIN_NAMESPACE
+
+// Heap usage seen by the replaced global operator new of the bench binary
+// and, after bench_curl_global_init, by the allocators given to libcurl.
+struct AllocStat {
+    uint64_t count;
+    uint64_t bytes;
+    uint64_t curl_count;        // part of count made by libcurl
+};
+
+AllocStat bench_alloc_stat();
+// Only the allocations of the calling thread.
+AllocStat bench_thread_alloc_stat();
+// Initializes libcurl with counting allocators, before HttpClient::init.
+int bench_curl_global_init();
+int64_t bench_now_ns();
+
+struct BenchResult {
+    std::string name;
+    uint64_t    iterations;
+    double      ns_per_op;
+    double      allocs_per_op;
+    double      bytes_per_op;
+    // further named values, printed and exported after the fixed ones
+    std::vector<std::pair<std::string, double> > extras;
+};
+
+// Collects results, prints one line per result and optionally a JSON array.
+class BenchReporter {
+public:
+    void add(const BenchResult &result);
+    void print_json(const std::string &file_name) const;
+    // Reports results slower than the same name in a print_json file by more
+    // than tolerance_pct percent, returns how many regressed.
+    int compare(const std::string &baseline_file, double tolerance_pct) const;
+
+private:
+    std::vector<BenchResult> _results;
+};
+
+// Runs op(arg) until min_ms elapsed, returns the per operation cost.
+BenchResult bench_run(const std::string &name, void (*op)(void *), void *arg,
+        int64_t min_ms = 200);
+
+END_NAMESPACE
+#endif
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
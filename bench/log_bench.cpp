@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "bench_util.h"
+#include "common/common.h"
+#include "common/util.h"
+#include "common/async_logger.h"
+#include "common/binary_log.h"
+
+BEGIN_NAMESPACE
+
+log_level_t g_log_level = LOG_LEVEL_INFO;
+bool g_log_behind       = false;
+
+static void log_info(void *arg)
+{
+    (void)arg;
+    INFO("request to %s finished with %d in %d us", "127.0.0.1:8080", 200, 1234);
+}
+
+static void log_debug(void *arg)
+{
+    (void)arg;
+    DEBUG("header %s: %s", "Content-Type", "text/plain");
+}
+
+void bench_log(BenchReporter *reporter)
+{
+    // sync lines go to stderr, which is pointed at /dev/null meanwhile
+    int null_fd = open("/dev/null", O_WRONLY);
+    int stderr_fd = dup(2);
+    dup2(null_fd, 2);
+
+    reporter->add(bench_run("log/disabled_debug", log_debug, NULL));
+    reporter->add(bench_run("log/sync_info", log_info, NULL));
+
+    AsyncLoggerOptions options;
+    options.fd = null_fd;
+    options.ring_bytes = 4 * 1024 * 1024;
+    AsyncLogger logger(options);
+    logger.start();
+    LogUtil::set_async_logger(&logger);
+    reporter->add(bench_run("log/async_info", log_info, NULL));
+    logger.flush(1000);
+    LogUtil::set_async_logger(NULL);
+    logger.stop();
+
+    AsyncLoggerStat stat;
+    logger.get_stat(&stat);
+
+    BinaryLog binary_log(options);
+    binary_log.start();
+    LogUtil::set_binary_log(&binary_log);
+    reporter->add(bench_run("log/binary_info", log_info, NULL));
+    binary_log.flush(1000);
+    LogUtil::set_binary_log(NULL);
+    binary_log.stop();
+
+    AsyncLoggerStat binary_stat;
+    binary_log.get_stat(&binary_stat);
+    dup2(stderr_fd, 2);
+    close(stderr_fd);
+    close(null_fd);
+    printf("async logger written: %llu, dropped: %llu\n",
+            static_cast<unsigned long long>(stat.written),
+            static_cast<unsigned long long>(stat.dropped));
+    printf("binary log written: %llu, dropped: %llu\n",
+            static_cast<unsigned long long>(binary_stat.written),
+            static_cast<unsigned long long>(binary_stat.dropped));
+}
+
+END_NAMESPACE
+
+int main(int argc, char ** argv)
+{
+    http4cpp_ns::BenchReporter reporter;
+    http4cpp_ns::bench_log(&reporter);
+    if (argc > 1) {
+        reporter.print_json(argv[1]);
+    }
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include <string>
+
+#include "bench_util.h"
+#include "common/common.h"
+#include "common/metrics.h"
+#include "common/util.h"
+
+BEGIN_NAMESPACE
+
+log_level_t g_log_level = LOG_LEVEL_WARN;
+bool g_log_behind       = false;
+
+static MetricsRegistry s_metrics;
+static const std::string s_host = "127.0.0.1:8080";
+
+static void record_request(void *arg)
+{
+    (void)arg;
+    static uint64_t s_n = 0;
+    ++s_n;
+    s_metrics.record_request(s_host, "GET", s_n % 16 == 0 ? 500 : 200,
+            static_cast<int64_t>(s_n % 5000), 120, 4096);
+}
+
+static void record_histogram(void *arg)
+{
+    static uint64_t s_n = 0;
+    reinterpret_cast<LatencyHistogram *>(arg)->record(++s_n % 100000);
+}
+
+static void add_counter(void *arg)
+{
+    reinterpret_cast<ShardedCounter *>(arg)->add(1);
+}
+
+struct ThreadArg {
+    BenchResult result;
+};
+
+static void * run_thread(void *arg)
+{
+    ThreadArg *thread_arg = reinterpret_cast<ThreadArg *>(arg);
+    thread_arg->result = bench_run("record_request", record_request, NULL);
+    return NULL;
+}
+
+void bench_metrics(BenchReporter *reporter)
+{
+    LatencyHistogram histogram;
+    ShardedCounter counter;
+    reporter->add(bench_run("metrics/counter_add", add_counter, &counter));
+    reporter->add(bench_run("metrics/histogram_record", record_histogram, &histogram));
+    reporter->add(bench_run("metrics/record_request", record_request, NULL));
+
+    const int threads = 4;
+    pthread_t tids[threads];
+    ThreadArg args[threads];
+    for (int i = 0; i < threads; ++i) {
+        pthread_create(&tids[i], NULL, run_thread, &args[i]);
+    }
+    double ns = 0;
+    for (int i = 0; i < threads; ++i) {
+        pthread_join(tids[i], NULL);
+        ns += args[i].result.ns_per_op;
+    }
+    BenchResult result = args[0].result;
+    result.name = "metrics/record_request_4_threads";
+    result.ns_per_op = ns / threads;
+    reporter->add(result);
+
+    int64_t start = bench_now_ns();
+    std::string output;
+    s_metrics.render_prometheus(&output);
+    printf("render_prometheus: %lld ns, %zu bytes\n",
+            static_cast<long long>(bench_now_ns() - start), output.size());
+}
+
+END_NAMESPACE
+
+int main(int argc, char ** argv)
+{
+    http4cpp_ns::BenchReporter reporter;
+    http4cpp_ns::bench_metrics(&reporter);
+    if (argc > 1) {
+        reporter.print_json(argv[1]);
+    }
+    return 0;
+}
@@ -0,0 +1,486 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <algorithm>
+
+#include "mock_server.h"
+#include "common/util.h"
+
+BEGIN_NAMESPACE
+
+struct MockServer::Connection {
+    Connection() :
+        fd(-1),
+        out_pos(0),
+        ready_ns(0),
+        close_after(false),
+        writing(false),
+        reset(false)
+    {
+        // nothing to do
+    }
+
+    int         fd;
+    std::string in;
+    std::string out;
+    size_t      out_pos;
+    std::string delayed_out;    // response held back until ready_ns
+    int64_t     ready_ns;
+    bool        close_after;
+    bool        writing;        // EPOLLOUT registered
+    bool        reset;          // closed with RST instead of FIN
+};
+
+static int64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+static double next_random(uint64_t *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return ((*state * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int open_listen_socket(int port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) != 0
+            || listen(fd, 1024) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static std::string get_query_value(const std::string &target, const char *key)
+{
+    size_t pos = target.find('?');
+    size_t key_len = strlen(key);
+    while (pos != std::string::npos) {
+        ++pos;
+        if (target.compare(pos, key_len, key) == 0 && pos + key_len < target.size()
+                && target[pos + key_len] == '=') {
+            size_t end = target.find('&', pos);
+            size_t start = pos + key_len + 1;
+            return target.substr(start, end == std::string::npos ? end : end - start);
+        }
+        pos = target.find('&', pos);
+    }
+    return "";
+}
+
+MockServer::MockServer(const MockServerOptions &options) :
+    _options(options),
+    _port(0),
+    _stopping(false),
+    _requests(0)
+{
+    if (_options.threads <= 0) {
+        _options.threads = 1;
+    }
+    for (int i = 0; i < 64 * 1024; ++i) {
+        _body.append(1, static_cast<char>('a' + i % 26));
+    }
+}
+
+MockServer::~MockServer()
+{
+    stop();
+}
+
+int MockServer::start()
+{
+    if (!_workers.empty()) {
+        return RET_ILLEGAL_OPERATION;
+    }
+    _stopping = false;
+    _port = _options.port;
+    for (int i = 0; i < _options.threads; ++i) {
+        int listen_fd = open_listen_socket(_port);
+        if (listen_fd < 0) {
+            stop();
+            return RET_ILLEGAL_OPERATION;
+        }
+        if (_port == 0) {
+            struct sockaddr_in addr;
+            socklen_t len = sizeof(addr);
+            getsockname(listen_fd, reinterpret_cast<struct sockaddr *>(&addr), &len);
+            _port = ntohs(addr.sin_port);
+        }
+
+        Worker *worker = new Worker();
+        worker->server = this;
+        worker->listen_fd = listen_fd;
+        worker->epoll_fd = epoll_create1(0);
+        worker->random = 0x9E3779B97F4A7C15ULL * (i + 1);
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.ptr = NULL;
+        epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, listen_fd, &event);
+        if (pthread_create(&worker->thread, NULL, run_thread, worker) != 0) {
+            close(worker->epoll_fd);
+            close(listen_fd);
+            delete worker;
+            stop();
+            return RET_ILLEGAL_OPERATION;
+        }
+        _workers.push_back(worker);
+    }
+    return RET_OK;
+}
+
+void MockServer::stop()
+{
+    __atomic_store_n(&_stopping, true, __ATOMIC_RELEASE);
+    for (size_t i = 0; i < _workers.size(); ++i) {
+        Worker *worker = _workers[i];
+        pthread_join(worker->thread, NULL);
+        std::set<Connection *>::iterator it = worker->connections.begin();
+        for (; it != worker->connections.end(); ++it) {
+            close((*it)->fd);
+            delete *it;
+        }
+        close(worker->epoll_fd);
+        close(worker->listen_fd);
+        delete worker;
+    }
+    _workers.clear();
+}
+
+std::string MockServer::get_url(const std::string &path_and_query) const
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), "http://127.0.0.1:%d", _port);
+    return std::string(buf) + path_and_query;
+}
+
+uint64_t MockServer::get_requests() const
+{
+    return __atomic_load_n(&_requests, __ATOMIC_RELAXED);
+}
+
+void * MockServer::run_thread(void *arg)
+{
+    Worker *worker = reinterpret_cast<Worker *>(arg);
+    worker->server->run(worker);
+    return NULL;
+}
+
+void MockServer::run(Worker *worker)
+{
+    struct epoll_event events[64];
+    int timeout_ms = 50;
+    while (!__atomic_load_n(&_stopping, __ATOMIC_ACQUIRE)) {
+        int n = epoll_wait(worker->epoll_fd, events, 64, timeout_ms);
+        for (int i = 0; i < n; ++i) {
+            Connection *conn = reinterpret_cast<Connection *>(events[i].data.ptr);
+            if (conn == NULL) {
+                accept_connections(worker);
+                continue;
+            }
+            bool alive = true;
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                alive = false;
+            }
+            if (alive && (events[i].events & EPOLLOUT)) {
+                alive = on_writable(worker, conn);
+            }
+            if (alive && (events[i].events & EPOLLIN)) {
+                alive = on_readable(worker, conn);
+            }
+            if (!alive) {
+                close_connection(worker, conn);
+            }
+        }
+
+        int64_t next_ns = fire_delayed(worker);
+        timeout_ms = 50;
+        if (next_ns > 0) {
+            int64_t wait_ms = (next_ns - now_ns() + 999999) / 1000000;
+            timeout_ms = wait_ms < 0 ? 0 : (wait_ms < 50 ? static_cast<int>(wait_ms) : 50);
+        }
+    }
+}
+
+void MockServer::accept_connections(Worker *worker)
+{
+    while (true) {
+        int fd = accept4(worker->listen_fd, NULL, NULL, SOCK_NONBLOCK);
+        if (fd < 0) {
+            return;
+        }
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        Connection *conn = new Connection();
+        conn->fd = fd;
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.ptr = conn;
+        epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+        worker->connections.insert(conn);
+    }
+}
+
+bool MockServer::on_readable(Worker *worker, Connection *conn)
+{
+    char buf[16 * 1024];
+    while (true) {
+        ssize_t n = read(conn->fd, buf, sizeof(buf));
+        if (n > 0) {
+            conn->in.append(buf, n);
+            continue;
+        }
+        if (n == 0) {
+            return false;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        }
+        return false;
+    }
+    return handle_requests(worker, conn);
+}
+
+bool MockServer::on_writable(Worker *worker, Connection *conn)
+{
+    while (conn->out_pos < conn->out.size()) {
+        ssize_t n = write(conn->fd, conn->out.data() + conn->out_pos,
+                conn->out.size() - conn->out_pos);
+        if (n > 0) {
+            conn->out_pos += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        return false;
+    }
+    if (conn->out_pos == conn->out.size()) {
+        conn->out.clear();
+        conn->out_pos = 0;
+        if (conn->close_after && conn->ready_ns == 0) {
+            return false;
+        }
+    }
+    update_events(worker, conn);
+    return true;
+}
+
+void MockServer::update_events(Worker *worker, Connection *conn)
+{
+    bool writing = conn->out_pos < conn->out.size();
+    if (writing == conn->writing) {
+        return;
+    }
+    conn->writing = writing;
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = writing ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+    event.data.ptr = conn;
+    epoll_ctl(worker->epoll_fd, EPOLL_CTL_MOD, conn->fd, &event);
+}
+
+bool MockServer::handle_requests(Worker *worker, Connection *conn)
+{
+    // one delayed response at a time keeps pipelined responses in order
+    while (conn->ready_ns == 0 && !conn->close_after) {
+        size_t header_end = conn->in.find("\r\n\r\n");
+        if (header_end == std::string::npos) {
+            break;
+        }
+        size_t line_end = conn->in.find("\r\n");
+        size_t target_start = conn->in.find(' ');
+        size_t target_end = target_start == std::string::npos ? std::string::npos
+                : conn->in.find(' ', target_start + 1);
+        if (target_end == std::string::npos || target_end > line_end) {
+            return false;
+        }
+        std::string target = conn->in.substr(target_start + 1, target_end - target_start - 1);
+        bool head = conn->in.compare(0, target_start, "HEAD") == 0;
+
+        std::string headers = conn->in.substr(line_end, header_end + 2 - line_end);
+        std::transform(headers.begin(), headers.end(), headers.begin(), ::tolower);
+        size_t body_len = 0;
+        size_t pos = headers.find("\r\ncontent-length:");
+        if (pos != std::string::npos) {
+            body_len = strtoul(headers.c_str() + pos + 17, NULL, 10);
+        }
+        if (conn->in.size() < header_end + 4 + body_len) {
+            break;
+        }
+        if (headers.find("\r\nconnection: close") != std::string::npos) {
+            conn->close_after = true;
+        }
+        conn->in.erase(0, header_end + 4 + body_len);
+        __atomic_fetch_add(&_requests, 1, __ATOMIC_RELAXED);
+
+        if (!build_response(worker, conn, target, head)) {
+            conn->reset = true;
+            return false;
+        }
+    }
+    return on_writable(worker, conn);
+}
+
+bool MockServer::build_response(Worker *worker, Connection *conn, const std::string &target,
+        bool head)
+{
+    if (_options.reset_rate > 0 && next_random(&worker->random) < _options.reset_rate) {
+        return false;
+    }
+
+    std::string value = get_query_value(target, "size");
+    size_t size = value.empty() ? _options.response_bytes : strtoul(value.c_str(), NULL, 10);
+    value = get_query_value(target, "chunk");
+    size_t chunk = value.empty() ? _options.chunk_bytes : strtoul(value.c_str(), NULL, 10);
+    value = get_query_value(target, "delay_us");
+    int64_t delay_us = value.empty() ? _options.delay_us : strtoll(value.c_str(), NULL, 10);
+    value = get_query_value(target, "status");
+    int status = value.empty() ? 200 : atoi(value.c_str());
+    if (_options.error_rate > 0 && next_random(&worker->random) < _options.error_rate) {
+        status = 500;
+    }
+
+    std::string *out = delay_us > 0 ? &conn->delayed_out : &conn->out;
+    char buf[128];
+    snprintf(buf, sizeof(buf), "HTTP/1.1 %d %s\r\nContent-Type: text/plain\r\n", status,
+            status < 400 ? "OK" : "Error");
+    out->append(buf);
+    if (conn->close_after) {
+        out->append("Connection: close\r\n");
+    }
+    value = get_query_value(target, "checksum");
+    if (!value.empty()) {
+        out->append("x-checksum: " + value + "\r\n");
+    }
+    if (chunk == 0) {
+        snprintf(buf, sizeof(buf), "Content-Length: %zu\r\n\r\n", size);
+        out->append(buf);
+    } else {
+        out->append("Transfer-Encoding: chunked\r\n\r\n");
+    }
+    // a HEAD response has the headers of the GET one and no body
+    size_t written = head ? size : 0;
+    while (written < size) {
+        size_t len = std::min(size - written, _body.size());
+        if (chunk > 0) {
+            len = std::min(len, chunk);
+            snprintf(buf, sizeof(buf), "%zx\r\n", len);
+            out->append(buf);
+        }
+        out->append(_body, 0, len);
+        if (chunk > 0) {
+            out->append("\r\n");
+        }
+        written += len;
+    }
+    if (chunk > 0 && !head) {
+        out->append("0\r\n\r\n");
+    }
+
+    if (delay_us > 0) {
+        conn->ready_ns = now_ns() + delay_us * 1000;
+        worker->delayed.push_back(conn);
+    }
+    return true;
+}
+
+int64_t MockServer::fire_delayed(Worker *worker)
+{
+    int64_t now = now_ns();
+    int64_t next = 0;
+    std::vector<Connection *> ready;
+    for (size_t i = 0; i < worker->delayed.size(); ) {
+        Connection *conn = worker->delayed[i];
+        if (conn->ready_ns <= now) {
+            ready.push_back(conn);
+            worker->delayed[i] = worker->delayed.back();
+            worker->delayed.pop_back();
+            continue;
+        }
+        if (next == 0 || conn->ready_ns < next) {
+            next = conn->ready_ns;
+        }
+        ++i;
+    }
+    for (size_t i = 0; i < ready.size(); ++i) {
+        Connection *conn = ready[i];
+        conn->out.append(conn->delayed_out);
+        conn->delayed_out.clear();
+        conn->ready_ns = 0;
+        if (!handle_requests(worker, conn)) {
+            close_connection(worker, conn);
+        }
+    }
+    for (size_t i = 0; i < worker->delayed.size(); ++i) {
+        if (next == 0 || worker->delayed[i]->ready_ns < next) {
+            next = worker->delayed[i]->ready_ns;
+        }
+    }
+    return next;
+}
+
+void MockServer::close_connection(Worker *worker, Connection *conn)
+{
+    if (conn->reset) {
+        struct linger option;
+        option.l_onoff = 1;
+        option.l_linger = 0;
+        setsockopt(conn->fd, SOL_SOCKET, SO_LINGER, &option, sizeof(option));
+    }
+    epoll_ctl(worker->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    std::vector<Connection *>::iterator it =
+            std::find(worker->delayed.begin(), worker->delayed.end(), conn);
+    if (it != worker->delayed.end()) {
+        worker->delayed.erase(it);
+    }
+    worker->connections.erase(conn);
+    delete conn;
+}
+
+END_NAMESPACE
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,102 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#ifndef HTTP4CPP_BENCH_MOCK_SERVER_H
+#define HTTP4CPP_BENCH_MOCK_SERVER_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "common/common.h"
+
+BEGIN_NAMESPACE
+
+struct MockServerOptions {
+    MockServerOptions() :
+        port(0),
+        threads(2),
+        response_bytes(1024),
+        chunk_bytes(0),
+        delay_us(0),
+        error_rate(0),
+        reset_rate(0)
+    {
+        // nothing to do
+    }
+
+    int      port;              // 0 picks a free one
+    int      threads;           // each has its own SO_REUSEPORT socket and epoll set
+    uint32_t response_bytes;
+    uint32_t chunk_bytes;       // chunked encoding with chunks of this size, 0 sends Content-Length
+    int64_t  delay_us;          // before the response is sent
+    double   error_rate;        // share of responses turned into 500
+    double   reset_rate;        // share of requests answered by a connection reset
+};
+
+/**
+ * HTTP/1.1 server on 127.0.0.1 for benchmarks. Keep-alive and pipelining are
+ * supported, request bodies are read and ignored. The query parameters
+ * size, chunk, delay_us and status override the options for one request,
+ * e.g. "/?size=65536&chunk=4096", checksum is sent back as x-checksum.
+ */
+class MockServer {
+public:
+    explicit MockServer(const MockServerOptions &options);
+    ~MockServer();
+
+    int start();
+    void stop();
+
+    int get_port() const
+    {
+        return _port;
+    }
+    std::string get_url(const std::string &path_and_query = "/") const;
+    uint64_t get_requests() const;
+
+private:
+    MockServer(const MockServer &);
+    MockServer & operator=(const MockServer &);
+
+    struct Connection;
+    struct Worker {
+        MockServer                  *server;
+        int                         listen_fd;
+        int                         epoll_fd;
+        pthread_t                   thread;
+        uint64_t                    random;
+        std::set<Connection *>      connections;
+        std::vector<Connection *>   delayed;
+    };
+
+    void run(Worker *worker);
+    static void * run_thread(void *arg);
+    void accept_connections(Worker *worker);
+    bool on_readable(Worker *worker, Connection *conn);
+    bool on_writable(Worker *worker, Connection *conn);
+    bool handle_requests(Worker *worker, Connection *conn);
+    bool build_response(Worker *worker, Connection *conn, const std::string &target, bool head);
+    void update_events(Worker *worker, Connection *conn);
+    void close_connection(Worker *worker, Connection *conn);
+    int64_t fire_delayed(Worker *worker);
+
+    MockServerOptions       _options;
+    int                     _port;
+    bool                    _stopping;
+    uint64_t                _requests;
+    std::string             _body;
+    std::vector<Worker *>   _workers;
+};
+
+END_NAMESPACE
+#endif
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,111 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#include <stdint.h>
+#include <string.h>
+
+#include <new>
+
+#include "common/arena.h"
+
+BEGIN_NAMESPACE
+
+static inline char * align_up(char *p, size_t alignment)
+{
+    uintptr_t value = reinterpret_cast<uintptr_t>(p);
+    return reinterpret_cast<char *>((value + alignment - 1) & ~(alignment - 1));
+}
+
+Arena::Arena(size_t block_size) :
+    _buffer(NULL),
+    _buffer_size(0),
+    _block_size(block_size),
+    _blocks(NULL),
+    _heap_blocks(0),
+    _pos(NULL),
+    _end(NULL),
+    _used(0)
+{
+    // the first block is allocated on first use
+}
+
+Arena::Arena(void *buffer, size_t size, size_t block_size) :
+    _buffer(reinterpret_cast<char *>(buffer)),
+    _buffer_size(size),
+    _block_size(block_size),
+    _blocks(NULL),
+    _heap_blocks(0),
+    _pos(reinterpret_cast<char *>(buffer)),
+    _end(reinterpret_cast<char *>(buffer) + size),
+    _used(0)
+{
+    // nothing to do
+}
+
+Arena::~Arena()
+{
+    reset();
+}
+
+void * Arena::allocate(size_t size)
+{
+    char *p = align_up(_pos, ALIGNMENT);
+    if (_pos == NULL || size > static_cast<size_t>(_end - p)) {
+        return allocate_slow(size);
+    }
+    _pos = p + size;
+    _used += size;
+    return p;
+}
+
+void * Arena::allocate_slow(size_t size)
+{
+    // the header is rounded up so the payload stays aligned
+    size_t header = (sizeof(Block) + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    size_t payload = size > _block_size ? size : _block_size;
+    Block *block = reinterpret_cast<Block *>(::operator new(header + payload + ALIGNMENT));
+    block->next = _blocks;
+    _blocks = block;
+    ++_heap_blocks;
+
+    char *p = align_up(reinterpret_cast<char *>(block) + header, ALIGNMENT);
+    char *end = p + payload;
+    // an oversized allocation keeps the rest of the current block in use
+    if (size <= _block_size || _pos == NULL || end - (p + size) > _end - _pos) {
+        _pos = p + size;
+        _end = end;
+    }
+    _used += size;
+    return p;
+}
+
+StringPiece Arena::copy(const StringPiece &src)
+{
+    char *p = reinterpret_cast<char *>(allocate(src.size() + 1));
+    if (!src.empty()) {
+        memcpy(p, src.data(), src.size());
+    }
+    p[src.size()] = '\0';
+    return StringPiece(p, src.size());
+}
+
+void Arena::reset()
+{
+    while (_blocks != NULL) {
+        Block *next = _blocks->next;
+        ::operator delete(_blocks);
+        _blocks = next;
+    }
+    _heap_blocks = 0;
+    _pos = _buffer;
+    _end = _buffer + _buffer_size;
+    _used = 0;
+}
+
+END_NAMESPACE
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
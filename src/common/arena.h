@@ -0,0 +1,77 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#ifndef HTTP4CPP_COMMON_ARENA_H
+#define HTTP4CPP_COMMON_ARENA_H
+
+#include <stddef.h>
+
+#include "common/common.h"
+#include "common/string_piece.h"
+
+BEGIN_NAMESPACE
+
+/**
+ * Monotonic buffer for the metadata of a request: an allocation only moves
+ * a pointer and nothing is freed on its own, reset() or the destructor
+ * release everything at once. The first block can be memory of the caller,
+ * e.g. on its stack, further blocks come from the heap. Not thread safe.
+ */
+class Arena {
+public:
+    static const size_t DEFAULT_BLOCK_SIZE = 1024;
+
+    explicit Arena(size_t block_size = DEFAULT_BLOCK_SIZE);
+    Arena(void *buffer, size_t size, size_t block_size = DEFAULT_BLOCK_SIZE);
+    ~Arena();
+
+    // size bytes aligned for any scalar type, never NULL.
+    void * allocate(size_t size);
+
+    // A copy of src followed by a '\0' that is not part of the piece.
+    StringPiece copy(const StringPiece &src);
+
+    // Releases the heap blocks and keeps the buffer of the caller.
+    void reset();
+
+    // Bytes handed out since the last reset.
+    size_t get_used() const
+    {
+        return _used;
+    }
+
+    size_t get_heap_blocks() const
+    {
+        return _heap_blocks;
+    }
+
+private:
+    Arena(const Arena &);
+    Arena & operator=(const Arena &);
+
+    struct Block {
+        Block *next;
+    };
+
+    static const size_t ALIGNMENT = 16;
+
+    void * allocate_slow(size_t size);
+
+    char * _buffer;         // of the caller, not freed
+    size_t _buffer_size;
+    size_t _block_size;
+    Block *_blocks;         // heap blocks, newest first
+    size_t _heap_blocks;
+    char * _pos;
+    char * _end;
+    size_t _used;
+};
+
+END_NAMESPACE
+#endif
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
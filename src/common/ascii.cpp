@@ -0,0 +1,247 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#include <string.h>
+
+#include "common/ascii.h"
+#include "common/util.h"
+
+#ifdef HTTP4CPP_X86_SIMD
+#include <immintrin.h>
+#endif
+
+BEGIN_NAMESPACE
+
+static const uint64_t ONES = 0x0101010101010101ULL;
+
+static inline uint64_t load64(const unsigned char *src)
+{
+    uint64_t word;
+    memcpy(&word, src, sizeof(word));
+    return word;
+}
+
+// 0x20 in every byte of word within [first, first + 25], eight bytes at once.
+// Adding to the low 7 bits never carries into the next byte.
+static inline uint64_t case_bits(uint64_t word, unsigned char first)
+{
+    uint64_t low = word & (ONES * 0x7f);
+    uint64_t from_first = low + ONES * (0x80 - first);
+    uint64_t past_last = low + ONES * (0x7f - (first + 25));
+    return (~word & (from_first ^ past_last) & (ONES * 0x80)) >> 2;
+}
+
+static inline unsigned char fold(unsigned char c)
+{
+    return static_cast<unsigned int>(c - 'A') < 26U ? c | 0x20 : c;
+}
+
+static void convert_scalar(const unsigned char *src, size_t size, unsigned char *dst,
+        unsigned char first)
+{
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word = load64(src + i);
+        word ^= case_bits(word, first);
+        memcpy(dst + i, &word, sizeof(word));
+    }
+    for (; i < size; ++i) {
+        dst[i] = static_cast<unsigned int>(src[i] - first) < 26U ? src[i] ^ 0x20 : src[i];
+    }
+}
+
+static size_t mismatch_scalar(const unsigned char *a, const unsigned char *b, size_t size)
+{
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t x = load64(a + i);
+        uint64_t y = load64(b + i);
+        if ((x | case_bits(x, 'A')) != (y | case_bits(y, 'A'))) {
+            break;
+        }
+    }
+    for (; i < size; ++i) {
+        if (fold(a[i]) != fold(b[i])) {
+            return i;
+        }
+    }
+    return size;
+}
+
+#ifdef HTTP4CPP_X86_SIMD
+
+// Shifting [first, first + 25] to [-128, -103] leaves one signed compare.
+HTTP4CPP_TARGET("sse4.1")
+static void convert_sse41(const unsigned char *src, size_t size, unsigned char *dst,
+        unsigned char first)
+{
+    const __m128i shift = _mm_set1_epi8(static_cast<char>(0x80 - first));
+    const __m128i limit = _mm_set1_epi8(-128 + 26);
+    const __m128i flip = _mm_set1_epi8(0x20);
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        __m128i in_range = _mm_cmpgt_epi8(limit, _mm_add_epi8(in, shift));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i),
+                _mm_xor_si128(in, _mm_and_si128(in_range, flip)));
+    }
+    convert_scalar(src + i, size - i, dst + i, first);
+}
+
+HTTP4CPP_TARGET("sse4.1")
+static size_t mismatch_sse41(const unsigned char *a, const unsigned char *b, size_t size)
+{
+    const __m128i shift = _mm_set1_epi8(static_cast<char>(0x80 - 'A'));
+    const __m128i limit = _mm_set1_epi8(-128 + 26);
+    const __m128i flip = _mm_set1_epi8(0x20);
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+        __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+        x = _mm_or_si128(x, _mm_and_si128(_mm_cmpgt_epi8(limit, _mm_add_epi8(x, shift)), flip));
+        y = _mm_or_si128(y, _mm_and_si128(_mm_cmpgt_epi8(limit, _mm_add_epi8(y, shift)), flip));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(x, y));
+        if (mask != 0xffff) {
+            return i + __builtin_ctz(~mask);
+        }
+    }
+    return i + mismatch_scalar(a + i, b + i, size - i);
+}
+
+HTTP4CPP_TARGET("avx2")
+static void convert_avx2(const unsigned char *src, size_t size, unsigned char *dst,
+        unsigned char first)
+{
+    const __m256i shift = _mm256_set1_epi8(static_cast<char>(0x80 - first));
+    const __m256i limit = _mm256_set1_epi8(-128 + 26);
+    const __m256i flip = _mm256_set1_epi8(0x20);
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        __m256i in_range = _mm256_cmpgt_epi8(limit, _mm256_add_epi8(in, shift));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i),
+                _mm256_xor_si256(in, _mm256_and_si256(in_range, flip)));
+    }
+    convert_sse41(src + i, size - i, dst + i, first);
+}
+
+HTTP4CPP_TARGET("avx2")
+static size_t mismatch_avx2(const unsigned char *a, const unsigned char *b, size_t size)
+{
+    const __m256i shift = _mm256_set1_epi8(static_cast<char>(0x80 - 'A'));
+    const __m256i limit = _mm256_set1_epi8(-128 + 26);
+    const __m256i flip = _mm256_set1_epi8(0x20);
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+        x = _mm256_or_si256(x,
+                _mm256_and_si256(_mm256_cmpgt_epi8(limit, _mm256_add_epi8(x, shift)), flip));
+        y = _mm256_or_si256(y,
+                _mm256_and_si256(_mm256_cmpgt_epi8(limit, _mm256_add_epi8(y, shift)), flip));
+        unsigned int mask = static_cast<unsigned int>(
+                _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)));
+        if (mask != 0xffffffffU) {
+            return i + __builtin_ctz(~mask);
+        }
+    }
+    return i + mismatch_sse41(a + i, b + i, size - i);
+}
+
+#endif
+
+typedef void (*convert_fn)(const unsigned char *src, size_t size, unsigned char *dst,
+        unsigned char first);
+typedef size_t (*mismatch_fn)(const unsigned char *a, const unsigned char *b, size_t size);
+
+static const convert_fn s_converters[] = {
+    convert_scalar,
+#ifdef HTTP4CPP_X86_SIMD
+    convert_sse41,
+    convert_avx2,
+#endif
+};
+
+static const mismatch_fn s_mismatchers[] = {
+    mismatch_scalar,
+#ifdef HTTP4CPP_X86_SIMD
+    mismatch_sse41,
+    mismatch_avx2,
+#endif
+};
+
+static simd_kernel_t s_kernel = CpuFeatures::best_kernel();
+
+void Ascii::lower(const char *src, size_t size, char *dst)
+{
+    s_converters[s_kernel](reinterpret_cast<const unsigned char *>(src), size,
+            reinterpret_cast<unsigned char *>(dst), 'A');
+}
+
+void Ascii::upper(const char *src, size_t size, char *dst)
+{
+    s_converters[s_kernel](reinterpret_cast<const unsigned char *>(src), size,
+            reinterpret_cast<unsigned char *>(dst), 'a');
+}
+
+bool Ascii::equals_ignore_case(const StringPiece &a, const StringPiece &b)
+{
+    return a.size() == b.size() && s_mismatchers[s_kernel](
+            reinterpret_cast<const unsigned char *>(a.data()),
+            reinterpret_cast<const unsigned char *>(b.data()), a.size()) == a.size();
+}
+
+int Ascii::compare_ignore_case(const StringPiece &a, const StringPiece &b)
+{
+    size_t size = a.size() < b.size() ? a.size() : b.size();
+    const unsigned char *x = reinterpret_cast<const unsigned char *>(a.data());
+    const unsigned char *y = reinterpret_cast<const unsigned char *>(b.data());
+    size_t i = s_mismatchers[s_kernel](x, y, size);
+    if (i < size) {
+        return static_cast<int>(fold(x[i])) - static_cast<int>(fold(y[i]));
+    }
+    return a.size() < b.size() ? -1 : (a.size() > b.size() ? 1 : 0);
+}
+
+uint64_t Ascii::hash_ignore_case(const StringPiece &src)
+{
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(src.data());
+    size_t size = src.size();
+    uint64_t hash = 0x9e3779b97f4a7c15ULL ^ size;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word = load64(p + i);
+        hash = (hash ^ (word | case_bits(word, 'A'))) * 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 32;
+    }
+    if (i < size) {
+        uint64_t word = 0;
+        memcpy(&word, p + i, size - i);
+        hash = (hash ^ (word | case_bits(word, 'A'))) * 0xff51afd7ed558ccdULL;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    return hash ^ (hash >> 33);
+}
+
+int Ascii::set_kernel(simd_kernel_t kernel)
+{
+    if (!CpuFeatures::supports(kernel)) {
+        return RET_ILLEGAL_OPERATION;
+    }
+    s_kernel = kernel;
+    return RET_OK;
+}
+
+simd_kernel_t Ascii::get_kernel()
+{
+    return s_kernel;
+}
+
+END_NAMESPACE
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,55 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#ifndef HTTP4CPP_COMMON_ASCII_H
+#define HTTP4CPP_COMMON_ASCII_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+#include "common/common.h"
+#include "common/cpu_features.h"
+#include "common/string_piece.h"
+
+BEGIN_NAMESPACE
+
+/**
+ * ASCII case folding without the locale, only A-Z and a-z change and bytes
+ * from 0x80 are left as they are. Meant for header names and tokens, 16 or
+ * 32 bytes are handled at a time and nothing is allocated.
+ */
+class Ascii {
+public:
+    // dst may be src to convert in place.
+    static void lower(const char *src, size_t size, char *dst);
+    static void upper(const char *src, size_t size, char *dst);
+
+    static bool equals_ignore_case(const StringPiece &a, const StringPiece &b);
+    // <0, 0 or >0 as strcasecmp in the C locale.
+    static int compare_ignore_case(const StringPiece &a, const StringPiece &b);
+    // Equal for strings that are equals_ignore_case, stable across runs.
+    static uint64_t hash_ignore_case(const StringPiece &src);
+
+    // Forces a kernel, RET_ILLEGAL_OPERATION if the cpu lacks it.
+    static int set_kernel(simd_kernel_t kernel);
+    static simd_kernel_t get_kernel();
+};
+
+// For std::map keys compared as HTTP header names.
+struct IgnoreCaseLess {
+    bool operator()(const std::string &a, const std::string &b) const
+    {
+        return Ascii::compare_ignore_case(a, b) < 0;
+    }
+};
+
+END_NAMESPACE
+#endif
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
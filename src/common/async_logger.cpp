@@ -0,0 +1,433 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <sys/uio.h>
+
+#include "common/async_logger.h"
+#include "common/util.h"
+
+BEGIN_NAMESPACE
+
+// Every line is a header and the text padded to 8 bytes, a line never wraps,
+// the producer skips the ring tail with a marker instead.
+struct LogRecordHeader {
+    uint32_t len;
+    uint16_t level;
+    uint16_t prefix_len;
+};
+
+static const uint32_t WRAP_MARKER = 0xFFFFFFFF;
+static const uint16_t RAW_LEVEL = 0xFFFF;
+static const uint32_t MIN_RING_BYTES = 64 * 1024;
+static const int WRITE_BATCH = 64;
+
+static inline uint64_t record_size(uint64_t len)
+{
+    return (sizeof(LogRecordHeader) + len + 7) & ~static_cast<uint64_t>(7);
+}
+
+AsyncLogger::AsyncLogger(const AsyncLoggerOptions &options) :
+    _options(options),
+    _rings(NULL),
+    _running(false),
+    _stopping(false),
+    _flush_requested(0),
+    _flush_done(0),
+    _written(0),
+    _dropped(0)
+{
+    uint32_t bytes = MIN_RING_BYTES;
+    while (bytes < _options.ring_bytes && bytes < (1U << 30)) {
+        bytes <<= 1;
+    }
+    _options.ring_bytes = bytes;
+    if (_options.flush_interval_ms <= 0) {
+        _options.flush_interval_ms = 1;
+    }
+
+    pthread_mutex_init(&_rings_mutex, NULL);
+    pthread_mutex_init(&_reliable_mutex, NULL);
+    pthread_mutex_init(&_mutex, NULL);
+    TimeUtil::init_cond(&_cond);
+    TimeUtil::init_cond(&_flush_cond);
+    pthread_key_create(&_ring_key, close_ring);
+}
+
+AsyncLogger::~AsyncLogger()
+{
+    stop();
+    // rings of threads still alive are freed here, their key is gone with it
+    pthread_key_delete(_ring_key);
+    while (_rings != NULL) {
+        Ring *next = _rings->next;
+        free_ring(_rings);
+        _rings = next;
+    }
+    pthread_cond_destroy(&_flush_cond);
+    pthread_cond_destroy(&_cond);
+    pthread_mutex_destroy(&_mutex);
+    pthread_mutex_destroy(&_reliable_mutex);
+    pthread_mutex_destroy(&_rings_mutex);
+}
+
+int AsyncLogger::start()
+{
+    pthread_mutex_lock(&_mutex);
+    if (_running) {
+        pthread_mutex_unlock(&_mutex);
+        return RET_ILLEGAL_OPERATION;
+    }
+    _stopping = false;
+    if (pthread_create(&_thread, NULL, run_thread, this) != 0) {
+        pthread_mutex_unlock(&_mutex);
+        return RET_ILLEGAL_OPERATION;
+    }
+    _running = true;
+    pthread_mutex_unlock(&_mutex);
+    return RET_OK;
+}
+
+void AsyncLogger::stop()
+{
+    pthread_mutex_lock(&_mutex);
+    if (!_running) {
+        pthread_mutex_unlock(&_mutex);
+        return;
+    }
+    _stopping = true;
+    pthread_cond_signal(&_cond);
+    pthread_mutex_unlock(&_mutex);
+
+    pthread_join(_thread, NULL);
+    pthread_mutex_lock(&_mutex);
+    _running = false;
+    pthread_mutex_unlock(&_mutex);
+}
+
+bool AsyncLogger::append(int level, const char *line, size_t len)
+{
+    Ring *ring = get_ring();
+    if (ring == NULL) {
+        return false;
+    }
+
+    char prefix[16];
+    int prefix_len = snprintf(prefix, sizeof(prefix), "[%s]", LogUtil::level_to_string(level));
+    uint64_t capacity = static_cast<uint64_t>(ring->mask) + 1;
+    if (record_size(prefix_len + len) > capacity / 4) {
+        // cut, the line still ends with its newline
+        len = capacity / 4 - sizeof(LogRecordHeader) - prefix_len - 8;
+        char *text = push(ring, level, prefix, prefix_len, line, len);
+        if (text != NULL) {
+            text[prefix_len + len - 1] = '\n';
+        }
+        return text != NULL;
+    }
+    return push(ring, level, prefix, prefix_len, line, len) != NULL;
+}
+
+bool AsyncLogger::append_raw(const char *data, size_t len)
+{
+    Ring *ring = get_ring();
+    if (ring == NULL) {
+        return false;
+    }
+
+    uint64_t capacity = static_cast<uint64_t>(ring->mask) + 1;
+    if (record_size(len) > capacity / 4) {
+        __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    return push(ring, RAW_LEVEL, NULL, 0, data, len) != NULL;
+}
+
+void AsyncLogger::append_reliable(const char *data, size_t len)
+{
+    pthread_mutex_lock(&_reliable_mutex);
+    _reliable.append(data, len);
+    pthread_mutex_unlock(&_reliable_mutex);
+}
+
+char * AsyncLogger::push(Ring *ring, int level, const char *prefix, size_t prefix_len,
+        const char *data, size_t len)
+{
+    uint64_t capacity = static_cast<uint64_t>(ring->mask) + 1;
+    uint64_t size = record_size(prefix_len + len);
+    uint64_t head = ring->head;
+    uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    uint64_t pos = head & ring->mask;
+    uint64_t contiguous = capacity - pos;
+    uint64_t need = contiguous < size ? contiguous + size : size;
+    if (head - tail + need > capacity) {
+        __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    LogRecordHeader *header = NULL;
+    if (contiguous < size) {
+        header = reinterpret_cast<LogRecordHeader *>(ring->buf + pos);
+        header->len = WRAP_MARKER;
+        pos = 0;
+    }
+    header = reinterpret_cast<LogRecordHeader *>(ring->buf + pos);
+    header->len = static_cast<uint32_t>(prefix_len + len);
+    header->level = static_cast<uint16_t>(level);
+    header->prefix_len = static_cast<uint16_t>(prefix_len);
+    char *text = ring->buf + pos + sizeof(LogRecordHeader);
+    if (prefix_len > 0) {
+        memcpy(text, prefix, prefix_len);
+    }
+    memcpy(text + prefix_len, data, len);
+
+    uint64_t new_head = head + need;
+    __atomic_store_n(&ring->head, new_head, __ATOMIC_RELEASE);
+    // the writer polls, it is only woken up early to keep a busy ring from filling
+    if (head - tail < capacity / 2 && new_head - tail >= capacity / 2) {
+        pthread_cond_signal(&_cond);
+    }
+    return text;
+}
+
+bool AsyncLogger::flush(int max_wait_ms)
+{
+    struct timespec ts;
+    TimeUtil::cond_abstime(static_cast<int64_t>(max_wait_ms) * 1000, &ts);
+
+    pthread_mutex_lock(&_mutex);
+    if (!_running) {
+        pthread_mutex_unlock(&_mutex);
+        return false;
+    }
+    uint64_t target = ++_flush_requested;
+    pthread_cond_signal(&_cond);
+    while (_flush_done < target) {
+        if (pthread_cond_timedwait(&_flush_cond, &_mutex, &ts) == ETIMEDOUT) {
+            break;
+        }
+    }
+    bool done = _flush_done >= target;
+    pthread_mutex_unlock(&_mutex);
+    return done;
+}
+
+void AsyncLogger::get_stat(AsyncLoggerStat *stat) const
+{
+    pthread_mutex_lock(&_rings_mutex);
+    stat->written = __atomic_load_n(&_written, __ATOMIC_RELAXED);
+    stat->dropped = _dropped;
+    stat->rings = 0;
+    for (Ring *ring = _rings; ring != NULL; ring = ring->next) {
+        stat->dropped += __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+        ++stat->rings;
+    }
+    pthread_mutex_unlock(&_rings_mutex);
+}
+
+AsyncLogger::Ring * AsyncLogger::get_ring()
+{
+    Ring *ring = reinterpret_cast<Ring *>(pthread_getspecific(_ring_key));
+    if (ring != NULL) {
+        return ring;
+    }
+
+    ring = new Ring();
+    memset(ring, 0, sizeof(Ring));
+    ring->buf = reinterpret_cast<char *>(malloc(_options.ring_bytes));
+    if (ring->buf == NULL) {
+        delete ring;
+        return NULL;
+    }
+    ring->mask = _options.ring_bytes - 1;
+
+    pthread_mutex_lock(&_rings_mutex);
+    ring->next = _rings;
+    _rings = ring;
+    pthread_mutex_unlock(&_rings_mutex);
+    pthread_setspecific(_ring_key, ring);
+    return ring;
+}
+
+bool AsyncLogger::drain(Ring *ring)
+{
+    bool closed = __atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE);
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t tail = ring->tail;
+    while (tail != head) {
+        tail = write_lines(ring, tail, head);
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+    }
+    return closed;
+}
+
+uint64_t AsyncLogger::write_lines(Ring *ring, uint64_t tail, uint64_t head)
+{
+    struct iovec iov[WRITE_BATCH];
+    int count = 0;
+    uint64_t capacity = static_cast<uint64_t>(ring->mask) + 1;
+
+    while (tail != head && count < WRITE_BATCH) {
+        uint64_t pos = tail & ring->mask;
+        const LogRecordHeader *header = reinterpret_cast<const LogRecordHeader *>(ring->buf + pos);
+        if (header->len == WRAP_MARKER) {
+            tail += capacity - pos;
+            continue;
+        }
+
+        char *text = ring->buf + pos + sizeof(LogRecordHeader);
+        if (g_log_behind && header->level != RAW_LEVEL) {
+            syslog(LogUtil::level_to_syslog(header->level), "%.*s",
+                    static_cast<int>(header->len - header->prefix_len), text + header->prefix_len);
+        } else {
+            iov[count].iov_base = text;
+            iov[count].iov_len = header->len;
+            ++count;
+        }
+        __atomic_store_n(&_written, _written + 1, __ATOMIC_RELAXED);
+        tail += record_size(header->len);
+    }
+
+    int index = 0;
+    while (index < count) {
+        ssize_t n = writev(_options.fd, iov + index, count - index);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        while (index < count && static_cast<size_t>(n) >= iov[index].iov_len) {
+            n -= iov[index].iov_len;
+            ++index;
+        }
+        if (index < count) {
+            iov[index].iov_base = reinterpret_cast<char *>(iov[index].iov_base) + n;
+            iov[index].iov_len -= n;
+        }
+    }
+    return tail;
+}
+
+void AsyncLogger::write_reliable()
+{
+    std::string data;
+    pthread_mutex_lock(&_reliable_mutex);
+    data.swap(_reliable);
+    pthread_mutex_unlock(&_reliable_mutex);
+
+    size_t offset = 0;
+    while (offset < data.size()) {
+        ssize_t n = write(_options.fd, data.data() + offset, data.size() - offset);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        offset += n;
+    }
+}
+
+void AsyncLogger::report_drops(uint64_t dropped)
+{
+    char buf[128];
+    int n = snprintf(buf, sizeof(buf), "[%s]%s async logger dropped %llu lines\n",
+            LogUtil::level_to_string(LOG_LEVEL_WARN), TimeUtil::now_utctime().c_str(),
+            static_cast<unsigned long long>(dropped));
+    if (g_log_behind) {
+        syslog(LOG_WARNING, "%s", buf);
+    } else if (n > 0 && write(_options.fd, buf, n) < 0) {
+        // nothing more can be done about it
+    }
+}
+
+void AsyncLogger::drain_rings()
+{
+    // Rings are only linked in front and only unlinked here, the ones after
+    // the head read now stay put while they are drained without the lock.
+    pthread_mutex_lock(&_rings_mutex);
+    Ring *ring = _rings;
+    pthread_mutex_unlock(&_rings_mutex);
+
+    uint64_t dropped = 0;
+    while (ring != NULL) {
+        Ring *next = ring->next;
+        bool closed = drain(ring);
+        uint64_t ring_dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+        dropped += ring_dropped - ring->reported;
+        ring->reported = ring_dropped;
+        if (closed) {
+            pthread_mutex_lock(&_rings_mutex);
+            Ring **link = &_rings;
+            while (*link != ring) {
+                link = &(*link)->next;
+            }
+            *link = next;
+            _dropped += ring_dropped;
+            pthread_mutex_unlock(&_rings_mutex);
+            free_ring(ring);
+        }
+        ring = next;
+    }
+    if (dropped > 0) {
+        report_drops(dropped);
+    }
+}
+
+void AsyncLogger::run()
+{
+    pthread_mutex_lock(&_mutex);
+    while (true) {
+        uint64_t requested = _flush_requested;
+        bool stopping = _stopping;
+        pthread_mutex_unlock(&_mutex);
+
+        write_reliable();
+        drain_rings();
+
+        pthread_mutex_lock(&_mutex);
+        _flush_done = requested;
+        pthread_cond_broadcast(&_flush_cond);
+        if (stopping) {
+            break;
+        }
+        if (_flush_requested != requested || _stopping) {
+            continue;
+        }
+
+        struct timespec ts;
+        TimeUtil::cond_abstime(static_cast<int64_t>(_options.flush_interval_ms) * 1000, &ts);
+        pthread_cond_timedwait(&_cond, &_mutex, &ts);
+    }
+    pthread_mutex_unlock(&_mutex);
+}
+
+void * AsyncLogger::run_thread(void *arg)
+{
+    reinterpret_cast<AsyncLogger *>(arg)->run();
+    return NULL;
+}
+
+void AsyncLogger::close_ring(void *ring)
+{
+    __atomic_store_n(&reinterpret_cast<Ring *>(ring)->closed, true, __ATOMIC_RELEASE);
+}
+
+void AsyncLogger::free_ring(Ring *ring)
+{
+    free(ring->buf);
+    delete ring;
+}
+
+END_NAMESPACE
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
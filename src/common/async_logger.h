@@ -0,0 +1,128 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#ifndef HTTP4CPP_COMMON_ASYNC_LOGGER_H
+#define HTTP4CPP_COMMON_ASYNC_LOGGER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include <string>
+
+#include "common/common.h"
+
+BEGIN_NAMESPACE
+
+struct AsyncLoggerOptions {
+    AsyncLoggerOptions() :
+        fd(2),
+        ring_bytes(256 * 1024),
+        flush_interval_ms(10),
+        fatal_flush_ms(1000)
+    {
+        // nothing to do
+    }
+
+    int      fd;                    // destination, ignored when g_log_behind selects syslog
+    uint32_t ring_bytes;            // per thread ring, rounded up to a power of two
+    int      flush_interval_ms;     // longest time a line waits in its ring
+    int      fatal_flush_ms;        // bound on the drain before FATAL exits
+};
+
+struct AsyncLoggerStat {
+    uint64_t written;
+    uint64_t dropped;
+    uint32_t rings;
+};
+
+/**
+ * Background log writer. Every logging thread owns a single producer ring,
+ * appending a line is a copy into it and a release store, the writer thread
+ * drains all rings with batched writev. A line that does not fit is dropped
+ * and counted, the writer reports drops on the log itself. Lines of different
+ * threads are not ordered against each other.
+ *
+ * Installed with LogUtil::set_async_logger, which must happen before and be
+ * undone after the threads that log. The writer holds no lock while writing,
+ * a thread logging for the first time never waits on the log device.
+ */
+class AsyncLogger {
+public:
+    explicit AsyncLogger(const AsyncLoggerOptions &options = AsyncLoggerOptions());
+    ~AsyncLogger();
+
+    int start();
+    void stop();
+
+    // false when the line was dropped
+    bool append(int level, const char *line, size_t len);
+    // Written as is, without level prefix and never to syslog, for binary logs.
+    bool append_raw(const char *data, size_t len);
+    // Like append_raw but queued under a lock and never dropped, written by
+    // the next pass of the writer ahead of the rings. For rare records.
+    void append_reliable(const char *data, size_t len);
+    // Waits until the lines appended before the call are written, true if so.
+    bool flush(int max_wait_ms);
+
+    const AsyncLoggerOptions & get_options() const
+    {
+        return _options;
+    }
+    void get_stat(AsyncLoggerStat *stat) const;
+
+private:
+    AsyncLogger(const AsyncLogger &);
+    AsyncLogger & operator=(const AsyncLogger &);
+
+    struct Ring {
+        char     *buf;
+        uint32_t mask;
+        uint64_t head;          // written by the producer only
+        char     pad0[64 - sizeof(uint64_t)];
+        uint64_t tail;          // written by the writer only
+        uint64_t dropped;
+        uint64_t reported;
+        bool     closed;
+        Ring     *next;
+    };
+
+    Ring * get_ring();
+    char * push(Ring *ring, int level, const char *prefix, size_t prefix_len,
+            const char *data, size_t len);
+    bool drain(Ring *ring);
+    uint64_t write_lines(Ring *ring, uint64_t tail, uint64_t head);
+    void write_reliable();
+    void drain_rings();
+    void report_drops(uint64_t dropped);
+    void run();
+    static void * run_thread(void *arg);
+    static void close_ring(void *ring);
+    static void free_ring(Ring *ring);
+
+    AsyncLoggerOptions      _options;
+    pthread_key_t           _ring_key;
+    Ring                    *_rings;            // new rings are linked in front
+    mutable pthread_mutex_t _rings_mutex;       // guards _rings and _dropped
+    bool                    _running;
+    bool                    _stopping;
+    pthread_t               _thread;
+    uint64_t                _flush_requested;
+    uint64_t                _flush_done;
+    uint64_t                _written;
+    uint64_t                _dropped;
+    std::string             _reliable;
+    pthread_mutex_t         _reliable_mutex;
+    mutable pthread_mutex_t _mutex;
+    pthread_cond_t          _cond;
+    pthread_cond_t          _flush_cond;
+};
+
+END_NAMESPACE
+#endif
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
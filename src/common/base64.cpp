@@ -0,0 +1,301 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#include "common/base64.h"
+#include "common/util.h"
+
+#ifdef HTTP4CPP_X86_SIMD
+#include <immintrin.h>
+#endif
+
+BEGIN_NAMESPACE
+
+static const char s_encode_table[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// 255 marks bytes outside the alphabet
+static const unsigned char s_decode_table[256] = {
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,  62, 255, 255, 255,  63,
+     52,  53,  54,  55,  56,  57,  58,  59,  60,  61, 255, 255, 255, 255, 255, 255,
+    255,   0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,
+     15,  16,  17,  18,  19,  20,  21,  22,  23,  24,  25, 255, 255, 255, 255, 255,
+    255,  26,  27,  28,  29,  30,  31,  32,  33,  34,  35,  36,  37,  38,  39,  40,
+     41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  51, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+};
+
+#ifdef HTTP4CPP_X86_SIMD
+
+// The vector kernels follow Mula and Lemire, "Faster Base64 Encoding and
+// Decoding using AVX2 Instructions". They only handle whole blocks and return
+// the input bytes consumed, the scalar loop does the rest.
+
+HTTP4CPP_TARGET("sse4.1")
+static inline __m128i encode_lookup_sse41(__m128i indices)
+{
+    // 0..25 -> 13, 26..51 -> 0, 52..61 -> 1..10, 62 -> 11, 63 -> 12
+    const __m128i shift = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+            '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63,
+            'A', 0, 0);
+    __m128i result = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+    result = _mm_or_si128(result, _mm_and_si128(less, _mm_set1_epi8(13)));
+    return _mm_add_epi8(_mm_shuffle_epi8(shift, result), indices);
+}
+
+HTTP4CPP_TARGET("sse4.1")
+static size_t encode_sse41(const unsigned char *src, size_t length, char *dst)
+{
+    const __m128i shuffle = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    size_t i = 0;
+    // 12 bytes are encoded, 16 are loaded
+    for (; i + 16 <= length; i += 12, dst += 16) {
+        __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        in = _mm_shuffle_epi8(in, shuffle);
+        __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+        __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+        __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+        __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst),
+                encode_lookup_sse41(_mm_or_si128(t1, t3)));
+    }
+    return i;
+}
+
+HTTP4CPP_TARGET("sse4.1")
+static size_t decode_sse41(const unsigned char *src, size_t length, char *dst)
+{
+    const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+            0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+    const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+            0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    size_t i = 0;
+    // 16 bytes are stored for 12 decoded, the margin keeps them inside dst
+    for (; i + 24 <= length; i += 16, dst += 12) {
+        __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(in, 4), nibble);
+        __m128i lo = _mm_shuffle_epi8(lut_lo, _mm_and_si128(in, nibble));
+        __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+        if (!_mm_testz_si128(lo, hi)) {
+            break;
+        }
+        __m128i eq_slash = _mm_cmpeq_epi8(in, _mm_set1_epi8('/'));
+        __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_slash, hi_nibbles));
+        __m128i values = _mm_add_epi8(in, roll);
+        __m128i merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+        __m128i out = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _mm_shuffle_epi8(out, pack));
+    }
+    return i;
+}
+
+HTTP4CPP_TARGET("avx2")
+static size_t encode_avx2(const unsigned char *src, size_t length, char *dst)
+{
+    const __m256i shuffle = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+            1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    const __m256i shift = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+            '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63,
+            'A', 0, 0,
+            'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+            '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63,
+            'A', 0, 0);
+    size_t i = 0;
+    // 24 bytes are encoded, 12 at offset 0 and 12 at offset 12 of 28 loaded
+    for (; i + 28 <= length; i += 24, dst += 32) {
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 12));
+        __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        in = _mm256_shuffle_epi8(in, shuffle);
+        __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+        __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+        __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+        __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+        __m256i indices = _mm256_or_si256(t1, t3);
+
+        __m256i result = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+        __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+        result = _mm256_or_si256(result, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+        result = _mm256_add_epi8(_mm256_shuffle_epi8(shift, result), indices);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), result);
+    }
+    return i + encode_sse41(src + i, length - i, dst);
+}
+
+HTTP4CPP_TARGET("avx2")
+static size_t decode_avx2(const unsigned char *src, size_t length, char *dst)
+{
+    const __m256i lut_lo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+            0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+            0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+            0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+    const __m256i lut_hi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+            0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i lut_roll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+            0, 0, 0, 0, 0, 0, 0, 0,
+            0, 16, 19, 4, -65, -65, -71, -71,
+            0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+            2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    size_t i = 0;
+    // 32 bytes are stored for 24 decoded, the margin keeps them inside dst
+    for (; i + 44 <= length; i += 32, dst += 24) {
+        __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(in, 4), nibble);
+        __m256i lo = _mm256_shuffle_epi8(lut_lo, _mm256_and_si256(in, nibble));
+        __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+        if (!_mm256_testz_si256(lo, hi)) {
+            break;
+        }
+        __m256i eq_slash = _mm256_cmpeq_epi8(in, _mm256_set1_epi8('/'));
+        __m256i roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_slash, hi_nibbles));
+        __m256i values = _mm256_add_epi8(in, roll);
+        __m256i merged = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+        __m256i out = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+        out = _mm256_shuffle_epi8(out, pack);
+        out = _mm256_permutevar8x32_epi32(out, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), out);
+    }
+    return i + decode_sse41(src + i, length - i, dst);
+}
+
+#endif
+
+typedef size_t (*block_fn)(const unsigned char *src, size_t length, char *dst);
+
+struct Base64Kernel {
+    block_fn encode;
+    block_fn decode;
+};
+
+static const Base64Kernel s_kernels[] = {
+    {NULL, NULL},
+#ifdef HTTP4CPP_X86_SIMD
+    {encode_sse41, decode_sse41},
+    {encode_avx2, decode_avx2},
+#endif
+};
+
+static simd_kernel_t s_kernel = CpuFeatures::best_kernel();
+
+size_t Base64::encode(const char *src, size_t length, char *dst)
+{
+    const unsigned char *in = reinterpret_cast<const unsigned char *>(src);
+    size_t i = 0;
+    char *out = dst;
+    block_fn block = s_kernels[s_kernel].encode;
+    if (block != NULL) {
+        i = block(in, length, out);
+        out += i / 3 * 4;
+    }
+    for (; i + 3 <= length; i += 3, out += 4) {
+        uint32_t v = (in[i] << 16) | (in[i + 1] << 8) | in[i + 2];
+        out[0] = s_encode_table[v >> 18];
+        out[1] = s_encode_table[(v >> 12) & 0x3f];
+        out[2] = s_encode_table[(v >> 6) & 0x3f];
+        out[3] = s_encode_table[v & 0x3f];
+    }
+    if (i < length) {
+        uint32_t v = in[i] << 16;
+        if (i + 1 < length) {
+            v |= in[i + 1] << 8;
+        }
+        out[0] = s_encode_table[v >> 18];
+        out[1] = s_encode_table[(v >> 12) & 0x3f];
+        out[2] = i + 1 < length ? s_encode_table[(v >> 6) & 0x3f] : '=';
+        out[3] = '=';
+        out += 4;
+    }
+    return out - dst;
+}
+
+int Base64::decode(const char *src, size_t length, char *dst, size_t *written)
+{
+    const unsigned char *in = reinterpret_cast<const unsigned char *>(src);
+    size_t i = 0;
+    char *out = dst;
+    block_fn block = s_kernels[s_kernel].decode;
+    if (block != NULL) {
+        i = block(in, length, out);
+        out += i / 4 * 3;
+    }
+    for (; i + 4 <= length; i += 4, out += 3) {
+        uint32_t a = s_decode_table[in[i]];
+        uint32_t b = s_decode_table[in[i + 1]];
+        uint32_t c = s_decode_table[in[i + 2]];
+        uint32_t d = s_decode_table[in[i + 3]];
+        if ((a | b | c | d) > 63) {
+            break;
+        }
+        uint32_t v = (a << 18) | (b << 12) | (c << 6) | d;
+        out[0] = static_cast<char>(v >> 16);
+        out[1] = static_cast<char>(v >> 8);
+        out[2] = static_cast<char>(v);
+    }
+
+    // the last group, up to two '=' and only when they complete it
+    size_t rest = length - i;
+    size_t padding = 0;
+    while (rest > 0 && padding < 2 && in[i + rest - 1] == '=') {
+        --rest;
+        ++padding;
+    }
+    if (rest > 4 || rest == 1 || (padding > 0 && rest + padding != 4)) {
+        return RET_ILLEGAL_ARGUMENT;
+    }
+    if (rest > 0) {
+        uint32_t v = 0;
+        for (size_t j = 0; j < rest; ++j) {
+            uint32_t c = s_decode_table[in[i + j]];
+            if (c > 63) {
+                return RET_ILLEGAL_ARGUMENT;
+            }
+            v |= c << (18 - 6 * j);
+        }
+        out[0] = static_cast<char>(v >> 16);
+        if (rest == 3) {
+            out[1] = static_cast<char>(v >> 8);
+        }
+        out += rest - 1;
+    }
+    *written = out - dst;
+    return RET_OK;
+}
+
+int Base64::set_kernel(simd_kernel_t kernel)
+{
+    if (!CpuFeatures::supports(kernel)) {
+        return RET_ILLEGAL_OPERATION;
+    }
+    s_kernel = kernel;
+    return RET_OK;
+}
+
+simd_kernel_t Base64::get_kernel()
+{
+    return s_kernel;
+}
+
+END_NAMESPACE
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
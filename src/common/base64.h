@@ -0,0 +1,48 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#ifndef HTTP4CPP_COMMON_BASE64_H
+#define HTTP4CPP_COMMON_BASE64_H
+
+#include <stddef.h>
+
+#include "common/common.h"
+#include "common/cpu_features.h"
+
+BEGIN_NAMESPACE
+
+/**
+ * Standard base64 (RFC 4648) over caller provided buffers. The kernel is
+ * picked once by the cpu features, AVX2 then SSE4.1 then a table driven
+ * scalar loop.
+ */
+class Base64 {
+public:
+    static size_t encoded_size(size_t length)
+    {
+        return (length + 2) / 3 * 4;
+    }
+    static size_t decoded_max_size(size_t length)
+    {
+        return (length + 3) / 4 * 3;
+    }
+
+    // dst must hold encoded_size(length) bytes, returns the bytes written.
+    static size_t encode(const char *src, size_t length, char *dst);
+    // dst must hold decoded_max_size(length) bytes. The padding is optional,
+    // anything else outside the alphabet fails with RET_ILLEGAL_ARGUMENT.
+    static int decode(const char *src, size_t length, char *dst, size_t *written);
+
+    // Forces a kernel, RET_ILLEGAL_OPERATION if the cpu lacks it.
+    static int set_kernel(simd_kernel_t kernel);
+    static simd_kernel_t get_kernel();
+};
+
+END_NAMESPACE
+#endif
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,552 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#include <stdio.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "common/binary_log.h"
+#include "common/util.h"
+
+BEGIN_NAMESPACE
+
+// site id, thread id and monotonic nanoseconds follow the frame header
+static const size_t RECORD_PREFIX = sizeof(BinaryLogFrameHeader) + 2 * sizeof(uint32_t)
+        + sizeof(int64_t);
+
+struct BinaryLogSite {
+    int         level;
+    int         line;
+    const char  *file;
+    const char  *func;
+    const char  *fmt;
+};
+
+// Sites are process wide so ids stay valid across BinaryLog instances.
+struct BinaryLogSites {
+    BinaryLogSites()
+    {
+        pthread_mutex_init(&mutex, NULL);
+    }
+
+    pthread_mutex_t                                 mutex;
+    std::vector<BinaryLogSite>                      sites;
+    std::map<std::pair<const char *, int>, uint32_t> ids;    // by file and line
+};
+
+static BinaryLogSites & get_sites()
+{
+    static BinaryLogSites s_sites;
+    return s_sites;
+}
+
+static int64_t clock_ns(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+static uint32_t thread_id()
+{
+    static __thread uint32_t s_tid = 0;
+    if (s_tid == 0) {
+        s_tid = static_cast<uint32_t>(syscall(SYS_gettid));
+    }
+    return s_tid;
+}
+
+static bool write_all(int fd, const char *data, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+BinaryLogRecord::BinaryLogRecord(uint32_t site) :
+    _site(site),
+    _size(RECORD_PREFIX)
+{
+    BinaryLogFrameHeader header;
+    header.len = 0;
+    header.type = BINARY_LOG_FRAME_RECORD;
+    uint32_t tid = thread_id();
+    int64_t now_ns = clock_ns(CLOCK_MONOTONIC);
+
+    char *pos = _buf;
+    memcpy(pos, &header, sizeof(header));
+    pos += sizeof(header);
+    memcpy(pos, &site, sizeof(site));
+    pos += sizeof(site);
+    memcpy(pos, &tid, sizeof(tid));
+    pos += sizeof(tid);
+    memcpy(pos, &now_ns, sizeof(now_ns));
+}
+
+const char * BinaryLogRecord::data()
+{
+    uint32_t len = static_cast<uint32_t>(_size);
+    memcpy(_buf, &len, sizeof(len));
+    return _buf;
+}
+
+void BinaryLogRecord::put_int(int64_t v)
+{
+    put_tagged(BINARY_LOG_ARG_INT, &v, sizeof(v));
+}
+
+void BinaryLogRecord::put_uint(uint64_t v)
+{
+    put_tagged(BINARY_LOG_ARG_UINT, &v, sizeof(v));
+}
+
+void BinaryLogRecord::put_double(double v)
+{
+    put_tagged(BINARY_LOG_ARG_DOUBLE, &v, sizeof(v));
+}
+
+void BinaryLogRecord::put_pointer(const void *v)
+{
+    uint64_t address = reinterpret_cast<uintptr_t>(v);
+    put_tagged(BINARY_LOG_ARG_POINTER, &address, sizeof(address));
+}
+
+void BinaryLogRecord::put_string(const char *v, size_t len)
+{
+    size_t room = MAX_SIZE - _size;
+    if (room < 1 + sizeof(uint32_t)) {
+        return;
+    }
+    room -= 1 + sizeof(uint32_t);
+    uint32_t n = static_cast<uint32_t>(len < room ? len : room);
+
+    _buf[_size++] = BINARY_LOG_ARG_STRING;
+    memcpy(_buf + _size, &n, sizeof(n));
+    _size += sizeof(n);
+    memcpy(_buf + _size, v, n);
+    _size += n;
+}
+
+void BinaryLogRecord::put_tagged(uint8_t tag, const void *v, size_t len)
+{
+    if (MAX_SIZE - _size < 1 + len) {
+        return;
+    }
+    _buf[_size++] = tag;
+    memcpy(_buf + _size, v, len);
+    _size += len;
+}
+
+BinaryLog::BinaryLog(const AsyncLoggerOptions &options) :
+    _logger(options),
+    _started(false),
+    _defined(0)
+{
+    pthread_mutex_init(&_mutex, NULL);
+}
+
+BinaryLog::~BinaryLog()
+{
+    stop();
+    pthread_mutex_destroy(&_mutex);
+}
+
+int BinaryLog::start()
+{
+    BinaryLogFileHeader header;
+    memcpy(header.magic, BINARY_LOG_MAGIC, sizeof(header.magic));
+    header.realtime_ns = clock_ns(CLOCK_REALTIME);
+    header.monotonic_ns = clock_ns(CLOCK_MONOTONIC);
+
+    pthread_mutex_lock(&_mutex);
+    if (_started) {
+        pthread_mutex_unlock(&_mutex);
+        return RET_ILLEGAL_OPERATION;
+    }
+    if (!write_all(_logger.get_options().fd,
+                reinterpret_cast<const char *>(&header), sizeof(header))) {
+        pthread_mutex_unlock(&_mutex);
+        return RET_FILE_INVALID;
+    }
+    int ret = _logger.start();
+    if (ret == RET_OK) {
+        __atomic_store_n(&_started, true, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&_mutex);
+    return ret;
+}
+
+void BinaryLog::stop()
+{
+    _logger.stop();
+}
+
+bool BinaryLog::flush(int max_wait_ms)
+{
+    return _logger.flush(max_wait_ms);
+}
+
+void BinaryLog::get_stat(AsyncLoggerStat *stat) const
+{
+    _logger.get_stat(stat);
+}
+
+uint32_t BinaryLog::register_site(int level, const char *file, int line,
+        const char *func, const char *fmt)
+{
+    BinaryLogSites &sites = get_sites();
+
+    pthread_mutex_lock(&sites.mutex);
+    uint32_t &id = sites.ids[std::make_pair(file, line)];
+    if (id == 0) {
+        BinaryLogSite site;
+        site.level = level;
+        site.line = line;
+        site.file = file;
+        site.func = func;
+        site.fmt = fmt;
+        sites.sites.push_back(site);
+        id = static_cast<uint32_t>(sites.sites.size());
+    }
+    uint32_t result = id;
+    pthread_mutex_unlock(&sites.mutex);
+    return result;
+}
+
+void BinaryLog::commit(BinaryLogRecord *record)
+{
+    // nothing may precede the file header
+    if (!__atomic_load_n(&_started, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    if (record->get_site() > __atomic_load_n(&_defined, __ATOMIC_ACQUIRE)) {
+        define_sites();
+    }
+    _logger.append_raw(record->data(), record->size());
+}
+
+void BinaryLog::define_sites()
+{
+    // Site frames bypass the rings, they must never be dropped. The writer
+    // thread writes them ahead of the records it drains in the same pass.
+    BinaryLogSites &sites = get_sites();
+    pthread_mutex_lock(&_mutex);
+    pthread_mutex_lock(&sites.mutex);
+    std::string frames;
+    uint32_t id = _defined;
+    for (; id < sites.sites.size(); ++id) {
+        const BinaryLogSite &site = sites.sites[id];
+        uint32_t fields[3];
+        fields[0] = id + 1;
+        fields[1] = static_cast<uint32_t>(site.level);
+        fields[2] = static_cast<uint32_t>(site.line);
+        BinaryLogFrameHeader header;
+        header.len = static_cast<uint32_t>(sizeof(header) + sizeof(fields) + strlen(site.file)
+                + strlen(site.func) + strlen(site.fmt) + 3);
+        header.type = BINARY_LOG_FRAME_SITE;
+
+        frames.append(reinterpret_cast<const char *>(&header), sizeof(header));
+        frames.append(reinterpret_cast<const char *>(fields), sizeof(fields));
+        frames.append(site.file, strlen(site.file) + 1);
+        frames.append(site.func, strlen(site.func) + 1);
+        frames.append(site.fmt, strlen(site.fmt) + 1);
+    }
+    pthread_mutex_unlock(&sites.mutex);
+
+    if (!frames.empty()) {
+        _logger.append_reliable(frames.data(), frames.size());
+        __atomic_store_n(&_defined, id, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&_mutex);
+}
+
+struct DecodedSite {
+    int         level;
+    int         line;
+    std::string file;
+    std::string func;
+    std::string fmt;
+};
+
+struct DecodedRecord {
+    uint32_t    site;
+    uint32_t    tid;
+    int64_t     ts_ns;
+    const char  *args;
+    const char  *end;
+
+    bool operator<(const DecodedRecord &other) const
+    {
+        return ts_ns < other.ts_ns;
+    }
+};
+
+struct DecodedArg {
+    uint8_t     tag;
+    int64_t     i;
+    uint64_t    u;
+    double      d;
+    std::string s;
+};
+
+static bool next_arg(const char **pos, const char *end, DecodedArg *arg)
+{
+    const char *p = *pos;
+    if (p >= end) {
+        return false;
+    }
+    arg->tag = static_cast<uint8_t>(*p++);
+    if (arg->tag == BINARY_LOG_ARG_STRING) {
+        uint32_t n = 0;
+        if (end - p < static_cast<ptrdiff_t>(sizeof(n))) {
+            return false;
+        }
+        memcpy(&n, p, sizeof(n));
+        p += sizeof(n);
+        if (end - p < static_cast<ptrdiff_t>(n)) {
+            return false;
+        }
+        arg->s.assign(p, n);
+        p += n;
+        *pos = p;
+        return true;
+    }
+
+    if (end - p < 8) {
+        return false;
+    }
+    memcpy(&arg->u, p, 8);
+    p += 8;
+    switch (arg->tag) {
+        case BINARY_LOG_ARG_INT:
+            arg->i = static_cast<int64_t>(arg->u);
+            arg->d = static_cast<double>(arg->i);
+            break;
+        case BINARY_LOG_ARG_DOUBLE:
+            memcpy(&arg->d, &arg->u, 8);
+            arg->i = static_cast<int64_t>(arg->d);
+            arg->u = static_cast<uint64_t>(arg->i);
+            break;
+        case BINARY_LOG_ARG_UINT:
+        case BINARY_LOG_ARG_POINTER:
+            arg->i = static_cast<int64_t>(arg->u);
+            arg->d = static_cast<double>(arg->u);
+            break;
+        default:
+            return false;
+    }
+    *pos = p;
+    return true;
+}
+
+static void format_arg(const std::string &spec, char conv, const DecodedArg &arg,
+        std::string *output)
+{
+    char buf[512];
+    std::string format = spec;
+    int n = 0;
+    switch (conv) {
+        case 'd': case 'i':
+            format.append("ll").append(1, conv);
+            n = snprintf(buf, sizeof(buf), format.c_str(), static_cast<long long>(arg.i));
+            break;
+        case 'u': case 'o': case 'x': case 'X':
+            format.append("ll").append(1, conv);
+            n = snprintf(buf, sizeof(buf), format.c_str(), static_cast<unsigned long long>(arg.u));
+            break;
+        case 'c':
+            format.append(1, conv);
+            n = snprintf(buf, sizeof(buf), format.c_str(), static_cast<int>(arg.i));
+            break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            format.append(1, conv);
+            n = snprintf(buf, sizeof(buf), format.c_str(), arg.d);
+            break;
+        case 'p':
+            format.append(1, conv);
+            n = snprintf(buf, sizeof(buf), format.c_str(),
+                    reinterpret_cast<void *>(static_cast<uintptr_t>(arg.u)));
+            break;
+        case 's':
+            if (arg.tag != BINARY_LOG_ARG_STRING) {
+                n = snprintf(buf, sizeof(buf), "%lld", static_cast<long long>(arg.i));
+                break;
+            }
+            if (spec.size() == 1) {
+                output->append(arg.s);
+                return;
+            }
+            format.append(1, conv);
+            n = snprintf(buf, sizeof(buf), format.c_str(), arg.s.c_str());
+            break;
+        default:
+            return;
+    }
+    if (n > 0) {
+        output->append(buf, n < static_cast<int>(sizeof(buf)) ? n : sizeof(buf) - 1);
+    }
+}
+
+static void render(const std::string &fmt, const char *args, const char *end,
+        std::string *output)
+{
+    const char *pos = args;
+    for (size_t i = 0; i < fmt.size(); ++i) {
+        if (fmt[i] != '%') {
+            output->append(1, fmt[i]);
+            continue;
+        }
+        if (i + 1 < fmt.size() && fmt[i + 1] == '%') {
+            output->append(1, '%');
+            ++i;
+            continue;
+        }
+
+        // flags, width, precision and length, the length is taken from the argument
+        std::string spec("%");
+        size_t j = i + 1;
+        while (j < fmt.size() && strchr("-+ #0123456789.*", fmt[j]) != NULL) {
+            if (fmt[j] == '*') {
+                DecodedArg width;
+                if (next_arg(&pos, end, &width)) {
+                    char num[32];
+                    snprintf(num, sizeof(num), "%lld", static_cast<long long>(width.i));
+                    spec.append(num);
+                }
+            } else {
+                spec.append(1, fmt[j]);
+            }
+            ++j;
+        }
+        while (j < fmt.size() && strchr("hlLqjzt", fmt[j]) != NULL) {
+            ++j;
+        }
+        if (j >= fmt.size()) {
+            break;
+        }
+
+        DecodedArg arg;
+        if (!next_arg(&pos, end, &arg)) {
+            output->append("<missing>");
+        } else {
+            format_arg(spec, fmt[j], arg, output);
+        }
+        i = j;
+    }
+}
+
+int BinaryLog::decode(const char *data, size_t len, std::string *output)
+{
+    BinaryLogFileHeader header;
+    if (len < sizeof(header)) {
+        return RET_FILE_INVALID;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, BINARY_LOG_MAGIC, sizeof(header.magic)) != 0) {
+        return RET_FILE_INVALID;
+    }
+
+    std::map<uint32_t, DecodedSite> sites;
+    std::vector<DecodedRecord> records;
+    const char *pos = data + sizeof(header);
+    const char *end = data + len;
+    while (end - pos >= static_cast<ptrdiff_t>(sizeof(BinaryLogFrameHeader))) {
+        BinaryLogFrameHeader frame;
+        memcpy(&frame, pos, sizeof(frame));
+        if (frame.len < sizeof(frame) || frame.len > static_cast<size_t>(end - pos)) {
+            break;
+        }
+        const char *frame_start = pos;
+        const char *body = pos + sizeof(frame);
+        const char *frame_end = pos + frame.len;
+        pos = frame_end;
+
+        if (frame.type == BINARY_LOG_FRAME_SITE) {
+            uint32_t fields[3];
+            if (frame_end - body < static_cast<ptrdiff_t>(sizeof(fields))) {
+                continue;
+            }
+            memcpy(fields, body, sizeof(fields));
+            const char *text = body + sizeof(fields);
+            DecodedSite &site = sites[fields[0]];
+            site.level = static_cast<int>(fields[1]);
+            site.line = static_cast<int>(fields[2]);
+            for (int k = 0; k < 3 && text < frame_end; ++k) {
+                const char *zero = reinterpret_cast<const char *>(
+                        memchr(text, '\0', frame_end - text));
+                if (zero == NULL) {
+                    break;
+                }
+                std::string &field = k == 0 ? site.file : (k == 1 ? site.func : site.fmt);
+                field.assign(text, zero - text);
+                text = zero + 1;
+            }
+        } else if (frame.type == BINARY_LOG_FRAME_RECORD && frame.len >= RECORD_PREFIX) {
+            DecodedRecord record;
+            memcpy(&record.site, body, sizeof(record.site));
+            memcpy(&record.tid, body + 4, sizeof(record.tid));
+            memcpy(&record.ts_ns, body + 8, sizeof(record.ts_ns));
+            record.args = frame_start + RECORD_PREFIX;
+            record.end = frame_end;
+            records.push_back(record);
+        }
+    }
+
+    // rings are drained one after another, order the threads by time again
+    std::stable_sort(records.begin(), records.end());
+    for (size_t i = 0; i < records.size(); ++i) {
+        const DecodedRecord &record = records[i];
+        int64_t wall_ns = header.realtime_ns + (record.ts_ns - header.monotonic_ns);
+        time_t sec = static_cast<time_t>(wall_ns / 1000000000);
+        struct tm tm_result;
+        gmtime_r(&sec, &tm_result);
+        char stamp[64];
+        size_t n = strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &tm_result);
+        snprintf(stamp + n, sizeof(stamp) - n, ".%06dZ",
+                static_cast<int>(wall_ns % 1000000000 / 1000));
+
+        std::map<uint32_t, DecodedSite>::const_iterator it = sites.find(record.site);
+        char prefix[128];
+        if (it == sites.end()) {
+            snprintf(prefix, sizeof(prefix), "[UNKNOWN]%s %u site %u\n", stamp, record.tid,
+                    record.site);
+            output->append(prefix);
+            continue;
+        }
+        const DecodedSite &site = it->second;
+        snprintf(prefix, sizeof(prefix), "[%s]%s %u ", LogUtil::level_to_string(site.level),
+                stamp, record.tid);
+        output->append(prefix);
+        output->append(site.file);
+        snprintf(prefix, sizeof(prefix), "(%d)", site.line);
+        output->append(prefix);
+        output->append(site.func);
+        output->append(": ");
+        render(site.fmt, record.args, record.end, output);
+        output->append("\n");
+    }
+    return RET_OK;
+}
+
+END_NAMESPACE
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
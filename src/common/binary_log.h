@@ -0,0 +1,244 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#ifndef HTTP4CPP_COMMON_BINARY_LOG_H
+#define HTTP4CPP_COMMON_BINARY_LOG_H
+
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <string>
+
+#include "common/common.h"
+#include "common/async_logger.h"
+
+BEGIN_NAMESPACE
+
+/**
+ * File layout: a BinaryLogFileHeader followed by frames, each starting with
+ * a BinaryLogFrameHeader. A site frame carries level, line, file, function
+ * and format of a log call site once, a record frame the site id, thread,
+ * monotonic nanoseconds and the tagged arguments. Frames of different threads
+ * are not ordered, a site may be defined after its first record.
+ */
+const char BINARY_LOG_MAGIC[8] = {'H', '4', 'C', 'B', 'L', 'O', 'G', '1'};
+
+struct BinaryLogFileHeader {
+    char    magic[8];
+    int64_t realtime_ns;        // wall clock and monotonic clock read at the same time,
+    int64_t monotonic_ns;       // records are placed on the wall clock from them
+};
+
+enum binary_log_frame_t {
+    BINARY_LOG_FRAME_SITE = 1,
+    BINARY_LOG_FRAME_RECORD = 2
+};
+
+struct BinaryLogFrameHeader {
+    uint32_t len;               // frame length including this header
+    uint32_t type;
+};
+
+enum binary_log_arg_t {
+    BINARY_LOG_ARG_INT = 1,     // int64_t
+    BINARY_LOG_ARG_UINT,        // uint64_t
+    BINARY_LOG_ARG_DOUBLE,      // double
+    BINARY_LOG_ARG_STRING,      // uint32_t length and the bytes
+    BINARY_LOG_ARG_POINTER      // uint64_t
+};
+
+// One record frame under construction, strings are cut when it is full.
+class BinaryLogRecord {
+public:
+    const static size_t MAX_SIZE = 1024;
+
+    explicit BinaryLogRecord(uint32_t site);
+
+    void put(bool v) { put_int(v); }
+    void put(char v) { put_int(v); }
+    void put(signed char v) { put_int(v); }
+    void put(unsigned char v) { put_uint(v); }
+    void put(short v) { put_int(v); }
+    void put(unsigned short v) { put_uint(v); }
+    void put(int v) { put_int(v); }
+    void put(unsigned int v) { put_uint(v); }
+    void put(long v) { put_int(v); }
+    void put(unsigned long v) { put_uint(v); }
+    void put(long long v) { put_int(v); }
+    void put(unsigned long long v) { put_uint(v); }
+    void put(float v) { put_double(v); }
+    void put(double v) { put_double(v); }
+    void put(const char *v) { put_string(v == NULL ? "(null)" : v, v == NULL ? 6 : strlen(v)); }
+    void put(const std::string &v) { put_string(v.data(), v.size()); }
+    template <typename T>
+    void put(const T *v) { put_pointer(v); }
+
+    uint32_t get_site() const
+    {
+        return _site;
+    }
+    const char * data();
+    size_t size() const
+    {
+        return _size;
+    }
+
+private:
+    void put_int(int64_t v);
+    void put_uint(uint64_t v);
+    void put_double(double v);
+    void put_string(const char *v, size_t len);
+    void put_pointer(const void *v);
+    void put_tagged(uint8_t tag, const void *v, size_t len);
+
+    uint32_t _site;
+    size_t   _size;
+    char     _buf[MAX_SIZE];
+};
+
+/**
+ * Binary mode of the log macros. Once installed with LogUtil::set_binary_log,
+ * an enabled site registers its format string on first use and then only
+ * appends its id, a timestamp and the raw arguments to the per thread ring
+ * of the underlying AsyncLogger, nothing is formatted. FATAL is always text.
+ * BinaryLog::decode, or tools/binary_log_decode, renders a file to text.
+ */
+class BinaryLog {
+public:
+    explicit BinaryLog(const AsyncLoggerOptions &options = AsyncLoggerOptions());
+    ~BinaryLog();
+
+    // Writes the file header and starts the writer thread, records of
+    // sites before are discarded.
+    int start();
+    void stop();
+    bool flush(int max_wait_ms);
+    void get_stat(AsyncLoggerStat *stat) const;
+
+    // Process wide and idempotent for the same site, ids start at 1.
+    static uint32_t register_site(int level, const char *file, int line,
+            const char *func, const char *fmt);
+
+    template <typename A1>
+    void write(uint32_t site, const A1 &a1)
+    {
+        BinaryLogRecord record(site);
+        record.put(a1);
+        commit(&record);
+    }
+
+    template <typename A1, typename A2>
+    void write(uint32_t site, const A1 &a1, const A2 &a2)
+    {
+        BinaryLogRecord record(site);
+        record.put(a1);
+        record.put(a2);
+        commit(&record);
+    }
+
+    template <typename A1, typename A2, typename A3>
+    void write(uint32_t site, const A1 &a1, const A2 &a2, const A3 &a3)
+    {
+        BinaryLogRecord record(site);
+        record.put(a1);
+        record.put(a2);
+        record.put(a3);
+        commit(&record);
+    }
+
+    template <typename A1, typename A2, typename A3, typename A4>
+    void write(uint32_t site, const A1 &a1, const A2 &a2, const A3 &a3, const A4 &a4)
+    {
+        BinaryLogRecord record(site);
+        record.put(a1);
+        record.put(a2);
+        record.put(a3);
+        record.put(a4);
+        commit(&record);
+    }
+
+    template <typename A1, typename A2, typename A3, typename A4, typename A5>
+    void write(uint32_t site, const A1 &a1, const A2 &a2, const A3 &a3, const A4 &a4,
+            const A5 &a5)
+    {
+        BinaryLogRecord record(site);
+        record.put(a1);
+        record.put(a2);
+        record.put(a3);
+        record.put(a4);
+        record.put(a5);
+        commit(&record);
+    }
+
+    template <typename A1, typename A2, typename A3, typename A4, typename A5, typename A6>
+    void write(uint32_t site, const A1 &a1, const A2 &a2, const A3 &a3, const A4 &a4,
+            const A5 &a5, const A6 &a6)
+    {
+        BinaryLogRecord record(site);
+        record.put(a1);
+        record.put(a2);
+        record.put(a3);
+        record.put(a4);
+        record.put(a5);
+        record.put(a6);
+        commit(&record);
+    }
+
+    template <typename A1, typename A2, typename A3, typename A4, typename A5, typename A6,
+             typename A7>
+    void write(uint32_t site, const A1 &a1, const A2 &a2, const A3 &a3, const A4 &a4,
+            const A5 &a5, const A6 &a6, const A7 &a7)
+    {
+        BinaryLogRecord record(site);
+        record.put(a1);
+        record.put(a2);
+        record.put(a3);
+        record.put(a4);
+        record.put(a5);
+        record.put(a6);
+        record.put(a7);
+        commit(&record);
+    }
+
+    template <typename A1, typename A2, typename A3, typename A4, typename A5, typename A6,
+             typename A7, typename A8>
+    void write(uint32_t site, const A1 &a1, const A2 &a2, const A3 &a3, const A4 &a4,
+            const A5 &a5, const A6 &a6, const A7 &a7, const A8 &a8)
+    {
+        BinaryLogRecord record(site);
+        record.put(a1);
+        record.put(a2);
+        record.put(a3);
+        record.put(a4);
+        record.put(a5);
+        record.put(a6);
+        record.put(a7);
+        record.put(a8);
+        commit(&record);
+    }
+
+    // Renders a whole binary log file, one text line per record.
+    static int decode(const char *data, size_t len, std::string *output);
+
+private:
+    BinaryLog(const BinaryLog &);
+    BinaryLog & operator=(const BinaryLog &);
+
+    void commit(BinaryLogRecord *record);
+    void define_sites();
+
+    AsyncLogger     _logger;
+    bool            _started;
+    uint32_t        _defined;       // sites up to this id are written to the file
+    pthread_mutex_t _mutex;
+};
+
+END_NAMESPACE
+#endif
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,533 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#include <errno.h>
+#include <string.h>
+
+#include "common/ascii.h"
+#include "common/charset.h"
+#include "common/util.h"
+
+#ifdef HTTP4CPP_X86_SIMD
+#include <immintrin.h>
+#endif
+
+BEGIN_NAMESPACE
+
+static const uint64_t HIGH_BITS = 0x8080808080808080ULL;
+
+// Length of the sequence starting at src, 0 if it is invalid and -1 if it
+// is valid so far but longer than size.
+static int sequence_length(const unsigned char *src, size_t size)
+{
+    unsigned char c = src[0];
+    unsigned char low = 0x80;
+    unsigned char high = 0xbf;
+    int length = 0;
+    if (c < 0x80) {
+        return 1;
+    } else if (c < 0xc2) {
+        return 0;
+    } else if (c < 0xe0) {
+        length = 2;
+    } else if (c < 0xf0) {
+        length = 3;
+        low = c == 0xe0 ? 0xa0 : low;       // overlong
+        high = c == 0xed ? 0x9f : high;     // surrogates
+    } else if (c < 0xf5) {
+        length = 4;
+        low = c == 0xf0 ? 0x90 : low;       // overlong
+        high = c == 0xf4 ? 0x8f : high;     // above U+10FFFF
+    } else {
+        return 0;
+    }
+    for (int i = 1; i < length; ++i) {
+        if (static_cast<size_t>(i) >= size) {
+            return -1;
+        }
+        if (src[i] < low || src[i] > high) {
+            return 0;
+        }
+        low = 0x80;
+        high = 0xbf;
+    }
+    return length;
+}
+
+static size_t valid_prefix_scalar(const unsigned char *src, size_t size)
+{
+    size_t i = 0;
+    while (i < size) {
+        if (i + 8 <= size) {
+            uint64_t word;
+            memcpy(&word, src + i, sizeof(word));
+            if ((word & HIGH_BITS) == 0) {
+                i += 8;
+                continue;
+            }
+        }
+        int length = sequence_length(src + i, size - i);
+        if (length <= 0) {
+            return i;
+        }
+        i += length;
+    }
+    return size;
+}
+
+static bool check_scalar(const unsigned char *src, size_t size)
+{
+    return valid_prefix_scalar(src, size) == size;
+}
+
+#ifdef HTTP4CPP_X86_SIMD
+
+// Keiser and Lemire, "Validating UTF-8 in less than one instruction per
+// byte". Each bit is an error a pair of bytes can show, a pair is invalid
+// when the bit is set in the tables of both the high and low nibble of the
+// first byte and of the high nibble of the second.
+enum {
+    TOO_SHORT       = 1 << 0,   // lead byte not followed by a continuation
+    TOO_LONG        = 1 << 1,   // continuation after ASCII
+    OVERLONG_3      = 1 << 2,
+    TOO_LARGE       = 1 << 3,
+    SURROGATE       = 1 << 4,
+    OVERLONG_2      = 1 << 5,
+    TOO_LARGE_1000  = 1 << 6,
+    OVERLONG_4      = 1 << 6,
+    TWO_CONTS       = 1 << 7,   // a third continuation is checked separately
+    CARRY           = TOO_SHORT | TOO_LONG | TWO_CONTS
+};
+
+static const unsigned char BYTE_1_HIGH[16] = {
+    TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+    TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+    TOO_SHORT | OVERLONG_2,
+    TOO_SHORT,
+    TOO_SHORT | OVERLONG_3 | SURROGATE,
+    TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4
+};
+
+static const unsigned char BYTE_1_LOW[16] = {
+    CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+    CARRY | OVERLONG_2,
+    CARRY,
+    CARRY,
+    CARRY | TOO_LARGE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+    CARRY | TOO_LARGE | TOO_LARGE_1000,
+    CARRY | TOO_LARGE | TOO_LARGE_1000
+};
+
+static const unsigned char BYTE_2_HIGH[16] = {
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+};
+
+// Errors of the 16 bytes of input, prev is the block before it.
+HTTP4CPP_TARGET("sse4.1")
+static inline __m128i block_errors_sse41(__m128i input, __m128i prev)
+{
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    __m128i prev1 = _mm_alignr_epi8(input, prev, 15);
+    __m128i byte_1_high = _mm_shuffle_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(BYTE_1_HIGH)),
+            _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble));
+    __m128i byte_1_low = _mm_shuffle_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(BYTE_1_LOW)),
+            _mm_and_si128(prev1, nibble));
+    __m128i byte_2_high = _mm_shuffle_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(BYTE_2_HIGH)),
+            _mm_and_si128(_mm_srli_epi16(input, 4), nibble));
+    __m128i special = _mm_and_si128(_mm_and_si128(byte_1_high, byte_1_low), byte_2_high);
+
+    // the third and fourth byte of a sequence must be continuations
+    __m128i third = _mm_subs_epu8(_mm_alignr_epi8(input, prev, 14), _mm_set1_epi8(0xe0 - 0x80));
+    __m128i fourth = _mm_subs_epu8(_mm_alignr_epi8(input, prev, 13), _mm_set1_epi8(0xf0 - 0x80));
+    __m128i must_continue = _mm_and_si128(_mm_or_si128(third, fourth),
+            _mm_set1_epi8(static_cast<char>(0x80)));
+    return _mm_xor_si128(must_continue, special);
+}
+
+HTTP4CPP_TARGET("sse4.1")
+static bool check_sse41(const unsigned char *src, size_t size)
+{
+    __m128i errors = _mm_setzero_si128();
+    __m128i prev = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        if (_mm_movemask_epi8(_mm_or_si128(input, prev)) != 0) {
+            errors = _mm_or_si128(errors, block_errors_sse41(input, prev));
+        }
+        prev = input;
+    }
+    // zero padding makes a sequence cut at the end an error
+    unsigned char tail[16] = {0};
+    memcpy(tail, src + i, size - i);
+    __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i *>(tail));
+    errors = _mm_or_si128(errors, block_errors_sse41(input, prev));
+    return _mm_testz_si128(errors, errors) != 0;
+}
+
+HTTP4CPP_TARGET("avx2")
+static inline __m256i lookup_avx2(const unsigned char *table, __m256i index)
+{
+    return _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(table))), index);
+}
+
+HTTP4CPP_TARGET("avx2")
+static inline __m256i block_errors_avx2(__m256i input, __m256i prev)
+{
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    // the upper half of prev and the lower half of input, so alignr works
+    // across the two 128 bit lanes
+    __m256i shifted = _mm256_permute2x128_si256(prev, input, 0x21);
+    __m256i prev1 = _mm256_alignr_epi8(input, shifted, 15);
+    __m256i byte_1_high = lookup_avx2(BYTE_1_HIGH,
+            _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble));
+    __m256i byte_1_low = lookup_avx2(BYTE_1_LOW, _mm256_and_si256(prev1, nibble));
+    __m256i byte_2_high = lookup_avx2(BYTE_2_HIGH,
+            _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble));
+    __m256i special = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+    __m256i third = _mm256_subs_epu8(_mm256_alignr_epi8(input, shifted, 14),
+            _mm256_set1_epi8(0xe0 - 0x80));
+    __m256i fourth = _mm256_subs_epu8(_mm256_alignr_epi8(input, shifted, 13),
+            _mm256_set1_epi8(0xf0 - 0x80));
+    __m256i must_continue = _mm256_and_si256(_mm256_or_si256(third, fourth),
+            _mm256_set1_epi8(static_cast<char>(0x80)));
+    return _mm256_xor_si256(must_continue, special);
+}
+
+HTTP4CPP_TARGET("avx2")
+static bool check_avx2(const unsigned char *src, size_t size)
+{
+    __m256i errors = _mm256_setzero_si256();
+    __m256i prev = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i input = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        if (_mm256_movemask_epi8(_mm256_or_si256(input, prev)) != 0) {
+            errors = _mm256_or_si256(errors, block_errors_avx2(input, prev));
+        }
+        prev = input;
+    }
+    unsigned char tail[32] = {0};
+    memcpy(tail, src + i, size - i);
+    __m256i input = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(tail));
+    errors = _mm256_or_si256(errors, block_errors_avx2(input, prev));
+    return _mm256_testz_si256(errors, errors) != 0;
+}
+
+#endif
+
+typedef bool (*check_fn)(const unsigned char *src, size_t size);
+
+static const check_fn s_checkers[] = {
+    check_scalar,
+#ifdef HTTP4CPP_X86_SIMD
+    check_sse41,
+    check_avx2,
+#endif
+};
+
+static simd_kernel_t s_kernel = CpuFeatures::best_kernel();
+
+bool Utf8::is_valid(const char *src, size_t size)
+{
+    return s_checkers[s_kernel](reinterpret_cast<const unsigned char *>(src), size);
+}
+
+size_t Utf8::valid_prefix(const char *src, size_t size)
+{
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(src);
+    // a sequence cut at the end is left out of the checked range
+    size_t end = size;
+    for (size_t back = 1; back <= 3 && back <= size; ++back) {
+        unsigned char c = p[size - back];
+        if (c >= 0xc0) {
+            end = sequence_length(p + size - back, back) < 0 ? size - back : size;
+            break;
+        } else if (c < 0x80) {
+            break;
+        }
+    }
+    if (s_checkers[s_kernel](p, end)) {
+        return end;
+    }
+    return valid_prefix_scalar(p, size);
+}
+
+bool Utf8::is_truncated(const char *src, size_t size)
+{
+    return size > 0 && sequence_length(reinterpret_cast<const unsigned char *>(src), size) < 0;
+}
+
+int Utf8::set_kernel(simd_kernel_t kernel)
+{
+    if (!CpuFeatures::supports(kernel)) {
+        return RET_ILLEGAL_OPERATION;
+    }
+    s_kernel = kernel;
+    return RET_OK;
+}
+
+simd_kernel_t Utf8::get_kernel()
+{
+    return s_kernel;
+}
+
+static bool is_utf8(const StringPiece &charset)
+{
+    return Ascii::equals_ignore_case(charset, "UTF-8")
+            || Ascii::equals_ignore_case(charset, "UTF8")
+            || Ascii::equals_ignore_case(charset, "US-ASCII");
+}
+
+CharsetOutputStream::CharsetOutputStream(OutputStream *sink, const std::string &default_charset,
+        const std::string &to_charset) :
+    _sink(sink),
+    _default_charset(default_charset),
+    _to_charset(to_charset),
+    _mode(MODE_UNSET),
+    _cd(reinterpret_cast<iconv_t>(-1)),
+    _pending_size(0)
+{
+    // nothing to do
+}
+
+CharsetOutputStream::~CharsetOutputStream()
+{
+    reset();
+}
+
+void CharsetOutputStream::reset()
+{
+    if (_cd != reinterpret_cast<iconv_t>(-1)) {
+        iconv_close(_cd);
+        _cd = reinterpret_cast<iconv_t>(-1);
+    }
+    _mode = MODE_UNSET;
+    _pending_size = 0;
+}
+
+StringPiece CharsetOutputStream::charset_of(const StringPiece &content_type)
+{
+    StringSplitter params(content_type, ";");
+    StringPiece param;
+    params.next(&param);    // the media type
+    while (params.next(&param)) {
+        size_t equal = param.find('=');
+        if (equal == std::string::npos
+                || !Ascii::equals_ignore_case(StringUtil::trim_view(param.substr(0, equal)),
+                    "charset")) {
+            continue;
+        }
+        StringPiece value = StringUtil::trim_view(param.substr(equal + 1));
+        if (value.size() >= 2 && value[0] == '"' && value[value.size() - 1] == '"') {
+            value = value.substr(1, value.size() - 2);
+        }
+        return value;
+    }
+    return StringPiece();
+}
+
+int CharsetOutputStream::set_content_type(const std::string &content_type)
+{
+    StringPiece charset = charset_of(content_type);
+    return set_charset(charset.empty() ? _default_charset : charset.as_string());
+}
+
+int CharsetOutputStream::set_charset(const std::string &charset)
+{
+    reset();
+    if (charset.empty()) {
+        _mode = MODE_PASS;
+        return RET_OK;
+    }
+    if (is_utf8(charset) && is_utf8(_to_charset)) {
+        _mode = MODE_VALIDATE;
+        return RET_OK;
+    }
+    _cd = iconv_open(_to_charset.c_str(), charset.c_str());
+    if (_cd == reinterpret_cast<iconv_t>(-1)) {
+        ERROR("unsupported charset conversion, from:%s to:%s", charset.c_str(),
+                _to_charset.c_str());
+        _mode = MODE_ERROR;
+        return RET_ILLEGAL_ARGUMENT;
+    }
+    _mode = MODE_TRANSCODE;
+    return RET_OK;
+}
+
+int64_t CharsetOutputStream::write(const char *buffer, int64_t size)
+{
+    if (_mode == MODE_UNSET) {
+        set_charset(_default_charset);
+    }
+    switch (_mode) {
+        case MODE_PASS:
+            return _sink->write(buffer, size);
+        case MODE_VALIDATE:
+            return validate(buffer, size);
+        case MODE_TRANSCODE:
+            return transcode(buffer, size);
+        default:
+            return -1;
+    }
+}
+
+int64_t CharsetOutputStream::fail()
+{
+    if (_mode != MODE_ERROR) {
+        ERROR("invalid or truncated body for charset conversion to %s", _to_charset.c_str());
+    }
+    reset();
+    _mode = MODE_ERROR;
+    return -1;
+}
+
+int64_t CharsetOutputStream::validate(const char *buffer, int64_t size)
+{
+    int64_t consumed = 0;
+    if (_pending_size > 0) {
+        // complete the sequence cut by the last write, at most 4 bytes long
+        char joined[MAX_PENDING];
+        size_t extra = 4 - _pending_size < static_cast<size_t>(size) ?
+                4 - _pending_size : static_cast<size_t>(size);
+        memcpy(joined, _pending, _pending_size);
+        memcpy(joined + _pending_size, buffer, extra);
+        size_t joined_size = _pending_size + extra;
+        size_t valid = Utf8::valid_prefix(joined, joined_size);
+        if (valid == 0) {
+            if (!Utf8::is_truncated(joined, joined_size)) {
+                return fail();
+            }
+            memcpy(_pending, joined, joined_size);
+            _pending_size = joined_size;
+            return size;
+        }
+        if (_sink->write(joined, valid) != static_cast<int64_t>(valid)) {
+            return -1;
+        }
+        consumed = valid - _pending_size;
+        _pending_size = 0;
+    }
+
+    size_t rest = size - consumed;
+    size_t valid = Utf8::valid_prefix(buffer + consumed, rest);
+    size_t tail = rest - valid;
+    if (tail > 0 && !Utf8::is_truncated(buffer + consumed + valid, tail)) {
+        return fail();
+    }
+    if (valid > 0 && _sink->write(buffer + consumed, valid) != static_cast<int64_t>(valid)) {
+        return -1;
+    }
+    memcpy(_pending, buffer + consumed + valid, tail);
+    _pending_size = tail;
+    return size;
+}
+
+int64_t CharsetOutputStream::transcode(const char *buffer, int64_t size)
+{
+    int64_t consumed = 0;
+    if (_pending_size > 0) {
+        char joined[MAX_PENDING * 2];
+        size_t extra = MAX_PENDING < static_cast<size_t>(size) ?
+                MAX_PENDING : static_cast<size_t>(size);
+        memcpy(joined, _pending, _pending_size);
+        memcpy(joined + _pending_size, buffer, extra);
+        size_t joined_size = _pending_size + extra;
+        int64_t left = convert(joined, joined_size);
+        if (left < 0) {
+            return fail();
+        }
+        size_t used = joined_size - left;
+        if (used < _pending_size) {
+            // still incomplete, so extra was all of buffer
+            if (joined_size > MAX_PENDING) {
+                return fail();
+            }
+            memcpy(_pending, joined, joined_size);
+            _pending_size = joined_size;
+            return size;
+        }
+        consumed = used - _pending_size;
+        _pending_size = 0;
+    }
+
+    int64_t left = convert(buffer + consumed, size - consumed);
+    if (left < 0 || left > static_cast<int64_t>(MAX_PENDING)) {
+        return fail();
+    }
+    memcpy(_pending, buffer + size - left, left);
+    _pending_size = left;
+    return size;
+}
+
+int64_t CharsetOutputStream::convert(const char *src, size_t size)
+{
+    char *in = const_cast<char *>(src);
+    size_t in_left = size;
+    while (in_left > 0) {
+        char *out = _buffer;
+        size_t out_left = sizeof(_buffer);
+        size_t ret = iconv(_cd, &in, &in_left, &out, &out_left);
+        int error = errno;
+        int64_t out_size = out - _buffer;
+        if (out_size > 0 && _sink->write(_buffer, out_size) != out_size) {
+            return -1;
+        }
+        if (ret == static_cast<size_t>(-1)) {
+            if (error == EINVAL) {
+                break;      // a sequence cut at the end of src
+            } else if (error != E2BIG) {
+                return -1;
+            }
+        }
+    }
+    return in_left;
+}
+
+int CharsetOutputStream::finish()
+{
+    int ret = RET_OK;
+    if (_mode == MODE_ERROR) {
+        ret = RET_ILLEGAL_ARGUMENT;
+    } else if (_pending_size > 0) {
+        fail();
+        ret = RET_ILLEGAL_ARGUMENT;
+    } else if (_mode == MODE_TRANSCODE) {
+        // back to the initial shift state of stateful charsets
+        char *out = _buffer;
+        size_t out_left = sizeof(_buffer);
+        if (iconv(_cd, NULL, NULL, &out, &out_left) == static_cast<size_t>(-1)
+                || (out != _buffer && _sink->write(_buffer, out - _buffer) != out - _buffer)) {
+            ret = RET_ILLEGAL_ARGUMENT;
+        }
+    }
+    reset();
+    return ret;
+}
+
+END_NAMESPACE
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
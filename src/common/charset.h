@@ -0,0 +1,134 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#ifndef HTTP4CPP_COMMON_CHARSET_H
+#define HTTP4CPP_COMMON_CHARSET_H
+
+#include <iconv.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+#include "common/common.h"
+#include "common/cpu_features.h"
+#include "common/stream.h"
+#include "common/string_piece.h"
+
+BEGIN_NAMESPACE
+
+/**
+ * UTF-8 validation as in RFC 3629: no overlong forms, surrogates or code
+ * points above U+10FFFF. The SIMD kernels check 16 or 32 bytes at a time
+ * with three table lookups and skip runs of ASCII.
+ */
+class Utf8 {
+public:
+    static bool is_valid(const char *src, size_t size);
+    static bool is_valid(const StringPiece &src)
+    {
+        return is_valid(src.data(), src.size());
+    }
+
+    // Length of the longest prefix of src made of whole valid sequences.
+    static size_t valid_prefix(const char *src, size_t size);
+
+    // Whether src is the start of a valid sequence that needs more bytes.
+    static bool is_truncated(const char *src, size_t size);
+
+    static int set_kernel(simd_kernel_t kernel);
+    static simd_kernel_t get_kernel();
+};
+
+/**
+ * Converts a response body to UTF-8 on its way to sink, the source charset
+ * is the charset parameter of the Content-Type header. A UTF-8 body is only
+ * validated and handed to sink without a copy, other charsets go through
+ * iconv. Bytes that are invalid in the source charset fail the write, so
+ * the transfer fails with them. Call finish() once the request returns.
+ */
+class CharsetOutputStream : public OutputStream {
+public:
+    // Bodies of a Content-Type without charset are taken as default_charset,
+    // an empty one passes them through unchecked.
+    explicit CharsetOutputStream(OutputStream *sink, const std::string &default_charset = "",
+            const std::string &to_charset = "UTF-8");
+    virtual ~CharsetOutputStream();
+
+    virtual int64_t write(const std::string &data)
+    {
+        return write(data.data(), data.size());
+    }
+
+    virtual int64_t write(const char *buffer, int64_t size);
+
+    virtual int64_t reserve(int64_t size)
+    {
+        return _sink->reserve(size);
+    }
+
+    virtual int64_t read(uint64_t start, int64_t length, std::string *data) const
+    {
+        return _sink->read(start, length, data);
+    }
+
+    virtual int set_content_type(const std::string &content_type);
+
+    // The source charset, before the first write. RET_ILLEGAL_ARGUMENT when
+    // iconv does not know it.
+    int set_charset(const std::string &charset);
+
+    // RET_OK when the body was valid and complete, RET_ILLEGAL_ARGUMENT
+    // after invalid bytes or a truncated sequence. The stream is ready for
+    // the next body then.
+    int finish();
+
+    // Whether the body was passed through without conversion.
+    bool is_passthrough() const
+    {
+        return _mode == MODE_PASS || _mode == MODE_VALIDATE;
+    }
+
+    // The charset parameter of a Content-Type value, empty if there is none.
+    static StringPiece charset_of(const StringPiece &content_type);
+
+private:
+    CharsetOutputStream(const CharsetOutputStream &);
+    CharsetOutputStream & operator=(const CharsetOutputStream &);
+
+    enum Mode {
+        MODE_UNSET,
+        MODE_PASS,
+        MODE_VALIDATE,
+        MODE_TRANSCODE,
+        MODE_ERROR
+    };
+
+    static const size_t MAX_PENDING = 8;
+
+    int64_t validate(const char *buffer, int64_t size);
+    int64_t transcode(const char *buffer, int64_t size);
+    // Converts src to sink, the return is the size of an incomplete
+    // sequence left at its end, -1 on invalid bytes.
+    int64_t convert(const char *src, size_t size);
+    int64_t fail();
+    void reset();
+
+    OutputStream *_sink;
+    std::string   _default_charset;
+    std::string   _to_charset;
+    Mode          _mode;
+    iconv_t       _cd;
+    char          _pending[MAX_PENDING];
+    size_t        _pending_size;
+    char          _buffer[4096];
+};
+
+END_NAMESPACE
+#endif
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,593 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#include <string.h>
+
+#include "common/checksum.h"
+#include "common/cpu_features.h"
+#include "common/util.h"
+
+#ifdef HTTP4CPP_X86_SIMD
+#include <immintrin.h>
+#endif
+
+BEGIN_NAMESPACE
+
+// reflected Castagnoli polynomial
+static const uint32_t CRC32C_POLY = 0x82f63b78;
+// bytes of each of the three streams merged with PCLMULQDQ
+static const size_t CRC32C_STRIPE = 256;
+
+// s_crc32c_table[k][b] is the crc of byte b followed by k zero bytes
+static uint32_t s_crc32c_table[8][256];
+// x^(8 * CRC32C_STRIPE - 33) and x^(16 * CRC32C_STRIPE - 33) mod P, reflected
+static uint32_t s_crc32c_shift1;
+static uint32_t s_crc32c_shift2;
+
+static inline uint32_t load_le32(const unsigned char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t load_le64(const unsigned char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t crc32c_xpow(size_t n)
+{
+    uint32_t value = 0x80000000;    // x^0
+    for (size_t i = 0; i < n; ++i) {
+        value = (value & 1) ? (value >> 1) ^ CRC32C_POLY : value >> 1;
+    }
+    return value;
+}
+
+static void init_crc32c_tables()
+{
+    for (uint32_t b = 0; b < 256; ++b) {
+        uint32_t crc = b;
+        for (int i = 0; i < 8; ++i) {
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        }
+        s_crc32c_table[0][b] = crc;
+    }
+    for (int k = 1; k < 8; ++k) {
+        for (int b = 0; b < 256; ++b) {
+            uint32_t prev = s_crc32c_table[k - 1][b];
+            s_crc32c_table[k][b] = (prev >> 8) ^ s_crc32c_table[0][prev & 0xff];
+        }
+    }
+    s_crc32c_shift1 = crc32c_xpow(8 * CRC32C_STRIPE - 33);
+    s_crc32c_shift2 = crc32c_xpow(16 * CRC32C_STRIPE - 33);
+}
+
+// The kernels work on the raw register, without the initial and final inversion.
+typedef uint32_t (*crc32c_fn)(uint32_t crc, const unsigned char *data, size_t size);
+
+static uint32_t crc32c_portable(uint32_t crc, const unsigned char *data, size_t size)
+{
+    for (; size >= 8; size -= 8, data += 8) {
+        uint32_t lo = load_le32(data) ^ crc;
+        uint32_t hi = load_le32(data + 4);
+        crc = s_crc32c_table[7][lo & 0xff] ^ s_crc32c_table[6][(lo >> 8) & 0xff]
+                ^ s_crc32c_table[5][(lo >> 16) & 0xff] ^ s_crc32c_table[4][lo >> 24]
+                ^ s_crc32c_table[3][hi & 0xff] ^ s_crc32c_table[2][(hi >> 8) & 0xff]
+                ^ s_crc32c_table[1][(hi >> 16) & 0xff] ^ s_crc32c_table[0][hi >> 24];
+    }
+    for (; size > 0; --size, ++data) {
+        crc = (crc >> 8) ^ s_crc32c_table[0][(crc ^ *data) & 0xff];
+    }
+    return crc;
+}
+
+#ifdef HTTP4CPP_X86_SIMD
+
+HTTP4CPP_TARGET("sse4.2")
+static uint32_t crc32c_sse42(uint32_t crc, const unsigned char *data, size_t size)
+{
+    uint64_t crc64 = crc;
+    for (; size >= 8; size -= 8, data += 8) {
+        crc64 = _mm_crc32_u64(crc64, load_le64(data));
+    }
+    crc = static_cast<uint32_t>(crc64);
+    for (; size > 0; --size, ++data) {
+        crc = _mm_crc32_u8(crc, *data);
+    }
+    return crc;
+}
+
+// crc followed by as many zero bytes as the constant stands for
+HTTP4CPP_TARGET("sse4.2,pclmul")
+static inline uint64_t crc32c_shift(uint32_t crc, uint32_t constant)
+{
+    __m128i product = _mm_clmulepi64_si128(_mm_cvtsi32_si128(crc),
+            _mm_cvtsi32_si128(constant), 0);
+    return _mm_crc32_u64(0, _mm_cvtsi128_si64(product));
+}
+
+// The crc32 instruction has a latency of three and a throughput of one, so
+// three independent streams keep it busy.
+HTTP4CPP_TARGET("sse4.2,pclmul")
+static uint32_t crc32c_pclmul(uint32_t crc, const unsigned char *data, size_t size)
+{
+    for (; size >= 3 * CRC32C_STRIPE; size -= 3 * CRC32C_STRIPE, data += 3 * CRC32C_STRIPE) {
+        uint64_t crc0 = crc;
+        uint64_t crc1 = 0;
+        uint64_t crc2 = 0;
+        for (size_t i = 0; i < CRC32C_STRIPE; i += 8) {
+            crc0 = _mm_crc32_u64(crc0, load_le64(data + i));
+            crc1 = _mm_crc32_u64(crc1, load_le64(data + CRC32C_STRIPE + i));
+            crc2 = _mm_crc32_u64(crc2, load_le64(data + 2 * CRC32C_STRIPE + i));
+        }
+        crc = static_cast<uint32_t>(crc32c_shift(static_cast<uint32_t>(crc0), s_crc32c_shift2)
+                ^ crc32c_shift(static_cast<uint32_t>(crc1), s_crc32c_shift1) ^ crc2);
+    }
+    return crc32c_sse42(crc, data, size);
+}
+
+#endif
+
+static crc32c_fn s_crc32c = crc32c_portable;
+
+class ChecksumInitializer {
+public:
+    ChecksumInitializer()
+    {
+        init_crc32c_tables();
+        Crc32c::set_hardware(true);
+    }
+};
+
+static ChecksumInitializer s_initializer;
+
+void Crc32c::finish(unsigned char *digest)
+{
+    digest[0] = static_cast<unsigned char>(_crc >> 24);
+    digest[1] = static_cast<unsigned char>(_crc >> 16);
+    digest[2] = static_cast<unsigned char>(_crc >> 8);
+    digest[3] = static_cast<unsigned char>(_crc);
+    reset();
+}
+
+uint32_t Crc32c::extend(uint32_t crc, const void *data, size_t size)
+{
+    return ~s_crc32c(~crc, reinterpret_cast<const unsigned char *>(data), size);
+}
+
+int Crc32c::set_hardware(bool enabled)
+{
+#ifdef HTTP4CPP_X86_SIMD
+    const CpuFeatures &cpu = CpuFeatures::get();
+    if (enabled && cpu.sse42) {
+        s_crc32c = cpu.pclmul ? crc32c_pclmul : crc32c_sse42;
+        return RET_OK;
+    }
+#endif
+    s_crc32c = crc32c_portable;
+    return enabled ? RET_ILLEGAL_OPERATION : RET_OK;
+}
+
+bool Crc32c::is_hardware()
+{
+    return s_crc32c != crc32c_portable;
+}
+
+static const uint64_t XXH_PRIME32_1 = 0x9e3779b1ULL;
+static const uint64_t XXH_PRIME32_2 = 0x85ebca77ULL;
+static const uint64_t XXH_PRIME32_3 = 0xc2b2ae3dULL;
+static const uint64_t XXH_PRIME64_1 = 0x9e3779b185ebca87ULL;
+static const uint64_t XXH_PRIME64_2 = 0xc2b2ae3d27d4eb4fULL;
+static const uint64_t XXH_PRIME64_3 = 0x165667b19e3779f9ULL;
+static const uint64_t XXH_PRIME64_4 = 0x85ebca77c2b2ae63ULL;
+static const uint64_t XXH_PRIME64_5 = 0x27d4eb2f165667c5ULL;
+
+// stripes hashed between two scrambles: (secret size - stripe) / 8
+static const size_t XXH3_BLOCK_STRIPES = 16;
+
+static const unsigned char XXH3_DEFAULT_SECRET[192] = {
+    0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+    0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+    0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+    0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+    0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+    0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+    0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+    0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+    0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+    0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+    0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+    0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+static inline uint64_t rotl64(uint64_t x, int n)
+{
+    return (x << n) | (x >> (64 - n));
+}
+
+static inline uint64_t xorshift64(uint64_t x, int n)
+{
+    return x ^ (x >> n);
+}
+
+// the low and the high half of the 128 bit product xored
+static inline uint64_t mul128_fold64(uint64_t a, uint64_t b)
+{
+    uint64_t a_lo = a & 0xffffffff;
+    uint64_t a_hi = a >> 32;
+    uint64_t b_lo = b & 0xffffffff;
+    uint64_t b_hi = b >> 32;
+    uint64_t lo_lo = a_lo * b_lo;
+    uint64_t hi_lo = a_hi * b_lo;
+    uint64_t lo_hi = a_lo * b_hi;
+    uint64_t hi_hi = a_hi * b_hi;
+    uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xffffffff) + lo_hi;
+    uint64_t upper = (hi_lo >> 32) + (cross >> 32) + hi_hi;
+    uint64_t lower = (cross << 32) | (lo_lo & 0xffffffff);
+    return lower ^ upper;
+}
+
+static inline uint64_t xxh64_avalanche(uint64_t h)
+{
+    h = xorshift64(h, 33) * XXH_PRIME64_2;
+    h = xorshift64(h, 29) * XXH_PRIME64_3;
+    return xorshift64(h, 32);
+}
+
+static inline uint64_t xxh3_avalanche(uint64_t h)
+{
+    h = xorshift64(h, 37) * 0x165667919e3779f9ULL;
+    return xorshift64(h, 32);
+}
+
+static inline uint64_t xxh3_rrmxmx(uint64_t h, uint64_t length)
+{
+    h ^= rotl64(h, 49) ^ rotl64(h, 24);
+    h *= 0x9fb21c651e98df25ULL;
+    h ^= (h >> 35) + length;
+    h *= 0x9fb21c651e98df25ULL;
+    return xorshift64(h, 28);
+}
+
+static inline uint64_t xxh3_mix16(const unsigned char *in, const unsigned char *secret,
+        uint64_t seed)
+{
+    return mul128_fold64(load_le64(in) ^ (load_le64(secret) + seed),
+            load_le64(in + 8) ^ (load_le64(secret + 8) - seed));
+}
+
+static uint64_t xxh3_0to16(const unsigned char *in, size_t size, const unsigned char *secret,
+        uint64_t seed)
+{
+    if (size > 8) {
+        uint64_t lo = load_le64(in) ^ ((load_le64(secret + 24) ^ load_le64(secret + 32)) + seed);
+        uint64_t hi = load_le64(in + size - 8)
+                ^ ((load_le64(secret + 40) ^ load_le64(secret + 48)) - seed);
+        return xxh3_avalanche(size + __builtin_bswap64(lo) + hi + mul128_fold64(lo, hi));
+    }
+    if (size >= 4) {
+        seed ^= static_cast<uint64_t>(__builtin_bswap32(static_cast<uint32_t>(seed))) << 32;
+        uint64_t flip = (load_le64(secret + 8) ^ load_le64(secret + 16)) - seed;
+        uint64_t input = load_le32(in + size - 4) + (static_cast<uint64_t>(load_le32(in)) << 32);
+        return xxh3_rrmxmx(input ^ flip, size);
+    }
+    if (size > 0) {
+        uint32_t combo = (static_cast<uint32_t>(in[0]) << 16)
+                | (static_cast<uint32_t>(in[size >> 1]) << 24)
+                | static_cast<uint32_t>(in[size - 1])
+                | (static_cast<uint32_t>(size) << 8);
+        uint64_t flip = (load_le32(secret) ^ load_le32(secret + 4)) + seed;
+        return xxh64_avalanche(combo ^ flip);
+    }
+    return xxh64_avalanche(seed ^ load_le64(secret + 56) ^ load_le64(secret + 64));
+}
+
+static uint64_t xxh3_17to128(const unsigned char *in, size_t size, const unsigned char *secret,
+        uint64_t seed)
+{
+    uint64_t acc = size * XXH_PRIME64_1;
+    if (size > 32) {
+        if (size > 64) {
+            if (size > 96) {
+                acc += xxh3_mix16(in + 48, secret + 96, seed);
+                acc += xxh3_mix16(in + size - 64, secret + 112, seed);
+            }
+            acc += xxh3_mix16(in + 32, secret + 64, seed);
+            acc += xxh3_mix16(in + size - 48, secret + 80, seed);
+        }
+        acc += xxh3_mix16(in + 16, secret + 32, seed);
+        acc += xxh3_mix16(in + size - 32, secret + 48, seed);
+    }
+    acc += xxh3_mix16(in, secret, seed);
+    acc += xxh3_mix16(in + size - 16, secret + 16, seed);
+    return xxh3_avalanche(acc);
+}
+
+static uint64_t xxh3_129to240(const unsigned char *in, size_t size, const unsigned char *secret,
+        uint64_t seed)
+{
+    uint64_t acc = size * XXH_PRIME64_1;
+    size_t rounds = size / 16;
+    for (size_t i = 0; i < 8; ++i) {
+        acc += xxh3_mix16(in + 16 * i, secret + 16 * i, seed);
+    }
+    acc = xxh3_avalanche(acc);
+    for (size_t i = 8; i < rounds; ++i) {
+        acc += xxh3_mix16(in + 16 * i, secret + 16 * (i - 8) + 3, seed);
+    }
+    // the last 16 bytes with the secret at its minimum size 136 - 17
+    acc += xxh3_mix16(in + size - 16, secret + 119, seed);
+    return xxh3_avalanche(acc);
+}
+
+static inline void xxh3_accumulate(uint64_t *acc, const unsigned char *in,
+        const unsigned char *secret)
+{
+    for (int i = 0; i < 8; ++i) {
+        uint64_t value = load_le64(in + 8 * i);
+        uint64_t key = value ^ load_le64(secret + 8 * i);
+        acc[i ^ 1] += value;
+        acc[i] += (key & 0xffffffff) * (key >> 32);
+    }
+}
+
+static inline void xxh3_scramble(uint64_t *acc, const unsigned char *secret)
+{
+    for (int i = 0; i < 8; ++i) {
+        acc[i] = (xorshift64(acc[i], 47) ^ load_le64(secret + 8 * i)) * XXH_PRIME32_1;
+    }
+}
+
+Xxh3::Xxh3(uint64_t seed) : _seed(seed)
+{
+    for (size_t i = 0; i < SECRET_SIZE; i += 16) {
+        uint64_t lo = load_le64(XXH3_DEFAULT_SECRET + i) + seed;
+        uint64_t hi = load_le64(XXH3_DEFAULT_SECRET + i + 8) - seed;
+        memcpy(_secret + i, &lo, 8);
+        memcpy(_secret + i + 8, &hi, 8);
+    }
+    reset();
+}
+
+void Xxh3::reset()
+{
+    _acc[0] = XXH_PRIME32_3;
+    _acc[1] = XXH_PRIME64_1;
+    _acc[2] = XXH_PRIME64_2;
+    _acc[3] = XXH_PRIME64_3;
+    _acc[4] = XXH_PRIME64_4;
+    _acc[5] = XXH_PRIME32_2;
+    _acc[6] = XXH_PRIME64_5;
+    _acc[7] = XXH_PRIME32_1;
+    _stripes = 0;
+    _length = 0;
+    _buffered = 0;
+}
+
+void Xxh3::consume(uint64_t *acc, size_t *stripes, const unsigned char *data, size_t count) const
+{
+    for (; count > 0; --count, data += 64) {
+        xxh3_accumulate(acc, data, _secret + *stripes * 8);
+        if (++*stripes == XXH3_BLOCK_STRIPES) {
+            xxh3_scramble(acc, _secret + SECRET_SIZE - 64);
+            *stripes = 0;
+        }
+    }
+}
+
+void Xxh3::update(const void *data, size_t size)
+{
+    // a stripe is only consumed once more input follows it, the last one is
+    // hashed with another part of the secret
+    const unsigned char *in = reinterpret_cast<const unsigned char *>(data);
+    _length += size;
+    if (_buffered + size <= BUFFER_SIZE) {
+        if (size > 0) {
+            memcpy(_buffer + _buffered, in, size);
+        }
+        _buffered += size;
+        return;
+    }
+    if (_buffered > 0) {
+        size_t fill = BUFFER_SIZE - _buffered;
+        memcpy(_buffer + _buffered, in, fill);
+        in += fill;
+        size -= fill;
+        consume(_acc, &_stripes, _buffer, BUFFER_SIZE / 64);
+        memcpy(_last_stripe, _buffer + BUFFER_SIZE - 64, 64);
+        _buffered = 0;
+    }
+    if (size > BUFFER_SIZE) {
+        size_t stripes = (size - 1) / 64;
+        consume(_acc, &_stripes, in, stripes);
+        in += stripes * 64;
+        size -= stripes * 64;
+        memcpy(_last_stripe, in - 64, 64);
+    }
+    memcpy(_buffer, in, size);
+    _buffered = size;
+}
+
+uint64_t Xxh3::digest() const
+{
+    // short inputs mix the seed into the default secret as they go
+    if (_length <= 16) {
+        return xxh3_0to16(_buffer, _buffered, XXH3_DEFAULT_SECRET, _seed);
+    }
+    if (_length <= 128) {
+        return xxh3_17to128(_buffer, _buffered, XXH3_DEFAULT_SECRET, _seed);
+    }
+    if (_length <= 240) {
+        return xxh3_129to240(_buffer, _buffered, XXH3_DEFAULT_SECRET, _seed);
+    }
+
+    // the long form only uses the secret derived from the seed
+    uint64_t acc[8];
+    memcpy(acc, _acc, sizeof(acc));
+    size_t stripes = _stripes;
+    consume(acc, &stripes, _buffer, (_buffered - 1) / 64);
+    unsigned char last[64];
+    const unsigned char *tail = _buffer + _buffered - 64;
+    if (_buffered < 64) {
+        memcpy(last, _last_stripe + _buffered, 64 - _buffered);
+        memcpy(last + 64 - _buffered, _buffer, _buffered);
+        tail = last;
+    }
+    xxh3_accumulate(acc, tail, _secret + SECRET_SIZE - 64 - 7);
+
+    uint64_t h = _length * XXH_PRIME64_1;
+    for (int i = 0; i < 4; ++i) {
+        h += mul128_fold64(acc[2 * i] ^ load_le64(_secret + 11 + 16 * i),
+                acc[2 * i + 1] ^ load_le64(_secret + 11 + 16 * i + 8));
+    }
+    return xxh3_avalanche(h);
+}
+
+void Xxh3::finish(unsigned char *digest_out)
+{
+    uint64_t h = digest();
+    for (int i = 0; i < 8; ++i) {
+        digest_out[i] = static_cast<unsigned char>(h >> (56 - 8 * i));
+    }
+    reset();
+}
+
+uint64_t Xxh3::hash(const void *data, size_t size, uint64_t seed)
+{
+    Xxh3 hasher(seed);
+    hasher.update(data, size);
+    return hasher.digest();
+}
+
+static const uint32_t MD5_K[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+};
+
+#define MD5_STEP(f, a, b, c, d, m, k, s) do { \
+    a += f(b, c, d) + (m) + (k); \
+    a = ((a << (s)) | (a >> (32 - (s)))) + b; \
+} while (0)
+#define MD5_F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define MD5_G(x, y, z) ((y) ^ ((z) & ((x) ^ (y))))
+#define MD5_H(x, y, z) ((x) ^ (y) ^ (z))
+#define MD5_I(x, y, z) ((y) ^ ((x) | ~(z)))
+
+static void md5_compress(uint32_t *state, const unsigned char *data, size_t blocks)
+{
+    for (; blocks > 0; --blocks, data += 64) {
+        uint32_t m[16];
+        for (int i = 0; i < 16; ++i) {
+            m[i] = load_le32(data + 4 * i);
+        }
+        uint32_t a = state[0];
+        uint32_t b = state[1];
+        uint32_t c = state[2];
+        uint32_t d = state[3];
+        for (int i = 0; i < 16; i += 4) {
+            MD5_STEP(MD5_F, a, b, c, d, m[i], MD5_K[i], 7);
+            MD5_STEP(MD5_F, d, a, b, c, m[i + 1], MD5_K[i + 1], 12);
+            MD5_STEP(MD5_F, c, d, a, b, m[i + 2], MD5_K[i + 2], 17);
+            MD5_STEP(MD5_F, b, c, d, a, m[i + 3], MD5_K[i + 3], 22);
+        }
+        for (int i = 16; i < 32; i += 4) {
+            MD5_STEP(MD5_G, a, b, c, d, m[(5 * i + 1) & 15], MD5_K[i], 5);
+            MD5_STEP(MD5_G, d, a, b, c, m[(5 * i + 6) & 15], MD5_K[i + 1], 9);
+            MD5_STEP(MD5_G, c, d, a, b, m[(5 * i + 11) & 15], MD5_K[i + 2], 14);
+            MD5_STEP(MD5_G, b, c, d, a, m[(5 * i + 16) & 15], MD5_K[i + 3], 20);
+        }
+        for (int i = 32; i < 48; i += 4) {
+            MD5_STEP(MD5_H, a, b, c, d, m[(3 * i + 5) & 15], MD5_K[i], 4);
+            MD5_STEP(MD5_H, d, a, b, c, m[(3 * i + 8) & 15], MD5_K[i + 1], 11);
+            MD5_STEP(MD5_H, c, d, a, b, m[(3 * i + 11) & 15], MD5_K[i + 2], 16);
+            MD5_STEP(MD5_H, b, c, d, a, m[(3 * i + 14) & 15], MD5_K[i + 3], 23);
+        }
+        for (int i = 48; i < 64; i += 4) {
+            MD5_STEP(MD5_I, a, b, c, d, m[(7 * i) & 15], MD5_K[i], 6);
+            MD5_STEP(MD5_I, d, a, b, c, m[(7 * i + 7) & 15], MD5_K[i + 1], 10);
+            MD5_STEP(MD5_I, c, d, a, b, m[(7 * i + 14) & 15], MD5_K[i + 2], 15);
+            MD5_STEP(MD5_I, b, c, d, a, m[(7 * i + 21) & 15], MD5_K[i + 3], 21);
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+    }
+}
+
+#undef MD5_STEP
+#undef MD5_F
+#undef MD5_G
+#undef MD5_H
+#undef MD5_I
+
+void Md5::reset()
+{
+    _state[0] = 0x67452301;
+    _state[1] = 0xefcdab89;
+    _state[2] = 0x98badcfe;
+    _state[3] = 0x10325476;
+    _length = 0;
+}
+
+void Md5::update(const void *data, size_t size)
+{
+    const unsigned char *in = reinterpret_cast<const unsigned char *>(data);
+    size_t used = static_cast<size_t>(_length & 63);
+    _length += size;
+    if (used > 0) {
+        size_t fill = 64 - used < size ? 64 - used : size;
+        memcpy(_buffer + used, in, fill);
+        in += fill;
+        size -= fill;
+        if (used + fill < 64) {
+            return;
+        }
+        md5_compress(_state, _buffer, 1);
+    }
+    md5_compress(_state, in, size / 64);
+    in += size / 64 * 64;
+    size &= 63;
+    if (size > 0) {
+        memcpy(_buffer, in, size);
+    }
+}
+
+void Md5::finish(unsigned char *digest)
+{
+    size_t used = static_cast<size_t>(_length & 63);
+    _buffer[used++] = 0x80;
+    if (used > 56) {
+        memset(_buffer + used, 0, 64 - used);
+        md5_compress(_state, _buffer, 1);
+        used = 0;
+    }
+    memset(_buffer + used, 0, 56 - used);
+    uint64_t bits = _length * 8;
+    for (int i = 0; i < 8; ++i) {
+        _buffer[56 + i] = static_cast<unsigned char>(bits >> (8 * i));
+    }
+    md5_compress(_state, _buffer, 1);
+    for (int i = 0; i < 16; ++i) {
+        digest[i] = static_cast<unsigned char>(_state[i / 4] >> (8 * (i % 4)));
+    }
+    reset();
+}
+
+END_NAMESPACE
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
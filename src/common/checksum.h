@@ -0,0 +1,133 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#ifndef HTTP4CPP_COMMON_CHECKSUM_H
+#define HTTP4CPP_COMMON_CHECKSUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common/common.h"
+#include "common/sha.h"
+
+BEGIN_NAMESPACE
+
+/**
+ * CRC-32C (Castagnoli) as used by x-goog-hash and x-amz-checksum-crc32c,
+ * the digest is the big-endian crc. SSE4.2 crc32 runs three streams at a
+ * time and merges them with PCLMULQDQ when the cpu has both.
+ */
+class Crc32c : public Hasher {
+public:
+    Crc32c() : _crc(0)
+    {
+        // nothing to do
+    }
+
+    virtual void update(const void *data, size_t size)
+    {
+        _crc = extend(_crc, data, size);
+    }
+
+    virtual void finish(unsigned char *digest);
+
+    virtual void reset()
+    {
+        _crc = 0;
+    }
+
+    virtual size_t get_digest_size() const
+    {
+        return 4;
+    }
+    using Hasher::update;
+    using Hasher::finish;
+
+    uint32_t value() const
+    {
+        return _crc;
+    }
+
+    // Continues crc, the value of the data so far, with more data.
+    static uint32_t extend(uint32_t crc, const void *data, size_t size);
+
+    // Turns SSE4.2 on or off, RET_ILLEGAL_OPERATION if missing.
+    static int set_hardware(bool enabled);
+    static bool is_hardware();
+
+private:
+    uint32_t _crc;
+};
+
+/**
+ * XXH3-64, a fast non-cryptographic hash for comparing copies of data that
+ * are both under our control. A seed other than 0 derives its own secret
+ * like the reference does. The digest is the canonical big-endian form.
+ */
+class Xxh3 : public Hasher {
+public:
+    explicit Xxh3(uint64_t seed = 0);
+
+    virtual void update(const void *data, size_t size);
+    virtual void finish(unsigned char *digest);
+    virtual void reset();
+    virtual size_t get_digest_size() const
+    {
+        return 8;
+    }
+    using Hasher::update;
+    using Hasher::finish;
+
+    static uint64_t hash(const void *data, size_t size, uint64_t seed = 0);
+
+private:
+    static const size_t SECRET_SIZE = 192;
+    static const size_t BUFFER_SIZE = 256;
+
+    uint64_t digest() const;
+    void consume(uint64_t *acc, size_t *stripes, const unsigned char *data, size_t count) const;
+
+    uint64_t        _seed;
+    uint64_t        _acc[8];
+    size_t          _stripes;               // of the current block
+    uint64_t        _length;
+    size_t          _buffered;
+    unsigned char   _secret[SECRET_SIZE];
+    unsigned char   _buffer[BUFFER_SIZE];
+    unsigned char   _last_stripe[64];       // the last 64 bytes consumed
+};
+
+// MD5 for Content-MD5, RFC 1864.
+class Md5 : public Hasher {
+public:
+    static const size_t DIGEST_SIZE = 16;
+
+    Md5()
+    {
+        reset();
+    }
+
+    virtual void update(const void *data, size_t size);
+    virtual void finish(unsigned char *digest);
+    virtual void reset();
+    virtual size_t get_digest_size() const
+    {
+        return DIGEST_SIZE;
+    }
+    using Hasher::update;
+    using Hasher::finish;
+
+private:
+    uint32_t        _state[4];
+    uint64_t        _length;
+    unsigned char   _buffer[64];
+};
+
+END_NAMESPACE
+#endif
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
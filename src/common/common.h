@@ -9,6 +9,8 @@
 #ifndef HTTP4CPP_COMMON_COMMON_H
 #define HTTP4CPP_COMMON_COMMON_H
 
+#include <string>
+
 #define BEGIN_NAMESPACE \
 namespace http4cpp { \
 
@@ -31,30 +33,71 @@ enum log_level_t{
 extern log_level_t      g_log_level;
 extern bool             g_log_behind;
 
-#define FATAL(fmt, ...) LogUtil::should_log(LOG_LEVEL_FATAL) ? \
-    LogUtil::log_fatal("%s %s(%d)%s: " fmt, TimeUtil::now_utctime().c_str(),\
-            __FILE__, __LINE__, __func__, __VA_ARGS__) :\
-    LogUtil::log_none()
-
-#define ERROR(fmt, ...) LogUtil::should_log(LOG_LEVEL_ERR) ? \
-    LogUtil::log_err("%s %s(%d)%s: " fmt, TimeUtil::now_utctime().c_str(),\
-            __FILE__, __LINE__, __func__, __VA_ARGS__) :\
-    LogUtil::log_none()
-
-#define WARN(fmt, ...) LogUtil::should_log(LOG_LEVEL_WARN) ? \
-    LogUtil::log_warn("%s %s(%d)%s: " fmt, TimeUtil::now_utctime().c_str(),\
-            __FILE__, __LINE__, __func__, __VA_ARGS__) :\
-    LogUtil::log_none()
-
-#define INFO(fmt, ...) LogUtil::should_log(LOG_LEVEL_INFO) ? \
-    LogUtil::log_info("%s %s(%d)%s: " fmt, TimeUtil::now_utctime().c_str(),\
-            __FILE__, __LINE__, __func__, __VA_ARGS__) :\
-    LogUtil::log_none()
-
-#define DEBUG(fmt, ...) LogUtil::should_log(LOG_LEVEL_DEBUG) ? \
-    LogUtil::log_debug("%s %s(%d)%s: " fmt, TimeUtil::now_utctime().c_str(),\
-            __FILE__, __LINE__, __func__, __VA_ARGS__) :\
-    LogUtil::log_none()
+// Sites above the compile time level are compiled out, arguments included.
+// The values are the ones of log_level_t, release builds default to INFO.
+#ifndef HTTP4CPP_LOG_LEVEL
+#define HTTP4CPP_LOG_LEVEL 15
+#endif
+
+#define HTTP4CPP_TEXT_LOG(level, func, fmt, ...) \
+    LogUtil::func("%s %s(%d)%s: " fmt, TimeUtil::cached_utctime(),\
+            __FILE__, __LINE__, __func__, __VA_ARGS__)
+
+// Counts up to 16 arguments, the binary encoding takes at most 8.
+#define HTTP4CPP_LOG_NARGS(...) HTTP4CPP_LOG_NARGS_(__VA_ARGS__, \
+        16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define HTTP4CPP_LOG_NARGS_(a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14, \
+        a15, a16, n, ...) n
+
+// With a binary log installed a site registers its format once and then
+// records only the raw arguments. The macros are void expressions, the site
+// id needs a statement expression.
+#define HTTP4CPP_LOG(level, func, fmt, ...) \
+    (LogUtil::should_log(level) ? ({ \
+        typedef char http4cpp_log_takes_at_most_8_args[ \
+                HTTP4CPP_LOG_NARGS(__VA_ARGS__) <= 8 ? 1 : -1] __attribute__((unused)); \
+        BinaryLog *http4cpp_binary_log = LogUtil::get_binary_log(); \
+        if (http4cpp_binary_log == NULL) { \
+            HTTP4CPP_TEXT_LOG(level, func, fmt, __VA_ARGS__); \
+        } else { \
+            static uint32_t http4cpp_log_site = 0; \
+            uint32_t http4cpp_site = __atomic_load_n(&http4cpp_log_site, __ATOMIC_RELAXED); \
+            if (http4cpp_site == 0) { \
+                http4cpp_site = BinaryLog::register_site(level, __FILE__, __LINE__, \
+                        __func__, fmt); \
+                __atomic_store_n(&http4cpp_log_site, http4cpp_site, __ATOMIC_RELAXED); \
+            } \
+            http4cpp_binary_log->write(http4cpp_site, __VA_ARGS__); \
+        } \
+    }) : LogUtil::log_none())
+
+#define FATAL(fmt, ...) (LogUtil::should_log(LOG_LEVEL_FATAL) ? \
+    HTTP4CPP_TEXT_LOG(LOG_LEVEL_FATAL, log_fatal, fmt, __VA_ARGS__) : \
+    LogUtil::log_none())
+
+#if HTTP4CPP_LOG_LEVEL >= 1
+#define ERROR(fmt, ...) HTTP4CPP_LOG(LOG_LEVEL_ERR, log_err, fmt, __VA_ARGS__)
+#else
+#define ERROR(fmt, ...) LogUtil::log_none()
+#endif
+
+#if HTTP4CPP_LOG_LEVEL >= 3
+#define WARN(fmt, ...) HTTP4CPP_LOG(LOG_LEVEL_WARN, log_warn, fmt, __VA_ARGS__)
+#else
+#define WARN(fmt, ...) LogUtil::log_none()
+#endif
+
+#if HTTP4CPP_LOG_LEVEL >= 7
+#define INFO(fmt, ...) HTTP4CPP_LOG(LOG_LEVEL_INFO, log_info, fmt, __VA_ARGS__)
+#else
+#define INFO(fmt, ...) LogUtil::log_none()
+#endif
+
+#if HTTP4CPP_LOG_LEVEL >= 15
+#define DEBUG(fmt, ...) HTTP4CPP_LOG(LOG_LEVEL_DEBUG, log_debug, fmt, __VA_ARGS__)
+#else
+#define DEBUG(fmt, ...) LogUtil::log_none()
+#endif
 
 // Time of clock type macro
 #ifndef CLOCK_REALTIME
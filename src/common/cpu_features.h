@@ -0,0 +1,127 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#ifndef HTTP4CPP_COMMON_CPU_FEATURES_H
+#define HTTP4CPP_COMMON_CPU_FEATURES_H
+
+#include "common/common.h"
+
+// SIMD kernels are compiled per function with the target attribute, so the
+// library itself is still built for the baseline instruction set.
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define HTTP4CPP_X86_SIMD 1
+#define HTTP4CPP_TARGET(isa) __attribute__((target(isa)))
+#include <cpuid.h>
+#endif
+
+BEGIN_NAMESPACE
+
+// Variants of the vectorized routines, each needs the ones before it.
+enum simd_kernel_t {
+    SIMD_KERNEL_SCALAR = 0,
+    SIMD_KERNEL_SSE41,
+    SIMD_KERNEL_AVX2,
+};
+
+// Instruction set extensions usable by the running process.
+struct CpuFeatures {
+    bool ssse3;
+    bool sse41;
+    bool sse42;
+    bool pclmul;
+    bool avx2;
+    bool bmi2;
+    bool sha;
+    bool invariant_tsc;     // the TSC ticks at a constant rate in every state
+
+    static const CpuFeatures & get()
+    {
+        static const CpuFeatures s_features = detect();
+        return s_features;
+    }
+
+    static bool supports(simd_kernel_t kernel)
+    {
+        const CpuFeatures &cpu = get();
+        switch (kernel) {
+            case SIMD_KERNEL_SCALAR:
+                return true;
+            case SIMD_KERNEL_SSE41:
+                return cpu.ssse3 && cpu.sse41;
+            case SIMD_KERNEL_AVX2:
+                return cpu.ssse3 && cpu.sse41 && cpu.avx2;
+            default:
+                return false;
+        }
+    }
+
+    static simd_kernel_t best_kernel()
+    {
+        return supports(SIMD_KERNEL_AVX2) ? SIMD_KERNEL_AVX2 :
+                supports(SIMD_KERNEL_SSE41) ? SIMD_KERNEL_SSE41 : SIMD_KERNEL_SCALAR;
+    }
+
+    static const char * kernel_name(simd_kernel_t kernel)
+    {
+        switch (kernel) {
+            case SIMD_KERNEL_SCALAR:
+                return "scalar";
+            case SIMD_KERNEL_SSE41:
+                return "sse4.1";
+            case SIMD_KERNEL_AVX2:
+                return "avx2";
+            default:
+                return "unknown";
+        }
+    }
+
+private:
+    static CpuFeatures detect()
+    {
+        CpuFeatures features = {false, false, false, false, false, false, false, false};
+#ifdef HTTP4CPP_X86_SIMD
+        unsigned int eax = 0;
+        unsigned int ebx = 0;
+        unsigned int ecx = 0;
+        unsigned int edx = 0;
+        unsigned int max_leaf = __get_cpuid_max(0, 0);
+        if (max_leaf < 1) {
+            return features;
+        }
+        __cpuid(1, eax, ebx, ecx, edx);
+        features.ssse3 = (ecx & (1U << 9)) != 0;
+        features.sse41 = (ecx & (1U << 19)) != 0;
+        features.sse42 = (ecx & (1U << 20)) != 0;
+        features.pclmul = (ecx & (1U << 1)) != 0;
+        // AVX state must be enabled by the OS as well
+        bool avx = false;
+        if ((ecx & (1U << 27)) != 0 && (ecx & (1U << 28)) != 0) {
+            unsigned int xcr0_lo = 0;
+            unsigned int xcr0_hi = 0;
+            __asm__ __volatile__(".byte 0x0f, 0x01, 0xd0" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+            avx = (xcr0_lo & 6) == 6;
+        }
+        if (max_leaf >= 7) {
+            __cpuid_count(7, 0, eax, ebx, ecx, edx);
+            features.avx2 = avx && (ebx & (1U << 5)) != 0;
+            features.bmi2 = (ebx & (1U << 8)) != 0;
+            features.sha = (ebx & (1U << 29)) != 0;
+        }
+        if (__get_cpuid_max(0x80000000, 0) >= 0x80000007) {
+            __cpuid(0x80000007, eax, ebx, ecx, edx);
+            features.invariant_tsc = (edx & (1U << 8)) != 0;
+        }
+#endif
+        return features;
+    }
+};
+
+END_NAMESPACE
+#endif
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,154 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#ifndef HTTP4CPP_COMMON_DIGEST_STREAM_H
+#define HTTP4CPP_COMMON_DIGEST_STREAM_H
+
+#include "common/common.h"
+#include "common/sha.h"
+#include "common/stream.h"
+
+BEGIN_NAMESPACE
+
+/**
+ * Hashes the bytes read from source on their way to the request body, so
+ * the payload digest costs no second pass. Rewinding to 0, as a retry does,
+ * starts the digest over; seeking elsewhere leaves it invalid.
+ */
+class DigestInputStream : public InputStream {
+public:
+    DigestInputStream(InputStream *source, Hasher *hasher) :
+        _source(source), _hasher(hasher), _valid(source->get_pos() == 0)
+    {
+        _hasher->reset();
+    }
+
+    virtual ~DigestInputStream()
+    {
+        // nothing to do
+    }
+
+    virtual int64_t read(int64_t size, std::string *data)
+    {
+        int64_t real_size = _source->read(size, data);
+        if (real_size > 0) {
+            _hasher->update(data->data(), real_size);
+        }
+        return real_size;
+    }
+
+    virtual int64_t read(char *buffer, int64_t size)
+    {
+        int64_t real_size = _source->read(buffer, size);
+        if (real_size > 0) {
+            _hasher->update(buffer, real_size);
+        }
+        return real_size;
+    }
+
+    virtual int64_t get_size() const
+    {
+        return _source->get_size();
+    }
+
+    virtual int64_t seek(int64_t pos)
+    {
+        int64_t old_pos = _source->get_pos();
+        int64_t ret = _source->seek(pos);
+        if (ret == 0) {
+            _hasher->reset();
+            _valid = true;
+        } else if (ret != old_pos) {
+            _valid = false;
+        }
+        return ret;
+    }
+
+    virtual int64_t get_pos() const
+    {
+        return _source->get_pos();
+    }
+
+    // Whether the digest covers every byte from the start of the source.
+    bool is_valid() const
+    {
+        return _valid;
+    }
+
+    // Call after the whole source has been read.
+    std::string finish()
+    {
+        return _hasher->finish();
+    }
+
+private:
+    InputStream *_source;
+    Hasher      *_hasher;
+    bool         _valid;
+};
+
+/**
+ * Tee of a response body: the bytes go to sink and through the hasher, so
+ * a download is verified without reading the file back. Attached with a
+ * digest header, HttpResponse::set_output_stream has the request check it.
+ */
+class DigestOutputStream : public OutputStream {
+public:
+    DigestOutputStream(OutputStream *sink, Hasher *hasher) : _sink(sink), _hasher(hasher)
+    {
+        _hasher->reset();
+    }
+
+    virtual ~DigestOutputStream()
+    {
+        // nothing to do
+    }
+
+    virtual int64_t write(const std::string &data)
+    {
+        return write(data.data(), data.size());
+    }
+
+    virtual int64_t write(const char *buffer, int64_t size)
+    {
+        int64_t ret = _sink->write(buffer, size);
+        if (ret > 0) {
+            _hasher->update(buffer, ret);
+        }
+        return ret;
+    }
+
+    virtual int64_t reserve(int64_t size)
+    {
+        return _sink->reserve(size);
+    }
+
+    virtual int64_t read(uint64_t start, int64_t length, std::string *data) const
+    {
+        return _sink->read(start, length, data);
+    }
+
+    virtual int set_content_type(const std::string &content_type)
+    {
+        return _sink->set_content_type(content_type);
+    }
+
+    // The digest of everything written, the hasher starts over.
+    std::string finish()
+    {
+        return _hasher->finish();
+    }
+
+private:
+    OutputStream *_sink;
+    Hasher       *_hasher;
+};
+
+END_NAMESPACE
+#endif
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
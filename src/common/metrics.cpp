@@ -0,0 +1,401 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/metrics.h"
+#include "common/util.h"
+
+BEGIN_NAMESPACE
+
+int metrics_thread_slot()
+{
+    static int s_next_slot = 0;
+    static __thread int s_slot = -1;
+    if (s_slot < 0) {
+        s_slot = __sync_fetch_and_add(&s_next_slot, 1) % METRICS_SHARDS;
+    }
+    return s_slot;
+}
+
+ShardedCounter::ShardedCounter()
+{
+    memset(_shards, 0, sizeof(_shards));
+}
+
+uint64_t ShardedCounter::value() const
+{
+    uint64_t total = 0;
+    for (int i = 0; i < METRICS_SHARDS; ++i) {
+        total += __atomic_load_n(&_shards[i].value, __ATOMIC_RELAXED);
+    }
+    return total;
+}
+
+LatencyHistogram::LatencyHistogram() : _shards(NULL)
+{
+    void *memory = NULL;
+    if (posix_memalign(&memory, 64, sizeof(Shard) * METRICS_SHARDS) != 0) {
+        FATAL("%s", "allocate histogram shards failed");
+    }
+    memset(memory, 0, sizeof(Shard) * METRICS_SHARDS);
+    _shards = reinterpret_cast<Shard *>(memory);
+}
+
+LatencyHistogram::~LatencyHistogram()
+{
+    free(_shards);
+    _shards = NULL;
+}
+
+void LatencyHistogram::record(int64_t value)
+{
+    uint64_t v = value < 0 ? 0 : static_cast<uint64_t>(value);
+    Shard &shard = _shards[metrics_thread_slot()];
+
+    __atomic_fetch_add(&shard.buckets[bucket_index(v)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&shard.count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&shard.sum, v, __ATOMIC_RELAXED);
+    uint64_t max = __atomic_load_n(&shard.max, __ATOMIC_RELAXED);
+    while (v > max && !__atomic_compare_exchange_n(&shard.max, &max, v, true,
+                __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        // max reloaded by the failed exchange
+    }
+}
+
+void LatencyHistogram::snapshot(HistogramSnapshot *snapshot) const
+{
+    snapshot->count = 0;
+    snapshot->sum = 0;
+    snapshot->max = 0;
+    snapshot->buckets.assign(BUCKETS, 0);
+    for (int i = 0; i < METRICS_SHARDS; ++i) {
+        const Shard &shard = _shards[i];
+        snapshot->count += __atomic_load_n(&shard.count, __ATOMIC_RELAXED);
+        snapshot->sum += __atomic_load_n(&shard.sum, __ATOMIC_RELAXED);
+        uint64_t max = __atomic_load_n(&shard.max, __ATOMIC_RELAXED);
+        if (max > snapshot->max) {
+            snapshot->max = max;
+        }
+        for (int j = 0; j < BUCKETS; ++j) {
+            snapshot->buckets[j] += __atomic_load_n(&shard.buckets[j], __ATOMIC_RELAXED);
+        }
+    }
+}
+
+int LatencyHistogram::bucket_index(uint64_t value)
+{
+    if (value < static_cast<uint64_t>(SUB_BUCKETS)) {
+        return static_cast<int>(value);
+    }
+    int exponent = 63 - __builtin_clzll(value);
+    if (exponent > MAX_EXPONENT) {
+        return BUCKETS - 1;
+    }
+    int sub = static_cast<int>(value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+    return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+uint64_t LatencyHistogram::bucket_upper_bound(int index)
+{
+    if (index < SUB_BUCKETS) {
+        return index;
+    }
+    int exponent = index / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+    uint64_t sub = index % SUB_BUCKETS;
+    uint64_t lower = (SUB_BUCKETS + sub) << (exponent - SUB_BUCKET_BITS);
+    return lower + (1ULL << (exponent - SUB_BUCKET_BITS)) - 1;
+}
+
+uint64_t HistogramSnapshot::percentile(double p) const
+{
+    if (count == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(p / 100.0 * count + 0.999999);
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            uint64_t upper = LatencyHistogram::bucket_upper_bound(i);
+            return upper < max ? upper : max;
+        }
+    }
+    return max;
+}
+
+uint64_t HistogramSnapshot::count_le(uint64_t value) const
+{
+    uint64_t total = 0;
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        if (LatencyHistogram::bucket_upper_bound(i) > value) {
+            break;
+        }
+        total += buckets[i];
+    }
+    return total;
+}
+
+MetricsRegistry::MetricsRegistry()
+{
+    pthread_mutex_init(&_mutex, NULL);
+    pthread_key_create(&_cache_key, free_thread_cache);
+}
+
+MetricsRegistry::~MetricsRegistry()
+{
+    // no thread frees its cache on exit from here on
+    pthread_key_delete(_cache_key);
+    std::set<ThreadCache *>::iterator cit = _caches.begin();
+    for (; cit != _caches.end(); ++cit) {
+        delete *cit;
+    }
+
+    RequestSeriesMap::iterator rit = _requests.begin();
+    for (; rit != _requests.end(); ++rit) {
+        delete rit->second;
+    }
+    StatusSeriesMap::iterator sit = _statuses.begin();
+    for (; sit != _statuses.end(); ++sit) {
+        delete sit->second;
+    }
+    pthread_mutex_destroy(&_mutex);
+}
+
+void MetricsRegistry::record_request(const std::string &host, const char *method, int status,
+        int64_t latency_us, int64_t bytes_sent, int64_t bytes_received)
+{
+    // the key buffer lives in the thread cache, a warm series costs no allocation
+    ThreadCache *cache = get_thread_cache();
+    std::string &key = cache->key;
+    key.assign(host).append(1, ' ').append(method);
+    RequestSeries *series = get_request_series(cache, key, host, method);
+    key.append(1, ' ');
+    StringUtil::append_num(status, &key);
+    StatusSeries *status_series = get_status_series(cache, key, host, method, status);
+
+    status_series->requests.add(1);
+    series->latency.record(latency_us);
+    if (bytes_sent > 0) {
+        series->bytes_sent.add(bytes_sent);
+    }
+    if (bytes_received > 0) {
+        series->bytes_received.add(bytes_received);
+    }
+}
+
+int MetricsRegistry::get_latency(const std::string &host, const char *method,
+        HistogramSnapshot *snapshot) const
+{
+    std::string key = host + " " + method;
+    int ret = RET_ILLEGAL_ARGUMENT;
+
+    pthread_mutex_lock(&_mutex);
+    RequestSeriesMap::const_iterator it = _requests.find(key);
+    if (it != _requests.end()) {
+        it->second->latency.snapshot(snapshot);
+        ret = RET_OK;
+    }
+    pthread_mutex_unlock(&_mutex);
+    return ret;
+}
+
+static void append_label_value(const std::string &value, std::string *output)
+{
+    for (size_t i = 0; i < value.size(); ++i) {
+        char c = value[i];
+        if (c == '\\' || c == '"') {
+            output->push_back('\\');
+            output->push_back(c);
+        } else if (c == '\n') {
+            output->append("\\n");
+        } else {
+            output->push_back(c);
+        }
+    }
+}
+
+static void append_labels(const std::string &host, const std::string &method,
+        std::string *output)
+{
+    output->append("host=\"");
+    append_label_value(host, output);
+    output->append("\",method=\"");
+    append_label_value(method, output);
+    output->append("\"");
+}
+
+int MetricsRegistry::render_prometheus(std::string *output) const
+{
+    // Prometheus histogram buckets in seconds, folded from the fine buckets
+    static const double LE_SECONDS[] = {
+        0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1,
+        0.25, 0.5, 1, 2.5, 5, 10, 30, 60
+    };
+    static const int LE_COUNT = sizeof(LE_SECONDS) / sizeof(LE_SECONDS[0]);
+    char buf[128];
+
+    pthread_mutex_lock(&_mutex);
+    output->append("# HELP http4cpp_client_requests_total Requests finished by the client.\n");
+    output->append("# TYPE http4cpp_client_requests_total counter\n");
+    StatusSeriesMap::const_iterator sit = _statuses.begin();
+    for (; sit != _statuses.end(); ++sit) {
+        const StatusSeries *series = sit->second;
+        output->append("http4cpp_client_requests_total{");
+        append_labels(series->host, series->method, output);
+        snprintf(buf, sizeof(buf), ",status=\"%d\"} %llu\n", series->status,
+                static_cast<unsigned long long>(series->requests.value()));
+        output->append(buf);
+    }
+
+    output->append("# HELP http4cpp_client_request_duration_seconds Request latency.\n");
+    output->append("# TYPE http4cpp_client_request_duration_seconds histogram\n");
+    HistogramSnapshot snapshot;
+    RequestSeriesMap::const_iterator rit = _requests.begin();
+    for (; rit != _requests.end(); ++rit) {
+        const RequestSeries *series = rit->second;
+        series->latency.snapshot(&snapshot);
+        for (int i = 0; i < LE_COUNT; ++i) {
+            output->append("http4cpp_client_request_duration_seconds_bucket{");
+            append_labels(series->host, series->method, output);
+            snprintf(buf, sizeof(buf), ",le=\"%g\"} %llu\n", LE_SECONDS[i],
+                    static_cast<unsigned long long>(snapshot.count_le(
+                            static_cast<uint64_t>(LE_SECONDS[i] * 1000000))));
+            output->append(buf);
+        }
+        output->append("http4cpp_client_request_duration_seconds_bucket{");
+        append_labels(series->host, series->method, output);
+        snprintf(buf, sizeof(buf), ",le=\"+Inf\"} %llu\n",
+                static_cast<unsigned long long>(snapshot.count));
+        output->append(buf);
+
+        output->append("http4cpp_client_request_duration_seconds_sum{");
+        append_labels(series->host, series->method, output);
+        snprintf(buf, sizeof(buf), "} %.6f\n", snapshot.sum / 1000000.0);
+        output->append(buf);
+
+        output->append("http4cpp_client_request_duration_seconds_count{");
+        append_labels(series->host, series->method, output);
+        snprintf(buf, sizeof(buf), "} %llu\n", static_cast<unsigned long long>(snapshot.count));
+        output->append(buf);
+    }
+
+    const char *byte_metrics[] = {"sent", "received"};
+    for (int m = 0; m < 2; ++m) {
+        snprintf(buf, sizeof(buf), "# TYPE http4cpp_client_bytes_%s_total counter\n",
+                byte_metrics[m]);
+        output->append(buf);
+        for (rit = _requests.begin(); rit != _requests.end(); ++rit) {
+            const RequestSeries *series = rit->second;
+            const ShardedCounter &counter = m == 0 ? series->bytes_sent : series->bytes_received;
+            snprintf(buf, sizeof(buf), "http4cpp_client_bytes_%s_total{", byte_metrics[m]);
+            output->append(buf);
+            append_labels(series->host, series->method, output);
+            snprintf(buf, sizeof(buf), "} %llu\n",
+                    static_cast<unsigned long long>(counter.value()));
+            output->append(buf);
+        }
+    }
+    pthread_mutex_unlock(&_mutex);
+
+    return RET_OK;
+}
+
+int MetricsRegistry::dump_prometheus(const std::string &file_name) const
+{
+    std::string output;
+    render_prometheus(&output);
+
+    // write aside and rename so a scraper never reads a partial file
+    std::string tmp_name = file_name + ".tmp";
+    FILE *fp = fopen(tmp_name.c_str(), "w");
+    if (fp == NULL) {
+        ERROR("open metrics file %s failed", tmp_name.c_str());
+        return RET_FILE_INVALID;
+    }
+    size_t written = fwrite(output.data(), 1, output.size(), fp);
+    fclose(fp);
+    if (written != output.size() || rename(tmp_name.c_str(), file_name.c_str()) != 0) {
+        ERROR("write metrics file %s failed", file_name.c_str());
+        return RET_FILE_INVALID;
+    }
+    return RET_OK;
+}
+
+MetricsRegistry::ThreadCache * MetricsRegistry::get_thread_cache()
+{
+    ThreadCache *cache = reinterpret_cast<ThreadCache *>(pthread_getspecific(_cache_key));
+    if (cache == NULL) {
+        cache = new ThreadCache();
+        cache->registry = this;
+        pthread_mutex_lock(&_mutex);
+        _caches.insert(cache);
+        pthread_mutex_unlock(&_mutex);
+        pthread_setspecific(_cache_key, cache);
+    }
+    return cache;
+}
+
+MetricsRegistry::RequestSeries * MetricsRegistry::get_request_series(ThreadCache *cache,
+        const std::string &key, const std::string &host, const char *method)
+{
+    RequestSeriesMap::iterator it = cache->requests.find(key);
+    if (it != cache->requests.end()) {
+        return it->second;
+    }
+
+    pthread_mutex_lock(&_mutex);
+    RequestSeries *&series = _requests[key];
+    if (series == NULL) {
+        series = new RequestSeries();
+        series->host = host;
+        series->method = method;
+    }
+    cache->requests[key] = series;
+    pthread_mutex_unlock(&_mutex);
+    return series;
+}
+
+MetricsRegistry::StatusSeries * MetricsRegistry::get_status_series(ThreadCache *cache,
+        const std::string &key, const std::string &host, const char *method, int status)
+{
+    StatusSeriesMap::iterator it = cache->statuses.find(key);
+    if (it != cache->statuses.end()) {
+        return it->second;
+    }
+
+    pthread_mutex_lock(&_mutex);
+    StatusSeries *&series = _statuses[key];
+    if (series == NULL) {
+        series = new StatusSeries();
+        series->host = host;
+        series->method = method;
+        series->status = status;
+    }
+    cache->statuses[key] = series;
+    pthread_mutex_unlock(&_mutex);
+    return series;
+}
+
+void MetricsRegistry::free_thread_cache(void *arg)
+{
+    ThreadCache *cache = reinterpret_cast<ThreadCache *>(arg);
+    MetricsRegistry *registry = cache->registry;
+    pthread_mutex_lock(&registry->_mutex);
+    registry->_caches.erase(cache);
+    pthread_mutex_unlock(&registry->_mutex);
+    delete cache;
+}
+
+END_NAMESPACE
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
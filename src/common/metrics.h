@@ -0,0 +1,174 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#ifndef HTTP4CPP_COMMON_METRICS_H
+#define HTTP4CPP_COMMON_METRICS_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "common/common.h"
+
+BEGIN_NAMESPACE
+
+// Writers are spread over a fixed number of cache line sized shards by a
+// per thread slot, so recording is a relaxed atomic add that almost never
+// contends. Readers merge the shards.
+const int METRICS_SHARDS = 8;
+
+int metrics_thread_slot();
+
+class ShardedCounter {
+public:
+    ShardedCounter();
+
+    void add(uint64_t n)
+    {
+        __atomic_fetch_add(&_shards[metrics_thread_slot()].value, n, __ATOMIC_RELAXED);
+    }
+
+    uint64_t value() const;
+
+private:
+    // padded rather than aligned, series are allocated with plain new
+    struct Shard {
+        uint64_t value;
+        char     pad[64 - sizeof(uint64_t)];
+    };
+
+    Shard _shards[METRICS_SHARDS];
+};
+
+struct HistogramSnapshot;
+
+/**
+ * HDR style log-linear histogram: values below 8 get their own bucket, above
+ * that every power of two is split in 8 sub-buckets, bounding the relative
+ * error to 12.5%. Values are plain integers, the client records microseconds.
+ */
+class LatencyHistogram {
+public:
+    const static int SUB_BUCKET_BITS = 3;
+    const static int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    const static int MAX_EXPONENT = 39;
+    const static int BUCKETS = (MAX_EXPONENT - SUB_BUCKET_BITS + 2) * SUB_BUCKETS;
+
+    LatencyHistogram();
+    ~LatencyHistogram();
+
+    void record(int64_t value);
+    void snapshot(HistogramSnapshot *snapshot) const;
+
+    static int bucket_index(uint64_t value);
+    static uint64_t bucket_upper_bound(int index);
+
+private:
+    LatencyHistogram(const LatencyHistogram &);
+    LatencyHistogram & operator=(const LatencyHistogram &);
+
+    struct Shard {
+        uint64_t count;
+        uint64_t sum;
+        uint64_t max;
+        uint64_t buckets[BUCKETS];
+    } __attribute__((aligned(64)));
+
+    Shard *_shards;
+};
+
+struct HistogramSnapshot {
+    HistogramSnapshot() : count(0), sum(0), max(0), buckets(LatencyHistogram::BUCKETS, 0)
+    {
+        // nothing to do
+    }
+
+    // Upper bound of the bucket holding the p-th percentile, 0 < p <= 100.
+    uint64_t percentile(double p) const;
+    // Observations not greater than value, exact on bucket boundaries.
+    uint64_t count_le(uint64_t value) const;
+
+    uint64_t              count;
+    uint64_t              sum;
+    uint64_t              max;
+    std::vector<uint64_t> buckets;
+};
+
+/**
+ * Process wide client telemetry: request counters per host, method and
+ * status, latency histograms and byte counters per host and method. Series
+ * are created under a mutex on first use and then cached per thread, so the
+ * request path itself never takes a lock. The registry must outlive the
+ * threads recording into it, it frees the caches of those still running.
+ */
+class MetricsRegistry {
+public:
+    MetricsRegistry();
+    ~MetricsRegistry();
+
+    // status is the http code, 0 for requests which got no response
+    void record_request(const std::string &host, const char *method, int status,
+            int64_t latency_us, int64_t bytes_sent, int64_t bytes_received);
+
+    int get_latency(const std::string &host, const char *method,
+            HistogramSnapshot *snapshot) const;
+
+    // Prometheus text exposition format 0.0.4
+    int render_prometheus(std::string *output) const;
+    int dump_prometheus(const std::string &file_name) const;
+
+private:
+    MetricsRegistry(const MetricsRegistry &);
+    MetricsRegistry & operator=(const MetricsRegistry &);
+
+    struct RequestSeries {
+        std::string      host;
+        std::string      method;
+        ShardedCounter   bytes_sent;
+        ShardedCounter   bytes_received;
+        LatencyHistogram latency;
+    };
+
+    struct StatusSeries {
+        std::string    host;
+        std::string    method;
+        int            status;
+        ShardedCounter requests;
+    };
+
+    typedef std::map<std::string, RequestSeries *> RequestSeriesMap;
+    typedef std::map<std::string, StatusSeries *>  StatusSeriesMap;
+
+    struct ThreadCache {
+        MetricsRegistry *registry;
+        RequestSeriesMap requests;
+        StatusSeriesMap  statuses;
+        std::string      key;
+    };
+
+    ThreadCache * get_thread_cache();
+    RequestSeries * get_request_series(ThreadCache *cache, const std::string &key,
+            const std::string &host, const char *method);
+    StatusSeries * get_status_series(ThreadCache *cache, const std::string &key,
+            const std::string &host, const char *method, int status);
+    static void free_thread_cache(void *cache);
+
+    pthread_key_t           _cache_key;
+    mutable pthread_mutex_t _mutex;
+    RequestSeriesMap        _requests;
+    StatusSeriesMap         _statuses;
+    std::set<ThreadCache *> _caches;
+};
+
+END_NAMESPACE
+#endif
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
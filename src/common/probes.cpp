@@ -0,0 +1,28 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#include "common/probes.h"
+
+#ifdef HTTP4CPP_USDT
+
+// Raised by the kernel while a tracer is attached to the probe, the section
+// is where sdt aware tools look for them.
+#define HTTP4CPP_SEMAPHORE __attribute__((section(".probes"))) = 0
+
+extern "C" {
+unsigned short http4cpp_request__start_semaphore HTTP4CPP_SEMAPHORE;
+unsigned short http4cpp_connection__acquired_semaphore HTTP4CPP_SEMAPHORE;
+unsigned short http4cpp_headers__received_semaphore HTTP4CPP_SEMAPHORE;
+unsigned short http4cpp_body__chunk_semaphore HTTP4CPP_SEMAPHORE;
+unsigned short http4cpp_request__done_semaphore HTTP4CPP_SEMAPHORE;
+}
+
+#undef HTTP4CPP_SEMAPHORE
+
+#endif
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,73 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#ifndef HTTP4CPP_COMMON_PROBES_H
+#define HTTP4CPP_COMMON_PROBES_H
+
+/**
+ * USDT probes of provider http4cpp for perf, bpftrace and systemtap, built
+ * with `make USDT=1` which needs sys/sdt.h (systemtap-sdt-dev). A probe site
+ * is a nop until a tracer attaches. Arguments that cost more than loading a
+ * value are computed under HTTP4CPP_PROBE_ENABLED, which reads the semaphore
+ * the kernel raises while the probe is attached. Without USDT all of it
+ * compiles away.
+ *
+ * The first argument of every probe is the HttpResponse pointer, to match the
+ * probes of one request:
+ *   request__start        (response, url, method)
+ *   connection__acquired  (response, url, primary ip, primary port)
+ *   headers__received     (response, http code, header count)
+ *   body__chunk           (response, bytes)
+ *   request__done         (response, url, ret, http code, bytes sent,
+ *                          bytes received, transfer us)
+ *
+ *   bpftrace -e 'usdt:output/libhttp4cpp.so:http4cpp:request__done
+ *           { printf("%s %d %d\n", str(arg1), arg3, arg5); }'
+ */
+#ifdef HTTP4CPP_USDT
+
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+extern "C" {
+extern unsigned short http4cpp_request__start_semaphore;
+extern unsigned short http4cpp_connection__acquired_semaphore;
+extern unsigned short http4cpp_headers__received_semaphore;
+extern unsigned short http4cpp_body__chunk_semaphore;
+extern unsigned short http4cpp_request__done_semaphore;
+}
+
+#define HTTP4CPP_PROBE_ENABLED(name) __builtin_expect(http4cpp_##name##_semaphore != 0, 0)
+#define HTTP4CPP_PROBE2(name, a1, a2) STAP_PROBE2(http4cpp, name, a1, a2)
+#define HTTP4CPP_PROBE3(name, a1, a2, a3) STAP_PROBE3(http4cpp, name, a1, a2, a3)
+#define HTTP4CPP_PROBE4(name, a1, a2, a3, a4) STAP_PROBE4(http4cpp, name, a1, a2, a3, a4)
+#define HTTP4CPP_PROBE7(name, a1, a2, a3, a4, a5, a6, a7) \
+    STAP_PROBE7(http4cpp, name, a1, a2, a3, a4, a5, a6, a7)
+
+#else
+
+// arguments are referenced but never evaluated
+#define HTTP4CPP_PROBE_ENABLED(name) false
+#define HTTP4CPP_PROBE2(name, a1, a2) do { \
+    if (false) { (void)(a1); (void)(a2); } \
+} while (0)
+#define HTTP4CPP_PROBE3(name, a1, a2, a3) do { \
+    if (false) { (void)(a1); (void)(a2); (void)(a3); } \
+} while (0)
+#define HTTP4CPP_PROBE4(name, a1, a2, a3, a4) do { \
+    if (false) { (void)(a1); (void)(a2); (void)(a3); (void)(a4); } \
+} while (0)
+#define HTTP4CPP_PROBE7(name, a1, a2, a3, a4, a5, a6, a7) do { \
+    if (false) { (void)(a1); (void)(a2); (void)(a3); (void)(a4); (void)(a5); (void)(a6); \
+        (void)(a7); } \
+} while (0)
+
+#endif
+
+#endif
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,434 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#include "common/cpu_features.h"
+#include "common/sha.h"
+#include "common/util.h"
+
+#ifdef HTTP4CPP_X86_SIMD
+#include <immintrin.h>
+#endif
+
+BEGIN_NAMESPACE
+
+typedef void (*compress_fn)(uint32_t *state, const unsigned char *data, size_t blocks);
+
+static const uint32_t SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static inline uint32_t rotl(uint32_t x, int n)
+{
+    return (x << n) | (x >> (32 - n));
+}
+
+static inline uint32_t rotr(uint32_t x, int n)
+{
+    return (x >> n) | (x << (32 - n));
+}
+
+static inline uint32_t load_be32(const unsigned char *p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16)
+            | (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+static inline void store_be32(unsigned char *p, uint32_t v)
+{
+    p[0] = static_cast<unsigned char>(v >> 24);
+    p[1] = static_cast<unsigned char>(v >> 16);
+    p[2] = static_cast<unsigned char>(v >> 8);
+    p[3] = static_cast<unsigned char>(v);
+}
+
+static void sha1_compress_portable(uint32_t *state, const unsigned char *data, size_t blocks)
+{
+    for (; blocks > 0; --blocks, data += 64) {
+        uint32_t w[80];
+        for (int i = 0; i < 16; ++i) {
+            w[i] = load_be32(data + 4 * i);
+        }
+        for (int i = 16; i < 80; ++i) {
+            w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+        uint32_t a = state[0];
+        uint32_t b = state[1];
+        uint32_t c = state[2];
+        uint32_t d = state[3];
+        uint32_t e = state[4];
+        for (int i = 0; i < 80; ++i) {
+            uint32_t f = 0;
+            uint32_t k = 0;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5a827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ed9eba1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8f1bbcdc;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xca62c1d6;
+            }
+            uint32_t t = rotl(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rotl(b, 30);
+            b = a;
+            a = t;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+    }
+}
+
+static void sha256_compress_portable(uint32_t *state, const unsigned char *data, size_t blocks)
+{
+    for (; blocks > 0; --blocks, data += 64) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; ++i) {
+            w[i] = load_be32(data + 4 * i);
+        }
+        for (int i = 16; i < 64; ++i) {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = state[0];
+        uint32_t b = state[1];
+        uint32_t c = state[2];
+        uint32_t d = state[3];
+        uint32_t e = state[4];
+        uint32_t f = state[5];
+        uint32_t g = state[6];
+        uint32_t h = state[7];
+        for (int i = 0; i < 64; ++i) {
+            uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+            uint32_t ch = (e & f) ^ (~e & g);
+            uint32_t t1 = h + s1 + ch + SHA256_K[i] + w[i];
+            uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+            uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t t2 = s0 + maj;
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+#ifdef HTTP4CPP_X86_SIMD
+
+// The SHA extension kernels follow the Intel white paper "Intel SHA
+// Extensions" (Gulley et al.), message words rotate through msg[0..3].
+
+// Four SHA-1 rounds of group g with function f, e_in takes the next e.
+#define SHA1_GROUP(g, e_in, e_out, f) do { \
+    e_in = _mm_sha1nexte_epu32(e_in, msg[(g) & 3]); \
+    e_out = abcd; \
+    if ((g) >= 3 && (g) <= 18) { \
+        msg[((g) + 1) & 3] = _mm_sha1msg2_epu32(msg[((g) + 1) & 3], msg[(g) & 3]); \
+    } \
+    abcd = _mm_sha1rnds4_epu32(abcd, e_in, f); \
+    if ((g) <= 16) { \
+        msg[((g) + 3) & 3] = _mm_sha1msg1_epu32(msg[((g) + 3) & 3], msg[(g) & 3]); \
+    } \
+    if ((g) >= 2 && (g) <= 17) { \
+        msg[((g) + 2) & 3] = _mm_xor_si128(msg[((g) + 2) & 3], msg[(g) & 3]); \
+    } \
+} while (0)
+
+HTTP4CPP_TARGET("sha,sse4.1")
+static void sha1_compress_shani(uint32_t *state, const unsigned char *data, size_t blocks)
+{
+    const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+    __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<__m128i *>(state)), 0x1b);
+    __m128i e0 = _mm_set_epi32(state[4], 0, 0, 0);
+    __m128i e1;
+    __m128i msg[4];
+    for (; blocks > 0; --blocks, data += 64) {
+        __m128i abcd_save = abcd;
+        __m128i e0_save = e0;
+        for (int i = 0; i < 4; ++i) {
+            msg[i] = _mm_shuffle_epi8(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 16 * i)), mask);
+        }
+
+        e0 = _mm_add_epi32(e0, msg[0]);
+        e1 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+        SHA1_GROUP(1, e1, e0, 0);
+        SHA1_GROUP(2, e0, e1, 0);
+        SHA1_GROUP(3, e1, e0, 0);
+        SHA1_GROUP(4, e0, e1, 0);
+        SHA1_GROUP(5, e1, e0, 1);
+        SHA1_GROUP(6, e0, e1, 1);
+        SHA1_GROUP(7, e1, e0, 1);
+        SHA1_GROUP(8, e0, e1, 1);
+        SHA1_GROUP(9, e1, e0, 1);
+        SHA1_GROUP(10, e0, e1, 2);
+        SHA1_GROUP(11, e1, e0, 2);
+        SHA1_GROUP(12, e0, e1, 2);
+        SHA1_GROUP(13, e1, e0, 2);
+        SHA1_GROUP(14, e0, e1, 2);
+        SHA1_GROUP(15, e1, e0, 3);
+        SHA1_GROUP(16, e0, e1, 3);
+        SHA1_GROUP(17, e1, e0, 3);
+        SHA1_GROUP(18, e0, e1, 3);
+        SHA1_GROUP(19, e1, e0, 3);
+
+        e0 = _mm_sha1nexte_epu32(e0, e0_save);
+        abcd = _mm_add_epi32(abcd, abcd_save);
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(state), _mm_shuffle_epi32(abcd, 0x1b));
+    state[4] = _mm_extract_epi32(e0, 3);
+}
+
+#undef SHA1_GROUP
+
+// Four SHA-256 rounds of group g and the schedule of the words ahead.
+#define SHA256_GROUP(g) do { \
+    __m128i k = _mm_add_epi32(msg[(g) & 3], \
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(SHA256_K + 4 * (g)))); \
+    state1 = _mm_sha256rnds2_epu32(state1, state0, k); \
+    state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(k, 0x0e)); \
+    if ((g) >= 3 && (g) <= 14) { \
+        __m128i t = _mm_alignr_epi8(msg[(g) & 3], msg[((g) + 3) & 3], 4); \
+        msg[((g) + 1) & 3] = _mm_sha256msg2_epu32(_mm_add_epi32(msg[((g) + 1) & 3], t), \
+                msg[(g) & 3]); \
+    } \
+    if ((g) >= 1 && (g) <= 12) { \
+        msg[((g) + 3) & 3] = _mm_sha256msg1_epu32(msg[((g) + 3) & 3], msg[(g) & 3]); \
+    } \
+} while (0)
+
+HTTP4CPP_TARGET("sha,sse4.1")
+static void sha256_compress_shani(uint32_t *state, const unsigned char *data, size_t blocks)
+{
+    const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<__m128i *>(state)), 0xb1);
+    __m128i state1 = _mm_shuffle_epi32(
+            _mm_loadu_si128(reinterpret_cast<__m128i *>(state + 4)), 0x1b);
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);   // ABEF
+    state1 = _mm_blend_epi16(state1, tmp, 0xf0);        // CDGH
+    __m128i msg[4];
+    for (; blocks > 0; --blocks, data += 64) {
+        __m128i abef_save = state0;
+        __m128i cdgh_save = state1;
+        for (int i = 0; i < 4; ++i) {
+            msg[i] = _mm_shuffle_epi8(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 16 * i)), mask);
+        }
+        SHA256_GROUP(0);
+        SHA256_GROUP(1);
+        SHA256_GROUP(2);
+        SHA256_GROUP(3);
+        SHA256_GROUP(4);
+        SHA256_GROUP(5);
+        SHA256_GROUP(6);
+        SHA256_GROUP(7);
+        SHA256_GROUP(8);
+        SHA256_GROUP(9);
+        SHA256_GROUP(10);
+        SHA256_GROUP(11);
+        SHA256_GROUP(12);
+        SHA256_GROUP(13);
+        SHA256_GROUP(14);
+        SHA256_GROUP(15);
+        state0 = _mm_add_epi32(state0, abef_save);
+        state1 = _mm_add_epi32(state1, cdgh_save);
+    }
+    tmp = _mm_shuffle_epi32(state0, 0x1b);              // FEBA
+    state1 = _mm_shuffle_epi32(state1, 0xb1);           // DCHG
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(state), _mm_blend_epi16(tmp, state1, 0xf0));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(state + 4), _mm_alignr_epi8(state1, tmp, 8));
+}
+
+#undef SHA256_GROUP
+
+#endif
+
+static bool has_sha_extensions()
+{
+#ifdef HTTP4CPP_X86_SIMD
+    const CpuFeatures &cpu = CpuFeatures::get();
+    return cpu.sha && cpu.ssse3 && cpu.sse41;
+#else
+    return false;
+#endif
+}
+
+static compress_fn s_sha1_compress = sha1_compress_portable;
+static compress_fn s_sha256_compress = sha256_compress_portable;
+
+class ShaInitializer {
+public:
+    ShaInitializer()
+    {
+        Sha1::set_hardware(true);
+        Sha256::set_hardware(true);
+    }
+};
+
+static ShaInitializer s_initializer;
+
+// Buffers a partial block, hands whole blocks to compress.
+static void hash_update(uint32_t *state, uint64_t *length, unsigned char *buffer,
+        compress_fn compress, const void *data, size_t size)
+{
+    const unsigned char *in = reinterpret_cast<const unsigned char *>(data);
+    size_t used = static_cast<size_t>(*length & 63);
+    *length += size;
+    if (used > 0) {
+        size_t fill = 64 - used < size ? 64 - used : size;
+        memcpy(buffer + used, in, fill);
+        in += fill;
+        size -= fill;
+        if (used + fill < 64) {
+            return;
+        }
+        compress(state, buffer, 1);
+    }
+    if (size >= 64) {
+        compress(state, in, size / 64);
+        in += size / 64 * 64;
+        size &= 63;
+    }
+    if (size > 0) {
+        memcpy(buffer, in, size);
+    }
+}
+
+static void hash_finish(uint32_t *state, uint64_t length, unsigned char *buffer,
+        compress_fn compress)
+{
+    size_t used = static_cast<size_t>(length & 63);
+    buffer[used++] = 0x80;
+    if (used > 56) {
+        memset(buffer + used, 0, 64 - used);
+        compress(state, buffer, 1);
+        used = 0;
+    }
+    memset(buffer + used, 0, 56 - used);
+    uint64_t bits = length * 8;
+    store_be32(buffer + 56, static_cast<uint32_t>(bits >> 32));
+    store_be32(buffer + 60, static_cast<uint32_t>(bits));
+    compress(state, buffer, 1);
+}
+
+void Sha1::reset()
+{
+    _state[0] = 0x67452301;
+    _state[1] = 0xefcdab89;
+    _state[2] = 0x98badcfe;
+    _state[3] = 0x10325476;
+    _state[4] = 0xc3d2e1f0;
+    _length = 0;
+}
+
+void Sha1::update(const void *data, size_t size)
+{
+    hash_update(_state, &_length, _buffer, s_sha1_compress, data, size);
+}
+
+void Sha1::finish(unsigned char *digest)
+{
+    hash_finish(_state, _length, _buffer, s_sha1_compress);
+    for (int i = 0; i < 5; ++i) {
+        store_be32(digest + 4 * i, _state[i]);
+    }
+    reset();
+}
+
+int Sha1::set_hardware(bool enabled)
+{
+#ifdef HTTP4CPP_X86_SIMD
+    if (enabled && has_sha_extensions()) {
+        s_sha1_compress = sha1_compress_shani;
+        return RET_OK;
+    }
+#endif
+    s_sha1_compress = sha1_compress_portable;
+    return enabled ? RET_ILLEGAL_OPERATION : RET_OK;
+}
+
+bool Sha1::is_hardware()
+{
+    return s_sha1_compress != sha1_compress_portable;
+}
+
+void Sha256::reset()
+{
+    _state[0] = 0x6a09e667;
+    _state[1] = 0xbb67ae85;
+    _state[2] = 0x3c6ef372;
+    _state[3] = 0xa54ff53a;
+    _state[4] = 0x510e527f;
+    _state[5] = 0x9b05688c;
+    _state[6] = 0x1f83d9ab;
+    _state[7] = 0x5be0cd19;
+    _length = 0;
+}
+
+void Sha256::update(const void *data, size_t size)
+{
+    hash_update(_state, &_length, _buffer, s_sha256_compress, data, size);
+}
+
+void Sha256::finish(unsigned char *digest)
+{
+    hash_finish(_state, _length, _buffer, s_sha256_compress);
+    for (int i = 0; i < 8; ++i) {
+        store_be32(digest + 4 * i, _state[i]);
+    }
+    reset();
+}
+
+int Sha256::set_hardware(bool enabled)
+{
+#ifdef HTTP4CPP_X86_SIMD
+    if (enabled && has_sha_extensions()) {
+        s_sha256_compress = sha256_compress_shani;
+        return RET_OK;
+    }
+#endif
+    s_sha256_compress = sha256_compress_portable;
+    return enabled ? RET_ILLEGAL_OPERATION : RET_OK;
+}
+
+bool Sha256::is_hardware()
+{
+    return s_sha256_compress != sha256_compress_portable;
+}
+
+END_NAMESPACE
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,183 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#ifndef HTTP4CPP_COMMON_SHA_H
+#define HTTP4CPP_COMMON_SHA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+
+#include "common/common.h"
+
+BEGIN_NAMESPACE
+
+/**
+ * Incremental message digest. update() may be called any number of times,
+ * finish() writes the digest and starts over for the next message.
+ */
+class Hasher {
+public:
+    virtual ~Hasher()
+    {
+        // nothing to do
+    }
+
+    virtual void update(const void *data, size_t size) = 0;
+    virtual void finish(unsigned char *digest) = 0;
+    virtual void reset() = 0;
+    virtual size_t get_digest_size() const = 0;
+
+    void update(const std::string &data)
+    {
+        update(data.data(), data.size());
+    }
+
+    // The raw digest bytes.
+    std::string finish()
+    {
+        unsigned char digest[64];
+        finish(digest);
+        return std::string(reinterpret_cast<char *>(digest), get_digest_size());
+    }
+};
+
+/**
+ * SHA-1 and SHA-256 with the x86 SHA extensions when the cpu has them and
+ * a portable implementation otherwise.
+ */
+class Sha1 : public Hasher {
+public:
+    static const size_t BLOCK_SIZE = 64;
+    static const size_t DIGEST_SIZE = 20;
+
+    Sha1()
+    {
+        reset();
+    }
+
+    virtual void update(const void *data, size_t size);
+    virtual void finish(unsigned char *digest);
+    virtual void reset();
+    virtual size_t get_digest_size() const
+    {
+        return DIGEST_SIZE;
+    }
+    using Hasher::update;
+    using Hasher::finish;
+
+    // Turns the SHA extensions on or off, RET_ILLEGAL_OPERATION if missing.
+    static int set_hardware(bool enabled);
+    static bool is_hardware();
+
+private:
+    uint32_t        _state[5];
+    uint64_t        _length;
+    unsigned char   _buffer[BLOCK_SIZE];
+};
+
+class Sha256 : public Hasher {
+public:
+    static const size_t BLOCK_SIZE = 64;
+    static const size_t DIGEST_SIZE = 32;
+
+    Sha256()
+    {
+        reset();
+    }
+
+    virtual void update(const void *data, size_t size);
+    virtual void finish(unsigned char *digest);
+    virtual void reset();
+    virtual size_t get_digest_size() const
+    {
+        return DIGEST_SIZE;
+    }
+    using Hasher::update;
+    using Hasher::finish;
+
+    static int set_hardware(bool enabled);
+    static bool is_hardware();
+
+private:
+    uint32_t        _state[8];
+    uint64_t        _length;
+    unsigned char   _buffer[BLOCK_SIZE];
+};
+
+/**
+ * HMAC (RFC 2104) over Sha1 or Sha256. The padded key blocks are hashed
+ * once in the constructor, each message then costs only its own blocks.
+ */
+template <typename H>
+class Hmac : public Hasher {
+public:
+    explicit Hmac(const std::string &key)
+    {
+        unsigned char block[H::BLOCK_SIZE];
+        memset(block, 0, sizeof(block));
+        if (key.size() > H::BLOCK_SIZE) {
+            H hasher;
+            hasher.update(key.data(), key.size());
+            hasher.finish(block);
+        } else {
+            memcpy(block, key.data(), key.size());
+        }
+        unsigned char pad[H::BLOCK_SIZE];
+        for (size_t i = 0; i < H::BLOCK_SIZE; ++i) {
+            pad[i] = block[i] ^ 0x36;
+        }
+        _inner_start.update(pad, sizeof(pad));
+        for (size_t i = 0; i < H::BLOCK_SIZE; ++i) {
+            pad[i] = block[i] ^ 0x5c;
+        }
+        _outer_start.update(pad, sizeof(pad));
+        _inner = _inner_start;
+    }
+
+    virtual void update(const void *data, size_t size)
+    {
+        _inner.update(data, size);
+    }
+
+    virtual void finish(unsigned char *digest)
+    {
+        unsigned char inner_digest[H::DIGEST_SIZE];
+        _inner.finish(inner_digest);
+        H outer = _outer_start;
+        outer.update(inner_digest, sizeof(inner_digest));
+        outer.finish(digest);
+        _inner = _inner_start;
+    }
+
+    virtual void reset()
+    {
+        _inner = _inner_start;
+    }
+
+    virtual size_t get_digest_size() const
+    {
+        return H::DIGEST_SIZE;
+    }
+    using Hasher::update;
+    using Hasher::finish;
+
+private:
+    H _inner;
+    H _inner_start;
+    H _outer_start;
+};
+
+typedef Hmac<Sha1> HmacSha1;
+typedef Hmac<Sha256> HmacSha256;
+
+END_NAMESPACE
+#endif
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -56,6 +56,13 @@ public:
     virtual int64_t write(const char *buffer, int64_t size) = 0;
     virtual int64_t reserve(int64_t size) = 0;
     virtual int64_t read(uint64_t start, int64_t length, std::string *data) const = 0;
+
+    // The Content-Type of the body, given before its first byte is written.
+    virtual int set_content_type(const std::string &content_type)
+    {
+        (void)content_type;
+        return 0;
+    }
 };
 
 END_NAMESPACE
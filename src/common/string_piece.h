@@ -0,0 +1,155 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#ifndef HTTP4CPP_COMMON_STRING_PIECE_H
+#define HTTP4CPP_COMMON_STRING_PIECE_H
+
+#include <stddef.h>
+#include <string.h>
+
+#include <string>
+
+#include "common/common.h"
+
+BEGIN_NAMESPACE
+
+/**
+ * A view of characters owned elsewhere, the owner must outlive it. Lets
+ * parsing and trimming work on a part of a string without copying it.
+ */
+class StringPiece {
+public:
+    StringPiece() : _data(NULL), _size(0)
+    {
+        // nothing to do
+    }
+
+    StringPiece(const char *data) : _data(data), _size(data == NULL ? 0 : strlen(data))
+    {
+        // nothing to do
+    }
+
+    StringPiece(const char *data, size_t size) : _data(data), _size(size)
+    {
+        // nothing to do
+    }
+
+    StringPiece(const std::string &str) : _data(str.data()), _size(str.size())
+    {
+        // nothing to do
+    }
+
+    const char * data() const
+    {
+        return _data;
+    }
+
+    size_t size() const
+    {
+        return _size;
+    }
+
+    bool empty() const
+    {
+        return _size == 0;
+    }
+
+    const char * begin() const
+    {
+        return _data;
+    }
+
+    const char * end() const
+    {
+        return _data + _size;
+    }
+
+    char operator[](size_t i) const
+    {
+        return _data[i];
+    }
+
+    void remove_prefix(size_t n)
+    {
+        _data += n;
+        _size -= n;
+    }
+
+    void remove_suffix(size_t n)
+    {
+        _size -= n;
+    }
+
+    // Like std::string::substr, pos past the end gives an empty piece.
+    StringPiece substr(size_t pos, size_t n = std::string::npos) const
+    {
+        if (pos > _size) {
+            pos = _size;
+        }
+        if (n > _size - pos) {
+            n = _size - pos;
+        }
+        return StringPiece(_data + pos, n);
+    }
+
+    size_t find(char c, size_t pos = 0) const
+    {
+        if (pos >= _size) {
+            return std::string::npos;
+        }
+        const void *found = memchr(_data + pos, c, _size - pos);
+        return found == NULL ? std::string::npos : static_cast<const char *>(found) - _data;
+    }
+
+    // The whole of s, an empty s is found at pos.
+    size_t find(const StringPiece &s, size_t pos = 0) const
+    {
+        if (s._size == 0) {
+            return pos <= _size ? pos : std::string::npos;
+        }
+        while (pos + s._size <= _size) {
+            pos = find(s._data[0], pos);
+            if (pos == std::string::npos || pos + s._size > _size) {
+                return std::string::npos;
+            }
+            if (memcmp(_data + pos + 1, s._data + 1, s._size - 1) == 0) {
+                return pos;
+            }
+            ++pos;
+        }
+        return std::string::npos;
+    }
+
+    bool starts_with(const StringPiece &prefix) const
+    {
+        return _size >= prefix._size && memcmp(_data, prefix._data, prefix._size) == 0;
+    }
+
+    std::string as_string() const
+    {
+        return std::string(_data, _size);
+    }
+
+    bool operator==(const StringPiece &other) const
+    {
+        return _size == other._size && (_size == 0 || memcmp(_data, other._data, _size) == 0);
+    }
+
+    bool operator!=(const StringPiece &other) const
+    {
+        return !(*this == other);
+    }
+
+private:
+    const char *_data;
+    size_t      _size;
+};
+
+END_NAMESPACE
+#endif
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,322 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "common/tracer.h"
+#include "common/util.h"
+
+BEGIN_NAMESPACE
+
+static uint64_t next_random()
+{
+    static __thread uint64_t s_state = 0;
+    if (s_state == 0) {
+        s_state = static_cast<uint64_t>(TimeUtil::now_us()) ^
+                (static_cast<uint64_t>(Tracer::current_tid()) << 32) ^
+                reinterpret_cast<uintptr_t>(&s_state);
+        if (s_state == 0) {
+            s_state = 0x9E3779B97F4A7C15ULL;
+        }
+    }
+    // xorshift64*
+    s_state ^= s_state >> 12;
+    s_state ^= s_state << 25;
+    s_state ^= s_state >> 27;
+    return s_state * 0x2545F4914F6CDD1DULL;
+}
+
+static bool parse_hex(const std::string &src, size_t pos, size_t len, uint64_t *value)
+{
+    uint64_t result = 0;
+    for (size_t i = pos; i < pos + len; ++i) {
+        char c = src[i];
+        if (c >= '0' && c <= '9') {
+            result = (result << 4) | (c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            result = (result << 4) | (c - 'a' + 10);
+        } else {
+            return false;
+        }
+    }
+    *value = result;
+    return true;
+}
+
+int TraceContext::parse(const std::string &traceparent, TraceContext *ctx)
+{
+    // later versions may append fields, the known prefix is kept
+    if (traceparent.size() < 55 || (traceparent.size() > 55 && traceparent[55] != '-')
+            || traceparent[2] != '-' || traceparent[35] != '-' || traceparent[52] != '-') {
+        return RET_ILLEGAL_ARGUMENT;
+    }
+
+    uint64_t version = 0;
+    uint64_t flags = 0;
+    TraceContext result;
+    if (!parse_hex(traceparent, 0, 2, &version) || version == 0xff
+            || (version == 0 && traceparent.size() != 55)
+            || !parse_hex(traceparent, 3, 16, &result.trace_id_high)
+            || !parse_hex(traceparent, 19, 16, &result.trace_id_low)
+            || !parse_hex(traceparent, 36, 16, &result.span_id)
+            || !parse_hex(traceparent, 53, 2, &flags)
+            || !result.is_valid()) {
+        return RET_ILLEGAL_ARGUMENT;
+    }
+    result.sampled = (flags & 0x01) != 0;
+    *ctx = result;
+    return RET_OK;
+}
+
+std::string TraceContext::to_traceparent() const
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), "00-%016llx%016llx-%016llx-%02x",
+            static_cast<unsigned long long>(trace_id_high),
+            static_cast<unsigned long long>(trace_id_low),
+            static_cast<unsigned long long>(span_id), sampled ? 1 : 0);
+    return std::string(buf);
+}
+
+Tracer::Tracer(const TracerOptions &options) :
+    _options(options),
+    _sample_threshold(0),
+    _file(NULL),
+    _first_event(true),
+    _running(false),
+    _stopping(false),
+    _sampled(0),
+    _exported(0),
+    _dropped(0)
+{
+    double rate = _options.sample_rate < 0 ? 0 : _options.sample_rate;
+    _sample_threshold = rate >= 1.0 ? (1ULL << 32) : static_cast<uint64_t>(rate * 4294967296.0);
+    if (_options.flush_interval_ms <= 0) {
+        _options.flush_interval_ms = 1000;
+    }
+
+    pthread_mutex_init(&_mutex, NULL);
+    pthread_mutex_init(&_file_mutex, NULL);
+    TimeUtil::init_cond(&_cond);
+}
+
+Tracer::~Tracer()
+{
+    stop();
+    pthread_cond_destroy(&_cond);
+    pthread_mutex_destroy(&_file_mutex);
+    pthread_mutex_destroy(&_mutex);
+}
+
+int Tracer::start()
+{
+    pthread_mutex_lock(&_mutex);
+    if (_running) {
+        pthread_mutex_unlock(&_mutex);
+        return RET_ILLEGAL_OPERATION;
+    }
+    _file = fopen(_options.file_name.c_str(), "w");
+    if (_file == NULL) {
+        pthread_mutex_unlock(&_mutex);
+        ERROR("open trace file %s failed", _options.file_name.c_str());
+        return RET_FILE_INVALID;
+    }
+    // chrome://tracing accepts the array unterminated while it is written
+    fputs("[\n", _file);
+    _first_event = true;
+    _stopping = false;
+    if (pthread_create(&_thread, NULL, run_thread, this) != 0) {
+        fclose(_file);
+        _file = NULL;
+        pthread_mutex_unlock(&_mutex);
+        return RET_ILLEGAL_OPERATION;
+    }
+    _running = true;
+    pthread_mutex_unlock(&_mutex);
+    return RET_OK;
+}
+
+void Tracer::stop()
+{
+    pthread_mutex_lock(&_mutex);
+    if (!_running) {
+        pthread_mutex_unlock(&_mutex);
+        return;
+    }
+    _stopping = true;
+    pthread_cond_signal(&_cond);
+    pthread_mutex_unlock(&_mutex);
+    pthread_join(_thread, NULL);
+
+    flush();
+    pthread_mutex_lock(&_file_mutex);
+    fputs("\n]\n", _file);
+    fclose(_file);
+    _file = NULL;
+    pthread_mutex_unlock(&_file_mutex);
+
+    pthread_mutex_lock(&_mutex);
+    _running = false;
+    pthread_mutex_unlock(&_mutex);
+}
+
+int Tracer::flush()
+{
+    std::vector<Span> spans;
+    pthread_mutex_lock(&_mutex);
+    spans.swap(_pending);
+    pthread_mutex_unlock(&_mutex);
+
+    pthread_mutex_lock(&_file_mutex);
+    if (_file == NULL) {
+        pthread_mutex_unlock(&_file_mutex);
+        return RET_ILLEGAL_OPERATION;
+    }
+    std::string output;
+    for (size_t i = 0; i < spans.size(); ++i) {
+        output.append(_first_event ? "" : ",\n");
+        _first_event = false;
+        render_chrome_event(spans[i], &output);
+    }
+    int ret = RET_OK;
+    if (!output.empty()
+            && (fwrite(output.data(), 1, output.size(), _file) != output.size()
+            || fflush(_file) != 0)) {
+        ret = RET_FILE_INVALID;
+    }
+    pthread_mutex_unlock(&_file_mutex);
+
+    pthread_mutex_lock(&_mutex);
+    _exported += spans.size();
+    pthread_mutex_unlock(&_mutex);
+    return ret;
+}
+
+void Tracer::start_trace(const TraceContext &parent, TraceContext *ctx)
+{
+    if (parent.is_valid()) {
+        ctx->trace_id_high = parent.trace_id_high;
+        ctx->trace_id_low = parent.trace_id_low;
+        ctx->sampled = parent.sampled;
+    } else {
+        ctx->trace_id_high = next_random();
+        ctx->trace_id_low = next_random();
+        ctx->sampled = (next_random() >> 32) < _sample_threshold;
+    }
+    ctx->span_id = new_span_id();
+    if (ctx->sampled) {
+        __atomic_fetch_add(&_sampled, 1, __ATOMIC_RELAXED);
+    }
+}
+
+uint64_t Tracer::new_span_id()
+{
+    uint64_t id = 0;
+    while (id == 0) {
+        id = next_random();
+    }
+    return id;
+}
+
+uint32_t Tracer::current_tid()
+{
+    static __thread uint32_t s_tid = 0;
+    if (s_tid == 0) {
+        s_tid = static_cast<uint32_t>(syscall(SYS_gettid));
+    }
+    return s_tid;
+}
+
+void Tracer::record(std::vector<Span> *spans)
+{
+    pthread_mutex_lock(&_mutex);
+    if (_pending.size() + spans->size() > _options.max_pending_spans) {
+        _dropped += spans->size();
+    } else {
+        _pending.insert(_pending.end(), spans->begin(), spans->end());
+    }
+    pthread_mutex_unlock(&_mutex);
+    spans->clear();
+}
+
+void Tracer::get_stat(TracerStat *stat) const
+{
+    pthread_mutex_lock(&_mutex);
+    stat->sampled = __atomic_load_n(&_sampled, __ATOMIC_RELAXED);
+    stat->exported = _exported;
+    stat->dropped = _dropped;
+    pthread_mutex_unlock(&_mutex);
+}
+
+static void append_json_string(const std::string &value, std::string *output)
+{
+    output->append(1, '"');
+    for (size_t i = 0; i < value.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(value[i]);
+        if (c == '"' || c == '\\') {
+            output->append(1, '\\').append(1, c);
+        } else if (c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            output->append(buf);
+        } else {
+            output->append(1, c);
+        }
+    }
+    output->append(1, '"');
+}
+
+void Tracer::render_chrome_event(const Span &span, std::string *output)
+{
+    char buf[320];
+    snprintf(buf, sizeof(buf),
+            "{\"name\":\"%s\",\"cat\":\"http4cpp\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,"
+            "\"pid\":%d,\"tid\":%u,\"args\":{\"trace_id\":\"%016llx%016llx\","
+            "\"span_id\":\"%016llx\",\"parent_id\":\"%016llx\"",
+            span.name == NULL ? "" : span.name,
+            static_cast<long long>(span.start_us), static_cast<long long>(span.duration_us),
+            static_cast<int>(getpid()), span.tid,
+            static_cast<unsigned long long>(span.trace_id_high),
+            static_cast<unsigned long long>(span.trace_id_low),
+            static_cast<unsigned long long>(span.span_id),
+            static_cast<unsigned long long>(span.parent_span_id));
+    output->append(buf);
+    if (!span.detail.empty()) {
+        output->append(",\"detail\":");
+        append_json_string(span.detail, output);
+    }
+    output->append("}}");
+}
+
+void Tracer::run()
+{
+    pthread_mutex_lock(&_mutex);
+    while (!_stopping) {
+        struct timespec ts;
+        TimeUtil::cond_abstime(static_cast<int64_t>(_options.flush_interval_ms) * 1000, &ts);
+        pthread_cond_timedwait(&_cond, &_mutex, &ts);
+        if (_stopping) {
+            break;
+        }
+
+        pthread_mutex_unlock(&_mutex);
+        flush();
+        pthread_mutex_lock(&_mutex);
+    }
+    pthread_mutex_unlock(&_mutex);
+}
+
+void * Tracer::run_thread(void *arg)
+{
+    reinterpret_cast<Tracer *>(arg)->run();
+    return NULL;
+}
+
+END_NAMESPACE
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,149 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#ifndef HTTP4CPP_COMMON_TRACER_H
+#define HTTP4CPP_COMMON_TRACER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include <string>
+#include <vector>
+
+#include "common/common.h"
+
+BEGIN_NAMESPACE
+
+// W3C trace context, https://www.w3.org/TR/trace-context/
+struct TraceContext {
+    TraceContext() :
+        trace_id_high(0),
+        trace_id_low(0),
+        span_id(0),
+        sampled(false)
+    {
+        // nothing to do
+    }
+
+    bool is_valid() const
+    {
+        return (trace_id_high != 0 || trace_id_low != 0) && span_id != 0;
+    }
+
+    // "00-<32 hex trace id>-<16 hex parent id>-<2 hex flags>"
+    static int parse(const std::string &traceparent, TraceContext *ctx);
+    std::string to_traceparent() const;
+
+    uint64_t trace_id_high;
+    uint64_t trace_id_low;
+    uint64_t span_id;
+    bool     sampled;
+};
+
+struct Span {
+    Span() :
+        name(NULL),
+        trace_id_high(0),
+        trace_id_low(0),
+        span_id(0),
+        parent_span_id(0),
+        start_us(0),
+        duration_us(0),
+        tid(0)
+    {
+        // nothing to do
+    }
+
+    const char  *name;          // static string
+    uint64_t    trace_id_high;
+    uint64_t    trace_id_low;
+    uint64_t    span_id;
+    uint64_t    parent_span_id;
+    int64_t     start_us;       // TimeUtil::monotonic_us() clock
+    int64_t     duration_us;
+    uint32_t    tid;
+    std::string detail;
+};
+
+struct TracerOptions {
+    TracerOptions() :
+        sample_rate(0.01),
+        flush_interval_ms(1000),
+        max_pending_spans(65536)
+    {
+        // nothing to do
+    }
+
+    double      sample_rate;        // share of new traces recorded, 0 to 1
+    std::string file_name;          // Chrome trace event JSON array
+    int         flush_interval_ms;
+    uint32_t    max_pending_spans;  // spans beyond are dropped until the next flush
+};
+
+struct TracerStat {
+    uint64_t sampled;
+    uint64_t exported;
+    uint64_t dropped;
+};
+
+/**
+ * Sampled span recorder with a file exporter. Spans of a trace are collected
+ * by the caller and handed over in one batch, a background thread appends
+ * them to the file in the Chrome trace event format, which chrome://tracing
+ * and Perfetto open directly. A trace continuing a remote parent follows the
+ * parent's sampling decision.
+ */
+class Tracer {
+public:
+    explicit Tracer(const TracerOptions &options);
+    ~Tracer();
+
+    int start();
+    void stop();
+    // Writes pending spans now.
+    int flush();
+
+    // New root span id in ctx, continuing parent when it is valid.
+    void start_trace(const TraceContext &parent, TraceContext *ctx);
+    static uint64_t new_span_id();
+    static uint32_t current_tid();
+
+    // Takes the spans out of the vector.
+    void record(std::vector<Span> *spans);
+
+    void get_stat(TracerStat *stat) const;
+
+    static void render_chrome_event(const Span &span, std::string *output);
+
+private:
+    Tracer(const Tracer &);
+    Tracer & operator=(const Tracer &);
+
+    void run();
+    static void * run_thread(void *arg);
+
+    TracerOptions           _options;
+    uint64_t                _sample_threshold;
+    FILE                    *_file;
+    bool                    _first_event;
+    bool                    _running;
+    bool                    _stopping;
+    pthread_t               _thread;
+    std::vector<Span>       _pending;
+    uint64_t                _sampled;
+    uint64_t                _exported;
+    uint64_t                _dropped;
+    mutable pthread_mutex_t _mutex;
+    pthread_mutex_t         _file_mutex;
+    pthread_cond_t          _cond;
+};
+
+END_NAMESPACE
+#endif
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
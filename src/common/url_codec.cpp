@@ -0,0 +1,270 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#include <string.h>
+
+#include "common/url_codec.h"
+#include "common/util.h"
+
+#ifdef HTTP4CPP_X86_SIMD
+#include <immintrin.h>
+#endif
+
+BEGIN_NAMESPACE
+
+static const int URL_CHARSET_COUNT = URL_CHARSET_PATH + 1;
+static const char * HEX_DIGITS = "0123456789ABCDEF";
+
+struct UrlCharset {
+    bool            safe[256];
+    // For the vector scan: bit h of lo_bits[l] is set when byte 0xhl is safe,
+    // hi_bits[h] is 1 << h. Bytes from 0x80 are never safe.
+    unsigned char   lo_bits[16];
+    unsigned char   hi_bits[16];
+};
+
+static UrlCharset s_charsets[URL_CHARSET_COUNT];
+// value of a hex digit, -1 for other bytes
+static signed char s_hex_values[256];
+
+static void init_tables()
+{
+    for (int charset = 0; charset < URL_CHARSET_COUNT; ++charset) {
+        UrlCharset *table = &s_charsets[charset];
+        memset(table, 0, sizeof(*table));
+        for (int c = 0; c < 128; ++c) {
+            bool safe = ('0' <= c && c <= '9') || ('A' <= c && c <= 'Z')
+                    || ('a' <= c && c <= 'z') || c == '-' || c == '.' || c == '_' || c == '~'
+                    || (c == '&' && charset != URL_CHARSET_UNRESERVED)
+                    || (c == '/' && charset == URL_CHARSET_PATH);
+            table->safe[c] = safe;
+            if (safe) {
+                table->lo_bits[c & 0x0f] |= static_cast<unsigned char>(1 << (c >> 4));
+            }
+        }
+        for (int h = 0; h < 8; ++h) {
+            table->hi_bits[h] = static_cast<unsigned char>(1 << h);
+        }
+    }
+    for (int c = 0; c < 256; ++c) {
+        s_hex_values[c] = static_cast<signed char>(('0' <= c && c <= '9') ? c - '0' :
+                ('A' <= c && c <= 'F') ? c - 'A' + 10 : ('a' <= c && c <= 'f') ? c - 'a' + 10 : -1);
+    }
+}
+
+class UrlCodecInitializer {
+public:
+    UrlCodecInitializer()
+    {
+        init_tables();
+    }
+};
+
+static UrlCodecInitializer s_initializer;
+
+static size_t scan_scalar(const unsigned char *src, size_t length, const UrlCharset *charset)
+{
+    size_t i = 0;
+    while (i < length && charset->safe[src[i]]) {
+        ++i;
+    }
+    return i;
+}
+
+#ifdef HTTP4CPP_X86_SIMD
+
+HTTP4CPP_TARGET("sse4.1")
+static size_t scan_sse41(const unsigned char *src, size_t length, const UrlCharset *charset)
+{
+    const __m128i lo_bits = _mm_loadu_si128(reinterpret_cast<const __m128i *>(charset->lo_bits));
+    const __m128i hi_bits = _mm_loadu_si128(reinterpret_cast<const __m128i *>(charset->hi_bits));
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        __m128i lo = _mm_shuffle_epi8(lo_bits, _mm_and_si128(in, nibble));
+        __m128i hi = _mm_shuffle_epi8(hi_bits, _mm_and_si128(_mm_srli_epi16(in, 4), nibble));
+        __m128i unsafe = _mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128());
+        int mask = _mm_movemask_epi8(unsafe);
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + scan_scalar(src + i, length - i, charset);
+}
+
+HTTP4CPP_TARGET("avx2")
+static size_t scan_avx2(const unsigned char *src, size_t length, const UrlCharset *charset)
+{
+    const __m256i lo_bits = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(charset->lo_bits)));
+    const __m256i hi_bits = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(charset->hi_bits)));
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        __m256i lo = _mm256_shuffle_epi8(lo_bits, _mm256_and_si256(in, nibble));
+        __m256i hi = _mm256_shuffle_epi8(hi_bits,
+                _mm256_and_si256(_mm256_srli_epi16(in, 4), nibble));
+        __m256i unsafe = _mm256_cmpeq_epi8(_mm256_and_si256(lo, hi), _mm256_setzero_si256());
+        unsigned int mask = static_cast<unsigned int>(_mm256_movemask_epi8(unsafe));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + scan_sse41(src + i, length - i, charset);
+}
+
+#endif
+
+typedef size_t (*scan_fn)(const unsigned char *src, size_t length, const UrlCharset *charset);
+
+static const scan_fn s_scanners[] = {
+    scan_scalar,
+#ifdef HTTP4CPP_X86_SIMD
+    scan_sse41,
+    scan_avx2,
+#endif
+};
+
+static simd_kernel_t s_kernel = CpuFeatures::best_kernel();
+
+void UrlCodec::encode(const char *src, size_t length, url_charset_t charset,
+        std::string *output)
+{
+    if (length == 0) {
+        return;
+    }
+    const unsigned char *in = reinterpret_cast<const unsigned char *>(src);
+    const UrlCharset *table = &s_charsets[charset];
+    scan_fn scan = s_scanners[s_kernel];
+    size_t offset = output->size();
+    output->resize(offset + length * 3);
+    char *begin = &(*output)[0];
+    char *out = begin + offset;
+    size_t i = 0;
+    while (i < length) {
+        size_t run = scan(in + i, length - i, table);
+        memcpy(out, in + i, run);
+        out += run;
+        i += run;
+        for (; i < length && !table->safe[in[i]]; ++i, out += 3) {
+            out[0] = '%';
+            out[1] = HEX_DIGITS[in[i] >> 4];
+            out[2] = HEX_DIGITS[in[i] & 0x0f];
+        }
+    }
+    output->resize(out - begin);
+}
+
+void UrlCodec::decode(const char *src, size_t length, std::string *output)
+{
+    if (length == 0) {
+        return;
+    }
+    const unsigned char *in = reinterpret_cast<const unsigned char *>(src);
+    size_t offset = output->size();
+    output->resize(offset + length);
+    char *begin = &(*output)[0];
+    char *out = begin + offset;
+    size_t i = 0;
+    while (i < length) {
+        const void *percent = memchr(in + i, '%', length - i);
+        size_t run = percent == NULL ? length - i :
+                static_cast<const unsigned char *>(percent) - (in + i);
+        memcpy(out, in + i, run);
+        out += run;
+        i += run;
+        if (i == length) {
+            break;
+        }
+        int hi = i + 2 < length ? s_hex_values[in[i + 1]] : -1;
+        int lo = i + 2 < length ? s_hex_values[in[i + 2]] : -1;
+        if (hi < 0 || lo < 0) {
+            *out++ = '%';
+            ++i;
+        } else {
+            *out++ = static_cast<char>((hi << 4) | lo);
+            i += 3;
+        }
+    }
+    output->resize(out - begin);
+}
+
+size_t UrlCodec::safe_prefix(const char *src, size_t length, url_charset_t charset)
+{
+    return s_scanners[s_kernel](reinterpret_cast<const unsigned char *>(src), length,
+            &s_charsets[charset]);
+}
+
+int UrlCodec::set_kernel(simd_kernel_t kernel)
+{
+    if (!CpuFeatures::supports(kernel)) {
+        return RET_ILLEGAL_OPERATION;
+    }
+    s_kernel = kernel;
+    return RET_OK;
+}
+
+simd_kernel_t UrlCodec::get_kernel()
+{
+    return s_kernel;
+}
+
+QueryBuilder::QueryBuilder(const std::string &base, size_t reserve_bytes) :
+    _url(base),
+    _base_size(base.size()),
+    _base_has_query(base.find('?') != std::string::npos)
+{
+    _url.reserve(base.size() + reserve_bytes);
+}
+
+void QueryBuilder::add_separator()
+{
+    if (_url.size() > _base_size) {
+        _url.push_back('&');
+    } else if (!_base_has_query) {
+        _url.push_back('?');
+    } else if (_base_size > 0 && _url[_base_size - 1] != '?' && _url[_base_size - 1] != '&') {
+        _url.push_back('&');
+    }
+}
+
+QueryBuilder & QueryBuilder::add(const std::string &key, const std::string &value)
+{
+    add_separator();
+    UrlCodec::encode(key.data(), key.size(), URL_CHARSET_UNRESERVED, &_url);
+    _url.push_back('=');
+    UrlCodec::encode(value.data(), value.size(), URL_CHARSET_UNRESERVED, &_url);
+    return *this;
+}
+
+QueryBuilder & QueryBuilder::add(const std::string &key, int64_t value)
+{
+    add_separator();
+    UrlCodec::encode(key.data(), key.size(), URL_CHARSET_UNRESERVED, &_url);
+    _url.push_back('=');
+    StringUtil::append_num(static_cast<long long>(value), &_url);
+    return *this;
+}
+
+QueryBuilder & QueryBuilder::add(const std::string &key)
+{
+    add_separator();
+    UrlCodec::encode(key.data(), key.size(), URL_CHARSET_UNRESERVED, &_url);
+    return *this;
+}
+
+void QueryBuilder::reset()
+{
+    _url.resize(_base_size);
+}
+
+END_NAMESPACE
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
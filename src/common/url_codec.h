@@ -0,0 +1,78 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#ifndef HTTP4CPP_COMMON_URL_CODEC_H
+#define HTTP4CPP_COMMON_URL_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+#include "common/common.h"
+#include "common/cpu_features.h"
+
+BEGIN_NAMESPACE
+
+// Characters left as they are by the percent encoding.
+enum url_charset_t {
+    URL_CHARSET_UNRESERVED = 0,     // A-Z a-z 0-9 - . _ ~ as RFC 3986
+    URL_CHARSET_DEFAULT,            // unreserved and '&', StringUtil::url_encode
+    URL_CHARSET_PATH,               // unreserved, '&' and '/'
+};
+
+/**
+ * Percent encoding appending to a string. Runs of characters that need no
+ * escaping are found 16 or 32 bytes at a time and copied as a whole.
+ */
+class UrlCodec {
+public:
+    static void encode(const char *src, size_t length, url_charset_t charset,
+            std::string *output);
+    // "%XY" with two hex digits is decoded, any other '%' is kept as it is.
+    static void decode(const char *src, size_t length, std::string *output);
+    // Length of the prefix of src that needs no escaping.
+    static size_t safe_prefix(const char *src, size_t length, url_charset_t charset);
+
+    // Forces a kernel, RET_ILLEGAL_OPERATION if the cpu lacks it.
+    static int set_kernel(simd_kernel_t kernel);
+    static simd_kernel_t get_kernel();
+};
+
+/**
+ * Assembles "base?key=value&key=value" in one buffer, keys and values are
+ * escaped except the unreserved characters. The result is meant for
+ * HttpRequest::set_url, reset() reuses the buffer for the next request.
+ */
+class QueryBuilder {
+public:
+    explicit QueryBuilder(const std::string &base, size_t reserve_bytes = 256);
+
+    QueryBuilder & add(const std::string &key, const std::string &value);
+    QueryBuilder & add(const std::string &key, int64_t value);
+    // A key without value.
+    QueryBuilder & add(const std::string &key);
+    // Drops the parameters, keeps base and the buffer.
+    void reset();
+
+    const std::string & get_url() const
+    {
+        return _url;
+    }
+
+private:
+    void add_separator();
+
+    std::string _url;
+    size_t      _base_size;
+    bool        _base_has_query;
+};
+
+END_NAMESPACE
+#endif
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -9,13 +9,17 @@
 #include <stdio.h>  /* for c-style IO */
 #include <syslog.h> /* for syslog */
 #include <stdarg.h> /* for ISO C variable arguments*/
-#include <ctype.h>  /* for upper/lower */
-#include <limits.h> /* for UCHAR_MAX */
 #include <stdlib.h> /* for exit */
-
-#include <algorithm>/* for std algorithms */
-#include <sstream>  /* string stream */
-
+#include <limits.h> /* for integer limits */
+#include <string.h> /* for memcpy */
+
+#include "common/ascii.h"
+#include "common/base64.h"
+#include "common/charset.h"
+#include "common/cpu_features.h"
+#include "common/memory_stream.h"
+#include "common/sha.h"
+#include "common/url_codec.h"
 #include "common/util.h"
 
 BEGIN_NAMESPACE
@@ -56,6 +60,25 @@ int LogUtil::level_to_syslog(int level)
     }
 }
 
+AsyncLogger * LogUtil::_s_async_logger = NULL;
+
+void LogUtil::set_async_logger(AsyncLogger *logger)
+{
+    __atomic_store_n(&_s_async_logger, logger, __ATOMIC_RELEASE);
+}
+
+AsyncLogger * LogUtil::get_async_logger()
+{
+    return __atomic_load_n(&_s_async_logger, __ATOMIC_ACQUIRE);
+}
+
+BinaryLog * LogUtil::_s_binary_log = NULL;
+
+void LogUtil::set_binary_log(BinaryLog *log)
+{
+    __atomic_store_n(&_s_binary_log, log, __ATOMIC_RELEASE);
+}
+
 void LogUtil::logging(int level, const char * fmt, va_list ap)
 {
     char buf[MAXLINE];
@@ -63,9 +86,18 @@ void LogUtil::logging(int level, const char * fmt, va_list ap)
     if (n == -1) {
         return;
     }
+    if (n > MAXLINE - 3) {
+        n = MAXLINE - 3;
+    }
     buf[n] = '\n';
     buf[n + 1] = '\0';
-    if (g_log_behind) {
+    AsyncLogger *logger = get_async_logger();
+    if (logger != NULL) {
+        logger->append(level, buf, n + 1);
+        if (level == LOG_LEVEL_FATAL) {
+            logger->flush(logger->get_options().fatal_flush_ms);
+        }
+    } else if (g_log_behind) {
         syslog(level_to_syslog(level), "%s", buf);
     } else {
         fflush(stdout);
@@ -74,11 +106,6 @@ void LogUtil::logging(int level, const char * fmt, va_list ap)
     }
 }
 
-bool LogUtil::should_log(int level)
-{
-    return level <= g_log_level;
-}
-
 void LogUtil::log_none()
 {
     // Nothing to do
@@ -135,6 +162,7 @@ void LogUtil::log_debug(const char * fmt, ...)
 const char * TimeUtil::UTC_FORMAT= "%Y-%m-%dT%H:%M:%SZ";
 const int TimeUtil::UTC_FORMAT_LENGTH= 20;
 const char * TimeUtil::GMT_FORMAT= "%a, %d %b %Y %H:%M:%S GMT";
+const int TimeUtil::GMT_FORMAT_LENGTH= 29;
 int64_t TimeUtil::_s_utc_offset = 0;
 TimeUtil::TimeUtilInitializer _s_initializer;
 
@@ -164,6 +192,131 @@ int64_t TimeUtil::now_us()
     return now.tv_sec * 1000000 + now.tv_usec;
 }
 
+static inline int64_t clock_ns(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+int64_t TimeUtil::monotonic_ns()
+{
+    return clock_ns(CLOCK_MONOTONIC);
+}
+
+int64_t TimeUtil::monotonic_us()
+{
+    return clock_ns(CLOCK_MONOTONIC) / 1000;
+}
+
+int64_t TimeUtil::monotonic_ms()
+{
+    return clock_ns(CLOCK_MONOTONIC) / 1000000;
+}
+
+int64_t TimeUtil::coarse_monotonic_ms()
+{
+    return clock_ns(CLOCK_MONOTONIC_COARSE) / 1000000;
+}
+
+#if defined(HTTP4CPP_X86_SIMD) && defined(__x86_64__)
+#define HTTP4CPP_TSC 1
+__extension__ typedef __int128 tsc_int128_t;
+
+// ns = base_ns + (tsc - base_tsc) * ns_per_tick, ns_per_tick in 32.32 fixed point
+struct TscCalibration {
+    uint64_t    base_tsc;
+    int64_t     base_ns;
+    int64_t     ns_per_tick;
+};
+
+static TscCalibration s_tsc;
+static bool s_tsc_enabled = false;
+static pthread_mutex_t s_tsc_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+int TimeUtil::enable_tsc(int calibrate_ms)
+{
+#ifdef HTTP4CPP_TSC
+    if (!CpuFeatures::get().invariant_tsc || calibrate_ms <= 0) {
+        return RET_ILLEGAL_OPERATION;
+    }
+    pthread_mutex_lock(&s_tsc_mutex);
+    if (!s_tsc_enabled) {
+        int64_t start_ns = monotonic_ns();
+        uint64_t start_tsc = __builtin_ia32_rdtsc();
+        struct timespec delay;
+        delay.tv_sec = calibrate_ms / 1000;
+        delay.tv_nsec = (calibrate_ms % 1000) * 1000000L;
+        nanosleep(&delay, NULL);
+        int64_t end_ns = monotonic_ns();
+        uint64_t end_tsc = __builtin_ia32_rdtsc();
+        s_tsc.base_tsc = end_tsc;
+        s_tsc.base_ns = end_ns;
+        tsc_int128_t elapsed_ns = static_cast<tsc_int128_t>(end_ns - start_ns) << 32;
+        s_tsc.ns_per_tick = static_cast<int64_t>(elapsed_ns
+                / static_cast<int64_t>(end_tsc - start_tsc));
+        __atomic_store_n(&s_tsc_enabled, true, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&s_tsc_mutex);
+    return RET_OK;
+#else
+    return RET_ILLEGAL_OPERATION;
+#endif
+}
+
+bool TimeUtil::is_tsc_enabled()
+{
+#ifdef HTTP4CPP_TSC
+    return __atomic_load_n(&s_tsc_enabled, __ATOMIC_ACQUIRE);
+#else
+    return false;
+#endif
+}
+
+int64_t TimeUtil::tsc_ns()
+{
+#ifdef HTTP4CPP_TSC
+    if (__atomic_load_n(&s_tsc_enabled, __ATOMIC_ACQUIRE)) {
+        int64_t ticks = static_cast<int64_t>(__builtin_ia32_rdtsc() - s_tsc.base_tsc);
+        return s_tsc.base_ns + static_cast<int64_t>(
+                (static_cast<tsc_int128_t>(ticks) * s_tsc.ns_per_tick) >> 32);
+    }
+#endif
+    return monotonic_ns();
+}
+
+// pthread_condattr_setclock is missing on Mac OS, the conditions wait on the
+// wall clock there
+#ifdef __APPLE__
+static const clockid_t COND_CLOCK = CLOCK_REALTIME;
+#else
+static const clockid_t COND_CLOCK = CLOCK_MONOTONIC;
+#endif
+
+void TimeUtil::init_cond(pthread_cond_t *cond)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+#ifndef __APPLE__
+    pthread_condattr_setclock(&attr, COND_CLOCK);
+#endif
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+void TimeUtil::cond_abstime(int64_t wait_us, struct timespec *abstime)
+{
+    if (wait_us < 0) {
+        wait_us = 0;
+    }
+    struct timespec now;
+    clock_gettime(COND_CLOCK, &now);
+    int64_t nsec = now.tv_nsec + (wait_us % 1000000) * 1000;
+    abstime->tv_sec = now.tv_sec + wait_us / 1000000 + nsec / 1000000000;
+    abstime->tv_nsec = nsec % 1000000000;
+}
+
 time_t TimeUtil::now()
 {
     return time(NULL);
@@ -182,6 +335,32 @@ std::string TimeUtil::now_utctime()
     return timestamp_to_utctime(now());
 }
 
+const char * TimeUtil::cached_utctime()
+{
+    static __thread time_t s_cached_ts = 0;
+    static __thread char s_cached[32];
+
+    time_t ts = now();
+    if (ts != s_cached_ts || s_cached[0] == '\0') {
+        s_cached[format_utctime(ts, s_cached)] = '\0';
+        s_cached_ts = ts;
+    }
+    return s_cached;
+}
+
+const char * TimeUtil::cached_gmttime()
+{
+    static __thread time_t s_cached_ts = 0;
+    static __thread char s_cached[32];
+
+    time_t ts = now();
+    if (ts != s_cached_ts || s_cached[0] == '\0') {
+        s_cached[format_gmttime(ts, s_cached)] = '\0';
+        s_cached_ts = ts;
+    }
+    return s_cached;
+}
+
 std::string TimeUtil::now_gmttime()
 {
     return timestamp_to_gmttime(now());
@@ -189,47 +368,331 @@ std::string TimeUtil::now_gmttime()
 
 std::string TimeUtil::timestamp_to_utctime(time_t ts)
 {
-    struct tm tm_result;
-    gmtime_r(&ts, &tm_result);
+    char buf[32];
+    return std::string(buf, format_utctime(ts, buf));
+}
 
-    char buf[128];
-    int size = strftime(buf, 128, UTC_FORMAT, &tm_result); 
+std::string TimeUtil::timestamp_to_gmttime(time_t ts)
+{
+    char buf[32];
+    return std::string(buf, format_gmttime(ts, buf));
+}
 
-    std::string result(buf, size);
-    return result;
+int64_t TimeUtil::utctime_to_timestamp(const std::string & utc)
+{
+    int64_t ts = -1;
+    parse_rfc3339(utc, &ts);
+    return ts;
 }
 
-std::string TimeUtil::timestamp_to_gmttime(time_t ts)
+int64_t TimeUtil::gmttime_to_timestamp(const std::string & gmt)
 {
-    struct tm tm_result;
-    gmtime_r(&ts, &tm_result);
+    int64_t ts = -1;
+    parse_http_date(gmt, &ts);
+    return ts;
+}
 
-    char buf[128];
-    int size = strftime(buf, 128, GMT_FORMAT, &tm_result);
+static const char * WEEKDAY_NAMES = "SunMonTueWedThuFriSat";
+static const char * LONG_WEEKDAY_NAMES[] = {
+    "Sunday", "Monday", "Tuesday", "Wednesday", "Thursday", "Friday", "Saturday"
+};
+static const char * MONTH_NAMES = "JanFebMarAprMayJunJulAugSepOctNovDec";
+static const int64_t SECONDS_PER_DAY = 86400;
+static const int64_t MIN_TIMESTAMP = -62167219200LL;   // 0000-01-01T00:00:00Z
+static const int64_t MAX_TIMESTAMP = 253402300799LL;   // 9999-12-31T23:59:59Z
+
+struct CivilTime {
+    int year;
+    int month;      // 1 to 12
+    int day;        // 1 to 31
+    int hour;
+    int minute;
+    int second;
+    int weekday;    // 0 is Sunday
+};
+
+// Days since 1970-01-01 of a proleptic Gregorian date and back, by counting
+// 400 year eras of March based years as in Howard Hinnant's algorithms.
+static int64_t days_from_civil(int64_t year, int month, int day)
+{
+    year -= month <= 2;
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    int64_t year_of_era = year - era * 400;
+    int64_t day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    int64_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + day_of_era - 719468;
+}
 
-    std::string result(buf, size);
-    return result;
+static void civil_from_timestamp(int64_t ts, CivilTime *civil)
+{
+    int64_t days = ts / SECONDS_PER_DAY;
+    int64_t seconds = ts % SECONDS_PER_DAY;
+    if (seconds < 0) {
+        seconds += SECONDS_PER_DAY;
+        --days;
+    }
+    civil->hour = static_cast<int>(seconds / 3600);
+    civil->minute = static_cast<int>(seconds / 60 % 60);
+    civil->second = static_cast<int>(seconds % 60);
+    civil->weekday = static_cast<int>((days % 7 + 11) % 7);   // 1970-01-01 was a Thursday
+
+    days += 719468;
+    int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    int64_t day_of_era = days - era * 146097;
+    int64_t year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524
+            - day_of_era / 146096) / 365;
+    int64_t day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    int64_t month = (5 * day_of_year + 2) / 153;
+    civil->day = static_cast<int>(day_of_year - (153 * month + 2) / 5 + 1);
+    civil->month = static_cast<int>(month < 10 ? month + 3 : month - 9);
+    civil->year = static_cast<int>(year_of_era + era * 400 + (civil->month <= 2));
 }
 
-int64_t TimeUtil::utctime_to_timestamp(const std::string & utc)
+static int days_in_month(int year, int month)
 {
-    struct tm tm_result;
-    if (strptime(utc.c_str(), UTC_FORMAT, &tm_result)
-            != utc.c_str() + UTC_FORMAT_LENGTH) {
-        return -1;
+    static const int DAYS[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    bool leap = year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+    return month == 2 && leap ? 29 : DAYS[month - 1];
+}
+
+static inline void put_digits(char *buffer, int value, int count)
+{
+    for (int i = count - 1; i >= 0; --i) {
+        buffer[i] = static_cast<char>('0' + value % 10);
+        value /= 10;
     }
+}
 
-    return static_cast<int64_t>(mktime(&tm_result));
+size_t TimeUtil::format_gmttime(int64_t ts, char *buffer)
+{
+    if (ts < MIN_TIMESTAMP || ts > MAX_TIMESTAMP) {
+        return 0;
+    }
+    CivilTime t;
+    civil_from_timestamp(ts, &t);
+    // Sun, 06 Nov 1994 08:49:37 GMT
+    memcpy(buffer, WEEKDAY_NAMES + t.weekday * 3, 3);
+    memcpy(buffer + 3, ", ", 2);
+    put_digits(buffer + 5, t.day, 2);
+    buffer[7] = ' ';
+    memcpy(buffer + 8, MONTH_NAMES + (t.month - 1) * 3, 3);
+    buffer[11] = ' ';
+    put_digits(buffer + 12, t.year, 4);
+    buffer[16] = ' ';
+    put_digits(buffer + 17, t.hour, 2);
+    buffer[19] = ':';
+    put_digits(buffer + 20, t.minute, 2);
+    buffer[22] = ':';
+    put_digits(buffer + 23, t.second, 2);
+    memcpy(buffer + 25, " GMT", 4);
+    return GMT_FORMAT_LENGTH;
 }
 
-int64_t TimeUtil::gmttime_to_timestamp(const std::string & gmt)
+size_t TimeUtil::format_utctime(int64_t ts, char *buffer)
+{
+    if (ts < MIN_TIMESTAMP || ts > MAX_TIMESTAMP) {
+        return 0;
+    }
+    CivilTime t;
+    civil_from_timestamp(ts, &t);
+    // 1994-11-06T08:49:37Z
+    put_digits(buffer, t.year, 4);
+    buffer[4] = '-';
+    put_digits(buffer + 5, t.month, 2);
+    buffer[7] = '-';
+    put_digits(buffer + 8, t.day, 2);
+    buffer[10] = 'T';
+    put_digits(buffer + 11, t.hour, 2);
+    buffer[13] = ':';
+    put_digits(buffer + 14, t.minute, 2);
+    buffer[16] = ':';
+    put_digits(buffer + 17, t.second, 2);
+    buffer[19] = 'Z';
+    return UTC_FORMAT_LENGTH;
+}
+
+// Reads the fields of a date from left to right, every step fails once
+// the text does not match.
+class DateReader {
+public:
+    explicit DateReader(const StringPiece &text) : _text(text), _pos(0)
+    {
+        // nothing to do
+    }
+
+    bool digits(int count, int *value)
+    {
+        if (_pos + count > _text.size()) {
+            return false;
+        }
+        int result = 0;
+        for (int i = 0; i < count; ++i) {
+            unsigned int digit = static_cast<unsigned char>(_text[_pos + i]) - '0';
+            if (digit > 9) {
+                return false;
+            }
+            result = result * 10 + digit;
+        }
+        _pos += count;
+        *value = result;
+        return true;
+    }
+
+    bool literal(const char *expected)
+    {
+        size_t size = strlen(expected);
+        if (_pos + size > _text.size() || memcmp(_text.data() + _pos, expected, size) != 0) {
+            return false;
+        }
+        _pos += size;
+        return true;
+    }
+
+    bool one_of(const char *expected)
+    {
+        if (_pos >= _text.size() || strchr(expected, _text[_pos]) == NULL
+                || _text[_pos] == '\0') {
+            return false;
+        }
+        ++_pos;
+        return true;
+    }
+
+    // index of a three letter name in names
+    bool name(const char *names, int count, int *index)
+    {
+        if (_pos + 3 > _text.size()) {
+            return false;
+        }
+        for (int i = 0; i < count; ++i) {
+            if (memcmp(_text.data() + _pos, names + i * 3, 3) == 0) {
+                _pos += 3;
+                *index = i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool time_of_day(int *hour, int *minute, int *second)
+    {
+        return digits(2, hour) && literal(":") && digits(2, minute) && literal(":")
+                && digits(2, second);
+    }
+
+    bool at_end() const
+    {
+        return _pos == _text.size();
+    }
+
+private:
+    StringPiece _text;
+    size_t      _pos;
+};
+
+static int to_timestamp(int year, int month, int day, int hour, int minute, int second,
+        int64_t *ts)
 {
-    struct tm tm_result;
-    if (strptime(gmt.c_str(), GMT_FORMAT, &tm_result) == NULL) {
-        return -1;
+    if (day < 1 || day > days_in_month(year, month) || hour > 23 || minute > 59
+            || second > 60) {
+        return RET_ILLEGAL_ARGUMENT;
+    }
+    *ts = days_from_civil(year, month, day) * SECONDS_PER_DAY + hour * 3600 + minute * 60
+            + second;
+    return RET_OK;
+}
+
+int TimeUtil::parse_http_date(const StringPiece &src, int64_t *ts)
+{
+    DateReader reader(StringUtil::trim_view(src));
+    int weekday = 0;
+    int day = 0;
+    int month = 0;
+    int year = 0;
+    int hour = 0;
+    int minute = 0;
+    int second = 0;
+    if (!reader.name(WEEKDAY_NAMES, 7, &weekday)) {
+        return RET_ILLEGAL_ARGUMENT;
+    }
+    bool valid = false;
+    if (reader.literal(", ")) {
+        // Sun, 06 Nov 1994 08:49:37 GMT
+        valid = reader.digits(2, &day) && reader.literal(" ")
+                && reader.name(MONTH_NAMES, 12, &month) && reader.literal(" ")
+                && reader.digits(4, &year) && reader.literal(" ")
+                && reader.time_of_day(&hour, &minute, &second) && reader.literal(" GMT");
+    } else if (reader.literal(" ")) {
+        // Sun Nov  6 08:49:37 1994
+        valid = reader.name(MONTH_NAMES, 12, &month) && reader.literal(" ")
+                && (reader.literal(" ") ? reader.digits(1, &day) : reader.digits(2, &day))
+                && reader.literal(" ") && reader.time_of_day(&hour, &minute, &second)
+                && reader.literal(" ") && reader.digits(4, &year);
+    } else {
+        // Sunday, 06-Nov-94 08:49:37 GMT, a year more than 50 years ahead
+        // is the last one in the past with the same two digits
+        valid = reader.literal(LONG_WEEKDAY_NAMES[weekday] + 3) && reader.literal(", ")
+                && reader.digits(2, &day) && reader.literal("-")
+                && reader.name(MONTH_NAMES, 12, &month) && reader.literal("-")
+                && reader.digits(2, &year) && reader.literal(" ")
+                && reader.time_of_day(&hour, &minute, &second) && reader.literal(" GMT");
+        if (valid) {
+            CivilTime today;
+            civil_from_timestamp(now(), &today);
+            year += today.year - today.year % 100;
+            if (year > today.year + 50) {
+                year -= 100;
+            }
+        }
     }
+    if (!valid || !reader.at_end()) {
+        return RET_ILLEGAL_ARGUMENT;
+    }
+    return to_timestamp(year, month + 1, day, hour, minute, second, ts);
+}
 
-    return static_cast<int64_t>(mktime(&tm_result));
+int TimeUtil::parse_rfc3339(const StringPiece &src, int64_t *ts)
+{
+    // 1985-04-12T23:20:50.52Z or 1996-12-19T16:39:57-08:00
+    DateReader reader(src);
+    int year = 0;
+    int month = 0;
+    int day = 0;
+    int hour = 0;
+    int minute = 0;
+    int second = 0;
+    int digit = 0;
+    if (!reader.digits(4, &year) || !reader.literal("-") || !reader.digits(2, &month)
+            || !reader.literal("-") || !reader.digits(2, &day) || !reader.one_of("Tt ")
+            || !reader.time_of_day(&hour, &minute, &second)) {
+        return RET_ILLEGAL_ARGUMENT;
+    }
+    if (reader.literal(".")) {
+        if (!reader.digits(1, &digit)) {
+            return RET_ILLEGAL_ARGUMENT;
+        }
+        while (reader.digits(1, &digit)) {
+            // the fraction of the second is dropped
+        }
+    }
+    int offset = 0;
+    if (!reader.one_of("Zz")) {
+        int sign = reader.literal("+") ? 1 : (reader.literal("-") ? -1 : 0);
+        int offset_hour = 0;
+        int offset_minute = 0;
+        if (sign == 0 || !reader.digits(2, &offset_hour) || !reader.literal(":")
+                || !reader.digits(2, &offset_minute) || offset_hour > 23 || offset_minute > 59) {
+            return RET_ILLEGAL_ARGUMENT;
+        }
+        offset = sign * (offset_hour * 3600 + offset_minute * 60);
+    }
+    int64_t local = 0;
+    if (!reader.at_end() || month < 1 || month > 12
+            || to_timestamp(year, month, day, hour, minute, second, &local) != RET_OK) {
+        return RET_ILLEGAL_ARGUMENT;
+    }
+    *ts = local - offset;
+    return RET_OK;
 }
 
 int64_t TimeUtil::get_utc_offset()
@@ -241,8 +704,6 @@ int64_t TimeUtil::get_utc_offset()
 //StringUtil definition
 const char * StringUtil::HEX_CHARS = "0123456789ABCDEF";
 const char * StringUtil::EMPTY_CHARS = " \r\n\t";
-const char * StringUtil::BASE64_CHARS = 
-        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/=";
 
 bool StringUtil::is_hex_char(unsigned char c)
 {
@@ -257,111 +718,329 @@ bool StringUtil::is_hex_char(unsigned char c)
 
 int StringUtil::trim(const std::string &src, std::string &output, const std::string &c)
 {
-    std::string tmp;
-    if (ltrim(src, tmp, c) < 0) {
-        return -1;
-    }
-    return rtrim(tmp, output, c);
+    StringPiece view = trim_view(src, c);
+    output.assign(view.data(), view.size());
+    return 0;
 }
 
 int StringUtil::ltrim(const std::string &src, std::string &output, const std::string &c)
 {
-    output.clear();
-    size_t start = src.find_first_not_of(c);
-    if (start == std::string::npos) {
-        return 0;
-    }
-    output.resize(src.size() - start);
-    std::string::iterator res = std::copy(src.begin() + start, src.end(), output.begin());
-    if (res == output.end()) {
-        return 0;
-    }
-    return -1;
+    StringPiece view = ltrim_view(src, c);
+    output.assign(view.data(), view.size());
+    return 0;
 }
 
 int StringUtil::rtrim(const std::string &src, std::string &output, const std::string &c)
 {
-    output.clear();
-    size_t end = src.find_last_not_of(c);
-    if (end == std::string::npos) {
-        return 0;
-    }
-    output.resize(end + 1);
-    std::string::iterator res = std::copy(src.begin(), src.begin() + end + 1, output.begin());
-    if (res == output.end()) {
-        return 0;
-    }
-    return -1;
+    StringPiece view = rtrim_view(src, c);
+    output.assign(view.data(), view.size());
+    return 0;
 }
 
 std::string StringUtil::trim(const std::string &src, const std::string &c)
 {
-    return rtrim(ltrim(src, c), c);
+    return trim_view(src, c).as_string();
 }
 
 std::string StringUtil::ltrim(const std::string &src, const std::string &c)
 {
-    std::string tmp;
-    if (ltrim(src, tmp, c) < 0) {
-        return src;
-    }
-    return tmp;
+    return ltrim_view(src, c).as_string();
 }
 
 std::string StringUtil::rtrim(const std::string &src, const std::string &c)
 {
-    std::string tmp;
-    if (rtrim(src, tmp, c) < 0) {
-        return src;
+    return rtrim_view(src, c).as_string();
+}
+
+// The characters to trim as a bitmap, one bit test per character.
+class TrimSet {
+public:
+    explicit TrimSet(const StringPiece &c)
+    {
+        memset(_bits, 0, sizeof(_bits));
+        for (size_t i = 0; i < c.size(); ++i) {
+            unsigned char ch = static_cast<unsigned char>(c[i]);
+            _bits[ch >> 5] |= 1U << (ch & 31);
+        }
+    }
+
+    bool contains(char c) const
+    {
+        unsigned char ch = static_cast<unsigned char>(c);
+        return (_bits[ch >> 5] >> (ch & 31)) & 1U;
+    }
+
+    StringPiece ltrim(const StringPiece &src) const
+    {
+        size_t start = 0;
+        while (start < src.size() && contains(src[start])) {
+            ++start;
+        }
+        return src.substr(start);
+    }
+
+    StringPiece rtrim(const StringPiece &src) const
+    {
+        size_t end = src.size();
+        while (end > 0 && contains(src[end - 1])) {
+            --end;
+        }
+        return src.substr(0, end);
     }
-    return tmp;
+
+private:
+    uint32_t _bits[8];
+};
+
+StringPiece StringUtil::trim_view(const StringPiece &src, const StringPiece &c)
+{
+    TrimSet set(c);
+    return set.rtrim(set.ltrim(src));
+}
+
+StringPiece StringUtil::ltrim_view(const StringPiece &src, const StringPiece &c)
+{
+    return TrimSet(c).ltrim(src);
+}
+
+StringPiece StringUtil::rtrim_view(const StringPiece &src, const StringPiece &c)
+{
+    return TrimSet(c).rtrim(src);
+}
+
+void StringUtil::trim_in_place(std::string *str, const StringPiece &c)
+{
+    StringPiece view = trim_view(*str, c);
+    size_t start = view.data() - str->data();
+    str->erase(start + view.size());
+    str->erase(0, start);
+}
+
+const size_t StringUtil::MAX_NUM_SIZE;
+
+static const char * NUM_DIGITS = "0123456789abcdef";
+static const char * NUM_DIGIT_PAIRS =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static inline bool is_num_base(int base)
+{
+    return base == 10 || base == 16 || base == 8 || base == 2;
+}
+
+static inline unsigned int num_digit_value(char c)
+{
+    if ('0' <= c && c <= '9') {
+        return c - '0';
+    }
+    c |= 0x20;
+    return 'a' <= c && c <= 'f' ? c - 'a' + 10 : 99;
+}
+
+// digits only, every character of [p, end) must be one
+static int parse_digits(const char *p, const char *end, unsigned int base,
+        unsigned long long max, unsigned long long *value)
+{
+    if (p == end) {
+        return RET_ILLEGAL_ARGUMENT;
+    }
+    // up to this many digits cannot overflow 64 bits, only max needs checking
+    size_t safe_digits = base == 10 ? 19 : base == 16 ? 16 : base == 8 ? 21 : 64;
+    if (static_cast<size_t>(end - p) <= safe_digits) {
+        unsigned long long result = 0;
+        for (; p != end; ++p) {
+            unsigned int digit = num_digit_value(*p);
+            if (digit >= base) {
+                return RET_ILLEGAL_ARGUMENT;
+            }
+            result = result * base + digit;
+        }
+        if (result > max) {
+            return RET_ILLEGAL_ARGUMENT;
+        }
+        *value = result;
+        return RET_OK;
+    }
+    unsigned long long limit = max / base;
+    unsigned int last = static_cast<unsigned int>(max % base);
+    unsigned long long result = 0;
+    for (; p != end; ++p) {
+        unsigned int digit = num_digit_value(*p);
+        if (digit >= base || result > limit || (result == limit && digit > last)) {
+            return RET_ILLEGAL_ARGUMENT;
+        }
+        result = result * base + digit;
+    }
+    *value = result;
+    return RET_OK;
+}
+
+static const char * skip_hex_prefix(const char *p, const char *end, int base)
+{
+    if (base == 16 && end - p > 2 && p[0] == '0' && (p[1] | 0x20) == 'x') {
+        return p + 2;
+    }
+    return p;
 }
 
 std::string StringUtil::num_to_string(int num)
 {
-    std::ostringstream oss;
-    oss.clear();
-    oss << num;
-    return oss.str();
+    char buffer[MAX_NUM_SIZE];
+    return std::string(buffer, format_num(num, buffer));
 }
 
 uint64_t StringUtil::string_to_num(std::string &str, uint8_t base)
 {
-    uint64_t result = 0;
-    std::string nstr = trim(str);
-    std::istringstream ss(nstr);
+    const char *p = str.data();
+    const char *end = p + str.size();
+    while (p != end && strchr(EMPTY_CHARS, *p) != NULL && *p != '\0') {
+        ++p;
+    }
+    const char *digits = p != end && *p == '+' ? p + 1 : p;
+    digits = skip_hex_prefix(digits, end, base);
+    const char *digits_end = digits;
+    while (digits_end != end && num_digit_value(*digits_end) < base) {
+        ++digits_end;
+    }
+    unsigned long long result = 0;
+    if (!is_num_base(base) || parse_unsigned(StringPiece(p, digits_end - p), base,
+            ULLONG_MAX, &result) != RET_OK) {
+        return 0;
+    }
+    return result;
+}
+
+size_t StringUtil::format_unsigned(unsigned long long value, char *buffer, int base)
+{
+    char digits[MAX_NUM_SIZE];
+    char *end = digits + sizeof(digits);
+    char *p = end;
     if (base == 10) {
-        ss >> std::dec >> result;
-    } else if (base == 16) {
-        ss >> std::hex >> result;
-    } else if (base == 8) {
-        ss >> std::oct >> result;
-    } else if (base == 2) {
-        size_t n = nstr.size();
-        const char * p = nstr.c_str();
-        for (size_t i = 0; i < n; ++i) {
-            uint64_t tmp = (p[i] - '0');
-            result = 2 * result + tmp;
+        while (value >= 100) {
+            unsigned int pair = static_cast<unsigned int>(value % 100) * 2;
+            value /= 100;
+            p -= 2;
+            memcpy(p, NUM_DIGIT_PAIRS + pair, 2);
+        }
+        if (value >= 10) {
+            p -= 2;
+            memcpy(p, NUM_DIGIT_PAIRS + value * 2, 2);
+        } else {
+            *--p = static_cast<char>('0' + value);
         }
+    } else if (is_num_base(base)) {
+        int shift = base == 16 ? 4 : base == 8 ? 3 : 1;
+        unsigned int mask = base - 1;
+        do {
+            *--p = NUM_DIGITS[value & mask];
+            value >>= shift;
+        } while (value != 0);
+    } else {
+        return 0;
     }
-    return result;
+    memcpy(buffer, p, end - p);
+    return end - p;
 }
 
+size_t StringUtil::format_signed(long long value, char *buffer, int base)
+{
+    if (value >= 0 || !is_num_base(base)) {
+        return format_unsigned(value < 0 ? 0 : value, buffer, base);
+    }
+    buffer[0] = '-';
+    return 1 + format_unsigned(0ULL - static_cast<unsigned long long>(value), buffer + 1, base);
+}
+
+int StringUtil::parse_unsigned(const StringPiece &src, int base, unsigned long long max,
+        unsigned long long *value)
+{
+    if (!is_num_base(base)) {
+        return RET_ILLEGAL_ARGUMENT;
+    }
+    const char *p = src.begin();
+    if (p != src.end() && *p == '+') {
+        ++p;
+    }
+    p = skip_hex_prefix(p, src.end(), base);
+    return parse_digits(p, src.end(), base, max, value);
+}
+
+int StringUtil::parse_signed(const StringPiece &src, int base, long long min, long long max,
+        long long *value)
+{
+    if (!is_num_base(base)) {
+        return RET_ILLEGAL_ARGUMENT;
+    }
+    const char *p = src.begin();
+    bool negative = p != src.end() && *p == '-';
+    if (p != src.end() && (*p == '-' || *p == '+')) {
+        ++p;
+    }
+    p = skip_hex_prefix(p, src.end(), base);
+    unsigned long long magnitude = 0;
+    int ret = parse_digits(p, src.end(), base, negative ?
+            0ULL - static_cast<unsigned long long>(min) : static_cast<unsigned long long>(max),
+            &magnitude);
+    if (ret == RET_OK) {
+        *value = negative ? static_cast<long long>(0ULL - magnitude)
+                : static_cast<long long>(magnitude);
+    }
+    return ret;
+}
+
+#define HTTP4CPP_PARSE_SIGNED(type, min, max) \
+int StringUtil::parse_num(const StringPiece &src, type *value, int base) \
+{ \
+    long long result = 0; \
+    int ret = parse_signed(src, base, min, max, &result); \
+    if (ret == RET_OK) { \
+        *value = static_cast<type>(result); \
+    } \
+    return ret; \
+}
+
+#define HTTP4CPP_PARSE_UNSIGNED(type, max) \
+int StringUtil::parse_num(const StringPiece &src, type *value, int base) \
+{ \
+    unsigned long long result = 0; \
+    int ret = parse_unsigned(src, base, max, &result); \
+    if (ret == RET_OK) { \
+        *value = static_cast<type>(result); \
+    } \
+    return ret; \
+}
+
+HTTP4CPP_PARSE_SIGNED(short, SHRT_MIN, SHRT_MAX)
+HTTP4CPP_PARSE_SIGNED(int, INT_MIN, INT_MAX)
+HTTP4CPP_PARSE_SIGNED(long, LONG_MIN, LONG_MAX)
+HTTP4CPP_PARSE_SIGNED(long long, LLONG_MIN, LLONG_MAX)
+HTTP4CPP_PARSE_UNSIGNED(unsigned short, USHRT_MAX)
+HTTP4CPP_PARSE_UNSIGNED(unsigned int, UINT_MAX)
+HTTP4CPP_PARSE_UNSIGNED(unsigned long, ULONG_MAX)
+HTTP4CPP_PARSE_UNSIGNED(unsigned long long, ULLONG_MAX)
+
+#undef HTTP4CPP_PARSE_SIGNED
+#undef HTTP4CPP_PARSE_UNSIGNED
+
 int StringUtil::split(const std::string &src, const std::string &delimiter,
         int max_items, std::vector<std::string> * result)
 {
-    size_t cur = 0;
-    size_t next = 0;
-
-    while (next != std::string::npos &&
-            (max_items < 0 || max_items > static_cast<int>(result->size()) + 1)) {
-        next = src.find_first_of(delimiter, cur);
-        result->push_back(src.substr(cur, next - cur));
-        cur = next + delimiter.size();
+    StringSplitter items(src, delimiter, max_items);
+    StringPiece item;
+    while (items.next(&item)) {
+        result->push_back(std::string(item.data(), item.size()));
     }
+    return 0;
+}
 
-    if (next != std::string::npos) { // over max items, and fill the last one
-        result->push_back(src.substr(cur));
+int StringUtil::split(const StringPiece &src, const StringPiece &delimiter,
+        int max_items, std::vector<StringPiece> * result)
+{
+    StringSplitter items(src, delimiter, max_items);
+    StringPiece item;
+    while (items.next(&item)) {
+        result->push_back(item);
     }
     return 0;
 }
@@ -369,43 +1048,49 @@ int StringUtil::split(const std::string &src, const std::string &delimiter,
 int StringUtil::lower(const std::string &src, std::string &output)
 {
     output.resize(src.size());
-    std::string::iterator end = std::transform(
-            src.begin(), src.end(), output.begin(), tolower);
-    if (end == output.end()) {
-        return 0;
+    if (!src.empty()) {
+        Ascii::lower(src.data(), src.size(), &output[0]);
     }
-    return -1;
+    return 0;
 }
 
 int StringUtil::upper(const std::string &src, std::string &output)
 {
     output.resize(src.size());
-    std::string::iterator end = std::transform(
-            src.begin(), src.end(), output.begin(), toupper);
-    if (end == output.end()) {
-        return 0;
+    if (!src.empty()) {
+        Ascii::upper(src.data(), src.size(), &output[0]);
     }
-    return -1;
+    return 0;
 }
 
 std::string StringUtil::lower(const std::string &src)
 {
     std::string res;
-    if (lower(src, res) < 0) {
-        return src;
-    }
+    lower(src, res);
     return res;
 }
 
 std::string StringUtil::upper(const std::string &src)
 {
     std::string res;
-    if (upper(src, res) < 0) {
-        return src;
-    }
+    upper(src, res);
     return res;
 }
 
+void StringUtil::lower_in_place(std::string *str)
+{
+    if (!str->empty()) {
+        Ascii::lower(&(*str)[0], str->size(), &(*str)[0]);
+    }
+}
+
+void StringUtil::upper_in_place(std::string *str)
+{
+    if (!str->empty()) {
+        Ascii::upper(&(*str)[0], str->size(), &(*str)[0]);
+    }
+}
+
 std::string StringUtil::hex(unsigned char c)
 {
     std::string result;
@@ -417,135 +1102,122 @@ std::string StringUtil::hex(unsigned char c)
 
 std::string StringUtil::hex(const std::string &src)
 {
-    std::stringstream ss;
-    ss.clear();
-    size_t length = src.size();
-    for (size_t i = 0; i < length; ++i) {
-        ss << hex(static_cast<unsigned char>(src[i]));
+    std::string result(src.size() * 2, '0');
+    for (size_t i = 0; i < src.size(); ++i) {
+        unsigned char c = src[i];
+        result[2 * i] = HEX_CHARS[c >> 4];
+        result[2 * i + 1] = HEX_CHARS[c & 0xf];
     }
-    return ss.str();
+    return result;
 }
 
 std::string StringUtil::base64_encode(const std::string &src)
 {
-    std::stringstream ss;
-    ss.clear();
+    std::string output;
+    base64_encode(src, &output);
+    return output;
+}
+
+std::string StringUtil::base64_decode(const std::string &src)
+{
+    std::string output;
+    base64_decode(src, &output);
+    return output;
+}
 
-    size_t length = src.size();
-    if (src.empty()) {
-        return src;
+void StringUtil::base64_encode(const std::string &src, std::string *output)
+{
+    size_t offset = output->size();
+    output->resize(offset + Base64::encoded_size(src.size()));
+    if (!src.empty()) {
+        Base64::encode(src.data(), src.size(), &(*output)[offset]);
     }
+}
 
-    unsigned char parts[4];
-    for (size_t i = 0; i < length; i += 3) {
-        parts[0] = (src[i] & 0xfc) >> 2;
-        parts[1] = ((src[i] & 0x03) << 4) | (((length > (i + 1) ? src[i + 1] : 0x00) & 0xf0) >> 4);
-        parts[2] = length > (i + 1) ? (((src[i + 1] & 0x0f) << 2) |
-                (((length > (i + 2) ? src[i + 2] : 0x00) & 0xc0) >> 6)) : 0x40;
-        parts[3] = length > (i + 2) ? (src[i + 2] & 0x3f) : 0x40;
+int StringUtil::base64_decode(const std::string &src, std::string *output)
+{
+    size_t offset = output->size();
+    output->resize(offset + Base64::decoded_max_size(src.size()));
+    size_t written = 0;
+    int ret = src.empty() ? RET_OK :
+            Base64::decode(src.data(), src.size(), &(*output)[offset], &written);
+    output->resize(offset + written);
+    return ret;
+}
 
-        for (int j = 0; j < 4; ++j) {
-            ss << BASE64_CHARS[parts[j]];
-        }
-    }
-    return ss.str();
+std::string StringUtil::url_encode(const std::string &src, bool encode_slash)
+{
+    std::string output;
+    url_encode(src, &output, encode_slash);
+    return output;
 }
 
-unsigned char StringUtil::base64_decode_char(const unsigned char c)
+std::string StringUtil::url_decode(const std::string &src)
 {
-    unsigned char result = 0;
-    if (isupper(c)) {
-        result = static_cast<unsigned char>(c - 'A');
-    } else if (islower(c)) {
-        result = static_cast<unsigned char>(c - 'a' + 26);
-    } else if (isdigit(c)) {
-        result = static_cast<unsigned char>(c - '0' + 52);
-    } else if ('+' == c) {
-        result = 62;
-    } else if ('/' == c) {
-        result = 63;
-    } else if ('=' == c) {
-        result = 64;
-    } else {
-        result = UCHAR_MAX;
-    }
-    return result;
+    std::string output;
+    url_decode(src, &output);
+    return output;
 }
 
-std::string StringUtil::base64_decode(const std::string &src)
+void StringUtil::url_encode(const std::string &src, std::string *output, bool encode_slash)
 {
-    std::stringstream ss;
-    ss.clear();
-    size_t length = src.size();
-    if (src.empty()) {
-        return src;
-    }
+    UrlCodec::encode(src.data(), src.size(), encode_slash ? URL_CHARSET_DEFAULT : URL_CHARSET_PATH,
+            output);
+}
 
-    unsigned char parts[4];
-    for (size_t i = 0; i < length; i += 4) {
-        parts[0] = base64_decode_char(src[i]);
-        parts[1] = length > (i + 1) ? base64_decode_char(src[i + 1]) : 64;
-        parts[2] = length > (i + 2) ? base64_decode_char(src[i + 2]) : 64;
-        parts[3] = length > (i + 3) ? base64_decode_char(src[i + 3]) : 64;
+void StringUtil::url_decode(const std::string &src, std::string *output)
+{
+    UrlCodec::decode(src.data(), src.size(), output);
+}
 
-        ss << static_cast<unsigned char>(((parts[0] << 2) & 0xfc) | ((parts[1] >> 4) & 0x03));
-        if (64 == parts[2]) {
-            break;
-        }
-        ss << static_cast<unsigned char>(((parts[1] << 4) & 0xf0) | ((parts[2] >> 2) & 0x0f));
-        if (64 == parts[3]) {
-            break;
-        }
-        ss << static_cast<unsigned char>(((parts[2] << 6) & 0xc0) | (parts[3] & 0x3f));
+int StringUtil::hmac(int type, const std::string &key, const std::string &data,
+        std::string *result)
+{
+    if (type == HMAC_TYPE_SHA1) {
+        HmacSha1 hasher(key);
+        hasher.update(data);
+        *result = hasher.finish();
+    } else if (type == HMAC_TYPE_SHA256) {
+        HmacSha256 hasher(key);
+        hasher.update(data);
+        *result = hasher.finish();
+    } else {
+        return RET_ILLEGAL_ARGUMENT;
     }
-    return ss.str();
+    return RET_OK;
 }
 
-std::string StringUtil::url_encode(const std::string &src, bool encode_slash)
+std::string StringUtil::sha256hex(const std::string &src, const std::string &sk)
 {
-    std::stringstream ss;
-    ss.clear();
-    size_t length = src.size();
-    for (size_t i = 0; i < length; ++i) {
-        unsigned char c = src[i];
-        if (isalnum(c) || c == '_' || c == '-' || c == '~' || c == '.' || c == '&') {
-            ss << c;
-        } else if (c == '/' && !encode_slash) {
-            ss << c;
-        } else {
-            ss << '%' << hex(c);
-        }
+    static const char * LOWER_HEX_CHARS = "0123456789abcdef";
+    unsigned char digest[Sha256::DIGEST_SIZE];
+    HmacSha256 hasher(sk);
+    hasher.update(src);
+    hasher.finish(digest);
+    std::string result(Sha256::DIGEST_SIZE * 2, '0');
+    for (size_t i = 0; i < Sha256::DIGEST_SIZE; ++i) {
+        result[2 * i] = LOWER_HEX_CHARS[digest[i] >> 4];
+        result[2 * i + 1] = LOWER_HEX_CHARS[digest[i] & 0xf];
     }
-    return ss.str();
+    return result;
 }
 
-std::string StringUtil::url_decode(const std::string &src)
+int StringUtil::iconv(const std::string &from_charset, const std::string &to_charset,
+        const std::string &src, std::string *output)
 {
-    std::stringstream ss;
-    ss.clear();
-    size_t length = src.size();
-    for (size_t i = 0; i < length; ++i) {
-        if (src[i] != '%') {
-            ss << src[i];
-        } else {
-            unsigned char c = 0;
-            if (length <= ++i) {
-                break;
-            }
-            c += isdigit(src[i]) ? (src[i] - '0') :
-                    isupper(src[i]) ? (src[i] - 'A' + 0x0a) :
-                        islower(src[i]) ? (src[i] - 'a' + 0x0a) : 0x00;
-            if (length <= ++i) {
-                break;
-            }
-            c *= 16;
-            c += isdigit(src[i]) ? (src[i] - '0') :
-                    isupper(src[i]) ? (src[i] - 'A' + 0x0a) :
-                        islower(src[i]) ? (src[i] - 'a' + 0x0a) : 0x00;
-            ss << c;
-        }
+    if (from_charset.empty()) {
+        return RET_ILLEGAL_ARGUMENT;
+    }
+    size_t old_size = output->size();
+    StringOutputStream sink(output);
+    CharsetOutputStream stream(&sink, "", to_charset);
+    if (stream.set_charset(from_charset) != RET_OK
+            || stream.write(src) != static_cast<int64_t>(src.size())
+            || stream.finish() != RET_OK) {
+        output->resize(old_size);
+        return RET_ILLEGAL_ARGUMENT;
     }
-    return ss.str();
+    return RET_OK;
 }
 
 // Definition for return code
@@ -566,6 +1238,22 @@ const char * stringfy_ret_code(int code)
             return "file pointer is invalid";
         case RET_ILLEGAL_OPERATION:
             return "operation is illegal";
+        case RET_NO_AVAILABLE_ENDPOINT:
+            return "no endpoint available for the service";
+        case RET_CIRCUIT_OPEN:
+            return "circuit breaker of the host is open";
+        case RET_RATE_LIMITED:
+            return "request rate of the host exceeds the limit";
+        case RET_OVERLOADED:
+            return "concurrent requests of the host exceed the limit";
+        case RET_DEADLINE_EXCEEDED:
+            return "request deadline exceeded";
+        case RET_TIMEOUT:
+            return "request timeout";
+        case RET_CHECKSUM_MISMATCH:
+            return "checksum of the body does not match";
+        case RET_CHECKSUM_MISSING:
+            return "response carries no checksum for the body";
         default:
             return "OK";
     }
@@ -11,6 +11,7 @@
 
 #include <stdint.h>
 #include <time.h>
+#include <pthread.h>
 #include <sys/time.h>
 #include <stdarg.h> /* for ISO C variable arguments*/
 
@@ -18,14 +19,30 @@
 #include <vector>
 
 #include "common/common.h"
+#include "common/async_logger.h"
+#include "common/binary_log.h"
+#include "common/string_piece.h"
 
 BEGIN_NAMESPACE
 
 class LogUtil {
 public:
-    static inline const char * level_to_string(int level);
-    static inline int level_to_syslog(int level);
-    static bool should_log(int level);
+    static const char * level_to_string(int level);
+    static int level_to_syslog(int level);
+    static bool should_log(int level)
+    {
+        return level <= g_log_level;
+    }
+
+    // Lines go through the logger once installed, NULL logs synchronously again.
+    static void set_async_logger(AsyncLogger *logger);
+    static AsyncLogger * get_async_logger();
+    // Takes precedence over the async logger for all levels but FATAL.
+    static void set_binary_log(BinaryLog *log);
+    static BinaryLog * get_binary_log()
+    {
+        return __atomic_load_n(&_s_binary_log, __ATOMIC_ACQUIRE);
+    }
 
     static void log_none();
     static void log_fatal(const char * fmt, ...);
@@ -37,26 +54,73 @@ public:
 private:
     static void logging(int level, const char * fmt, va_list ap);
     const static int MAXLINE = 10240;
+
+    static AsyncLogger *_s_async_logger;
+    static BinaryLog   *_s_binary_log;
 };
 
 class TimeUtil {
 public:
     static void init();
+    // Wall clock, it jumps when the system time is set, see monotonic_us.
     static int64_t now_ms();
     static int64_t now_us();
+
+    // Monotonic clocks for latencies, timeouts and deadlines, only the
+    // differences of their values mean something. The coarse clock is
+    // cheaper and up to a scheduler tick behind.
+    static int64_t monotonic_ns();
+    static int64_t monotonic_us();
+    static int64_t monotonic_ms();
+    static int64_t coarse_monotonic_ms();
+
+    // The TSC as a monotonic clock in nanoseconds, scaled by a calibration
+    // against monotonic_ns over calibrate_ms. RET_ILLEGAL_OPERATION without
+    // an invariant TSC, tsc_ns then stays monotonic_ns.
+    static int enable_tsc(int calibrate_ms = 10);
+    static bool is_tsc_enabled();
+    static int64_t tsc_ns();
+
+    // Conditions waiting on the monotonic clock: init_cond makes one,
+    // cond_abstime is the abstime of pthread_cond_timedwait after wait_us.
+    static void init_cond(pthread_cond_t *cond);
+    static void cond_abstime(int64_t wait_us, struct timespec *abstime);
+
     static time_t now();
     static struct tm now_tm();
     static std::string now_utctime();
+    // now_utctime of the calling thread, formatted again once a second
+    static const char * cached_utctime();
     static std::string now_gmttime();
     static std::string timestamp_to_utctime(time_t);
     static std::string timestamp_to_gmttime(time_t);
+    // -1 when the text is no valid time, the utc time is RFC 3339.
     static int64_t utctime_to_timestamp(const std::string &);
     static int64_t gmttime_to_timestamp(const std::string &);
     static int64_t get_utc_offset();
 
+    // now_gmttime of the calling thread, formatted again once a second, for
+    // Date and If-Modified-Since headers.
+    static const char * cached_gmttime();
+
+    // Dates by days-from-civil arithmetic instead of strftime, strptime and
+    // mktime, no time zone or libc lock involved. Timestamps are seconds
+    // since the epoch in UTC, years 0 to 9999. The formatting writes
+    // GMT_FORMAT_LENGTH or UTC_FORMAT_LENGTH characters and no terminator,
+    // 0 when the year is out of range.
+    static size_t format_gmttime(int64_t ts, char *buffer);
+    static size_t format_utctime(int64_t ts, char *buffer);
+    // An IMF-fixdate or one of the obsolete RFC 850 and asctime forms, the
+    // three formats of RFC 7231 section 7.1.1.1. RET_ILLEGAL_ARGUMENT for
+    // anything else, ts is left unchanged then.
+    static int parse_http_date(const StringPiece &src, int64_t *ts);
+    // An RFC 3339 date-time, the fraction of the second is dropped.
+    static int parse_rfc3339(const StringPiece &src, int64_t *ts);
+
     static const char * UTC_FORMAT;
     static const char * GMT_FORMAT;
     static const int UTC_FORMAT_LENGTH;
+    static const int GMT_FORMAT_LENGTH;
 
     class TimeUtilInitializer {
     public:
@@ -70,9 +134,10 @@ private:
     static TimeUtilInitializer  _s_initializer;
 };
 
-// Hmac encryption type, here just need sha1 and others can be added.
+// Hmac encryption type, see common/sha.h for the incremental interface.
 enum hmac_type_t {
-    HMAC_TYPE_SHA1 = 1
+    HMAC_TYPE_SHA1 = 1,
+    HMAC_TYPE_SHA256 = 2
 };
 
 class StringUtil {
@@ -83,35 +148,155 @@ public:
     static std::string trim(const std::string &src, const std::string &c=EMPTY_CHARS);
     static std::string ltrim(const std::string &src, const std::string &c=EMPTY_CHARS);
     static std::string rtrim(const std::string &src, const std::string &c=EMPTY_CHARS);
+    // The part of src without the characters of c at the ends, no copy.
+    static StringPiece trim_view(const StringPiece &src, const StringPiece &c=EMPTY_CHARS);
+    static StringPiece ltrim_view(const StringPiece &src, const StringPiece &c=EMPTY_CHARS);
+    static StringPiece rtrim_view(const StringPiece &src, const StringPiece &c=EMPTY_CHARS);
+    static void trim_in_place(std::string *str, const StringPiece &c=EMPTY_CHARS);
 
     static std::string num_to_string(int num);
+    // Leading digits after blanks, 0 when there are none or they overflow.
     static uint64_t string_to_num(std::string &str, uint8_t base=10);
+
+    // Integers of every width in base 2, 8, 10 or 16, without locale or
+    // allocation. format_num writes at most MAX_NUM_SIZE characters and no
+    // terminator and returns their count, 0 for another base. Negative
+    // numbers get a '-' in every base, hex digits are lowercase.
+    static const size_t MAX_NUM_SIZE = 66;
+    static size_t format_num(int value, char *buffer, int base=10)
+    {
+        return format_signed(value, buffer, base);
+    }
+    static size_t format_num(long value, char *buffer, int base=10)
+    {
+        return format_signed(value, buffer, base);
+    }
+    static size_t format_num(long long value, char *buffer, int base=10)
+    {
+        return format_signed(value, buffer, base);
+    }
+    static size_t format_num(unsigned int value, char *buffer, int base=10)
+    {
+        return format_unsigned(value, buffer, base);
+    }
+    static size_t format_num(unsigned long value, char *buffer, int base=10)
+    {
+        return format_unsigned(value, buffer, base);
+    }
+    static size_t format_num(unsigned long long value, char *buffer, int base=10)
+    {
+        return format_unsigned(value, buffer, base);
+    }
+    template <typename T>
+    static void append_num(T value, std::string *output, int base=10)
+    {
+        char buffer[MAX_NUM_SIZE];
+        output->append(buffer, format_num(value, buffer, base));
+    }
+
+    // The whole of src must be the number: an optional sign, "0x" allowed in
+    // base 16, no blanks. RET_ILLEGAL_ARGUMENT on anything else or when the
+    // value does not fit, value is left unchanged then.
+    static int parse_num(const StringPiece &src, short *value, int base=10);
+    static int parse_num(const StringPiece &src, int *value, int base=10);
+    static int parse_num(const StringPiece &src, long *value, int base=10);
+    static int parse_num(const StringPiece &src, long long *value, int base=10);
+    static int parse_num(const StringPiece &src, unsigned short *value, int base=10);
+    static int parse_num(const StringPiece &src, unsigned int *value, int base=10);
+    static int parse_num(const StringPiece &src, unsigned long *value, int base=10);
+    static int parse_num(const StringPiece &src, unsigned long long *value, int base=10);
+    // The whole delimiter separates the items, the last of max_items holds
+    // the rest of src, max_items < 0 for no limit. See StringSplitter.
     static int split(const std::string &src, const std::string &delimiter,
             int max_items, std::vector<std::string> * result);
+    static int split(const StringPiece &src, const StringPiece &delimiter,
+            int max_items, std::vector<StringPiece> * result);
 
+    // ASCII only, see Ascii.
     static int lower(const std::string &src, std::string &output);
     static int upper(const std::string &src, std::string &output);
     static std::string lower(const std::string &src);
     static std::string upper(const std::string &src);
+    static void lower_in_place(std::string *str);
+    static void upper_in_place(std::string *str);
 
     static std::string hex(unsigned char c);
     static std::string hex(const std::string &src);
 
     static std::string base64_encode(const std::string &src);
+    // Invalid input decodes to an empty string.
     static std::string base64_decode(const std::string &src);
+    // Append to output, the decoding leaves it unchanged on invalid input.
+    static void base64_encode(const std::string &src, std::string *output);
+    static int base64_decode(const std::string &src, std::string *output);
     static std::string url_encode(const std::string &src, bool=true);
     static std::string url_decode(const std::string &src);
+    // Append to output, see UrlCodec.
+    static void url_encode(const std::string &src, std::string *output, bool encode_slash=true);
+    static void url_decode(const std::string &src, std::string *output);
 
+    // The raw digest, RET_ILLEGAL_ARGUMENT for an unknown type.
     static int hmac(int type, const std::string &key, const std::string &data, std::string *result);
+    // Lowercase hex of HMAC-SHA256 of src keyed by sk.
     static std::string sha256hex(const std::string &src, const std::string &sk);
-    static int iconv(const std::string &, const std::string &, const std::string &, std::string *);
+    // Append src converted between charsets known to iconv to output, from
+    // UTF-8 to UTF-8 only validates it. RET_ILLEGAL_ARGUMENT leaves output
+    // unchanged, see CharsetOutputStream for bodies.
+    static int iconv(const std::string &from_charset, const std::string &to_charset,
+            const std::string &src, std::string *output);
 
 private:
+    static size_t format_signed(long long value, char *buffer, int base);
+    static size_t format_unsigned(unsigned long long value, char *buffer, int base);
+    static int parse_signed(const StringPiece &src, int base, long long min, long long max,
+            long long *value);
+    static int parse_unsigned(const StringPiece &src, int base, unsigned long long max,
+            unsigned long long *value);
+
     static bool is_hex_char(unsigned char c);
-    static inline unsigned char base64_decode_char(const unsigned char);
     const static char * HEX_CHARS;
     const static char * EMPTY_CHARS;
-    const static char * BASE64_CHARS;
+};
+
+/**
+ * Items of src separated by the whole delimiter as views into src, the
+ * same items as StringUtil::split without a vector or copies:
+ *
+ *     StringSplitter items(line, ",");
+ *     StringPiece item;
+ *     while (items.next(&item)) { ... }
+ */
+class StringSplitter {
+public:
+    StringSplitter(const StringPiece &src, const StringPiece &delimiter, int max_items = -1) :
+            _rest(src), _delimiter(delimiter), _items_left(max_items), _done(false)
+    {
+        // nothing to do
+    }
+
+    bool next(StringPiece *item)
+    {
+        if (_done) {
+            return false;
+        }
+        size_t pos = _items_left >= 0 && _items_left <= 1 ? std::string::npos
+                : (_delimiter.empty() ? std::string::npos : _rest.find(_delimiter));
+        if (pos == std::string::npos) {
+            *item = _rest;
+            _done = true;
+            return true;
+        }
+        *item = _rest.substr(0, pos);
+        _rest.remove_prefix(pos + _delimiter.size());
+        --_items_left;
+        return true;
+    }
+
+private:
+    StringPiece _rest;
+    StringPiece _delimiter;
+    int         _items_left;
+    bool        _done;
 };
 
 // Return code facilies
@@ -123,6 +308,14 @@ enum ret_code_t {
     RET_ILLEGAL_ARGUMENT,
     RET_FILE_INVALID,
     RET_ILLEGAL_OPERATION,
+    RET_NO_AVAILABLE_ENDPOINT,
+    RET_CIRCUIT_OPEN,
+    RET_RATE_LIMITED,
+    RET_OVERLOADED,
+    RET_DEADLINE_EXCEEDED,
+    RET_TIMEOUT,
+    RET_CHECKSUM_MISMATCH,
+    RET_CHECKSUM_MISSING,
 };
 const char * stringfy_ret_code(int code);
 
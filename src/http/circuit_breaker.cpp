@@ -0,0 +1,297 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#include "http/circuit_breaker.h"
+#include "common/util.h"
+
+BEGIN_NAMESPACE
+
+const char * stringfy_breaker_state(int state)
+{
+    switch (state) {
+        case BREAKER_STATE_CLOSED:
+            return "closed";
+        case BREAKER_STATE_OPEN:
+            return "open";
+        case BREAKER_STATE_HALF_OPEN:
+            return "half_open";
+        default:
+            return "unknown";
+    }
+}
+
+CircuitBreaker::CircuitBreaker(const CircuitBreakerOptions &options) :
+    _options(options),
+    _state(BREAKER_STATE_CLOSED),
+    _generation(0),
+    _open_until_ms(0),
+    _consecutive_failures(0),
+    _probes_inflight(0),
+    _probes_succeeded(0),
+    _trip_count(0),
+    _rejected_count(0)
+{
+    pthread_mutex_init(&_mutex, NULL);
+    if (_options.half_open_probes == 0) {
+        _options.half_open_probes = 1;
+    }
+    _bucket_ms = _options.window_ms / WINDOW_BUCKETS;
+    if (_bucket_ms <= 0) {
+        _bucket_ms = 1;
+    }
+    for (int i = 0; i < WINDOW_BUCKETS; ++i) {
+        _bucket_start[i] = 0;
+        _bucket_requests[i] = 0;
+        _bucket_failures[i] = 0;
+    }
+}
+
+CircuitBreaker::~CircuitBreaker()
+{
+    pthread_mutex_destroy(&_mutex);
+}
+
+bool CircuitBreaker::allow(uint64_t *generation)
+{
+    bool allowed = true;
+
+    pthread_mutex_lock(&_mutex);
+    if (_state == BREAKER_STATE_OPEN) {
+        if (TimeUtil::coarse_monotonic_ms() >= _open_until_ms) {
+            _state = BREAKER_STATE_HALF_OPEN;
+            ++_generation;
+            _probes_inflight = 0;
+            _probes_succeeded = 0;
+        } else {
+            allowed = false;
+        }
+    }
+    if (_state == BREAKER_STATE_HALF_OPEN) {
+        if (_probes_inflight + _probes_succeeded < _options.half_open_probes) {
+            ++_probes_inflight;
+        } else {
+            allowed = false;
+        }
+    }
+    if (!allowed) {
+        ++_rejected_count;
+    }
+    *generation = _generation;
+    pthread_mutex_unlock(&_mutex);
+
+    return allowed;
+}
+
+void CircuitBreaker::cancel(uint64_t generation)
+{
+    pthread_mutex_lock(&_mutex);
+    if (generation == _generation && _state == BREAKER_STATE_HALF_OPEN
+            && _probes_inflight > 0) {
+        --_probes_inflight;
+    }
+    pthread_mutex_unlock(&_mutex);
+}
+
+void CircuitBreaker::report(uint64_t generation, bool success)
+{
+    int64_t now_ms = TimeUtil::coarse_monotonic_ms();
+
+    pthread_mutex_lock(&_mutex);
+    if (generation != _generation) {
+        // admitted before the last trip or close, it tells nothing new
+        pthread_mutex_unlock(&_mutex);
+        return;
+    }
+
+    if (_state == BREAKER_STATE_HALF_OPEN) {
+        if (_probes_inflight > 0) {
+            --_probes_inflight;
+        }
+        if (!success) {
+            trip(now_ms);
+        } else if (++_probes_succeeded >= _options.half_open_probes) {
+            close();
+        }
+        pthread_mutex_unlock(&_mutex);
+        return;
+    }
+
+    advance_window(now_ms);
+    int idx = (now_ms / _bucket_ms) % WINDOW_BUCKETS;
+    ++_bucket_requests[idx];
+    if (success) {
+        _consecutive_failures = 0;
+        pthread_mutex_unlock(&_mutex);
+        return;
+    }
+
+    ++_bucket_failures[idx];
+    ++_consecutive_failures;
+    if (_options.consecutive_failures > 0
+            && _consecutive_failures >= _options.consecutive_failures) {
+        trip(now_ms);
+        pthread_mutex_unlock(&_mutex);
+        return;
+    }
+
+    if (_options.error_rate_percent > 0) {
+        uint64_t requests = 0;
+        uint64_t failures = 0;
+        for (int i = 0; i < WINDOW_BUCKETS; ++i) {
+            requests += _bucket_requests[i];
+            failures += _bucket_failures[i];
+        }
+        if (requests >= _options.min_requests && requests > 0
+                && failures * 100 >= requests * _options.error_rate_percent) {
+            trip(now_ms);
+        }
+    }
+    pthread_mutex_unlock(&_mutex);
+}
+
+breaker_state_t CircuitBreaker::get_state() const
+{
+    pthread_mutex_lock(&_mutex);
+    breaker_state_t state = _state;
+    pthread_mutex_unlock(&_mutex);
+    return state;
+}
+
+uint64_t CircuitBreaker::get_trip_count() const
+{
+    pthread_mutex_lock(&_mutex);
+    uint64_t count = _trip_count;
+    pthread_mutex_unlock(&_mutex);
+    return count;
+}
+
+uint64_t CircuitBreaker::get_rejected_count() const
+{
+    pthread_mutex_lock(&_mutex);
+    uint64_t count = _rejected_count;
+    pthread_mutex_unlock(&_mutex);
+    return count;
+}
+
+void CircuitBreaker::get_stat(CircuitBreakerStat *stat) const
+{
+    int64_t oldest_ms = TimeUtil::coarse_monotonic_ms() - _options.window_ms;
+
+    pthread_mutex_lock(&_mutex);
+    stat->state = _state;
+    stat->trip_count = _trip_count;
+    stat->rejected_count = _rejected_count;
+    stat->window_requests = 0;
+    stat->window_failures = 0;
+    for (int i = 0; i < WINDOW_BUCKETS; ++i) {
+        if (_bucket_start[i] > oldest_ms) {
+            stat->window_requests += _bucket_requests[i];
+            stat->window_failures += _bucket_failures[i];
+        }
+    }
+    pthread_mutex_unlock(&_mutex);
+}
+
+void CircuitBreaker::trip(int64_t now_ms)
+{
+    _state = BREAKER_STATE_OPEN;
+    ++_generation;
+    _open_until_ms = now_ms + _options.open_ms;
+    _consecutive_failures = 0;
+    _probes_inflight = 0;
+    _probes_succeeded = 0;
+    ++_trip_count;
+    for (int i = 0; i < WINDOW_BUCKETS; ++i) {
+        _bucket_requests[i] = 0;
+        _bucket_failures[i] = 0;
+    }
+}
+
+void CircuitBreaker::close()
+{
+    _state = BREAKER_STATE_CLOSED;
+    ++_generation;
+    _consecutive_failures = 0;
+    _probes_inflight = 0;
+    _probes_succeeded = 0;
+}
+
+void CircuitBreaker::advance_window(int64_t now_ms)
+{
+    int64_t start = now_ms - now_ms % _bucket_ms;
+    int idx = (now_ms / _bucket_ms) % WINDOW_BUCKETS;
+    if (_bucket_start[idx] != start) {
+        _bucket_start[idx] = start;
+        _bucket_requests[idx] = 0;
+        _bucket_failures[idx] = 0;
+    }
+    // buckets not touched for a whole window are stale
+    for (int i = 0; i < WINDOW_BUCKETS; ++i) {
+        if (_bucket_start[i] <= now_ms - _options.window_ms) {
+            _bucket_requests[i] = 0;
+            _bucket_failures[i] = 0;
+        }
+    }
+}
+
+CircuitBreakerRegistry::CircuitBreakerRegistry(const CircuitBreakerOptions &options) :
+    _options(options)
+{
+    pthread_rwlock_init(&_lock, NULL);
+}
+
+CircuitBreakerRegistry::~CircuitBreakerRegistry()
+{
+    std::map<std::string, CircuitBreaker *>::iterator it = _breakers.begin();
+    for (; it != _breakers.end(); ++it) {
+        delete it->second;
+    }
+    _breakers.clear();
+    pthread_rwlock_destroy(&_lock);
+}
+
+CircuitBreaker * CircuitBreakerRegistry::get(const std::string &host)
+{
+    CircuitBreaker *breaker = NULL;
+
+    pthread_rwlock_rdlock(&_lock);
+    std::map<std::string, CircuitBreaker *>::const_iterator it = _breakers.find(host);
+    if (it != _breakers.end()) {
+        breaker = it->second;
+    }
+    pthread_rwlock_unlock(&_lock);
+    if (breaker != NULL) {
+        return breaker;
+    }
+
+    pthread_rwlock_wrlock(&_lock);
+    CircuitBreaker *&slot = _breakers[host];
+    if (slot == NULL) {
+        slot = new CircuitBreaker(_options);
+    }
+    breaker = slot;
+    pthread_rwlock_unlock(&_lock);
+    return breaker;
+}
+
+int CircuitBreakerRegistry::get_stats(std::vector<CircuitBreakerStat> *stats) const
+{
+    pthread_rwlock_rdlock(&_lock);
+    std::map<std::string, CircuitBreaker *>::const_iterator it = _breakers.begin();
+    for (; it != _breakers.end(); ++it) {
+        CircuitBreakerStat stat;
+        stat.host = it->first;
+        it->second->get_stat(&stat);
+        stats->push_back(stat);
+    }
+    pthread_rwlock_unlock(&_lock);
+    return 0;
+}
+
+END_NAMESPACE
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
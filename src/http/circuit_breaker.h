@@ -0,0 +1,127 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#ifndef HTTP4CPP_HTTP_CIRCUIT_BREAKER_H
+#define HTTP4CPP_HTTP_CIRCUIT_BREAKER_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "common/common.h"
+
+BEGIN_NAMESPACE
+
+enum breaker_state_t {
+    BREAKER_STATE_CLOSED = 0,
+    BREAKER_STATE_OPEN,
+    BREAKER_STATE_HALF_OPEN
+};
+
+const char * stringfy_breaker_state(int state);
+
+struct CircuitBreakerOptions {
+    CircuitBreakerOptions() :
+        consecutive_failures(5),
+        error_rate_percent(50),
+        min_requests(20),
+        window_ms(10 * 1000),
+        open_ms(5 * 1000),
+        half_open_probes(3)
+    {
+        // nothing to do
+    }
+
+    uint32_t consecutive_failures;  // trip after so many failures in a row, 0 disables
+    uint32_t error_rate_percent;    // trip when the window error rate reaches it, 0 disables
+    uint32_t min_requests;          // requests needed in the window before the rate counts
+    int64_t  window_ms;             // sliding window length for the error rate
+    int64_t  open_ms;               // time spent open before probing
+    uint32_t half_open_probes;      // probes let through, all must succeed to close
+};
+
+struct CircuitBreakerStat {
+    std::string     host;
+    breaker_state_t state;
+    uint64_t        trip_count;
+    uint64_t        rejected_count;
+    uint64_t        window_requests;
+    uint64_t        window_failures;
+};
+
+class CircuitBreaker {
+public:
+    explicit CircuitBreaker(const CircuitBreakerOptions &options);
+    ~CircuitBreaker();
+
+    // Return false when the request must fail fast without touching the host,
+    // else generation is the state the request was admitted in.
+    bool allow(uint64_t *generation);
+    // Results of requests admitted before the last state change are ignored,
+    // so only probes admitted while half open decide whether to close.
+    void report(uint64_t generation, bool success);
+    // For a request that failed on this side, e.g. on the caller's deadline,
+    // frees its probe slot without counting a result.
+    void cancel(uint64_t generation);
+
+    breaker_state_t get_state() const;
+    uint64_t get_trip_count() const;
+    uint64_t get_rejected_count() const;
+    void get_stat(CircuitBreakerStat *stat) const;
+
+private:
+    CircuitBreaker(const CircuitBreaker &);
+    CircuitBreaker & operator=(const CircuitBreaker &);
+
+    void trip(int64_t now_ms);
+    void close();
+    void advance_window(int64_t now_ms);
+
+    const static int WINDOW_BUCKETS = 10;
+
+    CircuitBreakerOptions   _options;
+    mutable pthread_mutex_t _mutex;
+    breaker_state_t         _state;
+    uint64_t                _generation;        // bumped on every state change
+    int64_t                 _open_until_ms;
+    uint32_t                _consecutive_failures;
+    uint32_t                _probes_inflight;
+    uint32_t                _probes_succeeded;
+    uint64_t                _trip_count;
+    uint64_t                _rejected_count;
+    int64_t                 _bucket_ms;
+    int64_t                 _bucket_start[WINDOW_BUCKETS];
+    uint32_t                _bucket_requests[WINDOW_BUCKETS];
+    uint32_t                _bucket_failures[WINDOW_BUCKETS];
+};
+
+// Breakers keyed by "host:port", created on first use and kept for the
+// registry's lifetime.
+class CircuitBreakerRegistry {
+public:
+    explicit CircuitBreakerRegistry(const CircuitBreakerOptions &options);
+    ~CircuitBreakerRegistry();
+
+    CircuitBreaker * get(const std::string &host);
+    int get_stats(std::vector<CircuitBreakerStat> *stats) const;
+
+private:
+    CircuitBreakerRegistry(const CircuitBreakerRegistry &);
+    CircuitBreakerRegistry & operator=(const CircuitBreakerRegistry &);
+
+    CircuitBreakerOptions                   _options;
+    mutable pthread_rwlock_t                _lock;
+    std::map<std::string, CircuitBreaker *> _breakers;
+};
+
+END_NAMESPACE
+#endif
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,343 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#include <stdio.h>
+
+#include <algorithm>
+
+#include "http/endpoint_set.h"
+#include "common/util.h"
+
+BEGIN_NAMESPACE
+
+EndpointSet::EndpointSet(lb_policy_t policy) :
+    _policy(policy),
+    _eject_failures(5),
+    _base_eject_ms(30 * 1000),
+    _max_eject_ms(300 * 1000)
+{
+    pthread_rwlock_init(&_lock, NULL);
+}
+
+EndpointSet::~EndpointSet()
+{
+    for (size_t i = 0; i < _endpoints.size(); ++i) {
+        delete _endpoints[i];
+    }
+    _endpoints.clear();
+    _active.clear();
+    _ring.clear();
+    pthread_rwlock_destroy(&_lock);
+}
+
+int EndpointSet::add_endpoint(const std::string &address, uint32_t weight)
+{
+    if (address.empty()) {
+        return RET_ILLEGAL_ARGUMENT;
+    }
+
+    pthread_rwlock_wrlock(&_lock);
+    for (size_t i = 0; i < _active.size(); ++i) {
+        if (_active[i]->_address == address) {
+            pthread_rwlock_unlock(&_lock);
+            return RET_ILLEGAL_ARGUMENT;
+        }
+    }
+
+    // An address that comes back gets its old endpoint and history, a removed
+    // one is freed once no request holds it any more.
+    reclaim_removed();
+    Endpoint *endpoint = NULL;
+    for (size_t i = 0; i < _endpoints.size(); ++i) {
+        if (_endpoints[i]->_address == address) {
+            endpoint = _endpoints[i];
+            endpoint->_weight = weight == 0 ? 1 : weight;
+            endpoint->_removed = false;
+            break;
+        }
+    }
+    if (endpoint == NULL) {
+        endpoint = new Endpoint(address, weight);
+        _endpoints.push_back(endpoint);
+    }
+    _active.push_back(endpoint);
+    rebuild_ring();
+    pthread_rwlock_unlock(&_lock);
+
+    DEBUG("add endpoint %s weight %u", address.c_str(), endpoint->_weight);
+    return RET_OK;
+}
+
+int EndpointSet::remove_endpoint(const std::string &address)
+{
+    int ret = RET_ILLEGAL_ARGUMENT;
+
+    pthread_rwlock_wrlock(&_lock);
+    std::vector<Endpoint *>::iterator it = _active.begin();
+    for (; it != _active.end(); ++it) {
+        if ((*it)->_address == address) {
+            (*it)->_removed = true;
+            _active.erase(it);
+            rebuild_ring();
+            ret = RET_OK;
+            break;
+        }
+    }
+    reclaim_removed();
+    pthread_rwlock_unlock(&_lock);
+
+    return ret;
+}
+
+size_t EndpointSet::size() const
+{
+    pthread_rwlock_rdlock(&_lock);
+    size_t size = _active.size();
+    pthread_rwlock_unlock(&_lock);
+    return size;
+}
+
+void EndpointSet::set_ejection(uint32_t consecutive_failures, int64_t base_eject_ms,
+        int64_t max_eject_ms)
+{
+    _eject_failures = consecutive_failures;
+    _base_eject_ms = base_eject_ms;
+    _max_eject_ms = max_eject_ms < base_eject_ms ? base_eject_ms : max_eject_ms;
+}
+
+Endpoint * EndpointSet::select(const std::string &hash_key)
+{
+    int64_t now_ms = TimeUtil::coarse_monotonic_ms();
+    Endpoint *endpoint = NULL;
+
+    pthread_rwlock_rdlock(&_lock);
+    if (_policy == LB_POLICY_CONSISTENT_HASH) {
+        endpoint = select_hash(hash_key, now_ms);
+    } else {
+        endpoint = select_p2c(now_ms);
+    }
+    if (endpoint != NULL) {
+        __sync_fetch_and_add(&endpoint->_outstanding, 1);
+    }
+    pthread_rwlock_unlock(&_lock);
+
+    return endpoint;
+}
+
+void EndpointSet::release(Endpoint *endpoint, bool success, int64_t latency_us)
+{
+    if (endpoint == NULL) {
+        return;
+    }
+
+    __sync_fetch_and_add(&endpoint->_total_requests, 1);
+
+    // A failing endpoint usually fails fast, never let a failure make it look
+    // faster than it was or P2C turns it into a black hole.
+    int64_t old_ewma = endpoint->get_ewma_latency_us();
+    int64_t sample = latency_us < 0 ? 0 : latency_us;
+    if (!success && sample < old_ewma * 2) {
+        sample = old_ewma * 2;
+    }
+    while (true) {
+        int64_t new_ewma = old_ewma == 0 ? sample :
+                old_ewma + ((sample - old_ewma) >> EWMA_SHIFT);
+        int64_t cur = __sync_val_compare_and_swap(&endpoint->_ewma_latency_us,
+                old_ewma, new_ewma);
+        if (cur == old_ewma) {
+            break;
+        }
+        old_ewma = cur;
+    }
+
+    if (success) {
+        __sync_lock_test_and_set(&endpoint->_consecutive_failures, 0);
+        __sync_lock_test_and_set(&endpoint->_eject_times, 0);
+    } else {
+        __sync_fetch_and_add(&endpoint->_total_failures, 1);
+        record_failure(endpoint);
+    }
+    // the last touch, a removed endpoint may be freed right after
+    __sync_fetch_and_sub(&endpoint->_outstanding, 1);
+}
+
+void EndpointSet::record_failure(Endpoint *endpoint)
+{
+    int64_t failures = __sync_add_and_fetch(&endpoint->_consecutive_failures, 1);
+    if (_eject_failures <= 0 || failures < _eject_failures) {
+        return;
+    }
+
+    if (__sync_bool_compare_and_swap(&endpoint->_consecutive_failures, failures, 0)) {
+        // doubles with every ejection in a row, up to max_eject_ms
+        int64_t times = __sync_add_and_fetch(&endpoint->_eject_times, 1);
+        int64_t eject_ms = _base_eject_ms;
+        for (int64_t i = 1; i < times && eject_ms < _max_eject_ms; ++i) {
+            eject_ms *= 2;
+        }
+        if (eject_ms > _max_eject_ms) {
+            eject_ms = _max_eject_ms;
+        }
+        __sync_lock_test_and_set(&endpoint->_ejected_until_ms,
+                TimeUtil::coarse_monotonic_ms() + eject_ms);
+        WARN("eject endpoint %s for %lld ms after %lld consecutive failures",
+                endpoint->_address.c_str(), (long long)eject_ms, (long long)failures);
+    }
+}
+
+void EndpointSet::cancel(Endpoint *endpoint)
+{
+    if (endpoint != NULL) {
+        __sync_fetch_and_sub(&endpoint->_outstanding, 1);
+    }
+}
+
+int EndpointSet::get_endpoints(std::vector<const Endpoint *> *endpoints) const
+{
+    pthread_rwlock_rdlock(&_lock);
+    endpoints->assign(_active.begin(), _active.end());
+    pthread_rwlock_unlock(&_lock);
+    return 0;
+}
+
+Endpoint * EndpointSet::select_p2c(int64_t now_ms)
+{
+    size_t n = _active.size();
+    if (n == 0) {
+        return NULL;
+    }
+    if (n == 1) {
+        return _active[0];
+    }
+
+    size_t first = next_random() % n;
+    size_t second = next_random() % (n - 1);
+    if (second >= first) {
+        ++second;
+    }
+
+    // Probe forward from the random picks for available endpoints, fall back
+    // to the raw picks (panic mode) when everything is ejected.
+    Endpoint *a = NULL;
+    Endpoint *b = NULL;
+    for (size_t i = 0; i < n && a == NULL; ++i) {
+        Endpoint *e = _active[(first + i) % n];
+        if (e->is_available(now_ms)) {
+            a = e;
+        }
+    }
+    for (size_t i = 0; i < n && b == NULL; ++i) {
+        Endpoint *e = _active[(second + i) % n];
+        if (e != a && e->is_available(now_ms)) {
+            b = e;
+        }
+    }
+    if (a == NULL) {
+        a = _active[first];
+        b = _active[second];
+    } else if (b == NULL) {
+        return a;
+    }
+
+    double score_a = static_cast<double>(a->get_outstanding() + 1) *
+            (a->get_ewma_latency_us() + 1) / a->_weight;
+    double score_b = static_cast<double>(b->get_outstanding() + 1) *
+            (b->get_ewma_latency_us() + 1) / b->_weight;
+    return score_a <= score_b ? a : b;
+}
+
+Endpoint * EndpointSet::select_hash(const std::string &hash_key, int64_t now_ms)
+{
+    if (_ring.empty()) {
+        return NULL;
+    }
+
+    RingNode target;
+    target.hash = hash(hash_key.data(), hash_key.size(), 0);
+    target.endpoint = NULL;
+    std::vector<RingNode>::const_iterator it = std::lower_bound(
+            _ring.begin(), _ring.end(), target);
+    size_t start = it == _ring.end() ? 0 : it - _ring.begin();
+
+    // Walk clockwise past ejected endpoints so only their keys move.
+    size_t n = _ring.size();
+    for (size_t i = 0; i < n; ++i) {
+        Endpoint *e = _ring[(start + i) % n].endpoint;
+        if (e->is_available(now_ms)) {
+            return e;
+        }
+    }
+    return _ring[start].endpoint;
+}
+
+void EndpointSet::reclaim_removed()
+{
+    size_t kept = 0;
+    for (size_t i = 0; i < _endpoints.size(); ++i) {
+        Endpoint *e = _endpoints[i];
+        if (e->_removed && e->get_outstanding() == 0) {
+            DEBUG("free removed endpoint %s", e->_address.c_str());
+            delete e;
+        } else {
+            _endpoints[kept++] = e;
+        }
+    }
+    _endpoints.resize(kept);
+}
+
+void EndpointSet::rebuild_ring()
+{
+    _ring.clear();
+    char buf[32];
+    for (size_t i = 0; i < _active.size(); ++i) {
+        Endpoint *e = _active[i];
+        int nodes = e->_weight * VIRTUAL_NODES_PER_WEIGHT;
+        uint64_t seed = hash(e->_address.data(), e->_address.size(), 0);
+        for (int v = 0; v < nodes; ++v) {
+            int len = snprintf(buf, sizeof(buf), "#%d", v);
+            RingNode node;
+            node.hash = hash(buf, len, seed);
+            node.endpoint = e;
+            _ring.push_back(node);
+        }
+    }
+    std::sort(_ring.begin(), _ring.end());
+}
+
+uint64_t EndpointSet::hash(const char *data, size_t size, uint64_t seed)
+{
+    // FNV-1a followed by the murmur3 finalizer for good avalanche on short keys
+    uint64_t h = 14695981039346656037ULL ^ seed;
+    for (size_t i = 0; i < size; ++i) {
+        h ^= static_cast<unsigned char>(data[i]);
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+uint64_t EndpointSet::next_random()
+{
+    static __thread uint64_t s_state = 0;
+    if (s_state == 0) {
+        s_state = static_cast<uint64_t>(TimeUtil::now_us()) ^
+                reinterpret_cast<uintptr_t>(&s_state) ^ 0x9e3779b97f4a7c15ULL;
+    }
+    // xorshift64*
+    s_state ^= s_state >> 12;
+    s_state ^= s_state << 25;
+    s_state ^= s_state >> 27;
+    return s_state * 2685821657736338717ULL;
+}
+
+END_NAMESPACE
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,179 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#ifndef HTTP4CPP_HTTP_ENDPOINT_SET_H
+#define HTTP4CPP_HTTP_ENDPOINT_SET_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include <string>
+#include <vector>
+
+#include "common/common.h"
+
+BEGIN_NAMESPACE
+
+// Policy used by EndpointSet::select to pick a concrete endpoint.
+enum lb_policy_t {
+    LB_POLICY_P2C = 0,          // power of two choices on outstanding * ewma latency
+    LB_POLICY_CONSISTENT_HASH   // ketama style ring keyed on the request hash key
+};
+
+class Endpoint {
+public:
+    explicit Endpoint(const std::string &address, uint32_t weight) :
+        _address(address),
+        _weight(weight == 0 ? 1 : weight),
+        _removed(false),
+        _outstanding(0),
+        _ewma_latency_us(0),
+        _consecutive_failures(0),
+        _ejected_until_ms(0),
+        _eject_times(0),
+        _total_requests(0),
+        _total_failures(0)
+    {
+        // nothing to do
+    }
+
+    const std::string & get_address() const
+    {
+        return _address;
+    }
+
+    uint32_t get_weight() const
+    {
+        return _weight;
+    }
+
+    int64_t get_outstanding() const
+    {
+        return __sync_fetch_and_add(const_cast<int64_t *>(&_outstanding), 0);
+    }
+
+    int64_t get_ewma_latency_us() const
+    {
+        return __sync_fetch_and_add(const_cast<int64_t *>(&_ewma_latency_us), 0);
+    }
+
+    int64_t get_ejected_until_ms() const
+    {
+        return __sync_fetch_and_add(const_cast<int64_t *>(&_ejected_until_ms), 0);
+    }
+
+    uint64_t get_total_requests() const
+    {
+        return __sync_fetch_and_add(const_cast<uint64_t *>(&_total_requests), 0);
+    }
+
+    uint64_t get_total_failures() const
+    {
+        return __sync_fetch_and_add(const_cast<uint64_t *>(&_total_failures), 0);
+    }
+
+    bool is_available(int64_t now_ms) const
+    {
+        return !_removed && get_ejected_until_ms() <= now_ms;
+    }
+
+private:
+    friend class EndpointSet;
+
+    std::string _address;
+    uint32_t    _weight;
+    bool        _removed;
+    int64_t     _outstanding;
+    int64_t     _ewma_latency_us;
+    int64_t     _consecutive_failures;
+    int64_t     _ejected_until_ms;
+    int64_t     _eject_times;
+    uint64_t    _total_requests;
+    uint64_t    _total_failures;
+};
+
+/**
+ * A set of concrete endpoints (e.g. "http://10.0.0.1:8080") serving one logical
+ * service. select/release are safe to call concurrently from many threads, the
+ * endpoint list itself is protected by a read-write lock taken exclusively only
+ * by add_endpoint/remove_endpoint. A removed endpoint lives on until its last
+ * request is released, re-adding the address before that revives it.
+ */
+class EndpointSet {
+public:
+    explicit EndpointSet(lb_policy_t policy = LB_POLICY_P2C);
+    ~EndpointSet();
+
+    int add_endpoint(const std::string &address, uint32_t weight = 1);
+    int remove_endpoint(const std::string &address);
+    size_t size() const;
+
+    void set_policy(lb_policy_t policy)
+    {
+        _policy = policy;
+    }
+
+    lb_policy_t get_policy() const
+    {
+        return _policy;
+    }
+
+    // Eject an endpoint after consecutive_failures failures in a row, for
+    // base_eject_ms doubled with every ejection since its last success and
+    // capped by max_eject_ms. Zero failures disables ejection.
+    void set_ejection(uint32_t consecutive_failures, int64_t base_eject_ms, int64_t max_eject_ms);
+
+    // Pick an endpoint, NULL if the set is empty. The returned endpoint must be
+    // handed back by release() when the request finishes.
+    Endpoint * select(const std::string &hash_key);
+    void release(Endpoint *endpoint, bool success, int64_t latency_us);
+    // Hands back an endpoint whose request never reached it, nothing is recorded.
+    void cancel(Endpoint *endpoint);
+
+    // A pointer turns invalid once its endpoint is removed and idle.
+    int get_endpoints(std::vector<const Endpoint *> *endpoints) const;
+
+private:
+    EndpointSet(const EndpointSet &);
+    EndpointSet & operator=(const EndpointSet &);
+
+    struct RingNode {
+        uint64_t  hash;
+        Endpoint *endpoint;
+
+        bool operator<(const RingNode &other) const
+        {
+            return hash < other.hash;
+        }
+    };
+
+    Endpoint * select_p2c(int64_t now_ms);
+    Endpoint * select_hash(const std::string &hash_key, int64_t now_ms);
+    void record_failure(Endpoint *endpoint);
+    void reclaim_removed();
+    void rebuild_ring();
+
+    static uint64_t hash(const char *data, size_t size, uint64_t seed);
+    static uint64_t next_random();
+
+    lb_policy_t                    _policy;
+    std::vector<Endpoint *>        _endpoints;
+    std::vector<Endpoint *>        _active;
+    std::vector<RingNode>          _ring;
+    mutable pthread_rwlock_t       _lock;
+    int64_t                        _eject_failures;
+    int64_t                        _base_eject_ms;
+    int64_t                        _max_eject_ms;
+
+    const static int VIRTUAL_NODES_PER_WEIGHT = 160;
+    const static int EWMA_SHIFT = 3;
+};
+
+END_NAMESPACE
+#endif
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
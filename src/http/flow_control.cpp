@@ -0,0 +1,260 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#include "http/flow_control.h"
+#include "common/util.h"
+
+BEGIN_NAMESPACE
+
+FlowController::FlowController(const FlowControlOptions &options) :
+    _options(options),
+    _tokens(0),
+    _refill_us(0),
+    _limit(0),
+    _inflight(0),
+    _waiting(0),
+    _ewma_latency_us(0),
+    _last_decrease_us(0),
+    _admitted(0),
+    _rate_limited(0),
+    _overloaded(0)
+{
+    pthread_mutex_init(&_mutex, NULL);
+    TimeUtil::init_cond(&_cond);
+
+    if (_options.burst <= 0) {
+        _options.burst = _options.rate_per_sec < 1 ? 1 : _options.rate_per_sec;
+    }
+    _tokens = _options.burst;
+    _refill_us = TimeUtil::monotonic_us();
+
+    if (_options.min_concurrency == 0) {
+        _options.min_concurrency = 1;
+    }
+    if (_options.max_concurrency > 0 && _options.max_concurrency < _options.min_concurrency) {
+        _options.max_concurrency = _options.min_concurrency;
+    }
+    _limit = _options.initial_concurrency;
+    if (_limit < _options.min_concurrency) {
+        _limit = _options.min_concurrency;
+    }
+    if (_options.max_concurrency > 0 && _limit > _options.max_concurrency) {
+        _limit = _options.max_concurrency;
+    }
+}
+
+FlowController::~FlowController()
+{
+    pthread_cond_destroy(&_cond);
+    pthread_mutex_destroy(&_mutex);
+}
+
+int FlowController::acquire(int64_t max_wait_ms)
+{
+    if (max_wait_ms < 0) {
+        max_wait_ms = _options.max_wait_ms;
+    }
+    int64_t now_us = TimeUtil::monotonic_us();
+    int64_t deadline_us = now_us + max_wait_ms * 1000;
+
+    pthread_mutex_lock(&_mutex);
+    if (_options.rate_per_sec > 0) {
+        refill(now_us);
+        while (_tokens < 1.0) {
+            int64_t wait_us = static_cast<int64_t>(
+                    (1.0 - _tokens) * 1000000 / _options.rate_per_sec) + 1;
+            if (now_us + wait_us > deadline_us) {
+                ++_rate_limited;
+                pthread_mutex_unlock(&_mutex);
+                return RET_RATE_LIMITED;
+            }
+            struct timespec ts;
+            TimeUtil::cond_abstime(wait_us, &ts);
+            ++_waiting;
+            pthread_cond_timedwait(&_cond, &_mutex, &ts);
+            --_waiting;
+            now_us = TimeUtil::monotonic_us();
+            refill(now_us);
+        }
+        _tokens -= 1.0;
+    }
+
+    if (_options.max_concurrency > 0) {
+        while (_inflight >= static_cast<uint32_t>(_limit)) {
+            if (now_us >= deadline_us) {
+                if (_options.rate_per_sec > 0) {
+                    _tokens += 1.0;
+                }
+                ++_overloaded;
+                pthread_mutex_unlock(&_mutex);
+                return RET_OVERLOADED;
+            }
+            struct timespec ts;
+            TimeUtil::cond_abstime(deadline_us - now_us, &ts);
+            ++_waiting;
+            pthread_cond_timedwait(&_cond, &_mutex, &ts);
+            --_waiting;
+            now_us = TimeUtil::monotonic_us();
+        }
+    }
+
+    ++_inflight;
+    ++_admitted;
+    pthread_mutex_unlock(&_mutex);
+    return RET_OK;
+}
+
+void FlowController::release(bool success, int64_t latency_us)
+{
+    int64_t now_us = TimeUtil::monotonic_us();
+
+    pthread_mutex_lock(&_mutex);
+    uint32_t inflight = _inflight;
+    finish();
+    if (_options.max_concurrency == 0) {
+        pthread_mutex_unlock(&_mutex);
+        return;
+    }
+
+    _ewma_latency_us = _ewma_latency_us == 0 ? latency_us :
+            _ewma_latency_us + (latency_us - _ewma_latency_us) / 8;
+    bool slow = _options.latency_threshold_us > 0 && latency_us > _options.latency_threshold_us;
+    if (!success || slow) {
+        if (now_us - _last_decrease_us >= _ewma_latency_us) {
+            _limit *= _options.backoff_ratio;
+            if (_limit < _options.min_concurrency) {
+                _limit = _options.min_concurrency;
+            }
+            _last_decrease_us = now_us;
+            DEBUG("decrease concurrency limit to %u", static_cast<uint32_t>(_limit));
+        }
+    } else if (inflight * 2 >= static_cast<uint32_t>(_limit)) {
+        // only grow while the limit is actually being used
+        _limit += 1.0 / _limit;
+        if (_limit > _options.max_concurrency) {
+            _limit = _options.max_concurrency;
+        }
+    }
+    pthread_mutex_unlock(&_mutex);
+}
+
+void FlowController::cancel()
+{
+    int64_t now_us = TimeUtil::monotonic_us();
+
+    pthread_mutex_lock(&_mutex);
+    if (_options.rate_per_sec > 0) {
+        refill(now_us);
+        _tokens += 1.0;
+        if (_tokens > _options.burst) {
+            _tokens = _options.burst;
+        }
+    }
+    finish();
+    pthread_mutex_unlock(&_mutex);
+}
+
+uint32_t FlowController::get_limit() const
+{
+    pthread_mutex_lock(&_mutex);
+    uint32_t limit = static_cast<uint32_t>(_limit);
+    pthread_mutex_unlock(&_mutex);
+    return limit;
+}
+
+void FlowController::get_stat(FlowControlStat *stat) const
+{
+    pthread_mutex_lock(&_mutex);
+    stat->limit = _options.max_concurrency > 0 ? static_cast<uint32_t>(_limit) : 0;
+    stat->inflight = _inflight;
+    stat->waiting = _waiting;
+    stat->tokens = _tokens;
+    stat->admitted = _admitted;
+    stat->rate_limited = _rate_limited;
+    stat->overloaded = _overloaded;
+    pthread_mutex_unlock(&_mutex);
+}
+
+void FlowController::refill(int64_t now_us)
+{
+    if (now_us <= _refill_us) {
+        return;
+    }
+    _tokens += (now_us - _refill_us) * _options.rate_per_sec / 1000000;
+    if (_tokens > _options.burst) {
+        _tokens = _options.burst;
+    }
+    _refill_us = now_us;
+}
+
+void FlowController::finish()
+{
+    if (_inflight > 0) {
+        --_inflight;
+    }
+    if (_waiting > 0) {
+        pthread_cond_broadcast(&_cond);
+    }
+}
+
+FlowControlRegistry::FlowControlRegistry(const FlowControlOptions &options) :
+    _options(options)
+{
+    pthread_rwlock_init(&_lock, NULL);
+}
+
+FlowControlRegistry::~FlowControlRegistry()
+{
+    std::map<std::string, FlowController *>::iterator it = _controllers.begin();
+    for (; it != _controllers.end(); ++it) {
+        delete it->second;
+    }
+    _controllers.clear();
+    pthread_rwlock_destroy(&_lock);
+}
+
+FlowController * FlowControlRegistry::get(const std::string &host)
+{
+    FlowController *controller = NULL;
+
+    pthread_rwlock_rdlock(&_lock);
+    std::map<std::string, FlowController *>::const_iterator it = _controllers.find(host);
+    if (it != _controllers.end()) {
+        controller = it->second;
+    }
+    pthread_rwlock_unlock(&_lock);
+    if (controller != NULL) {
+        return controller;
+    }
+
+    pthread_rwlock_wrlock(&_lock);
+    FlowController *&slot = _controllers[host];
+    if (slot == NULL) {
+        slot = new FlowController(_options);
+    }
+    controller = slot;
+    pthread_rwlock_unlock(&_lock);
+    return controller;
+}
+
+int FlowControlRegistry::get_stats(std::vector<FlowControlStat> *stats) const
+{
+    pthread_rwlock_rdlock(&_lock);
+    std::map<std::string, FlowController *>::const_iterator it = _controllers.begin();
+    for (; it != _controllers.end(); ++it) {
+        FlowControlStat stat;
+        stat.host = it->first;
+        it->second->get_stat(&stat);
+        stats->push_back(stat);
+    }
+    pthread_rwlock_unlock(&_lock);
+    return 0;
+}
+
+END_NAMESPACE
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,123 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#ifndef HTTP4CPP_HTTP_FLOW_CONTROL_H
+#define HTTP4CPP_HTTP_FLOW_CONTROL_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "common/common.h"
+
+BEGIN_NAMESPACE
+
+struct FlowControlOptions {
+    FlowControlOptions() :
+        rate_per_sec(0),
+        burst(0),
+        initial_concurrency(16),
+        min_concurrency(1),
+        max_concurrency(0),
+        latency_threshold_us(0),
+        backoff_ratio(0.9),
+        max_wait_ms(0)
+    {
+        // nothing to do
+    }
+
+    double   rate_per_sec;          // token bucket refill rate, 0 disables the bucket
+    double   burst;                 // bucket capacity, rate_per_sec if 0
+    uint32_t initial_concurrency;
+    uint32_t min_concurrency;
+    uint32_t max_concurrency;       // 0 disables the concurrency limiter
+    int64_t  latency_threshold_us;  // slower completions shrink the limit, 0 only on errors
+    double   backoff_ratio;         // multiplicative decrease factor
+    int64_t  max_wait_ms;           // queueing budget, 0 rejects immediately
+};
+
+struct FlowControlStat {
+    std::string host;
+    uint32_t    limit;
+    uint32_t    inflight;
+    uint32_t    waiting;
+    double      tokens;
+    uint64_t    admitted;
+    uint64_t    rate_limited;
+    uint64_t    overloaded;
+};
+
+/**
+ * Token bucket rate limiter plus an AIMD concurrency limiter for one host.
+ * The concurrency limit grows by one per limit successful completions and is
+ * multiplied by backoff_ratio on errors or completions slower than the
+ * threshold, at most once per smoothed latency.
+ */
+class FlowController {
+public:
+    explicit FlowController(const FlowControlOptions &options);
+    ~FlowController();
+
+    // RET_OK, RET_RATE_LIMITED or RET_OVERLOADED. max_wait_ms < 0 uses the
+    // configured budget. An admitted request must be finished by release()
+    // or cancel().
+    int acquire(int64_t max_wait_ms = -1);
+    void release(bool success, int64_t latency_us);
+    // For a request the host never judged, gives back its token, up to the
+    // burst, and leaves the limit alone.
+    void cancel();
+
+    uint32_t get_limit() const;
+    void get_stat(FlowControlStat *stat) const;
+
+private:
+    FlowController(const FlowController &);
+    FlowController & operator=(const FlowController &);
+
+    void refill(int64_t now_us);
+    void finish();
+
+    FlowControlOptions      _options;
+    mutable pthread_mutex_t _mutex;
+    pthread_cond_t          _cond;
+    double                  _tokens;
+    int64_t                 _refill_us;
+    double                  _limit;
+    uint32_t                _inflight;
+    uint32_t                _waiting;
+    int64_t                 _ewma_latency_us;
+    int64_t                 _last_decrease_us;
+    uint64_t                _admitted;
+    uint64_t                _rate_limited;
+    uint64_t                _overloaded;
+};
+
+// FlowControllers keyed by "host:port", created on first use.
+class FlowControlRegistry {
+public:
+    explicit FlowControlRegistry(const FlowControlOptions &options);
+    ~FlowControlRegistry();
+
+    FlowController * get(const std::string &host);
+    int get_stats(std::vector<FlowControlStat> *stats) const;
+
+private:
+    FlowControlRegistry(const FlowControlRegistry &);
+    FlowControlRegistry & operator=(const FlowControlRegistry &);
+
+    FlowControlOptions                      _options;
+    mutable pthread_rwlock_t                _lock;
+    std::map<std::string, FlowController *> _controllers;
+};
+
+END_NAMESPACE
+#endif
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
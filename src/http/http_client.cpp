@@ -6,53 +6,422 @@
  * Distributed under the Apache License Version 2.0
  * http://www.apache.org/licenses/LICENSE-2.0
  */
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
 #include <curl/curl.h>
 
+#include <algorithm>
+
 #include "http/http_client.h"
+#include "common/arena.h"
+#include "common/ascii.h"
 #include "common/util.h"
 #include "common/memory_stream.h"
+#include "common/probes.h"
 
 BEGIN_NAMESPACE
 
+static pthread_key_t                        s_handle_key;
+static pthread_once_t                       s_handle_key_once = PTHREAD_ONCE_INIT;
+static pthread_rwlock_t                     s_service_lock = PTHREAD_RWLOCK_INITIALIZER;
+static std::map<std::string, EndpointSet *> s_services;
+static CircuitBreakerRegistry *             s_breakers = NULL;
+static FlowControlRegistry *                s_flow_control = NULL;
+static RequestScheduler *                   s_scheduler = NULL;
+static bool                                 s_collect_transfer_info = true;
+static MetricsRegistry *                    s_metrics = NULL;
+static Tracer *                             s_tracer = NULL;
+static SlowRequestSampler *                 s_slow_request_sampler = NULL;
+
 int HttpClient::init()
 {
     DEBUG("%s", "call curl_global_init");
+    pthread_once(&s_handle_key_once, init_handle_key);
     return curl_global_init(CURL_GLOBAL_ALL);
 }
 
 int HttpClient::cleanup()
 {
     DEBUG("%s", "call curl_global_cleanup");
+    pthread_once(&s_handle_key_once, init_handle_key);
+    void *handles = pthread_getspecific(s_handle_key);
+    if (handles != NULL) {
+        pthread_setspecific(s_handle_key, NULL);
+        release_thread_handles(handles);
+    }
     curl_global_cleanup();
     return 0;
 }
 
+int HttpClient::register_service(const std::string &name, EndpointSet *endpoints)
+{
+    if (name.empty() || endpoints == NULL) {
+        return RET_ILLEGAL_ARGUMENT;
+    }
+
+    pthread_rwlock_wrlock(&s_service_lock);
+    s_services[name] = endpoints;
+    pthread_rwlock_unlock(&s_service_lock);
+    return RET_OK;
+}
+
+int HttpClient::unregister_service(const std::string &name)
+{
+    pthread_rwlock_wrlock(&s_service_lock);
+    size_t erased = s_services.erase(name);
+    pthread_rwlock_unlock(&s_service_lock);
+    return erased > 0 ? RET_OK : RET_ILLEGAL_ARGUMENT;
+}
+
+EndpointSet * HttpClient::get_service(const std::string &name)
+{
+    EndpointSet *endpoints = NULL;
+
+    pthread_rwlock_rdlock(&s_service_lock);
+    std::map<std::string, EndpointSet *>::const_iterator it = s_services.find(name);
+    if (it != s_services.end()) {
+        endpoints = it->second;
+    }
+    pthread_rwlock_unlock(&s_service_lock);
+    return endpoints;
+}
+
+void HttpClient::set_circuit_breakers(CircuitBreakerRegistry *breakers)
+{
+    s_breakers = breakers;
+}
+
+CircuitBreakerRegistry * HttpClient::get_circuit_breakers()
+{
+    return s_breakers;
+}
+
+void HttpClient::set_flow_control(FlowControlRegistry *flow_control)
+{
+    s_flow_control = flow_control;
+}
+
+FlowControlRegistry * HttpClient::get_flow_control()
+{
+    return s_flow_control;
+}
+
+void HttpClient::set_scheduler(RequestScheduler *scheduler)
+{
+    s_scheduler = scheduler;
+}
+
+RequestScheduler * HttpClient::get_scheduler()
+{
+    return s_scheduler;
+}
+
+void HttpClient::set_collect_transfer_info(bool collect)
+{
+    s_collect_transfer_info = collect;
+}
+
+bool HttpClient::get_collect_transfer_info()
+{
+    return s_collect_transfer_info;
+}
+
+void HttpClient::set_metrics(MetricsRegistry *metrics)
+{
+    s_metrics = metrics;
+}
+
+MetricsRegistry * HttpClient::get_metrics()
+{
+    return s_metrics;
+}
+
+void HttpClient::set_tracer(Tracer *tracer)
+{
+    s_tracer = tracer;
+}
+
+Tracer * HttpClient::get_tracer()
+{
+    return s_tracer;
+}
+
+void HttpClient::set_slow_request_sampler(SlowRequestSampler *sampler)
+{
+    s_slow_request_sampler = sampler;
+}
+
+SlowRequestSampler * HttpClient::get_slow_request_sampler()
+{
+    return s_slow_request_sampler;
+}
+
+std::string HttpClient::get_host(const std::string &url)
+{
+    size_t start = url.find("://");
+    start = start == std::string::npos ? 0 : start + 3;
+    size_t end = url.find_first_of("/?#", start);
+    if (end == std::string::npos) {
+        end = url.size();
+    }
+    size_t at = url.rfind('@', end);
+    if (at != std::string::npos && at >= start) {
+        start = at + 1;
+    }
+    std::string host(url, start, end - start);
+    StringUtil::lower_in_place(&host);
+    return host;
+}
+
 int HttpClient::request(const HttpRequest &request, HttpResponse *response)
 {
-    CURL *curl_handle = NULL;
+    HTTP4CPP_PROBE3(request__start, response, request.get_url().c_str(),
+            static_cast<int>(request.get_http_method()));
+    Context ctx;
+    SlowRequestSampler *sampler = s_slow_request_sampler;
+    int64_t start_us = 0;
+    if (sampler != NULL) {
+        ctx.sampler = sampler;
+        start_us = TimeUtil::monotonic_us();
+    }
+    Tracer *tracer = s_tracer;
+    int ret = tracer == NULL ? schedule(request, &ctx, response)
+            : trace(tracer, request, &ctx, response);
+    if (ret == RET_OK && request.get_http_method() != HTTP_METHOD_HEAD) {
+        ret = response->verify_body_digest();
+    }
+    if (sampler != NULL) {
+        sampler->sample(request, ctx.url == NULL ? request.get_url() : *ctx.url, *response, ret,
+                TimeUtil::monotonic_us() - start_us, ctx.capture);
+    }
+    // only loads, tracers without semaphore support see it too, the transfer
+    // info is collected while the probe is attached
+    const HttpTransferInfo &info = response->get_transfer_info();
+    HTTP4CPP_PROBE7(request__done, response, request.get_url().c_str(), ret,
+            ret == RET_OK ? response->get_http_code() : 0,
+            info.bytes_sent, info.bytes_received, info.total_us);
+    return ret;
+}
 
-    struct curl_slist *http_header_slist = NULL;
-    int ret = 0;
-    do {
+int HttpClient::trace(Tracer *tracer, const HttpRequest &request, Context *ctx,
+        HttpResponse *response)
+{
+    TraceContext parent;
+    TraceContext::parse(request.get_trace_parent(), &parent);
+    tracer->start_trace(parent, &ctx->trace);
+    ctx->tracer = ctx->trace.sampled ? tracer : NULL;
+
+    int64_t start_us = TimeUtil::monotonic_us();
+    int ret = schedule(request, ctx, response);
+    if (ctx->tracer != NULL) {
+        char status[64];
+        snprintf(status, sizeof(status), " ret:%d code:%d", ret,
+                ret == RET_OK ? response->get_http_code() : 0);
+        add_span(ctx, "http.request", ctx->trace.span_id, parent.span_id, start_us,
+                TimeUtil::monotonic_us() - start_us,
+                std::string(stringfy_http_method(request.get_http_method())) + " "
+                + request.get_url() + status);
+        tracer->record(&ctx->spans);
+    }
+    return ret;
+}
+
+int HttpClient::schedule(const HttpRequest &request, Context *ctx, HttpResponse *response)
+{
+    int64_t deadline_ms = request.get_deadline_ms();
+    if (deadline_ms > 0 && TimeUtil::monotonic_ms() >= deadline_ms) {
+        return RET_DEADLINE_EXCEEDED;
+    }
+
+    RequestScheduler *scheduler = s_scheduler;
+    if (scheduler == NULL) {
+        return route(request, ctx, response);
+    }
+
+    SchedulerTicket ticket;
+    int ret = scheduler->acquire(request.get_priority(), deadline_ms, &ticket);
+    if (ret != RET_OK) {
+        DEBUG("%s, priority:%d", stringfy_ret_code(ret), request.get_priority());
+        return ret;
+    }
+    ctx->max_recv_bytes_per_sec = ticket.max_recv_bytes_per_sec;
+    ctx->max_send_bytes_per_sec = ticket.max_send_bytes_per_sec;
+    ctx->queued_us = ticket.queued_us;
+    if (ctx->tracer != NULL && ticket.queued_us > 0) {
+        add_span(ctx, "queue", Tracer::new_span_id(), ctx->trace.span_id,
+                TimeUtil::monotonic_us() - ticket.queued_us, ticket.queued_us, "");
+    }
+
+    ret = route(request, ctx, response);
+    scheduler->release(ticket);
+    return ret;
+}
+
+int HttpClient::route(const HttpRequest &request, Context *ctx, HttpResponse *response)
+{
+    const std::string &service = request.get_service();
+    if (service.empty()) {
+        ctx->url = &request.get_url();
+        return dispatch(request, ctx, response);
+    }
+
+    EndpointSet *endpoints = get_service(service);
+    if (endpoints == NULL) {
+        ERROR("service not registered: %s", service.c_str());
+        return RET_ILLEGAL_ARGUMENT;
+    }
+
+    const std::string &url = request.get_url();
+    const std::string &hash_key = request.get_hash_key();
+    Endpoint *endpoint = endpoints->select(hash_key.empty() ? url : hash_key);
+    if (endpoint == NULL) {
+        ERROR("%s: %s", stringfy_ret_code(RET_NO_AVAILABLE_ENDPOINT), service.c_str());
+        return RET_NO_AVAILABLE_ENDPOINT;
+    }
+
+    int64_t start_us = TimeUtil::monotonic_us();
+    ctx->routed_url = endpoint->get_address() + url;
+    ctx->url = &ctx->routed_url;
+    int ret = dispatch(request, ctx, response);
+    if (!ctx->sent || ret == RET_DEADLINE_EXCEEDED) {
+        // rejected by a breaker or flow control, or out of the caller's time
+        endpoints->cancel(endpoint);
+        return ret;
+    }
+    bool success = ret == RET_OK && response->get_http_code() < 500;
+    endpoints->release(endpoint, success, TimeUtil::monotonic_us() - start_us);
+    return ret;
+}
+
+int HttpClient::dispatch(const HttpRequest &request, Context *ctx, HttpResponse *response)
+{
+    CircuitBreakerRegistry *breakers = s_breakers;
+    FlowControlRegistry *flow_control = s_flow_control;
+    MetricsRegistry *metrics = s_metrics;
+    if (breakers == NULL && flow_control == NULL && metrics == NULL) {
+        return perform(request, ctx, response);
+    }
+
+    std::string host = get_host(*ctx->url);
+    FlowController *controller = NULL;
+    if (flow_control != NULL) {
+        // never queue beyond the request deadline
+        int64_t max_wait_ms = -1;
+        int64_t deadline_ms = request.get_deadline_ms();
+        if (deadline_ms > 0) {
+            max_wait_ms = deadline_ms - TimeUtil::monotonic_ms();
+            if (max_wait_ms < 0) {
+                return RET_DEADLINE_EXCEEDED;
+            }
+        }
+        controller = flow_control->get(host);
+        int64_t acquire_us = ctx->tracer != NULL ? TimeUtil::monotonic_us() : 0;
+        int ret = controller->acquire(max_wait_ms);
+        if (ret != RET_OK) {
+            DEBUG("%s, reject url:%s", stringfy_ret_code(ret), ctx->url->c_str());
+            return ret;
+        }
+        if (ctx->tracer != NULL) {
+            add_span(ctx, "flow_control", Tracer::new_span_id(), ctx->trace.span_id,
+                    acquire_us, TimeUtil::monotonic_us() - acquire_us, host);
+        }
+    }
+
+    CircuitBreaker *breaker = NULL;
+    uint64_t breaker_generation = 0;
+    if (breakers != NULL) {
+        breaker = breakers->get(host);
+        if (!breaker->allow(&breaker_generation)) {
+            DEBUG("circuit open, reject url:%s", ctx->url->c_str());
+            if (controller != NULL) {
+                controller->cancel();
+            }
+            return RET_CIRCUIT_OPEN;
+        }
+    }
 
-        curl_handle = curl_easy_init();
-        if (curl_handle == NULL) {
-            curl_global_cleanup();
-            return RET_INIT_CURL_FAIL;
+    int64_t start_us = TimeUtil::monotonic_us();
+    int ret = perform(request, ctx, response);
+    int64_t latency_us = TimeUtil::monotonic_us() - start_us;
+    bool success = ret == RET_OK && response->get_http_code() < 500;
+
+    // the caller's deadline says nothing about the host
+    bool local = !ctx->sent || ret == RET_DEADLINE_EXCEEDED;
+    if (breaker != NULL) {
+        if (local) {
+            breaker->cancel(breaker_generation);
+        } else {
+            breaker->report(breaker_generation, success);
         }
+    }
+    if (controller != NULL) {
+        if (local) {
+            controller->cancel();
+        } else {
+            controller->release(success, latency_us);
+        }
+    }
+    if (metrics != NULL) {
+        const HttpTransferInfo &info = response->get_transfer_info();
+        metrics->record_request(host, stringfy_http_method(request.get_http_method()),
+                ret == RET_OK ? response->get_http_code() : 0, latency_us,
+                info.bytes_sent, info.bytes_received);
+    }
+    return ret;
+}
+
+// A "name:value" list node, as get_all_headers() formats a header.
+static struct curl_slist * new_header(Arena *arena, const StringPiece &name,
+        const StringPiece &value)
+{
+    char *line = reinterpret_cast<char *>(arena->allocate(name.size() + value.size() + 2));
+    memcpy(line, name.data(), name.size());
+    line[name.size()] = ':';
+    memcpy(line + name.size() + 1, value.data(), value.size());
+    line[name.size() + 1 + value.size()] = '\0';
 
-        std::string url = request.get_url();
+    struct curl_slist *node = reinterpret_cast<struct curl_slist *>(
+            arena->allocate(sizeof(struct curl_slist)));
+    node->data = line;
+    node->next = NULL;
+    return node;
+}
+
+int HttpClient::perform(const HttpRequest &request, Context *ctx, HttpResponse *response)
+{
+    // The easy handle is kept per thread so its connection cache is reused
+    // across requests to the same host, with or without a first byte timeout.
+    CURL *curl_handle = reinterpret_cast<CURL *>(get_curl_handle());
+    if (curl_handle == NULL) {
+        return RET_INIT_CURL_FAIL;
+    }
+
+    // header lines and list nodes live on the stack for the transfer, the
+    // handle lets go of them before they go out of scope
+    char scratch[1024];
+    Arena arena(scratch, sizeof(scratch));
+    struct curl_slist *http_header_slist = NULL;
+    int ret = RET_OK;
+    do {
+        const std::string &url = *ctx->url;
         DEBUG("http_request: url:%s", url.c_str());
         curl_easy_setopt(curl_handle, CURLOPT_URL, url.c_str());
         curl_easy_setopt(curl_handle, CURLOPT_HEADER, 1L);
         curl_easy_setopt(curl_handle, CURLOPT_NOPROGRESS, 1L);
 
-        // prevent core dump when used in multi-thread application 
+        // prevent core dump when used in multi-thread application
         // for the case the libcurl is not built with c-ares
         curl_easy_setopt(curl_handle, CURLOPT_NOSIGNAL, 1L);
 
-        curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, response);
-        curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, write_stream);
+        ctx->response = response;
+        if (ctx->tracer != NULL || ctx->sampler != NULL) {
+            curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, ctx);
+            curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, context_write_stream);
+        } else {
+            curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, response);
+            curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, write_stream);
+        }
 
         InputStream *req_stream = request.get_input_stream();
         http_method_t http_method = request.get_http_method();
@@ -63,80 +432,315 @@ int HttpClient::request(const HttpRequest &request, HttpResponse *response)
             curl_easy_setopt(curl_handle, CURLOPT_READFUNCTION, read_stream);
             curl_easy_setopt(curl_handle, CURLOPT_READDATA, req_stream);
             if (req_stream == NULL) {
-                curl_easy_setopt(curl_handle, CURLOPT_INFILESIZE_LARGE, 0);
+                curl_easy_setopt(curl_handle, CURLOPT_INFILESIZE_LARGE, (curl_off_t)0);
             } else {
                 curl_easy_setopt(curl_handle, CURLOPT_INFILESIZE_LARGE,
-                        req_stream->get_size() - req_stream->get_pos());
+                        (curl_off_t)(req_stream->get_size() - req_stream->get_pos()));
             }
         } else if (http_method == HTTP_METHOD_DELETE) {
             curl_easy_setopt(curl_handle, CURLOPT_CUSTOMREQUEST, "DELETE");
         } else if (http_method == HTTP_METHOD_HEAD) {
-            curl_easy_setopt(curl_handle, CURLOPT_NOBODY, true);
+            curl_easy_setopt(curl_handle, CURLOPT_NOBODY, 1L);
         } else if (http_method == HTTP_METHOD_POST) {
             if (req_stream == NULL) {
-                curl_easy_setopt(curl_handle, CURLOPT_POST, true);
-                curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDSIZE, 0);
+                curl_easy_setopt(curl_handle, CURLOPT_POST, 1L);
+                curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDSIZE, 0L);
             } else {
                 int64_t size = req_stream->get_size() - req_stream->get_pos();
                 // !!! CURL_POSTFIELDS must be char *, not string.c_str()(const char *)
                 // string converted to char * must be carefully used!
                 post_data.reserve(size);
                 req_stream->read(size, &post_data);
-                curl_easy_setopt(curl_handle, CURLOPT_POST, true);
+                curl_easy_setopt(curl_handle, CURLOPT_POST, 1L);
                 curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDS,
                         const_cast<char *>(post_data.c_str()));
-                curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDSIZE, size);
+                curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDSIZE, (long)size);
             }
         }
 
         // set http header
-        std::vector<std::string > headers;
-        request.get_all_headers(&headers);
-        for (uint32_t i = 0; i < headers.size(); i++) {
-            http_header_slist = curl_slist_append(http_header_slist, headers[i].c_str());
-            DEBUG("http_request: header:%s", headers[i].c_str());
+        struct curl_slist **tail = &http_header_slist;
+        bool traced = ctx->trace.span_id != 0;
+        for (const HttpHeaderField *field = request.get_header_list().first(); field != NULL;
+                field = field->next) {
+            if (traced && Ascii::equals_ignore_case(field->name, "traceparent")) {
+                continue;
+            }
+            *tail = new_header(&arena, field->name, field->value);
+            DEBUG("http_request: header:%s", (*tail)->data);
+            tail = &(*tail)->next;
+        }
+        if (traced) {
+            // the server side continues from the span of this transfer
+            TraceContext outgoing = ctx->trace;
+            outgoing.span_id = Tracer::new_span_id();
+            ctx->transfer_span_id = outgoing.span_id;
+            *tail = new_header(&arena, "traceparent", outgoing.to_traceparent());
         }
         if (http_header_slist != NULL) {
             curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, http_header_slist);
         }
 
-        int timeout = request.get_timeout();
-        if (timeout > 0) {
-            curl_easy_setopt(curl_handle, CURLOPT_TIMEOUT, timeout);
+        // The deadline caps every timeout so the whole call never outlives the
+        // caller's budget.
+        int64_t timeout_ms = request.get_timeout();
+        int64_t remaining_ms = request.get_remaining_ms();
+        bool by_deadline = false;
+        if (remaining_ms == 0) {
+            ret = RET_DEADLINE_EXCEEDED;
+            break;
+        }
+        if (remaining_ms > 0 && (timeout_ms <= 0 || remaining_ms < timeout_ms)) {
+            timeout_ms = remaining_ms;
+            by_deadline = true;
+        }
+        if (timeout_ms > 0) {
+            curl_easy_setopt(curl_handle, CURLOPT_TIMEOUT_MS, (long)timeout_ms);
         }
 
-        int ret = curl_easy_perform(curl_handle);
-        if (ret != 0) {
-            std::ostringstream oss;
-            oss << "curl_easy_perform :ret " << ret;
-            WARN("%s", oss.str().c_str());
-            std::stringstream ss;
-            ss << "Request server fail, ret:" << ret;
-
-            if (curl_handle != NULL) {
-                curl_easy_cleanup(curl_handle);
+        int64_t connect_timeout_ms = request.get_connect_timeout();
+        if (connect_timeout_ms > 0) {
+            if (timeout_ms > 0 && connect_timeout_ms > timeout_ms) {
+                connect_timeout_ms = timeout_ms;
             }
+            curl_easy_setopt(curl_handle, CURLOPT_CONNECTTIMEOUT_MS, (long)connect_timeout_ms);
+        }
 
-            if (http_header_slist != NULL) {
-                curl_slist_free_all(http_header_slist);
-            }
-            curl_global_cleanup();
-            ERROR("%S", ss.str().c_str());
-            return RET_CLIENT_ERROR;
+        if (request.get_first_byte_timeout() > 0) {
+            ctx->first_byte_deadline_us = TimeUtil::monotonic_us() +
+                    static_cast<int64_t>(request.get_first_byte_timeout()) * 1000;
+        }
+
+#if LIBCURL_VERSION_NUM >= 0x075000
+        if (HTTP4CPP_PROBE_ENABLED(connection__acquired)) {
+            curl_easy_setopt(curl_handle, CURLOPT_PREREQFUNCTION, prereq);
+            curl_easy_setopt(curl_handle, CURLOPT_PREREQDATA, ctx);
+        }
+#endif
+
+        if (request.get_low_speed_limit() > 0 && request.get_low_speed_time() > 0) {
+            curl_easy_setopt(curl_handle, CURLOPT_LOW_SPEED_LIMIT,
+                    (long)request.get_low_speed_limit());
+            curl_easy_setopt(curl_handle, CURLOPT_LOW_SPEED_TIME,
+                    (long)request.get_low_speed_time());
         }
 
-        ret = RET_OK;
+        if (ctx->max_recv_bytes_per_sec > 0) {
+            curl_easy_setopt(curl_handle, CURLOPT_MAX_RECV_SPEED_LARGE,
+                    (curl_off_t)ctx->max_recv_bytes_per_sec);
+        }
+        if (ctx->max_send_bytes_per_sec > 0) {
+            curl_easy_setopt(curl_handle, CURLOPT_MAX_SEND_SPEED_LARGE,
+                    (curl_off_t)ctx->max_send_bytes_per_sec);
+        }
+
+        int64_t perform_us = ctx->tracer != NULL ? TimeUtil::monotonic_us() : 0;
+        ctx->sent = true;
+        CURLcode code = ctx->first_byte_deadline_us > 0 ?
+                static_cast<CURLcode>(perform_first_byte(curl_handle, ctx)) :
+                curl_easy_perform(curl_handle);
+        if (s_collect_transfer_info || ctx->tracer != NULL || ctx->sampler != NULL
+                || HTTP4CPP_PROBE_ENABLED(request__done)) {
+            collect_transfer_info(curl_handle, *ctx, response);
+        }
+        if (ctx->tracer != NULL) {
+            add_transfer_spans(ctx, perform_us, *response);
+        }
+        if (code == CURLE_OPERATION_TIMEDOUT || code == CURLE_ABORTED_BY_CALLBACK) {
+            ret = by_deadline && request.get_remaining_ms() == 0 ?
+                    RET_DEADLINE_EXCEEDED : RET_TIMEOUT;
+            WARN("Request timeout, ret:%d %s url:%s", code, curl_easy_strerror(code),
+                    url.c_str());
+            break;
+        }
+        if (code != CURLE_OK) {
+            WARN("curl_easy_perform :ret %d", code);
+            ERROR("Request server fail, ret:%d %s", code, curl_easy_strerror(code));
+            ret = RET_CLIENT_ERROR;
+            break;
+        }
     } while (false);
 
-    if (curl_handle != NULL) {
-        curl_easy_cleanup(curl_handle);
+    if (http_header_slist != NULL) {
+        curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, NULL);
     }
+    return ret;
+}
 
-    if (http_header_slist != NULL) {
-        curl_slist_free_all(http_header_slist);
+#if LIBCURL_VERSION_NUM >= 0x073d00
+#define GET_TIME_US(handle, info, result) do { \
+    curl_off_t us = 0; \
+    curl_easy_getinfo(handle, info##_T, &us); \
+    result = static_cast<int64_t>(us); \
+} while (0)
+#else
+#define GET_TIME_US(handle, info, result) do { \
+    double sec = 0; \
+    curl_easy_getinfo(handle, info, &sec); \
+    result = static_cast<int64_t>(sec * 1000000); \
+} while (0)
+#endif
+
+void HttpClient::collect_transfer_info(void *handle, const Context &ctx, HttpResponse *response)
+{
+    CURL *curl_handle = reinterpret_cast<CURL *>(handle);
+    HttpTransferInfo info;
+
+    info.collected = true;
+    info.queue_us = ctx.queued_us;
+    GET_TIME_US(curl_handle, CURLINFO_NAMELOOKUP_TIME, info.namelookup_us);
+    GET_TIME_US(curl_handle, CURLINFO_CONNECT_TIME, info.connect_us);
+    GET_TIME_US(curl_handle, CURLINFO_APPCONNECT_TIME, info.appconnect_us);
+    GET_TIME_US(curl_handle, CURLINFO_PRETRANSFER_TIME, info.pretransfer_us);
+    GET_TIME_US(curl_handle, CURLINFO_STARTTRANSFER_TIME, info.starttransfer_us);
+    GET_TIME_US(curl_handle, CURLINFO_TOTAL_TIME, info.total_us);
+
+    long request_size = 0;
+    long header_size = 0;
+    long connects = 0;
+    curl_easy_getinfo(curl_handle, CURLINFO_REQUEST_SIZE, &request_size);
+    curl_easy_getinfo(curl_handle, CURLINFO_HEADER_SIZE, &header_size);
+    curl_easy_getinfo(curl_handle, CURLINFO_NUM_CONNECTS, &connects);
+#if LIBCURL_VERSION_NUM >= 0x073700
+    curl_off_t uploaded = 0;
+    curl_off_t downloaded = 0;
+    curl_easy_getinfo(curl_handle, CURLINFO_SIZE_UPLOAD_T, &uploaded);
+    curl_easy_getinfo(curl_handle, CURLINFO_SIZE_DOWNLOAD_T, &downloaded);
+#else
+    double uploaded = 0;
+    double downloaded = 0;
+    curl_easy_getinfo(curl_handle, CURLINFO_SIZE_UPLOAD, &uploaded);
+    curl_easy_getinfo(curl_handle, CURLINFO_SIZE_DOWNLOAD, &downloaded);
+#endif
+    info.bytes_sent = request_size + static_cast<int64_t>(uploaded);
+    info.bytes_received = header_size + static_cast<int64_t>(downloaded);
+    info.connection_reused = connects == 0 && info.pretransfer_us > 0;
+
+    response->set_transfer_info(info);
+}
+
+#undef GET_TIME_US
+
+void HttpClient::add_span(Context *ctx, const char *name, uint64_t span_id, uint64_t parent_id,
+        int64_t start_us, int64_t duration_us, const std::string &detail)
+{
+    ctx->spans.push_back(Span());
+    Span &span = ctx->spans.back();
+    span.name = name;
+    span.trace_id_high = ctx->trace.trace_id_high;
+    span.trace_id_low = ctx->trace.trace_id_low;
+    span.span_id = span_id;
+    span.parent_span_id = parent_id;
+    span.start_us = start_us;
+    span.duration_us = duration_us;
+    span.tid = Tracer::current_tid();
+    span.detail = detail;
+}
+
+void HttpClient::add_transfer_spans(Context *ctx, int64_t start_us, const HttpResponse &response)
+{
+    const HttpTransferInfo &info = response.get_transfer_info();
+    uint64_t parent = ctx->transfer_span_id;
+    add_span(ctx, "transfer", parent, ctx->trace.span_id, start_us,
+            TimeUtil::monotonic_us() - start_us, *ctx->url);
+
+    // curl phases are offsets from the start of the transfer, libcurl has no
+    // timestamp for the request being sent so server includes sending it
+    const char *names[] = {"dns", "connect", "tls", "server", "receive"};
+    int64_t ends[] = {info.namelookup_us, info.connect_us, info.appconnect_us,
+            info.starttransfer_us, info.total_us};
+    int64_t phase_start = 0;
+    for (size_t i = 0; i < sizeof(ends) / sizeof(ends[0]); ++i) {
+        if (i == 3) {
+            phase_start = info.pretransfer_us > phase_start ? info.pretransfer_us : phase_start;
+        }
+        if (ends[i] <= phase_start) {
+            continue;
+        }
+        add_span(ctx, names[i], Tracer::new_span_id(), parent, start_us + phase_start,
+                ends[i] - phase_start, "");
+        phase_start = ends[i];
     }
 
-    return ret;
+    if (ctx->write_calls > 0) {
+        char detail[32];
+        snprintf(detail, sizeof(detail), "calls:%u", ctx->write_calls);
+        add_span(ctx, "stream_write", Tracer::new_span_id(), parent, ctx->first_write_us,
+                ctx->write_ns / 1000, detail);
+    }
+}
+
+// The curl handles of a thread. The easy handle and the transfers run on the
+// multi handle share one connection cache, only this thread uses it so the
+// share needs no lock.
+struct ThreadHandles {
+    CURL   *easy;
+    CURLM  *multi;
+    CURLSH *share;
+};
+
+static ThreadHandles * get_thread_handles()
+{
+    ThreadHandles *handles = reinterpret_cast<ThreadHandles *>(pthread_getspecific(s_handle_key));
+    if (handles != NULL) {
+        return handles;
+    }
+
+    handles = new ThreadHandles();
+    handles->easy = NULL;
+    handles->multi = NULL;
+    handles->share = curl_share_init();
+    if (handles->share != NULL) {
+        curl_share_setopt(handles->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    }
+    pthread_setspecific(s_handle_key, handles);
+    return handles;
+}
+
+void * HttpClient::get_curl_handle()
+{
+    pthread_once(&s_handle_key_once, init_handle_key);
+    ThreadHandles *handles = get_thread_handles();
+    if (handles->easy != NULL) {
+        curl_easy_reset(handles->easy);
+    } else {
+        handles->easy = curl_easy_init();
+    }
+    if (handles->easy != NULL && handles->share != NULL) {
+        curl_easy_setopt(handles->easy, CURLOPT_SHARE, handles->share);
+    }
+    return handles->easy;
+}
+
+void * HttpClient::get_multi_handle()
+{
+    pthread_once(&s_handle_key_once, init_handle_key);
+    ThreadHandles *handles = get_thread_handles();
+    if (handles->multi == NULL) {
+        handles->multi = curl_multi_init();
+    }
+    return handles->multi;
+}
+
+void HttpClient::release_thread_handles(void *data)
+{
+    // the share goes last, it cannot be freed while a handle uses it
+    ThreadHandles *handles = reinterpret_cast<ThreadHandles *>(data);
+    if (handles->easy != NULL) {
+        curl_easy_cleanup(handles->easy);
+    }
+    if (handles->multi != NULL) {
+        curl_multi_cleanup(handles->multi);
+    }
+    if (handles->share != NULL) {
+        curl_share_cleanup(handles->share);
+    }
+    delete handles;
+}
+
+void HttpClient::init_handle_key()
+{
+    pthread_key_create(&s_handle_key, release_thread_handles);
 }
 
 size_t HttpClient::write_stream(void *ptr, size_t size, size_t nmemb, void *stream_handler)
@@ -151,6 +755,30 @@ size_t HttpClient::write_stream(void *ptr, size_t size, size_t nmemb, void *stre
     return response->write_body(reinterpret_cast<char *>(ptr), len);
 }
 
+size_t HttpClient::context_write_stream(void *ptr, size_t size, size_t nmemb, void *data)
+{
+    Context *ctx = reinterpret_cast<Context *>(data);
+    if (ctx->sampler != NULL && ctx->response->has_recv_header_line()) {
+        size_t limit = ctx->sampler->get_options().capture_bytes;
+        if (ctx->capture.size() < limit) {
+            size_t len = size * nmemb;
+            ctx->capture.append(reinterpret_cast<char *>(ptr),
+                    std::min(len, limit - ctx->capture.size()));
+        }
+    }
+    if (ctx->tracer == NULL) {
+        return write_stream(ptr, size, nmemb, ctx->response);
+    }
+
+    if (ctx->write_calls++ == 0) {
+        ctx->first_write_us = TimeUtil::monotonic_us();
+    }
+    int64_t start_ns = TimeUtil::tsc_ns();
+    size_t written = write_stream(ptr, size, nmemb, ctx->response);
+    ctx->write_ns += TimeUtil::tsc_ns() - start_ns;
+    return written;
+}
+
 size_t HttpClient::read_stream(void *ptr, size_t size, size_t nmemb, void *stream)
 {
     if (stream == NULL) {
@@ -161,5 +789,70 @@ size_t HttpClient::read_stream(void *ptr, size_t size, size_t nmemb, void *strea
     return reader->read(reinterpret_cast<char *>(ptr), size * nmemb);
 }
 
+int HttpClient::prereq(void *data, char *primary_ip, char *local_ip,
+        int primary_port, int local_port)
+{
+    Context *ctx = reinterpret_cast<Context *>(data);
+    HTTP4CPP_PROBE4(connection__acquired, ctx->response, ctx->url->c_str(), primary_ip,
+            primary_port);
+    return 0;
+}
+
+// The transfer runs on a multi handle of the thread so the wait for the
+// status line is a timer of its own, a progress callback only runs about
+// once a second while the socket is idle.
+int HttpClient::perform_first_byte(void *handle, Context *ctx)
+{
+    CURL *curl_handle = reinterpret_cast<CURL *>(handle);
+    CURLM *multi = reinterpret_cast<CURLM *>(get_multi_handle());
+    if (multi == NULL || curl_multi_add_handle(multi, curl_handle) != CURLM_OK) {
+        return CURLE_FAILED_INIT;
+    }
+
+    CURLcode code = CURLE_OK;
+    int running = 1;
+    while (true) {
+        if (curl_multi_perform(multi, &running) != CURLM_OK) {
+            code = CURLE_FAILED_INIT;
+            break;
+        }
+        if (running == 0) {
+            int left = 0;
+            CURLMsg *msg = NULL;
+            while ((msg = curl_multi_info_read(multi, &left)) != NULL) {
+                if (msg->msg == CURLMSG_DONE && msg->easy_handle == curl_handle) {
+                    code = msg->data.result;
+                }
+            }
+            break;
+        }
+
+        int wait_ms = 1000;
+        if (ctx->first_byte_deadline_us > 0) {
+            if (ctx->response->has_recv_status_line()) {
+                ctx->first_byte_deadline_us = 0;
+            } else {
+                int64_t left_us = ctx->first_byte_deadline_us - TimeUtil::monotonic_us();
+                if (left_us <= 0) {
+                    code = CURLE_OPERATION_TIMEDOUT;
+                    break;
+                }
+                if (left_us < wait_ms * 1000) {
+                    wait_ms = static_cast<int>((left_us + 999) / 1000);
+                }
+            }
+        }
+        // libcurl cuts the wait short for its own timers
+#if LIBCURL_VERSION_NUM >= 0x074200
+        curl_multi_poll(multi, NULL, 0, wait_ms, NULL);
+#else
+        curl_multi_wait(multi, NULL, 0, wait_ms, NULL);
+#endif
+    }
+    // removing an unfinished transfer closes its connection
+    curl_multi_remove_handle(multi, curl_handle);
+    return code;
+}
+
 END_NAMESPACE
 /* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -14,7 +14,14 @@
 #include <sstream>
 
 #include "common/common.h"
+#include "common/metrics.h"
 #include "common/stream.h"
+#include "common/tracer.h"
+#include "http/slow_request_sampler.h"
+#include "http/circuit_breaker.h"
+#include "http/endpoint_set.h"
+#include "http/flow_control.h"
+#include "http/request_scheduler.h"
 #include "http_request.h"
 #include "http_response.h"
 
@@ -29,9 +36,112 @@ public:
     static int cleanup();
     static int request(const HttpRequest &request, HttpResponse *response);
 
+    // Registered endpoint sets are owned by the caller and must outlive
+    // every request naming the service.
+    static int register_service(const std::string &name, EndpointSet *endpoints);
+    static int unregister_service(const std::string &name);
+    static EndpointSet * get_service(const std::string &name);
+
+    // Per host circuit breakers, NULL disables them. The registry is owned
+    // by the caller.
+    static void set_circuit_breakers(CircuitBreakerRegistry *breakers);
+    static CircuitBreakerRegistry * get_circuit_breakers();
+
+    // Per host rate and concurrency limits in front of dispatch, NULL disables
+    // them. The registry is owned by the caller.
+    static void set_flow_control(FlowControlRegistry *flow_control);
+    static FlowControlRegistry * get_flow_control();
+
+    // Priority and deadline aware admission of requests, NULL disables it.
+    // The scheduler is owned by the caller.
+    static void set_scheduler(RequestScheduler *scheduler);
+    static RequestScheduler * get_scheduler();
+
+    // Fill HttpResponse::get_transfer_info after each transfer, on by default.
+    static void set_collect_transfer_info(bool collect);
+    static bool get_collect_transfer_info();
+
+    // Record every finished request into the registry, NULL disables it.
+    // The registry is owned by the caller.
+    static void set_metrics(MetricsRegistry *metrics);
+    static MetricsRegistry * get_metrics();
+
+    // Sampled request spans and traceparent injection, NULL disables both.
+    // The tracer is owned by the caller.
+    static void set_tracer(Tracer *tracer);
+    static Tracer * get_tracer();
+
+    // Outlier capture, NULL disables it. The sampler is owned by the caller.
+    static void set_slow_request_sampler(SlowRequestSampler *sampler);
+    static SlowRequestSampler * get_slow_request_sampler();
+
+    // "host:port" part of an url, used as the key of per host state.
+    static std::string get_host(const std::string &url);
+
 private:
+    // Per call state threaded from request() down to perform()
+    struct Context {
+        Context() :
+            url(NULL),
+            sent(false),
+            max_recv_bytes_per_sec(0),
+            max_send_bytes_per_sec(0),
+            queued_us(0),
+            response(NULL),
+            first_byte_deadline_us(0),
+            tracer(NULL),
+            transfer_span_id(0),
+            first_write_us(0),
+            write_ns(0),
+            write_calls(0),
+            sampler(NULL)
+        {
+            // nothing to do
+        }
+
+        // the url of the request, or routed_url for a service
+        const std::string * url;
+        std::string         routed_url;
+        bool                sent;       // the transfer was started
+        int64_t             max_recv_bytes_per_sec;
+        int64_t             max_send_bytes_per_sec;
+        int64_t             queued_us;
+        HttpResponse *      response;
+        int64_t             first_byte_deadline_us;
+        // tracing, tracer is only set for sampled requests
+        Tracer *            tracer;
+        TraceContext        trace;
+        uint64_t            transfer_span_id;
+        int64_t             first_write_us;
+        int64_t             write_ns;
+        uint32_t            write_calls;
+        std::vector<Span>   spans;
+        // leading body bytes for the slow request sampler
+        SlowRequestSampler *sampler;
+        std::string         capture;
+    };
+
+    static int trace(Tracer *tracer, const HttpRequest &request, Context *ctx,
+            HttpResponse *response);
+    static int schedule(const HttpRequest &request, Context *ctx, HttpResponse *response);
+    static int route(const HttpRequest &request, Context *ctx, HttpResponse *response);
+    static int dispatch(const HttpRequest &request, Context *ctx, HttpResponse *response);
+    static int perform(const HttpRequest &request, Context *ctx, HttpResponse *response);
+    static void collect_transfer_info(void *handle, const Context &ctx, HttpResponse *response);
+    static void add_span(Context *ctx, const char *name, uint64_t span_id, uint64_t parent_id,
+            int64_t start_us, int64_t duration_us, const std::string &detail);
+    static void add_transfer_spans(Context *ctx, int64_t start_us, const HttpResponse &response);
+    static void * get_curl_handle();
+    static void * get_multi_handle();
+    static void release_thread_handles(void *handles);
+    static void init_handle_key();
+
     static size_t write_stream(void *ptr, size_t size, size_t nmemb, void *stream);
+    static size_t context_write_stream(void *ptr, size_t size, size_t nmemb, void *data);
     static size_t read_stream(void *ptr, size_t size, size_t nmemb, void *stream);
+    static int prereq(void *data, char *primary_ip, char *local_ip,
+            int primary_port, int local_port);
+    static int perform_first_byte(void *handle, Context *ctx);
 };
 
 END_NAMESPACE
@@ -0,0 +1,182 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#include <string.h>
+
+#include "http/request_scheduler.h"
+#include "common/util.h"
+
+BEGIN_NAMESPACE
+
+RequestScheduler::RequestScheduler(uint32_t max_concurrency) :
+    _max_concurrency(max_concurrency == 0 ? 1 : max_concurrency),
+    _inflight(0),
+    _seq(0)
+{
+    memset(_stats, 0, sizeof(_stats));
+    pthread_mutex_init(&_mutex, NULL);
+}
+
+RequestScheduler::~RequestScheduler()
+{
+    pthread_mutex_destroy(&_mutex);
+}
+
+void RequestScheduler::set_class_options(request_priority_t priority,
+        const SchedulerClassOptions &options)
+{
+    if (priority < 0 || priority >= REQUEST_PRIORITY_COUNT) {
+        return;
+    }
+
+    pthread_mutex_lock(&_mutex);
+    _options[priority] = options;
+    grant_waiters();
+    pthread_mutex_unlock(&_mutex);
+}
+
+int RequestScheduler::acquire(request_priority_t priority, int64_t deadline_ms,
+        SchedulerTicket *ticket)
+{
+    if (priority < 0 || priority >= REQUEST_PRIORITY_COUNT) {
+        priority = REQUEST_PRIORITY_NORMAL;
+    }
+    int64_t start_us = TimeUtil::monotonic_us();
+
+    pthread_mutex_lock(&_mutex);
+    if (deadline_ms > 0 && start_us / 1000 >= deadline_ms) {
+        ++_stats[priority].expired;
+        pthread_mutex_unlock(&_mutex);
+        return RET_DEADLINE_EXCEEDED;
+    }
+
+    if (_waiters.empty() && has_room(priority)) {
+        ++_inflight;
+        ++_stats[priority].inflight;
+        ++_stats[priority].admitted;
+        fill_ticket(priority, ticket);
+        ticket->queued_us = 0;
+        pthread_mutex_unlock(&_mutex);
+        return RET_OK;
+    }
+
+    Waiter waiter;
+    waiter.priority = priority;
+    waiter.deadline_ms = deadline_ms > 0 ? deadline_ms : INT64_MAX;
+    waiter.seq = _seq++;
+    waiter.granted = false;
+    TimeUtil::init_cond(&waiter.cond);
+    _waiters.insert(&waiter);
+    ++_stats[priority].waiting;
+    grant_waiters();
+
+    int ret = RET_OK;
+    while (!waiter.granted) {
+        if (deadline_ms <= 0) {
+            pthread_cond_wait(&waiter.cond, &_mutex);
+            continue;
+        }
+
+        struct timespec ts;
+        TimeUtil::cond_abstime((deadline_ms - TimeUtil::monotonic_ms()) * 1000, &ts);
+        pthread_cond_timedwait(&waiter.cond, &_mutex, &ts);
+        if (!waiter.granted && TimeUtil::monotonic_ms() >= deadline_ms) {
+            _waiters.erase(&waiter);
+            --_stats[priority].waiting;
+            ++_stats[priority].expired;
+            ret = RET_DEADLINE_EXCEEDED;
+            break;
+        }
+    }
+    if (ret == RET_OK) {
+        fill_ticket(priority, ticket);
+        ticket->queued_us = TimeUtil::monotonic_us() - start_us;
+    }
+    pthread_mutex_unlock(&_mutex);
+    pthread_cond_destroy(&waiter.cond);
+
+    return ret;
+}
+
+void RequestScheduler::release(const SchedulerTicket &ticket)
+{
+    pthread_mutex_lock(&_mutex);
+    if (_inflight > 0) {
+        --_inflight;
+    }
+    if (_stats[ticket.priority].inflight > 0) {
+        --_stats[ticket.priority].inflight;
+    }
+    grant_waiters();
+    pthread_mutex_unlock(&_mutex);
+}
+
+void RequestScheduler::get_class_stat(request_priority_t priority,
+        SchedulerClassStat *stat) const
+{
+    if (priority < 0 || priority >= REQUEST_PRIORITY_COUNT) {
+        return;
+    }
+
+    pthread_mutex_lock(&_mutex);
+    *stat = _stats[priority];
+    pthread_mutex_unlock(&_mutex);
+}
+
+bool RequestScheduler::has_room(request_priority_t priority) const
+{
+    if (_inflight >= _max_concurrency) {
+        return false;
+    }
+    uint32_t class_max = _options[priority].max_concurrency;
+    return class_max == 0 || _stats[priority].inflight < class_max;
+}
+
+void RequestScheduler::grant_waiters()
+{
+    int64_t now_ms = TimeUtil::monotonic_ms();
+    std::set<Waiter *, WaiterLess>::iterator it = _waiters.begin();
+    while (it != _waiters.end() && _inflight < _max_concurrency) {
+        Waiter *waiter = *it;
+        // expired waiters are left to time out, they must never reach the wire
+        if (waiter->deadline_ms <= now_ms || !has_room(waiter->priority)) {
+            ++it;
+            continue;
+        }
+
+        waiter->granted = true;
+        ++_inflight;
+        ++_stats[waiter->priority].inflight;
+        ++_stats[waiter->priority].admitted;
+        --_stats[waiter->priority].waiting;
+        _waiters.erase(it++);
+        pthread_cond_signal(&waiter->cond);
+    }
+}
+
+void RequestScheduler::fill_ticket(request_priority_t priority, SchedulerTicket *ticket) const
+{
+    // A rate handed to curl can not be changed during the transfer, so every
+    // slot gets a fixed part and the slots in flight never exceed the share.
+    const SchedulerClassOptions &options = _options[priority];
+    int64_t slots = options.max_concurrency == 0 || options.max_concurrency > _max_concurrency ?
+            _max_concurrency : options.max_concurrency;
+
+    ticket->priority = priority;
+    ticket->max_recv_bytes_per_sec = options.max_recv_bytes_per_sec / slots;
+    ticket->max_send_bytes_per_sec = options.max_send_bytes_per_sec / slots;
+    if (options.max_recv_bytes_per_sec > 0 && ticket->max_recv_bytes_per_sec == 0) {
+        ticket->max_recv_bytes_per_sec = 1;
+    }
+    if (options.max_send_bytes_per_sec > 0 && ticket->max_send_bytes_per_sec == 0) {
+        ticket->max_send_bytes_per_sec = 1;
+    }
+}
+
+END_NAMESPACE
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
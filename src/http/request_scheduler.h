@@ -0,0 +1,111 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#ifndef HTTP4CPP_HTTP_REQUEST_SCHEDULER_H
+#define HTTP4CPP_HTTP_REQUEST_SCHEDULER_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include <set>
+
+#include "common/common.h"
+#include "http_request.h"
+
+BEGIN_NAMESPACE
+
+struct SchedulerClassOptions {
+    SchedulerClassOptions() :
+        max_concurrency(0),
+        max_recv_bytes_per_sec(0),
+        max_send_bytes_per_sec(0)
+    {
+        // nothing to do
+    }
+
+    uint32_t max_concurrency;           // slots the class may hold, 0 means the total
+    int64_t  max_recv_bytes_per_sec;    // download share of the class, 0 unlimited
+    int64_t  max_send_bytes_per_sec;    // upload share of the class, 0 unlimited
+};
+
+struct SchedulerClassStat {
+    uint32_t inflight;
+    uint32_t waiting;
+    uint64_t admitted;
+    uint64_t expired;
+};
+
+// Grant handed out by RequestScheduler::acquire, the byte rates are the
+// class share divided by the slots of the class, so the requests in flight
+// together never exceed it.
+struct SchedulerTicket {
+    request_priority_t priority;
+    int64_t            max_recv_bytes_per_sec;
+    int64_t            max_send_bytes_per_sec;
+    int64_t            queued_us;
+};
+
+/**
+ * Admission gate for HttpClient::request. Waiting requests are ordered by
+ * priority, then earliest deadline, then arrival, and are admitted while
+ * both the total and the class concurrency allow it. A request whose
+ * deadline passes while queued leaves with RET_DEADLINE_EXCEEDED.
+ */
+class RequestScheduler {
+public:
+    explicit RequestScheduler(uint32_t max_concurrency);
+    ~RequestScheduler();
+
+    void set_class_options(request_priority_t priority, const SchedulerClassOptions &options);
+
+    int acquire(request_priority_t priority, int64_t deadline_ms, SchedulerTicket *ticket);
+    void release(const SchedulerTicket &ticket);
+
+    void get_class_stat(request_priority_t priority, SchedulerClassStat *stat) const;
+
+private:
+    RequestScheduler(const RequestScheduler &);
+    RequestScheduler & operator=(const RequestScheduler &);
+
+    struct Waiter {
+        request_priority_t priority;
+        int64_t            deadline_ms;
+        uint64_t           seq;
+        bool               granted;
+        pthread_cond_t     cond;
+    };
+
+    struct WaiterLess {
+        bool operator()(const Waiter *a, const Waiter *b) const
+        {
+            if (a->priority != b->priority) {
+                return a->priority < b->priority;
+            }
+            if (a->deadline_ms != b->deadline_ms) {
+                return a->deadline_ms < b->deadline_ms;
+            }
+            return a->seq < b->seq;
+        }
+    };
+
+    bool has_room(request_priority_t priority) const;
+    void grant_waiters();
+    void fill_ticket(request_priority_t priority, SchedulerTicket *ticket) const;
+
+    uint32_t                        _max_concurrency;
+    uint32_t                        _inflight;
+    uint64_t                        _seq;
+    SchedulerClassOptions           _options[REQUEST_PRIORITY_COUNT];
+    SchedulerClassStat              _stats[REQUEST_PRIORITY_COUNT];
+    std::set<Waiter *, WaiterLess>  _waiters;
+    mutable pthread_mutex_t         _mutex;
+};
+
+END_NAMESPACE
+#endif
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,344 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "http/slow_request_sampler.h"
+#include "common/ascii.h"
+#include "common/util.h"
+
+BEGIN_NAMESPACE
+
+struct SignalSampler {
+    int                signo;
+    SlowRequestSampler *sampler;
+};
+
+static const int MAX_SIGNAL_SAMPLERS = 8;
+static SignalSampler s_signal_samplers[MAX_SIGNAL_SAMPLERS];
+static pthread_mutex_t s_signal_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void on_dump_signal(int signo)
+{
+    for (int i = 0; i < MAX_SIGNAL_SAMPLERS; ++i) {
+        SlowRequestSampler *sampler = __atomic_load_n(&s_signal_samplers[i].sampler,
+                __ATOMIC_ACQUIRE);
+        if (sampler != NULL && s_signal_samplers[i].signo == signo) {
+            sampler->request_dump();
+        }
+    }
+}
+
+static const char *SENSITIVE_HEADERS[] = {
+    "authorization", "proxy-authorization", "cookie", "set-cookie"
+};
+
+static const char *SENSITIVE_WORDS[] = {
+    "token", "signature", "secret", "key", "session", "password", "credential"
+};
+
+static const char REDACTED[] = "<redacted>";
+
+SlowRequestSampler::SlowRequestSampler(const SlowRequestSamplerOptions &options) :
+    _options(options),
+    _observed(0),
+    _percentile_us(0),
+    _seq(0),
+    _dump_requested(0)
+{
+    if (_options.capacity == 0) {
+        _options.capacity = 1;
+    }
+    if (_options.window == 0) {
+        _options.window = 1000;
+    }
+    if (_options.percentile > 100) {
+        _options.percentile = 100;
+    }
+    _records.reserve(_options.capacity);
+    pthread_mutex_init(&_mutex, NULL);
+    pthread_mutex_init(&_window_mutex, NULL);
+}
+
+SlowRequestSampler::~SlowRequestSampler()
+{
+    pthread_mutex_lock(&s_signal_mutex);
+    for (int i = 0; i < MAX_SIGNAL_SAMPLERS; ++i) {
+        if (s_signal_samplers[i].sampler == this) {
+            __atomic_store_n(&s_signal_samplers[i].sampler, NULL, __ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock(&s_signal_mutex);
+    pthread_mutex_destroy(&_window_mutex);
+    pthread_mutex_destroy(&_mutex);
+}
+
+bool SlowRequestSampler::sample(const HttpRequest &request, const std::string &url,
+        const HttpResponse &response, int ret, int64_t latency_us, const std::string &body)
+{
+    if (_options.percentile > 0) {
+        _histogram.record(latency_us);
+        if (__atomic_add_fetch(&_observed, 1, __ATOMIC_RELAXED) % _options.window == 0) {
+            update_percentile();
+        }
+    }
+    poll_dump();
+
+    int64_t threshold_us = get_threshold_us();
+    if (threshold_us <= 0 || latency_us < threshold_us) {
+        return false;
+    }
+
+    SlowRequestRecord record;
+    record.time_ms = TimeUtil::now_ms();
+    record.latency_us = latency_us;
+    record.threshold_us = threshold_us;
+    record.ret = ret;
+    record.method = stringfy_http_method(request.get_http_method());
+    record.url = url.empty() ? request.get_url() : url;
+    request.get_all_headers(&record.request_headers);
+    record.http_code = response.get_http_code();
+    record.http_version = response.get_http_version();
+    record.reason_phrase = response.get_reason_phrase();
+    record.response_headers = response.get_response_header();
+    for (size_t i = 0; i < record.request_headers.size(); ++i) {
+        std::string &line = record.request_headers[i];
+        size_t colon = line.find(':');
+        if (colon != std::string::npos && should_redact(line.substr(0, colon))) {
+            line.replace(colon + 1, std::string::npos, REDACTED);
+        }
+    }
+    std::map<std::string, std::string>::iterator it = record.response_headers.begin();
+    for (; it != record.response_headers.end(); ++it) {
+        if (should_redact(it->first)) {
+            it->second = REDACTED;
+        }
+    }
+    record.transfer_info = response.get_transfer_info();
+    record.body.assign(body, 0, _options.capture_bytes);
+
+    pthread_mutex_lock(&_mutex);
+    record.seq = ++_seq;
+    if (_records.size() < _options.capacity) {
+        _records.push_back(SlowRequestRecord());
+    }
+    _records[(record.seq - 1) % _options.capacity] = record;
+    pthread_mutex_unlock(&_mutex);
+    return true;
+}
+
+int64_t SlowRequestSampler::get_threshold_us() const
+{
+    int64_t fixed_us = _options.threshold_ms * 1000;
+    int64_t percentile_us = __atomic_load_n(&_percentile_us, __ATOMIC_RELAXED);
+    if (fixed_us <= 0) {
+        return percentile_us;
+    }
+    if (percentile_us <= 0) {
+        return fixed_us;
+    }
+    return fixed_us < percentile_us ? fixed_us : percentile_us;
+}
+
+void SlowRequestSampler::update_percentile()
+{
+    if (pthread_mutex_trylock(&_window_mutex) != 0) {
+        return;
+    }
+    HistogramSnapshot now;
+    _histogram.snapshot(&now);
+    HistogramSnapshot window;
+    window.count = now.count - _window_start.count;
+    window.max = now.max;
+    for (size_t i = 0; i < window.buckets.size(); ++i) {
+        window.buckets[i] = now.buckets[i] - _window_start.buckets[i];
+    }
+    if (window.count > 0) {
+        __atomic_store_n(&_percentile_us,
+                static_cast<int64_t>(window.percentile(_options.percentile)), __ATOMIC_RELAXED);
+    }
+    _window_start = now;
+    pthread_mutex_unlock(&_window_mutex);
+}
+
+void SlowRequestSampler::get_records(std::vector<SlowRequestRecord> *records) const
+{
+    pthread_mutex_lock(&_mutex);
+    size_t size = _records.size();
+    size_t oldest = size < _options.capacity ? 0 : _seq % _options.capacity;
+    for (size_t i = 0; i < size; ++i) {
+        records->push_back(_records[(oldest + i) % size]);
+    }
+    pthread_mutex_unlock(&_mutex);
+}
+
+void SlowRequestSampler::dump(std::string *output) const
+{
+    std::vector<SlowRequestRecord> records;
+    get_records(&records);
+    char buf[128];
+    snprintf(buf, sizeof(buf), "slow requests: %u, threshold_us: %lld\n",
+            static_cast<unsigned>(records.size()), static_cast<long long>(get_threshold_us()));
+    output->append(buf);
+    for (size_t i = 0; i < records.size(); ++i) {
+        render(records[i], output);
+    }
+}
+
+int SlowRequestSampler::dump(int fd) const
+{
+    std::string output;
+    dump(&output);
+    size_t written = 0;
+    while (written < output.size()) {
+        ssize_t n = write(fd, output.data() + written, output.size() - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return RET_FILE_INVALID;
+        }
+        written += n;
+    }
+    return RET_OK;
+}
+
+int SlowRequestSampler::install_signal_handler(int signo)
+{
+    pthread_mutex_lock(&s_signal_mutex);
+    int slot = 0;
+    while (slot < MAX_SIGNAL_SAMPLERS && s_signal_samplers[slot].sampler != NULL) {
+        ++slot;
+    }
+    if (slot == MAX_SIGNAL_SAMPLERS) {
+        pthread_mutex_unlock(&s_signal_mutex);
+        return RET_ILLEGAL_OPERATION;
+    }
+    s_signal_samplers[slot].signo = signo;
+    __atomic_store_n(&s_signal_samplers[slot].sampler, this, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&s_signal_mutex);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_dump_signal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    if (sigaction(signo, &action, NULL) != 0) {
+        return RET_ILLEGAL_ARGUMENT;
+    }
+    return RET_OK;
+}
+
+bool SlowRequestSampler::poll_dump()
+{
+    if (__atomic_load_n(&_dump_requested, __ATOMIC_RELAXED) == 0
+            || !__sync_bool_compare_and_swap(&_dump_requested, 1, 0)) {
+        return false;
+    }
+    dump(_options.dump_fd);
+    return true;
+}
+
+bool SlowRequestSampler::is_sensitive_header(const std::string &name)
+{
+    std::string lower = StringUtil::lower(name);
+    for (size_t i = 0; i < sizeof(SENSITIVE_HEADERS) / sizeof(SENSITIVE_HEADERS[0]); ++i) {
+        if (lower == SENSITIVE_HEADERS[i]) {
+            return true;
+        }
+    }
+    if (lower.compare(0, 2, "x-") != 0) {
+        return false;
+    }
+    for (size_t i = 0; i < sizeof(SENSITIVE_WORDS) / sizeof(SENSITIVE_WORDS[0]); ++i) {
+        if (lower.find(SENSITIVE_WORDS[i], 2) != std::string::npos) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SlowRequestSampler::should_redact(const std::string &name) const
+{
+    if (!_options.redact_headers) {
+        return false;
+    }
+    for (size_t i = 0; i < _options.sensitive_headers.size(); ++i) {
+        if (Ascii::equals_ignore_case(name, _options.sensitive_headers[i])) {
+            return true;
+        }
+    }
+    return is_sensitive_header(name);
+}
+
+static void append_escaped(const std::string &data, std::string *output)
+{
+    for (size_t i = 0; i < data.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(data[i]);
+        if (c == '\\') {
+            output->append("\\\\");
+        } else if (c == '\n') {
+            output->append("\\n");
+        } else if (c == '\r') {
+            output->append("\\r");
+        } else if (c < 0x20 || c >= 0x7f) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\x%02x", c);
+            output->append(buf);
+        } else {
+            output->append(1, c);
+        }
+    }
+}
+
+void SlowRequestSampler::render(const SlowRequestRecord &record, std::string *output)
+{
+    char buf[512];
+    snprintf(buf, sizeof(buf), "#%llu %s latency_us:%lld threshold_us:%lld ret:%d\n",
+            static_cast<unsigned long long>(record.seq),
+            TimeUtil::timestamp_to_utctime(record.time_ms / 1000).c_str(),
+            static_cast<long long>(record.latency_us),
+            static_cast<long long>(record.threshold_us), record.ret);
+    output->append(buf);
+
+    output->append("> ").append(record.method).append(" ").append(record.url).append("\n");
+    for (size_t i = 0; i < record.request_headers.size(); ++i) {
+        output->append("> ").append(record.request_headers[i]).append("\n");
+    }
+
+    snprintf(buf, sizeof(buf), "< %s %d ", record.http_version.c_str(), record.http_code);
+    output->append(buf).append(record.reason_phrase).append("\n");
+    std::map<std::string, std::string>::const_iterator it = record.response_headers.begin();
+    for (; it != record.response_headers.end(); ++it) {
+        output->append("< ").append(it->first).append(": ").append(it->second).append("\n");
+    }
+
+    const HttpTransferInfo &info = record.transfer_info;
+    snprintf(buf, sizeof(buf), "  queue_us:%lld namelookup_us:%lld connect_us:%lld "
+            "appconnect_us:%lld pretransfer_us:%lld starttransfer_us:%lld total_us:%lld "
+            "reused:%d sent:%lld received:%lld\n",
+            static_cast<long long>(info.queue_us), static_cast<long long>(info.namelookup_us),
+            static_cast<long long>(info.connect_us), static_cast<long long>(info.appconnect_us),
+            static_cast<long long>(info.pretransfer_us),
+            static_cast<long long>(info.starttransfer_us),
+            static_cast<long long>(info.total_us), info.connection_reused ? 1 : 0,
+            static_cast<long long>(info.bytes_sent), static_cast<long long>(info.bytes_received));
+    output->append(buf);
+
+    snprintf(buf, sizeof(buf), "  body(%u): ", static_cast<unsigned>(record.body.size()));
+    output->append(buf);
+    append_escaped(record.body, output);
+    output->append("\n");
+}
+
+END_NAMESPACE
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,151 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#ifndef HTTP4CPP_HTTP_SLOW_REQUEST_SAMPLER_H
+#define HTTP4CPP_HTTP_SLOW_REQUEST_SAMPLER_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "common/common.h"
+#include "common/metrics.h"
+#include "http_request.h"
+#include "http_response.h"
+
+BEGIN_NAMESPACE
+
+struct SlowRequestSamplerOptions {
+    SlowRequestSamplerOptions() :
+        threshold_ms(0),
+        percentile(0),
+        window(1000),
+        capacity(64),
+        capture_bytes(1024),
+        dump_fd(2),
+        redact_headers(true)
+    {
+        // nothing to do
+    }
+
+    int64_t  threshold_ms;      // fixed trigger, 0 disables it
+    double   percentile;        // trigger above this percentile, 0 to 100, of the last window,
+                                // 0 disables it
+    uint32_t window;            // requests per percentile window
+    uint32_t capacity;          // records kept, the oldest is overwritten
+    uint32_t capture_bytes;     // leading response body bytes kept
+    int      dump_fd;           // destination of signal requested dumps
+    bool     redact_headers;    // keep credentials out of the records, see is_sensitive_header
+    std::vector<std::string> sensitive_headers;     // further names to redact
+};
+
+struct SlowRequestRecord {
+    SlowRequestRecord() :
+        seq(0),
+        time_ms(0),
+        latency_us(0),
+        threshold_us(0),
+        ret(0),
+        http_code(0)
+    {
+        // nothing to do
+    }
+
+    uint64_t                            seq;
+    int64_t                             time_ms;        // wall clock at completion
+    int64_t                             latency_us;
+    int64_t                             threshold_us;   // trigger that fired
+    int                                 ret;
+    std::string                         method;
+    std::string                         url;
+    std::vector<std::string>            request_headers;
+    int                                 http_code;
+    std::string                         http_version;
+    std::string                         reason_phrase;
+    std::map<std::string, std::string>  response_headers;
+    HttpTransferInfo                    transfer_info;
+    std::string                         body;
+};
+
+/**
+ * Keeps the diagnostics of outlier requests in a bounded ring. Every request
+ * is checked against a fixed threshold and the given percentile of the
+ * previous window, only the ones above are copied. Installed with
+ * HttpClient::set_slow_request_sampler, which then captures the first
+ * capture_bytes of each response body and the transfer timings.
+ *
+ * Values of credential headers are replaced by "<redacted>" before a record
+ * is stored, unless redact_headers is off.
+ *
+ * dump() renders the ring on demand. After install_signal_handler the signal
+ * only raises the flag of this sampler, the next request it completes, or
+ * poll_dump(), writes the dump to dump_fd outside of the signal context.
+ */
+class SlowRequestSampler {
+public:
+    explicit SlowRequestSampler(const SlowRequestSamplerOptions &options);
+    ~SlowRequestSampler();
+
+    const SlowRequestSamplerOptions & get_options() const
+    {
+        return _options;
+    }
+
+    // Called for every completed request, true when it was recorded.
+    bool sample(const HttpRequest &request, const std::string &url,
+            const HttpResponse &response, int ret, int64_t latency_us, const std::string &body);
+
+    // Current trigger in microseconds, 0 before any is known.
+    int64_t get_threshold_us() const;
+
+    // Oldest first.
+    void get_records(std::vector<SlowRequestRecord> *records) const;
+    void dump(std::string *output) const;
+    int dump(int fd) const;
+
+    // At most 8 samplers take signals, until they are destroyed.
+    int install_signal_handler(int signo);
+    // Async signal safe, the dump is written by poll_dump().
+    void request_dump()
+    {
+        __atomic_store_n(&_dump_requested, 1, __ATOMIC_RELAXED);
+    }
+    // Writes a dump when one was requested since the last call, true if so.
+    bool poll_dump();
+
+    static void render(const SlowRequestRecord &record, std::string *output);
+    // Authorization, Proxy-Authorization, Cookie, Set-Cookie and x- headers
+    // naming a token, signature, secret, key, session, password or
+    // credential, case insensitive.
+    static bool is_sensitive_header(const std::string &name);
+
+private:
+    SlowRequestSampler(const SlowRequestSampler &);
+    SlowRequestSampler & operator=(const SlowRequestSampler &);
+
+    void update_percentile();
+    bool should_redact(const std::string &name) const;
+
+    SlowRequestSamplerOptions       _options;
+    LatencyHistogram                _histogram;
+    HistogramSnapshot               _window_start;
+    uint64_t                        _observed;
+    int64_t                         _percentile_us;
+    std::vector<SlowRequestRecord>  _records;
+    uint64_t                        _seq;
+    int                             _dump_requested;
+    mutable pthread_mutex_t         _mutex;
+    pthread_mutex_t                 _window_mutex;
+};
+
+END_NAMESPACE
+#endif
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
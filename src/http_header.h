@@ -0,0 +1,167 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#ifndef HTTP4CPP_HTTP_HEADER_H
+#define HTTP4CPP_HTTP_HEADER_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <map>
+#include <string>
+
+#include "common/arena.h"
+#include "common/ascii.h"
+#include "common/common.h"
+#include "common/string_piece.h"
+
+BEGIN_NAMESPACE
+
+// Name and value are '\0' terminated copies in an Arena.
+struct HttpHeaderField {
+    StringPiece      name;
+    StringPiece      value;
+    size_t           value_capacity;    // bytes of the value slot, with the '\0'
+    HttpHeaderField *next;
+};
+
+/**
+ * Header fields in the order they were added, kept with their names and
+ * values in an Arena so adding one costs no heap allocation. Lookups are
+ * linear, a message has few fields.
+ */
+class HttpHeaderList {
+public:
+    HttpHeaderList() : _first(NULL), _last(NULL), _size(0), _map_built(0)
+    {
+        pthread_mutex_init(&_map_mutex, NULL);
+    }
+
+    ~HttpHeaderList()
+    {
+        pthread_mutex_destroy(&_map_mutex);
+    }
+
+    // With replace a field of the same name, spelled the same, gets the value.
+    // It is written over the old one when that slot is large enough, so a
+    // header updated for every call does not grow the arena.
+    void add(Arena *arena, const StringPiece &name, const StringPiece &value, bool replace)
+    {
+        if (_map_built) {
+            _map[name.as_string()] = value.as_string();
+        }
+        if (replace) {
+            for (HttpHeaderField *field = _first; field != NULL; field = field->next) {
+                if (field->name != name) {
+                    continue;
+                }
+                if (value.size() < field->value_capacity) {
+                    char *slot = const_cast<char *>(field->value.data());
+                    if (!value.empty()) {
+                        memmove(slot, value.data(), value.size());
+                    }
+                    slot[value.size()] = '\0';
+                    field->value = StringPiece(slot, value.size());
+                } else {
+                    field->value = arena->copy(value);
+                    field->value_capacity = value.size() + 1;
+                }
+                return;
+            }
+        }
+        HttpHeaderField *field = reinterpret_cast<HttpHeaderField *>(
+                arena->allocate(sizeof(HttpHeaderField)));
+        field->name = arena->copy(name);
+        field->value = arena->copy(value);
+        field->value_capacity = value.size() + 1;
+        field->next = NULL;
+        if (_last == NULL) {
+            _first = field;
+        } else {
+            _last->next = field;
+        }
+        _last = field;
+        ++_size;
+    }
+
+    // The last field spelled like name, else the last one differing in case.
+    const HttpHeaderField * find(const StringPiece &name) const
+    {
+        const HttpHeaderField *folded = NULL;
+        const HttpHeaderField *exact = NULL;
+        for (const HttpHeaderField *field = _first; field != NULL; field = field->next) {
+            if (field->name == name) {
+                exact = field;
+            } else if (Ascii::equals_ignore_case(field->name, name)) {
+                folded = field;
+            }
+        }
+        return exact != NULL ? exact : folded;
+    }
+
+    const HttpHeaderField * first() const
+    {
+        return _first;
+    }
+
+    size_t size() const
+    {
+        return _size;
+    }
+
+    // The arena keeps the memory until it is reset.
+    void clear()
+    {
+        _map.clear();
+        _first = NULL;
+        _last = NULL;
+        _size = 0;
+    }
+
+    // Later fields of the same name win.
+    void to_map(std::map<std::string, std::string> *headers) const
+    {
+        headers->clear();
+        for (const HttpHeaderField *field = _first; field != NULL; field = field->next) {
+            (*headers)[field->name.as_string()] = field->value.as_string();
+        }
+    }
+
+    // The fields as a map, built on the first call and kept up to date by
+    // later changes, so a reference stays valid as long as the list. Threads
+    // that only read the list may call it concurrently.
+    const std::map<std::string, std::string> & as_map() const
+    {
+        if (!__atomic_load_n(&_map_built, __ATOMIC_ACQUIRE)) {
+            pthread_mutex_lock(&_map_mutex);
+            if (!_map_built) {
+                to_map(&_map);
+                __atomic_store_n(&_map_built, 1, __ATOMIC_RELEASE);
+            }
+            pthread_mutex_unlock(&_map_mutex);
+        }
+        return _map;
+    }
+
+private:
+    HttpHeaderList(const HttpHeaderList &);
+    HttpHeaderList & operator=(const HttpHeaderList &);
+
+    HttpHeaderField *_first;
+    HttpHeaderField *_last;
+    size_t           _size;
+    // the as_map() copy, kept in step with the fields once built
+    mutable std::map<std::string, std::string> _map;
+    mutable int                                 _map_built;
+    mutable pthread_mutex_t                     _map_mutex;
+};
+
+END_NAMESPACE
+#endif
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -7,33 +7,164 @@
  * http://www.apache.org/licenses/LICENSE-2.0
  */
 #include "http_request.h"
+#include "common/util.h"
 
 BEGIN_NAMESPACE
 
+const char * stringfy_http_method(int method)
+{
+    switch (method) {
+        case HTTP_METHOD_PUT:
+            return "PUT";
+        case HTTP_METHOD_GET:
+            return "GET";
+        case HTTP_METHOD_POST:
+            return "POST";
+        case HTTP_METHOD_HEAD:
+            return "HEAD";
+        case HTTP_METHOD_DELETE:
+            return "DELETE";
+        default:
+            return "INVALID";
+    }
+}
+
 HttpRequest::HttpRequest() :
+    _own_arena(),
+    _arena(&_own_arena),
     _in_stream(NULL),
     _url(""),
+    _service(""),
+    _hash_key(""),
     _headers(),
     _method(HTTP_METHOD_INVALID),
-    _timeout(-1)
+    _timeout(-1),
+    _connect_timeout(-1),
+    _first_byte_timeout(-1),
+    _low_speed_limit(0),
+    _low_speed_time(0),
+    _priority(REQUEST_PRIORITY_NORMAL),
+    _deadline_ms(0),
+    _trace_parent("")
 {
     // Nothint to do
 }
 
+HttpRequest::HttpRequest(Arena *arena) :
+    _own_arena(),
+    _arena(arena != NULL ? arena : &_own_arena),
+    _in_stream(NULL),
+    _url(""),
+    _service(""),
+    _hash_key(""),
+    _headers(),
+    _method(HTTP_METHOD_INVALID),
+    _timeout(-1),
+    _connect_timeout(-1),
+    _first_byte_timeout(-1),
+    _low_speed_limit(0),
+    _low_speed_time(0),
+    _priority(REQUEST_PRIORITY_NORMAL),
+    _deadline_ms(0),
+    _trace_parent("")
+{
+    // Nothint to do
+}
+
+// A copy shares the arena given to the original, else it has its own.
+HttpRequest::HttpRequest(const HttpRequest &other) :
+    _own_arena(),
+    _arena(other._arena == &other._own_arena ? &_own_arena : other._arena),
+    _in_stream(other._in_stream),
+    _url(other._url),
+    _service(other._service),
+    _hash_key(other._hash_key),
+    _headers(),
+    _method(other._method),
+    _timeout(other._timeout),
+    _connect_timeout(other._connect_timeout),
+    _first_byte_timeout(other._first_byte_timeout),
+    _low_speed_limit(other._low_speed_limit),
+    _low_speed_time(other._low_speed_time),
+    _priority(other._priority),
+    _deadline_ms(other._deadline_ms),
+    _trace_parent(other._trace_parent)
+{
+    copy_headers(other);
+}
+
+HttpRequest & HttpRequest::operator=(const HttpRequest &other)
+{
+    if (this == &other) {
+        return *this;
+    }
+    _in_stream = other._in_stream;
+    _url = other._url;
+    _service = other._service;
+    _hash_key = other._hash_key;
+    _method = other._method;
+    _timeout = other._timeout;
+    _connect_timeout = other._connect_timeout;
+    _first_byte_timeout = other._first_byte_timeout;
+    _low_speed_limit = other._low_speed_limit;
+    _low_speed_time = other._low_speed_time;
+    _priority = other._priority;
+    _deadline_ms = other._deadline_ms;
+    _trace_parent = other._trace_parent;
+
+    _headers.clear();
+    if (_arena == &_own_arena) {
+        _own_arena.reset();
+    }
+    copy_headers(other);
+    return *this;
+}
+
 HttpRequest::~HttpRequest()
 {
     _in_stream = NULL;
     _url.clear();
+    _service.clear();
+    _hash_key.clear();
     _headers.clear();
     _method = HTTP_METHOD_INVALID;
     _timeout = -1;
+    _connect_timeout = -1;
+    _first_byte_timeout = -1;
+    _deadline_ms = 0;
+}
+
+void HttpRequest::copy_headers(const HttpRequest &other)
+{
+    for (const HttpHeaderField *field = other._headers.first(); field != NULL;
+            field = field->next) {
+        _headers.add(_arena, field->name, field->value, false);
+    }
+}
+
+void HttpRequest::set_deadline_after_ms(int64_t budget_ms)
+{
+    _deadline_ms = TimeUtil::monotonic_ms() + budget_ms;
+}
+
+int64_t HttpRequest::get_remaining_ms() const
+{
+    if (_deadline_ms <= 0) {
+        return -1;
+    }
+    int64_t remaining = _deadline_ms - TimeUtil::monotonic_ms();
+    return remaining < 0 ? 0 : remaining;
 }
 
 int HttpRequest::get_all_headers(std::vector<std::string> *header) const
 {
-    std::map<std::string, std::string>::const_iterator it = _headers.begin();
-    for (; it != _headers.end(); it++) {
-        header->push_back(it->first + ":" + it->second);
+    for (const HttpHeaderField *field = _headers.first(); field != NULL; field = field->next) {
+        std::string line;
+        line.reserve(field->name.size() + 1 + field->value.size());
+        line.append(field->name.data(), field->name.size());
+        line.append(1, ':');
+        line.append(field->value.data(), field->value.size());
+        header->push_back(line);
     }
 
     return 0;
@@ -9,11 +9,15 @@
 #ifndef HTTP4CPP_REQUEST_HTTP_REQUEST_H
 #define HTTP4CPP_REQUEST_HTTP_REQUEST_H
 
+#include <stdint.h>
+
 #include <string>
 #include <vector>
 #include <map>
 
+#include "common/arena.h"
 #include "common/common.h"
+#include "http_header.h"
 
 BEGIN_NAMESPACE
 
@@ -26,12 +30,30 @@ enum http_method_t {
     HTTP_METHOD_DELETE
 };
 
+const char * stringfy_http_method(int method);
+
+// Scheduling class of a request, smaller value is served first.
+enum request_priority_t {
+    REQUEST_PRIORITY_INTERACTIVE = 0,
+    REQUEST_PRIORITY_NORMAL,
+    REQUEST_PRIORITY_BULK,
+    REQUEST_PRIORITY_COUNT
+};
+
 class InputStream;
 
 class HttpRequest {
 public:
     HttpRequest();
 
+    // Header fields are kept in arena, which must outlive the request, NULL
+    // gives the request an arena of its own.
+    explicit HttpRequest(Arena *arena);
+
+    HttpRequest(const HttpRequest &other);
+
+    HttpRequest & operator=(const HttpRequest &other);
+
     ~HttpRequest();
 
     void set_input_stream(InputStream *in_stream)
@@ -54,26 +76,58 @@ public:
         return _method;
     }
 
-    void add_http_header(const std::string &key, const std::string &val)
+    // A header of the same name replaces the value, headers are sent in the
+    // order they were first added.
+    void add_http_header(const StringPiece &key, const StringPiece &val)
     {
-        _headers[key] = val;
+        _headers.add(_arena, key, val, true);
     }
 
-    const std::map<std::string, std::string> & get_http_header() const
+    const HttpHeaderList & get_header_list() const
     {
         return _headers;
     }
 
+    // Built on first use and updated in place, prefer get_header_list().
+    const std::map<std::string, std::string> & get_http_header() const
+    {
+        return _headers.as_map();
+    }
+
     void set_url(const std::string &url)
     {
         _url = url;
     }
 
-    std::string get_url() const
+    const std::string & get_url() const
     {
         return _url;
     }
 
+    // Name of a service registered by HttpClient::register_service, the url
+    // is then taken as the path appended to the picked endpoint address.
+    void set_service(const std::string &service)
+    {
+        _service = service;
+    }
+
+    const std::string & get_service() const
+    {
+        return _service;
+    }
+
+    // Key used by consistent hash balancing, the url is used if not set.
+    void set_hash_key(const std::string &hash_key)
+    {
+        _hash_key = hash_key;
+    }
+
+    const std::string & get_hash_key() const
+    {
+        return _hash_key;
+    }
+
+    // All timeouts are in milliseconds, values <= 0 disable them.
     int get_timeout() const
     {
         return _timeout;
@@ -84,14 +138,104 @@ public:
         _timeout = timeout;
     }
 
+    int get_connect_timeout() const
+    {
+        return _connect_timeout;
+    }
+
+    void set_connect_timeout(int timeout)
+    {
+        _connect_timeout = timeout;
+    }
+
+    // Time allowed until the response status line arrives.
+    int get_first_byte_timeout() const
+    {
+        return _first_byte_timeout;
+    }
+
+    void set_first_byte_timeout(int timeout)
+    {
+        _first_byte_timeout = timeout;
+    }
+
+    // Abort when the transfer stays below bytes_per_sec for seconds.
+    void set_low_speed_limit(int64_t bytes_per_sec, int seconds)
+    {
+        _low_speed_limit = bytes_per_sec;
+        _low_speed_time = seconds;
+    }
+
+    int64_t get_low_speed_limit() const
+    {
+        return _low_speed_limit;
+    }
+
+    int get_low_speed_time() const
+    {
+        return _low_speed_time;
+    }
+
+    void set_priority(request_priority_t priority)
+    {
+        _priority = priority;
+    }
+
+    request_priority_t get_priority() const
+    {
+        return _priority;
+    }
+
+    // Absolute deadline in TimeUtil::monotonic_ms() milliseconds, 0 means none.
+    void set_deadline_ms(int64_t deadline_ms)
+    {
+        _deadline_ms = deadline_ms;
+    }
+
+    int64_t get_deadline_ms() const
+    {
+        return _deadline_ms;
+    }
+
+    void set_deadline_after_ms(int64_t budget_ms);
+
+    // Milliseconds left before the deadline, -1 without deadline. The deadline
+    // stays on the request, so retries of it share one budget.
+    int64_t get_remaining_ms() const;
+
+    // W3C traceparent of the caller's own trace, a traced request becomes its
+    // child. The header sent is always generated by the tracer.
+    void set_trace_parent(const std::string &trace_parent)
+    {
+        _trace_parent = trace_parent;
+    }
+
+    const std::string & get_trace_parent() const
+    {
+        return _trace_parent;
+    }
+
     int get_all_headers(std::vector<std::string> *header) const;
 
 private:
+    void copy_headers(const HttpRequest &other);
+
+    Arena                              _own_arena;
+    Arena *                            _arena;
     InputStream *                      _in_stream;
     std::string                        _url;
-    std::map<std::string, std::string> _headers;
+    std::string                        _service;
+    std::string                        _hash_key;
+    HttpHeaderList                     _headers;
     http_method_t                      _method;
     int                                _timeout;
+    int                                _connect_timeout;
+    int                                _first_byte_timeout;
+    int64_t                            _low_speed_limit;
+    int                                _low_speed_time;
+    request_priority_t                 _priority;
+    int64_t                            _deadline_ms;
+    std::string                        _trace_parent;
 };
 
 END_NAMESPACE
@@ -6,29 +6,33 @@
  * Distributed under the Apache License Version 2.0
  * http://www.apache.org/licenses/LICENSE-2.0
  */
-#include <string.h>
 
 #include "http_response.h"
+#include "common/ascii.h"
+#include "common/digest_stream.h"
 #include "common/util.h"
 #include "common/memory_stream.h"
+#include "common/probes.h"
 
 BEGIN_NAMESPACE
 
-int HttpResponse::parse_status_line(const std::string &status_line)
+int HttpResponse::parse_status_line(const StringPiece &status_line)
 {
-    std::vector<std::string> items;
-    StringUtil::split(status_line, std::string(" "), 3, &items);
-    if (items.size() != 3U) {
-        std::stringstream ss;
-        ss << "status_line format error, status_line:" << status_line;
-        ERROR("%s", ss.str().c_str());
+    StringSplitter items(status_line, " ", 3);
+    StringPiece version;
+    StringPiece code;
+    StringPiece reason;
+    if (!items.next(&version) || !items.next(&code) || !items.next(&reason)) {
+        ERROR("status_line format error, status_line:%.*s",
+                static_cast<int>(status_line.size()), status_line.data());
         return RET_SERVICE_ERROR;
     }
 
-    _http_version = StringUtil::trim(items[0]);
-    std::stringstream ss(StringUtil::trim(items[1]));
-    ss >> _http_code;
-    _reason_phrase = StringUtil::trim(items[2]);
+    _http_version = StringUtil::trim_view(version).as_string();
+    if (StringUtil::parse_num(StringUtil::trim_view(code), &_http_code) != RET_OK) {
+        _http_code = 0;
+    }
+    _reason_phrase = StringUtil::trim_view(reason).as_string();
 
     DEBUG("Http version : %s", _http_version.c_str());
     DEBUG("Http code : %d", _http_code);
@@ -36,39 +40,37 @@ int HttpResponse::parse_status_line(const std::string &status_line)
     return 0;
 }
 
-int HttpResponse::parse_header_line(const std::string &header_line,
-        std::string *key, std::string *value)
+int HttpResponse::parse_header_line(const StringPiece &header_line,
+        StringPiece *key, StringPiece *value)
 {
-    std::vector<std::string> items;
-    StringUtil::split(header_line, std::string(":"), 2, &items);
-    if (items.size() != 2U) {
-        std::stringstream ss;
-        ss << "parse_header_line error, header_line:" << header_line;
-        ERROR("%s", ss.str().c_str());
+    size_t colon = header_line.find(':');
+    if (colon == std::string::npos) {
+        ERROR("parse_header_line error, header_line:%.*s",
+                static_cast<int>(header_line.size()), header_line.data());
         return 0;
     }
 
-    key->assign(StringUtil::trim(items[0]));
-    value->assign(StringUtil::trim(items[1]));
+    *key = StringUtil::trim_view(header_line.substr(0, colon));
+    *value = StringUtil::trim_view(header_line.substr(colon + 1));
     return 0;
 }
 
-int HttpResponse::write_header(const std::string &line)
+int HttpResponse::write_header(const StringPiece &line)
 {
-    DEBUG("receive http header line: %s", StringUtil::trim(line).c_str());
+    DEBUG("receive http header line: %.*s", static_cast<int>(StringUtil::rtrim_view(line).size()),
+            line.data());
     if (_has_recv_status_line) {
-        std::string key;
-        std::string value;
+        StringPiece key;
+        StringPiece value;
 
         int ret = parse_header_line(line, &key, &value);
         if (ret != 0) {
             return ret;
         }
 
-        if (strncmp("Content-Length", key.c_str(), key.size()) == 0 && _body_stream != NULL) {
-            std::stringstream ss(value);
+        if (_body_stream != NULL && Ascii::equals_ignore_case(key, "Content-Length")) {
             long long content_length = 0;
-            ss >> content_length;
+            StringUtil::parse_num(value, &content_length);
             ret = _body_stream->reserve(content_length);
             if (ret != 0) {
                 ERROR("%s", stringfy_ret_code(RET_CLIENT_ERROR));
@@ -76,9 +78,18 @@ int HttpResponse::write_header(const std::string &line)
             }
         }
 
-        _response_headers[key] = value;
+        if (_body_stream != NULL && Ascii::equals_ignore_case(key, "Content-Type")) {
+            // a stream that can not take the body fails its writes
+            if (_body_stream->set_content_type(value.as_string()) != 0) {
+                ERROR("body stream rejects content type:%.*s",
+                        static_cast<int>(value.size()), value.data());
+            }
+        }
+
+        _headers.add(_arena, key, value, false);
 
-        DEBUG("add response header, %s : %s", key.c_str(), value.c_str());
+        DEBUG("add response header, %.*s : %.*s", static_cast<int>(key.size()), key.data(),
+                static_cast<int>(value.size()), value.data());
         return 0;
     } else {
         _has_recv_status_line = true;
@@ -88,10 +99,12 @@ int HttpResponse::write_header(const std::string &line)
 
 int HttpResponse::write_body(void *ptr, size_t size)
 {
-    std::string line(reinterpret_cast<char *>(ptr), size);
+    StringPiece line(reinterpret_cast<char *>(ptr), size);
     if (!_has_recv_header_line) {
-        if (line == std::string("\r\n")) {
+        if (line == "\r\n") {
             _has_recv_header_line = true;
+            HTTP4CPP_PROBE3(headers__received, this, _http_code,
+                    static_cast<int>(_headers.size()));
             return 2;
         }
         int ret = write_header(line);
@@ -100,9 +113,10 @@ int HttpResponse::write_body(void *ptr, size_t size)
         }
         return size;
     } else {
-        DEBUG("receive http body, length: %d", line.size());
+        DEBUG("receive http body, length: %d", static_cast<int>(size));
+        HTTP4CPP_PROBE2(body__chunk, this, size);
         if (_http_code < 200 || _http_code >= 300) {
-            _error_stream << line;
+            _error_message.append(line.data(), line.size());
             return size;
         }
 
@@ -111,17 +125,70 @@ int HttpResponse::write_body(void *ptr, size_t size)
     return size;
 }
 
-int HttpResponse::get_response_header(const std::string &key, std::string *data) const
+int HttpResponse::get_response_header(const StringPiece &key, std::string *data) const
 {
-    std::map<std::string, std::string>::const_iterator it = _response_headers.find(key);
-    if (it == _response_headers.end()) {
-        ERROR("get response header failed : %s", key.c_str());
+    // header names are case insensitive, the exact spelling is preferred
+    const HttpHeaderField *field = _headers.find(key);
+    if (field == NULL) {
+        ERROR("get response header failed : %.*s", static_cast<int>(key.size()), key.data());
         return -1;
     }
-    data->assign(it->second);
+    data->assign(field->value.data(), field->value.size());
 
     return 0;
 }
 
+int HttpResponse::get_response_date(const std::string &key, int64_t *timestamp) const
+{
+    std::string value;
+    if (get_response_header(key, &value) != 0) {
+        return RET_ILLEGAL_ARGUMENT;
+    }
+    return TimeUtil::parse_http_date(value, timestamp);
+}
+
+int HttpResponse::verify_digest(const std::string &header, const std::string &digest) const
+{
+    const HttpHeaderField *field = _headers.find(header);
+    if (field == NULL) {
+        ERROR("get response header failed : %s", header.c_str());
+        return RET_CHECKSUM_MISSING;
+    }
+    const StringPiece &value = field->value;
+    std::string base64 = StringUtil::base64_encode(digest);
+    std::string hex = StringUtil::hex(digest);
+    StringSplitter items(value, ",");
+    StringPiece item;
+    while (items.next(&item)) {
+        item = StringUtil::trim_view(item);
+        // "name=value", the '=' of base64 padding only appears at the end
+        size_t equal = item.find('=');
+        if (equal != std::string::npos
+                && StringUtil::ltrim_view(item.substr(equal), "=").size() > 0) {
+            item.remove_prefix(equal + 1);
+        }
+        if (item == base64 || Ascii::equals_ignore_case(item, hex)) {
+            return RET_OK;
+        }
+    }
+    ERROR("digest mismatch, %s : %s", header.c_str(), value.data());
+    return RET_CHECKSUM_MISMATCH;
+}
+
+int HttpResponse::verify_body_digest()
+{
+    if (_digest_stream == NULL || _http_code / 100 != 2 || _http_code == 206) {
+        return RET_OK;
+    }
+    return verify_digest(_digest_header, _digest_stream->finish());
+}
+
+void HttpResponse::set_output_stream(DigestOutputStream *tee, const std::string &digest_header)
+{
+    _body_stream = tee;
+    _digest_stream = tee;
+    _digest_header = digest_header;
+}
+
 END_NAMESPACE
 /* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
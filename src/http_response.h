@@ -9,32 +9,93 @@
 #ifndef HTTP4CPP_HTTP_RESPONSE_H
 #define HTTP4CPP_HTTP_RESPONSE_H
 
+#include <stdint.h>
+
 #include <map>
 #include <string>
-#include <sstream>
 #include <vector>
 
+#include "common/arena.h"
 #include "common/common.h"
 #include "common/stream.h"
+#include "common/string_piece.h"
+#include "http_header.h"
 
 BEGIN_NAMESPACE
 
+class DigestOutputStream;
 class OutputStream;
 
+// Transfer phases as reported by curl, every *_us value is measured from the
+// start of the transfer, so connect_us - namelookup_us is the TCP handshake.
+struct HttpTransferInfo {
+    HttpTransferInfo() :
+        collected(false),
+        queue_us(0),
+        namelookup_us(0),
+        connect_us(0),
+        appconnect_us(0),
+        pretransfer_us(0),
+        starttransfer_us(0),
+        total_us(0),
+        bytes_sent(0),
+        bytes_received(0),
+        connection_reused(false)
+    {
+        // nothing to do
+    }
+
+    bool    collected;
+    int64_t queue_us;           // spent in the scheduler before the transfer
+    int64_t namelookup_us;      // DNS done
+    int64_t connect_us;         // TCP connected
+    int64_t appconnect_us;      // TLS handshake done, 0 for plain http
+    int64_t pretransfer_us;     // request about to be sent
+    int64_t starttransfer_us;   // first response byte
+    int64_t total_us;
+    int64_t bytes_sent;         // request line, headers and body
+    int64_t bytes_received;     // response headers and body
+    bool    connection_reused;
+};
+
 class HttpResponse {
 public:
-    HttpResponse()
+    HttpResponse() :
+        _own_arena(),
+        _arena(&_own_arena),
+        _body_stream(NULL),
+        _digest_stream(NULL),
+        _http_code(0),
+        _has_recv_status_line(false),
+        _has_recv_header_line(false)
     {
-        _body_stream = NULL;
-        _has_recv_status_line = false;
-        _has_recv_header_line = false;
+        // nothing to do
+    }
+
+    // Header fields are kept in arena, which must outlive the response, NULL
+    // gives the response an arena of its own.
+    explicit HttpResponse(Arena *arena) :
+        _own_arena(),
+        _arena(arena != NULL ? arena : &_own_arena),
+        _body_stream(NULL),
+        _digest_stream(NULL),
+        _http_code(0),
+        _has_recv_status_line(false),
+        _has_recv_header_line(false)
+    {
+        // nothing to do
     }
 
     void set_output_stream(OutputStream * data)
     {
         _body_stream = data;
+        _digest_stream = NULL;
     }
 
+    // The body goes through tee, HttpClient::request compares its digest with
+    // digest_header once a 2xx transfer completes, see verify_digest.
+    void set_output_stream(DigestOutputStream *tee, const std::string &digest_header);
+
     OutputStream * get_output_stream() const
     {
         return _body_stream;
@@ -72,30 +133,76 @@ public:
 
     std::string get_error_message() const
     {
-        return _error_stream.str();
+        return _error_message;
+    }
+
+    const HttpHeaderList & get_header_list() const
+    {
+        return _headers;
     }
 
+    // Built on first use and updated in place, prefer get_header_list().
     const std::map<std::string, std::string> & get_response_header() const
     {
-        return _response_headers;
+        return _headers.as_map();
     }
 
-    int write_header(const std::string &line);
+    const HttpTransferInfo & get_transfer_info() const
+    {
+        return _transfer_info;
+    }
+
+    void set_transfer_info(const HttpTransferInfo &info)
+    {
+        _transfer_info = info;
+    }
+
+    bool has_recv_status_line() const
+    {
+        return _has_recv_status_line;
+    }
+
+    bool has_recv_header_line() const
+    {
+        return _has_recv_header_line;
+    }
+
+    int write_header(const StringPiece &line);
     int write_body(void *ptr, size_t size);
-    int get_response_header(const std::string &key, std::string *data) const;
+    int get_response_header(const StringPiece &key, std::string *data) const;
+    // A date header such as Date, Last-Modified or Expires as seconds since
+    // the epoch, RET_ILLEGAL_ARGUMENT if it is missing or no HTTP date.
+    int get_response_date(const std::string &key, int64_t *timestamp) const;
+    // Compares a raw digest, e.g. DigestOutputStream::finish(), with the base64
+    // or hex value in header. A "crc32c=...,md5=..." list matches on any item.
+    // RET_CHECKSUM_MISSING if the header is missing, RET_CHECKSUM_MISMATCH if
+    // no value matches.
+    int verify_digest(const std::string &header, const std::string &digest) const;
+    // RET_OK without a digest header, for a status other than 2xx and for a
+    // 206 whose body is only part of what the digest describes, else as
+    // verify_digest with what the tee computed. HEAD is never checked.
+    int verify_body_digest();
 
 private:
-    int parse_status_line(const std::string &status_line);
-    int parse_header_line(const std::string &header_line, std::string *key, std::string *value);
+    HttpResponse(const HttpResponse &);
+    HttpResponse & operator=(const HttpResponse &);
+
+    int parse_status_line(const StringPiece &status_line);
+    int parse_header_line(const StringPiece &header_line, StringPiece *key, StringPiece *value);
 
+    Arena                              _own_arena;
+    Arena *                            _arena;
     OutputStream *                     _body_stream;
-    std::stringstream                  _error_stream;
+    DigestOutputStream *               _digest_stream;
+    std::string                        _digest_header;
+    std::string                        _error_message;
     std::string                        _http_version;
     int                                _http_code;
     std::string                        _reason_phrase;
-    std::map<std::string, std::string> _response_headers;
+    HttpHeaderList                     _headers;
     bool                               _has_recv_status_line;
     bool                               _has_recv_header_line;
+    HttpTransferInfo                   _transfer_info;
 };
 
 END_NAMESPACE
@@ -0,0 +1,200 @@
+#include <stdint.h>
+#include <string.h>
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "common/arena.h"
+#include "common/common.h"
+#include "common/memory_stream.h"
+#include "http_header.h"
+#include "http_request.h"
+#include "http_response.h"
+
+BEGIN_NAMESPACE
+
+log_level_t g_log_level = LOG_LEVEL_FATAL;
+bool g_log_behind       = false;
+
+static int s_failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        std::cout << __FILE__ << "(" << __LINE__ << ") check failed: " #cond << std::endl; \
+        ++s_failures; \
+    } \
+} while (0)
+
+static bool aligned(const void *p)
+{
+    return reinterpret_cast<uintptr_t>(p) % 16 == 0;
+}
+
+static void test_arena()
+{
+    Arena heap(64);
+    CHECK(heap.get_heap_blocks() == 0);
+    char *a = reinterpret_cast<char *>(heap.allocate(3));
+    char *b = reinterpret_cast<char *>(heap.allocate(8));
+    CHECK(aligned(a) && aligned(b) && b - a == 16);
+    CHECK(heap.get_heap_blocks() == 1 && heap.get_used() == 11);
+
+    // oversized allocations get a block of their own and keep the current one
+    char *big = reinterpret_cast<char *>(heap.allocate(1000));
+    memset(big, 'x', 1000);
+    CHECK(aligned(big) && heap.get_heap_blocks() == 2);
+    char *c = reinterpret_cast<char *>(heap.allocate(8));
+    CHECK(c - b == 16);
+
+    StringPiece copy = heap.copy("content-type");
+    CHECK(copy == "content-type" && copy.data()[copy.size()] == '\0');
+    CHECK(heap.copy(StringPiece()).empty());
+
+    heap.reset();
+    CHECK(heap.get_heap_blocks() == 0 && heap.get_used() == 0);
+
+    char scratch[128];
+    Arena stack(scratch, sizeof(scratch), 64);
+    void *first = stack.allocate(16);
+    CHECK(first >= scratch && first < scratch + sizeof(scratch));
+    for (int i = 0; i < 16; ++i) {
+        stack.allocate(16);
+    }
+    CHECK(stack.get_heap_blocks() > 0);
+    stack.reset();
+    CHECK(stack.get_heap_blocks() == 0 && stack.allocate(16) == first);
+}
+
+static void test_header_list()
+{
+    Arena arena;
+    HttpHeaderList list;
+    list.add(&arena, "Host", "a", true);
+    list.add(&arena, "X-Id", "1", false);
+    list.add(&arena, "x-id", "2", false);
+    list.add(&arena, "Host", "b", true);
+    CHECK(list.size() == 3);
+    CHECK(list.first()->name == "Host" && list.first()->value == "b");
+    CHECK(list.find("X-Id")->value == "1");
+    CHECK(list.find("X-ID")->value == "2");
+    CHECK(list.find("host")->value == "b");
+    CHECK(list.find("Accept") == NULL);
+
+    std::map<std::string, std::string> headers;
+    list.to_map(&headers);
+    CHECK(headers.size() == 3 && headers["x-id"] == "2");
+    CHECK(list.as_map().size() == 3 && &list.as_map() == &list.as_map());
+
+    // a value that fits is written over the old one
+    list.add(&arena, "Host", "example.org", true);
+    size_t used = arena.get_used();
+    for (int i = 0; i < 100; ++i) {
+        list.add(&arena, "Host", i % 2 == 0 ? "example.com" : "a.org", true);
+    }
+    CHECK(arena.get_used() == used && list.find("Host")->value == "a.org");
+    CHECK(list.as_map().find("Host")->second == "a.org");
+    list.clear();
+    CHECK(list.size() == 0 && list.first() == NULL && list.as_map().empty());
+}
+
+static void test_request()
+{
+    char scratch[512];
+    Arena arena(scratch, sizeof(scratch));
+    HttpRequest request(&arena);
+    request.add_http_header("Host", "example.com");
+    request.add_http_header("Accept", "*/*");
+    CHECK(request.get_http_header().size() == 2);
+    request.add_http_header("Host", "example.org");
+    CHECK(request.get_http_header().size() == 2);
+    CHECK(request.get_http_header().find("Host")->second == "example.org");
+    CHECK(arena.get_heap_blocks() == 0);
+
+    // headers keep the order they were added in
+    std::vector<std::string> lines;
+    request.get_all_headers(&lines);
+    CHECK(lines.size() == 2 && lines[0] == "Host:example.org" && lines[1] == "Accept:*/*");
+
+    HttpRequest copy(request);
+    copy.add_http_header("Range", "bytes=0-1");
+    CHECK(copy.get_header_list().size() == 3 && request.get_header_list().size() == 2);
+
+    HttpRequest own;
+    own.add_http_header("X-Own", "1");
+    own = request;
+    CHECK(own.get_header_list().size() == 2 && own.get_header_list().find("X-Own") == NULL);
+    HttpRequest own_copy(own);
+    own = own_copy;
+    CHECK(own.get_http_header().find("Accept")->second == "*/*");
+
+    // a reference to the map stays valid and current across changes
+    const std::map<std::string, std::string> &held = request.get_http_header();
+    request.add_http_header("X-Id", "1");
+    request.add_http_header("Host", "example.net");
+    CHECK(held.size() == 3 && held.find("X-Id")->second == "1");
+    CHECK(held.find("Host")->second == "example.net" && &held == &request.get_http_header());
+    own = request;
+    const std::map<std::string, std::string> &own_held = own.get_http_header();
+    own = own_copy;
+    CHECK(own_held.size() == 2 && own_held.find("Host")->second == "example.org");
+}
+
+static void test_response()
+{
+    static const char *lines[] = {
+        "HTTP/1.1 200 OK\r\n",
+        "Content-Type: text/plain\r\n",
+        "Set-Cookie: a=1\r\n",
+        "Set-Cookie: b=2\r\n",
+        "content-length: 4\r\n",
+        "\r\n",
+    };
+    char scratch[1024];
+    Arena arena(scratch, sizeof(scratch));
+    HttpResponse response(&arena);
+    char body[16];
+    MemoryOutputStream output(body, sizeof(body));
+    response.set_output_stream(&output);
+    for (size_t i = 0; i < sizeof(lines) / sizeof(lines[0]); ++i) {
+        response.write_body(const_cast<char *>(lines[i]), strlen(lines[i]));
+    }
+    CHECK(response.get_http_code() == 200);
+    CHECK(response.get_header_list().size() == 4);
+    CHECK(arena.get_heap_blocks() == 0);
+
+    std::string value;
+    CHECK(response.get_response_header("Content-Length", &value) == 0 && value == "4");
+    CHECK(response.get_response_header("Set-Cookie", &value) == 0 && value == "b=2");
+    CHECK(response.get_response_header("ETag", &value) != 0);
+    const std::map<std::string, std::string> &headers = response.get_response_header();
+    CHECK(headers.size() == 3 && headers.find("Content-Type")->second == "text/plain");
+    CHECK(response.write_body(const_cast<char *>("body"), 4) == 4);
+
+    HttpResponse held;
+    held.write_body(const_cast<char *>(lines[0]), strlen(lines[0]));
+    const std::map<std::string, std::string> &held_headers = held.get_response_header();
+    CHECK(held_headers.empty());
+    held.write_body(const_cast<char *>(lines[1]), strlen(lines[1]));
+    CHECK(held_headers.size() == 1 && held_headers.find("Content-Type")->second == "text/plain");
+
+    HttpResponse failed;
+    const char *status = "HTTP/1.1 404 Not Found\r\n";
+    failed.write_body(const_cast<char *>(status), strlen(status));
+    failed.write_body(const_cast<char *>("\r\n"), 2);
+    failed.write_body(const_cast<char *>("missing"), 7);
+    CHECK(failed.get_http_code() == 404 && failed.get_error_message() == "missing");
+}
+
+END_NAMESPACE
+
+int main(int argc, char ** argv)
+{
+    http4cpp_ns::test_arena();
+    http4cpp_ns::test_header_list();
+    http4cpp_ns::test_request();
+    http4cpp_ns::test_response();
+    std::cout << (http4cpp_ns::s_failures == 0 ? "PASS" : "FAIL") << std::endl;
+    return http4cpp_ns::s_failures == 0 ? 0 : 1;
+}
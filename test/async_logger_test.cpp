@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <iostream>
+#include <string>
+
+#include "common/common.h"
+#include "common/util.h"
+#include "common/async_logger.h"
+
+BEGIN_NAMESPACE
+
+log_level_t g_log_level = LOG_LEVEL_INFO;
+bool g_log_behind       = false;
+
+static int s_failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        std::cout << __FILE__ << "(" << __LINE__ << ") check failed: " #cond << std::endl; \
+        ++s_failures; \
+    } \
+} while (0)
+
+static const int THREADS = 4;
+static const int LINES = 5000;
+
+static int open_temp_file(char *path)
+{
+    strcpy(path, "/tmp/async_logger_test.XXXXXX");
+    return mkstemp(path);
+}
+
+static std::string read_file(const char *path)
+{
+    std::string content;
+    FILE *fp = fopen(path, "r");
+    char buf[4096];
+    size_t n = 0;
+    while (fp != NULL && (n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        content.append(buf, n);
+    }
+    if (fp != NULL) {
+        fclose(fp);
+    }
+    return content;
+}
+
+static void * log_lines(void *arg)
+{
+    for (int i = 0; i < LINES; ++i) {
+        INFO("thread %ld line %d", reinterpret_cast<long>(arg), i);
+        DEBUG("never written %d", i);
+    }
+    return NULL;
+}
+
+void test_threads()
+{
+    char path[64];
+    AsyncLoggerOptions options;
+    options.fd = open_temp_file(path);
+    options.ring_bytes = 4 * 1024 * 1024;
+    AsyncLogger logger(options);
+    CHECK(logger.start() == RET_OK);
+    CHECK(logger.start() == RET_ILLEGAL_OPERATION);
+    LogUtil::set_async_logger(&logger);
+
+    pthread_t tids[THREADS];
+    for (long i = 0; i < THREADS; ++i) {
+        pthread_create(&tids[i], NULL, log_lines, reinterpret_cast<void *>(i));
+    }
+    for (int i = 0; i < THREADS; ++i) {
+        pthread_join(tids[i], NULL);
+    }
+    CHECK(logger.flush(5000));
+    LogUtil::set_async_logger(NULL);
+
+    AsyncLoggerStat stat;
+    logger.get_stat(&stat);
+    CHECK(stat.written == static_cast<uint64_t>(THREADS * LINES));
+    CHECK(stat.dropped == 0U);
+    // rings of exited threads are released by the writer
+    CHECK(stat.rings == 0U);
+    logger.stop();
+    close(options.fd);
+
+    std::string content = read_file(path);
+    unlink(path);
+    int lines = 0;
+    size_t pos = 0;
+    while (pos < content.size()) {
+        size_t end = content.find('\n', pos);
+        if (end == std::string::npos) {
+            break;
+        }
+        CHECK(content.compare(pos, 6, "[INFO]") == 0);
+        CHECK(content.find("thread", pos) < end);
+        ++lines;
+        pos = end + 1;
+    }
+    CHECK(lines == THREADS * LINES);
+    CHECK(pos == content.size());
+}
+
+void test_drop_on_full()
+{
+    char path[64];
+    AsyncLoggerOptions options;
+    options.fd = open_temp_file(path);
+    options.ring_bytes = 1;
+    AsyncLogger logger(options);
+    CHECK(logger.get_options().ring_bytes == 64U * 1024);
+
+    // nothing drains before start, the ring has to overflow
+    std::string line(100, 'x');
+    line.append(1, '\n');
+    int appended = 0;
+    for (int i = 0; i < 2000; ++i) {
+        appended += logger.append(LOG_LEVEL_WARN, line.data(), line.size()) ? 1 : 0;
+    }
+    CHECK(appended > 0 && appended < 2000);
+
+    // a full ring drops any line, once drained a line over a quarter of it is cut
+    std::string huge(20000, 'y');
+    CHECK(!logger.append(LOG_LEVEL_WARN, huge.data(), huge.size()));
+
+    CHECK(logger.start() == RET_OK);
+    CHECK(logger.flush(5000));
+    AsyncLoggerStat stat;
+    logger.get_stat(&stat);
+    CHECK(stat.written == static_cast<uint64_t>(appended));
+    CHECK(stat.dropped == static_cast<uint64_t>(2001 - appended));
+    CHECK(logger.append(LOG_LEVEL_WARN, huge.data(), huge.size()));
+    logger.stop();
+    close(options.fd);
+
+    std::string content = read_file(path);
+    unlink(path);
+    CHECK(content.find("async logger dropped") != std::string::npos);
+    CHECK(content.find("[WARN]yyyy") != std::string::npos);
+    CHECK(content[content.size() - 1] == '\n');
+}
+
+static bool s_appended = false;
+
+static void * append_and_mark(void *arg)
+{
+    AsyncLogger *logger = reinterpret_cast<AsyncLogger *>(arg);
+    std::string line("first line of a new thread\n");
+    logger->append(LOG_LEVEL_INFO, line.data(), line.size());
+    __atomic_store_n(&s_appended, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+void test_blocked_writer()
+{
+    // nobody reads the pipe until the end, the writer blocks in writev
+    int fds[2];
+    CHECK(pipe(fds) == 0);
+    AsyncLoggerOptions options;
+    options.fd = fds[1];
+    options.ring_bytes = 1024 * 1024;
+    AsyncLogger logger(options);
+    CHECK(logger.start() == RET_OK);
+    std::string line(1000, 'x');
+    line.append(1, '\n');
+    for (int i = 0; i < 512; ++i) {
+        logger.append(LOG_LEVEL_INFO, line.data(), line.size());
+    }
+    usleep(50 * 1000);
+
+    // a new ring and the stats do not wait for the device
+    pthread_t tid;
+    pthread_create(&tid, NULL, append_and_mark, &logger);
+    for (int i = 0; i < 1000 && !__atomic_load_n(&s_appended, __ATOMIC_ACQUIRE); ++i) {
+        usleep(1000);
+    }
+    CHECK(__atomic_load_n(&s_appended, __ATOMIC_ACQUIRE));
+    AsyncLoggerStat stat;
+    logger.get_stat(&stat);
+    CHECK(stat.dropped == 0U);
+
+    char buf[65536];
+    size_t total = 0;
+    size_t expected = 512 * (strlen("[INFO]") + line.size())
+            + strlen("[INFO]first line of a new thread\n");
+    while (total < expected) {
+        ssize_t n = read(fds[0], buf, sizeof(buf));
+        if (n <= 0) {
+            break;
+        }
+        total += n;
+    }
+    CHECK(total == expected);
+    pthread_join(tid, NULL);
+    logger.stop();
+    close(fds[0]);
+    close(fds[1]);
+}
+
+END_NAMESPACE
+
+int main(int argc, char ** argv)
+{
+    http4cpp_ns::test_threads();
+    http4cpp_ns::test_drop_on_full();
+    http4cpp_ns::test_blocked_writer();
+    std::cout << (http4cpp_ns::s_failures == 0 ? "PASS" : "FAIL") << std::endl;
+    return http4cpp_ns::s_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "common/base64.h"
+#include "common/common.h"
+#include "common/util.h"
+
+BEGIN_NAMESPACE
+
+log_level_t g_log_level = LOG_LEVEL_WARN;
+bool g_log_behind       = false;
+
+static int s_failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        std::cout << __FILE__ << "(" << __LINE__ << ") check failed: " #cond << std::endl; \
+        ++s_failures; \
+    } \
+} while (0)
+
+static const simd_kernel_t s_kernels[] = {
+    SIMD_KERNEL_SCALAR, SIMD_KERNEL_SSE41, SIMD_KERNEL_AVX2
+};
+
+static std::string random_bytes(size_t size)
+{
+    std::string data(size, '\0');
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = static_cast<char>(rand() & 0xff);
+    }
+    return data;
+}
+
+void test_vectors()
+{
+    // RFC 4648 section 10
+    const char *vectors[][2] = {
+        {"", ""}, {"f", "Zg=="}, {"fo", "Zm8="}, {"foo", "Zm9v"}, {"foob", "Zm9vYg=="},
+        {"fooba", "Zm9vYmE="}, {"foobar", "Zm9vYmFy"}
+    };
+    for (size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); ++i) {
+        CHECK(StringUtil::base64_encode(vectors[i][0]) == vectors[i][1]);
+        CHECK(StringUtil::base64_decode(vectors[i][1]) == vectors[i][0]);
+    }
+
+    // padding is optional, appending keeps what is there
+    std::string output = "x";
+    CHECK(StringUtil::base64_decode("Zm9vYg", &output) == RET_OK);
+    CHECK(output == "xfoob");
+    StringUtil::base64_encode("fo", &output);
+    CHECK(output == "xfoobZm8=");
+}
+
+void test_invalid()
+{
+    const char *invalid[] = {"Z", "Zm9vY", "Zg=", "Z===", "Zg==Zg==", "Zm9v\nYmFy", "Zm9v YmFy",
+        "=Zg=", "Zm-v", "Zm_v"};
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); ++i) {
+        std::string output = "kept";
+        CHECK(StringUtil::base64_decode(invalid[i], &output) == RET_ILLEGAL_ARGUMENT);
+        CHECK(output == "kept");
+        CHECK(StringUtil::base64_decode(invalid[i]).empty());
+    }
+}
+
+// every kernel must agree with the scalar one on all lengths and positions
+void test_kernels()
+{
+    std::vector<std::string> inputs;
+    for (size_t size = 0; size < 300; ++size) {
+        inputs.push_back(random_bytes(size));
+    }
+    inputs.push_back(random_bytes(65536 + 7));
+
+    CHECK(Base64::set_kernel(SIMD_KERNEL_SCALAR) == RET_OK);
+    std::vector<std::string> expected;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        expected.push_back(StringUtil::base64_encode(inputs[i]));
+    }
+
+    for (size_t k = 0; k < sizeof(s_kernels) / sizeof(s_kernels[0]); ++k) {
+        if (!CpuFeatures::supports(s_kernels[k])) {
+            CHECK(Base64::set_kernel(s_kernels[k]) == RET_ILLEGAL_OPERATION);
+            std::cout << "skip " << CpuFeatures::kernel_name(s_kernels[k]) << std::endl;
+            continue;
+        }
+        CHECK(Base64::set_kernel(s_kernels[k]) == RET_OK);
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            CHECK(StringUtil::base64_encode(inputs[i]) == expected[i]);
+            std::string decoded;
+            CHECK(StringUtil::base64_decode(expected[i], &decoded) == RET_OK);
+            CHECK(decoded == inputs[i]);
+        }
+
+        // a bad byte is found wherever it is, inside or after a vector block
+        const std::string &text = expected[240];
+        for (size_t pos = 0; pos < text.size(); pos += 3) {
+            for (int c = 0; c < 256; c += 7) {
+                std::string bad = text;
+                bad[pos] = static_cast<char>(c);
+                std::string decoded;
+                bool valid = StringUtil::base64_encode(StringUtil::base64_decode(bad)) == bad;
+                CHECK((StringUtil::base64_decode(bad, &decoded) == RET_OK) == valid);
+            }
+        }
+    }
+    Base64::set_kernel(SIMD_KERNEL_SCALAR);
+}
+
+END_NAMESPACE
+
+int main(int argc, char ** argv)
+{
+    http4cpp_ns::test_vectors();
+    http4cpp_ns::test_invalid();
+    http4cpp_ns::test_kernels();
+    std::cout << (http4cpp_ns::s_failures == 0 ? "PASS" : "FAIL") << std::endl;
+    return http4cpp_ns::s_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <iostream>
+#include <string>
+
+#include "common/common.h"
+#include "common/util.h"
+#include "common/binary_log.h"
+
+BEGIN_NAMESPACE
+
+log_level_t g_log_level = LOG_LEVEL_INFO;
+bool g_log_behind       = false;
+
+static int s_failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        std::cout << __FILE__ << "(" << __LINE__ << ") check failed: " #cond << std::endl; \
+        ++s_failures; \
+    } \
+} while (0)
+
+static const int THREADS = 3;
+static const int LINES = 1000;
+
+static std::string read_file(const char *path)
+{
+    std::string content;
+    FILE *fp = fopen(path, "r");
+    char buf[4096];
+    size_t n = 0;
+    while (fp != NULL && (n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        content.append(buf, n);
+    }
+    if (fp != NULL) {
+        fclose(fp);
+    }
+    return content;
+}
+
+static void * log_lines(void *arg)
+{
+    for (int i = 0; i < LINES; ++i) {
+        INFO("thread %ld line %d", reinterpret_cast<long>(arg), i);
+    }
+    return NULL;
+}
+
+void test_binary_log()
+{
+    char path[] = "/tmp/binary_log_test.XXXXXX";
+    AsyncLoggerOptions options;
+    options.fd = mkstemp(path);
+    options.ring_bytes = 1024 * 1024;
+    BinaryLog log(options);
+    CHECK(log.start() == RET_OK);
+    CHECK(log.start() == RET_ILLEGAL_OPERATION);
+    LogUtil::set_binary_log(&log);
+
+    std::string host = "127.0.0.1:8080";
+    char name[16] = "buffer";
+    INFO("host:%s code:%d latency:%.3f ms size:%zu", host.c_str(), 200, 1.5, host.size());
+    WARN("%-8s|%5d|%x|%c|%lld|%u%%", name, -42, 255U, 'z', -1LL, 7U);
+    DEBUG("%s", "compiled in but disabled at runtime");
+    INFO("%s", name);
+    INFO("pointer %p", reinterpret_cast<void *>(0x1234));
+    INFO("missing %d %d", 1);
+    // the macros are expressions
+    bool traced = true;
+    traced ? INFO("as an %s", "expression") : LogUtil::log_none();
+    pthread_t tids[THREADS];
+    for (long i = 0; i < THREADS; ++i) {
+        pthread_create(&tids[i], NULL, log_lines, reinterpret_cast<void *>(i));
+    }
+    for (int i = 0; i < THREADS; ++i) {
+        pthread_join(tids[i], NULL);
+    }
+    CHECK(log.flush(5000));
+    LogUtil::set_binary_log(NULL);
+    log.stop();
+    close(options.fd);
+
+    AsyncLoggerStat stat;
+    log.get_stat(&stat);
+    CHECK(stat.dropped == 0U);
+
+    std::string content = read_file(path);
+    unlink(path);
+    std::string text;
+    CHECK(BinaryLog::decode(content.data(), content.size(), &text) == RET_OK);
+    CHECK(text.find("host:127.0.0.1:8080 code:200 latency:1.500 ms size:14\n")
+            != std::string::npos);
+    CHECK(text.find("[WARN]") != std::string::npos);
+    CHECK(text.find("buffer  |  -42|ff|z|-1|7%\n") != std::string::npos);
+    CHECK(text.find("compiled in") == std::string::npos);
+    CHECK(text.find("test_binary_log: buffer\n") != std::string::npos);
+    CHECK(text.find("pointer 0x1234\n") != std::string::npos);
+    CHECK(text.find("missing 1 <missing>\n") != std::string::npos);
+    CHECK(text.find("as an expression\n") != std::string::npos);
+    CHECK(text.find("thread 2 line 999\n") != std::string::npos);
+
+    size_t lines = 0;
+    for (size_t pos = text.find('\n'); pos != std::string::npos; pos = text.find('\n', pos + 1)) {
+        ++lines;
+    }
+    CHECK(lines == 6U + THREADS * LINES);
+
+    CHECK(BinaryLog::decode("garbage", 7, &text) == RET_FILE_INVALID);
+}
+
+END_NAMESPACE
+
+int main(int argc, char ** argv)
+{
+    http4cpp_ns::test_binary_log();
+    std::cout << (http4cpp_ns::s_failures == 0 ? "PASS" : "FAIL") << std::endl;
+    return http4cpp_ns::s_failures == 0 ? 0 : 1;
+}
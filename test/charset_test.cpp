@@ -0,0 +1,327 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "common/charset.h"
+#include "common/checksum.h"
+#include "common/common.h"
+#include "common/digest_stream.h"
+#include "common/memory_stream.h"
+#include "common/util.h"
+#include "http_response.h"
+
+BEGIN_NAMESPACE
+
+log_level_t g_log_level = LOG_LEVEL_FATAL;
+bool g_log_behind       = false;
+
+static int s_failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        std::cout << __FILE__ << "(" << __LINE__ << ") check failed: " #cond << std::endl; \
+        ++s_failures; \
+    } \
+} while (0)
+
+static const simd_kernel_t s_kernels[] = {
+    SIMD_KERNEL_SCALAR, SIMD_KERNEL_SSE41, SIMD_KERNEL_AVX2
+};
+
+// GBK, GB18030 with four byte sequences and the same text in UTF-8
+static const std::string GBK("\xd6\xd0\xce\xc4 gbk", 8);
+static const std::string GBK_UTF8("\xe4\xb8\xad\xe6\x96\x87 gbk", 10);
+static const std::string GB18030("\x81\x30\x89\x38\xa2\xe3\x94\x39\xfc\x36", 10);
+static const std::string GB18030_UTF8("\xc3\x9f\xe2\x82\xac\xf0\x9f\x98\x80", 9);
+
+// decodes the code points, independent of the validator
+static bool reference_valid(const std::string &src)
+{
+    const unsigned char *s = reinterpret_cast<const unsigned char *>(src.data());
+    size_t size = src.size();
+    size_t i = 0;
+    while (i < size) {
+        unsigned char c = s[i];
+        size_t length = 0;
+        uint32_t cp = 0;
+        if (c < 0x80) {
+            ++i;
+            continue;
+        } else if ((c & 0xe0) == 0xc0) {
+            length = 2;
+            cp = c & 0x1f;
+        } else if ((c & 0xf0) == 0xe0) {
+            length = 3;
+            cp = c & 0x0f;
+        } else if ((c & 0xf8) == 0xf0) {
+            length = 4;
+            cp = c & 0x07;
+        } else {
+            return false;
+        }
+        if (i + length > size) {
+            return false;
+        }
+        for (size_t k = 1; k < length; ++k) {
+            if ((s[i + k] & 0xc0) != 0x80) {
+                return false;
+            }
+            cp = (cp << 6) | (s[i + k] & 0x3f);
+        }
+        if ((length == 2 && cp < 0x80) || (length == 3 && cp < 0x800)
+                || (length == 4 && cp < 0x10000) || cp > 0x10ffff
+                || (cp >= 0xd800 && cp <= 0xdfff)) {
+            return false;
+        }
+        i += length;
+    }
+    return true;
+}
+
+static void append_code_point(uint32_t cp, std::string *out)
+{
+    if (cp < 0x80) {
+        out->push_back(static_cast<char>(cp));
+    } else if (cp < 0x800) {
+        out->push_back(static_cast<char>(0xc0 | (cp >> 6)));
+        out->push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+    } else if (cp < 0x10000) {
+        out->push_back(static_cast<char>(0xe0 | (cp >> 12)));
+        out->push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+        out->push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+    } else {
+        out->push_back(static_cast<char>(0xf0 | (cp >> 18)));
+        out->push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3f)));
+        out->push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+        out->push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+    }
+}
+
+// mostly ASCII with runs of every sequence length, sometimes broken
+static std::string random_text(size_t code_points, bool corrupt)
+{
+    static const uint32_t ranges[][2] = {
+        {0x20, 0x7e}, {0x80, 0x7ff}, {0x800, 0xd7ff}, {0xe000, 0xffff}, {0x10000, 0x10ffff}
+    };
+    std::string text;
+    for (size_t i = 0; i < code_points; ++i) {
+        const uint32_t *range = ranges[rand() % 3 == 0 ? rand() % 5 : 0];
+        append_code_point(range[0] + rand() % (range[1] - range[0] + 1), &text);
+    }
+    if (corrupt && !text.empty()) {
+        text[rand() % text.size()] = static_cast<char>(rand() % 256);
+    }
+    return text;
+}
+
+void test_vectors()
+{
+    static const char *valid[] = {
+        "", "ascii only", "\xc2\x80", "\xdf\xbf", "\xe0\xa0\x80", "\xed\x9f\xbf", "\xee\x80\x80",
+        "\xef\xbf\xbf", "\xf0\x90\x80\x80", "\xf4\x8f\xbf\xbf", "0123456789abcde\xc3\xa9",
+        "0123456789abcdef0123456789abcd\xe2\x82\xac tail",
+    };
+    static const char *invalid[] = {
+        "\x80", "\xbf", "\xc0\x80", "\xc1\xbf", "\xc2", "\xc2\x41", "\xe0\x80\x80", "\xe0\x9f\xbf",
+        "\xed\xa0\x80", "\xed\xbf\xbf", "\xe2\x82", "\xf0\x80\x80\x80", "\xf0\x8f\xbf\xbf",
+        "\xf4\x90\x80\x80", "\xf5\x80\x80\x80", "\xff", "\xc2\x80\x80",
+        "\xe2\x82\xac\x80", "0123456789abcde\xc3", "0123456789abcdef0123456789abcde\xf0\x9f\x98",
+    };
+    for (size_t k = 0; k < sizeof(s_kernels) / sizeof(s_kernels[0]); ++k) {
+        if (Utf8::set_kernel(s_kernels[k]) != RET_OK) {
+            std::cout << "skip " << CpuFeatures::kernel_name(s_kernels[k]) << std::endl;
+            continue;
+        }
+        for (size_t i = 0; i < sizeof(valid) / sizeof(valid[0]); ++i) {
+            CHECK(Utf8::is_valid(valid[i]));
+            CHECK(Utf8::valid_prefix(valid[i], strlen(valid[i])) == strlen(valid[i]));
+        }
+        for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); ++i) {
+            CHECK(!Utf8::is_valid(invalid[i]));
+        }
+        CHECK(Utf8::valid_prefix("ab\xe2\x82", 4) == 2);
+        CHECK(Utf8::valid_prefix("ab\xe2\x82\xac", 5) == 5);
+        CHECK(Utf8::valid_prefix("ab\x80xy", 5) == 2);
+    }
+    Utf8::set_kernel(CpuFeatures::best_kernel());
+
+    CHECK(Utf8::is_truncated("\xf0\x9f\x98", 3));
+    CHECK(Utf8::is_truncated("\xe2", 1));
+    CHECK(!Utf8::is_truncated("\xe2\x82\xac", 3));
+    CHECK(!Utf8::is_truncated("\xe0\x80", 2));
+    CHECK(!Utf8::is_truncated("a", 1));
+    CHECK(!Utf8::is_truncated("", 0));
+}
+
+// every kernel must agree with the reference decoder
+void test_kernels()
+{
+    srand(49);
+    for (int i = 0; i < 20000; ++i) {
+        std::string text = random_text(rand() % 80, rand() % 2 == 0);
+        bool expected = reference_valid(text);
+        size_t expected_prefix = 0;
+        for (size_t k = 0; k < sizeof(s_kernels) / sizeof(s_kernels[0]); ++k) {
+            if (Utf8::set_kernel(s_kernels[k]) != RET_OK) {
+                continue;
+            }
+            CHECK(Utf8::is_valid(text) == expected);
+            size_t prefix = Utf8::valid_prefix(text.data(), text.size());
+            CHECK(reference_valid(text.substr(0, prefix)));
+            if (k == 0) {
+                expected_prefix = prefix;
+            }
+            CHECK(prefix == expected_prefix);
+        }
+    }
+    Utf8::set_kernel(CpuFeatures::best_kernel());
+}
+
+// remembers where the bytes it was given came from
+class RecordingOutputStream : public StringOutputStream {
+public:
+    explicit RecordingOutputStream(std::string *buffer) : StringOutputStream(buffer)
+    {
+        // nothing to do
+    }
+
+    virtual int64_t write(const char *buffer, int64_t size)
+    {
+        sources.push_back(buffer);
+        return StringOutputStream::write(buffer, size);
+    }
+
+    std::vector<const char *> sources;
+};
+
+static bool stream_converts(const std::string &charset, const std::string &src,
+        size_t chunk, const std::string &expected)
+{
+    std::string output;
+    StringOutputStream sink(&output);
+    CharsetOutputStream stream(&sink);
+    if (stream.set_content_type("text/plain; charset=" + charset) != RET_OK) {
+        return false;
+    }
+    for (size_t i = 0; i < src.size(); i += chunk) {
+        size_t size = src.size() - i < chunk ? src.size() - i : chunk;
+        if (stream.write(src.data() + i, size) != static_cast<int64_t>(size)) {
+            return false;
+        }
+    }
+    return stream.finish() == RET_OK && output == expected;
+}
+
+void test_stream()
+{
+    std::string utf8 = random_text(500, false);
+    for (size_t chunk = 1; chunk <= 40; ++chunk) {
+        CHECK(stream_converts("utf-8", utf8, chunk, utf8));
+        CHECK(stream_converts("GBK", GBK + GBK + GBK, chunk, GBK_UTF8 + GBK_UTF8 + GBK_UTF8));
+        CHECK(stream_converts("gb18030", GB18030 + GBK + GB18030, chunk,
+                GB18030_UTF8 + GBK_UTF8 + GB18030_UTF8));
+    }
+
+    // valid UTF-8 reaches the sink without a copy
+    std::string output;
+    RecordingOutputStream sink(&output);
+    CharsetOutputStream stream(&sink, "UTF-8");
+    CHECK(stream.write(utf8) == static_cast<int64_t>(utf8.size()));
+    CHECK(stream.is_passthrough());
+    CHECK(sink.sources.size() == 1 && sink.sources[0] == utf8.data());
+    CHECK(stream.finish() == RET_OK && output == utf8);
+
+    // invalid bytes fail the write, a cut sequence fails finish
+    std::string broken = utf8 + "\xc3\x28";
+    CHECK(stream.set_content_type("text/plain;charset=\"UTF-8\"") == RET_OK);
+    CHECK(stream.write(broken) == -1);
+    CHECK(stream.write("more") == -1);
+    CHECK(stream.finish() == RET_ILLEGAL_ARGUMENT);
+    CHECK(stream.set_charset("utf8") == RET_OK);
+    CHECK(stream.write("\xe2\x82", 2) == 2);
+    CHECK(stream.finish() == RET_ILLEGAL_ARGUMENT);
+    CHECK(stream.set_charset("GBK") == RET_OK);
+    CHECK(stream.write("\xd6\xd0\x81\x20", 4) == -1);
+    CHECK(stream.finish() == RET_ILLEGAL_ARGUMENT);
+
+    // no charset and no default passes any bytes
+    CharsetOutputStream raw(&sink);
+    CHECK(raw.set_content_type("application/octet-stream") == RET_OK);
+    CHECK(raw.write("\xff\xfe", 2) == 2);
+    CHECK(raw.finish() == RET_OK);
+    CHECK(raw.set_charset("no-such-charset") == RET_ILLEGAL_ARGUMENT);
+    CHECK(raw.write("abc", 3) == -1);
+    CHECK(raw.finish() == RET_ILLEGAL_ARGUMENT);
+
+    CHECK(CharsetOutputStream::charset_of("text/html; charset=GBK") == "GBK");
+    CHECK(CharsetOutputStream::charset_of("text/html;Charset = \"gb18030\" ; q=1") == "gb18030");
+    CHECK(CharsetOutputStream::charset_of("text/html; format=flowed") == "");
+    CHECK(CharsetOutputStream::charset_of("text/html") == "");
+    CHECK(CharsetOutputStream::charset_of("") == "");
+}
+
+void test_response()
+{
+    static const char *headers[] = {
+        "HTTP/1.1 200 OK\r\n",
+        "Content-Type: text/html; charset=GBK\r\n",
+        "\r\n",
+    };
+    std::string output;
+    StringOutputStream sink(&output);
+    CharsetOutputStream charset(&sink);
+    Crc32c crc;
+    DigestOutputStream tee(&charset, &crc);
+    HttpResponse response;
+    response.set_output_stream(&tee);
+    for (size_t i = 0; i < sizeof(headers) / sizeof(headers[0]); ++i) {
+        response.write_body(const_cast<char *>(headers[i]), strlen(headers[i]));
+    }
+    std::string body = GBK + GBK;
+    for (size_t i = 0; i < body.size(); i += 3) {
+        size_t size = body.size() - i < 3 ? body.size() - i : 3;
+        CHECK(response.write_body(&body[i], size) == static_cast<int>(size));
+    }
+    CHECK(charset.finish() == RET_OK);
+    CHECK(output == GBK_UTF8 + GBK_UTF8);
+    // the digest is of the bytes as sent
+    Crc32c expected;
+    expected.update(body);
+    CHECK(tee.finish() == expected.finish());
+}
+
+void test_iconv()
+{
+    std::string output = "prefix:";
+    CHECK(StringUtil::iconv("GBK", "UTF-8", GBK, &output) == RET_OK);
+    CHECK(output == "prefix:" + GBK_UTF8);
+    output.clear();
+    CHECK(StringUtil::iconv("UTF-8", "GB18030", GB18030_UTF8, &output) == RET_OK);
+    CHECK(output == GB18030);
+    output.clear();
+    CHECK(StringUtil::iconv("utf-8", "utf-8", GBK_UTF8, &output) == RET_OK);
+    CHECK(output == GBK_UTF8);
+
+    output = "kept";
+    CHECK(StringUtil::iconv("UTF-8", "UTF-8", GBK, &output) == RET_ILLEGAL_ARGUMENT);
+    CHECK(StringUtil::iconv("GBK", "UTF-8", GBK.substr(0, 1), &output) == RET_ILLEGAL_ARGUMENT);
+    CHECK(StringUtil::iconv("no-such-charset", "UTF-8", GBK, &output) == RET_ILLEGAL_ARGUMENT);
+    CHECK(StringUtil::iconv("", "UTF-8", GBK, &output) == RET_ILLEGAL_ARGUMENT);
+    CHECK(output == "kept");
+}
+
+END_NAMESPACE
+
+int main(int argc, char ** argv)
+{
+    http4cpp_ns::test_vectors();
+    http4cpp_ns::test_kernels();
+    http4cpp_ns::test_stream();
+    http4cpp_ns::test_response();
+    http4cpp_ns::test_iconv();
+    std::cout << (http4cpp_ns::s_failures == 0 ? "PASS" : "FAIL") << std::endl;
+    return http4cpp_ns::s_failures == 0 ? 0 : 1;
+}
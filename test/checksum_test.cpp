@@ -0,0 +1,206 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+#include "common/checksum.h"
+#include "common/common.h"
+#include "common/digest_stream.h"
+#include "common/memory_stream.h"
+#include "common/util.h"
+#include "http_response.h"
+
+BEGIN_NAMESPACE
+
+log_level_t g_log_level = LOG_LEVEL_FATAL;
+bool g_log_behind       = false;
+
+static int s_failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        std::cout << __FILE__ << "(" << __LINE__ << ") check failed: " #cond << std::endl; \
+        ++s_failures; \
+    } \
+} while (0)
+
+static std::string digest_hex(Hasher *hasher, const std::string &data)
+{
+    hasher->update(data);
+    return StringUtil::lower(StringUtil::hex(hasher->finish()));
+}
+
+static uint32_t crc32c(const std::string &data)
+{
+    return Crc32c::extend(0, data.data(), data.size());
+}
+
+void test_vectors()
+{
+    CHECK(crc32c("") == 0);
+    CHECK(crc32c("123456789") == 0xe3069283);
+    CHECK(crc32c(std::string(32, '\0')) == 0x8a9136aa);
+    Crc32c crc;
+    crc.update("hello ");
+    crc.update("world");
+    CHECK(crc.value() == 0xc99465aa);
+    CHECK(StringUtil::base64_encode(crc.finish()) == "yZRlqg==");
+
+    // upstream xxhash values, 200 bytes take the mid-size path, 1000 and
+    // 5000 the striped one
+    Xxh3 xxh;
+    CHECK(digest_hex(&xxh, "") == "2d06800538d394c2");
+    CHECK(digest_hex(&xxh, "a") == "e6c632b61e964e1f");
+    CHECK(digest_hex(&xxh, "abc") == "78af5f94892f3950");
+    CHECK(digest_hex(&xxh, "Nobody inspects the spammish repetition") == "6cb00603b5cc47e9");
+    CHECK(Xxh3::hash("abc", 3, 1) == 0x6b4467b443c76228ULL);
+    std::string bytes(5000, '\0');
+    for (size_t i = 0; i < bytes.size(); ++i) {
+        bytes[i] = static_cast<char>(i % 251);
+    }
+    CHECK(Xxh3::hash(bytes.data(), 200) == 0xf42a8864feaf0703ULL);
+    CHECK(Xxh3::hash(bytes.data(), 200, 1) == 0x4e18eb39c54569e1ULL);
+    CHECK(Xxh3::hash(bytes.data(), 1000) == 0x33ef703fb2b20ed1ULL);
+    CHECK(Xxh3::hash(bytes.data(), 1000, 1) == 0x1cb958c3452e813bULL);
+    CHECK(Xxh3::hash(bytes.data(), bytes.size()) == 0xb418500fc42320eeULL);
+    CHECK(Xxh3::hash(bytes.data(), bytes.size(), 1) == 0xb007eafdf0aa5ec6ULL);
+
+    Md5 md5;
+    CHECK(digest_hex(&md5, "") == "d41d8cd98f00b204e9800998ecf8427e");
+    CHECK(digest_hex(&md5, "abc") == "900150983cd24fb0d6963f7d28e17f72");
+    CHECK(digest_hex(&md5, "The quick brown fox jumps over the lazy dog")
+            == "9e107d9d372bb6826bd81d3542a419d6");
+    CHECK(digest_hex(&md5, std::string(1000, 'a')) == "cabe45dcc9ae5b66ba86600cca6b8ba8");
+}
+
+// splitting the input anywhere must not change any digest
+void test_chunked()
+{
+    std::string data(3000, 'a');
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<char>(rand() & 0xff);
+    }
+    Crc32c crc;
+    Xxh3 xxh;
+    Md5 md5;
+    Hasher *hashers[] = {&crc, &xxh, &md5};
+    for (size_t h = 0; h < sizeof(hashers) / sizeof(hashers[0]); ++h) {
+        hashers[h]->update(data);
+        std::string whole = hashers[h]->finish();
+        for (size_t chunk = 1; chunk < 100; chunk += 7) {
+            for (size_t pos = 0; pos < data.size(); pos += chunk) {
+                hashers[h]->update(data.data() + pos, std::min(chunk, data.size() - pos));
+            }
+            CHECK(hashers[h]->finish() == whole);
+        }
+    }
+}
+
+// SSE4.2 and the merged streams must match the table code
+void test_crc32c_hardware()
+{
+    if (Crc32c::set_hardware(true) != RET_OK) {
+        std::cout << "skip sse4.2" << std::endl;
+        return;
+    }
+    std::string data(5000, 'a');
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<char>(rand() & 0xff);
+    }
+    for (size_t size = 0; size <= data.size(); size += 1 + size / 16) {
+        for (size_t offset = 0; offset < 8; offset += 3) {
+            if (offset + size > data.size()) {
+                continue;
+            }
+            uint32_t hardware = Crc32c::extend(0x12345678, data.data() + offset, size);
+            Crc32c::set_hardware(false);
+            CHECK(!Crc32c::is_hardware());
+            CHECK(Crc32c::extend(0x12345678, data.data() + offset, size) == hardware);
+            Crc32c::set_hardware(true);
+        }
+    }
+}
+
+void test_tee()
+{
+    std::string body(70000, 'x');
+    for (size_t i = 0; i < body.size(); ++i) {
+        body[i] = static_cast<char>('a' + i % 26);
+    }
+    Md5 md5;
+    md5.update(body);
+    std::string content_md5 = StringUtil::base64_encode(md5.finish());
+
+    std::string received;
+    StringOutputStream sink(&received);
+    Md5 tee_md5;
+    DigestOutputStream tee(&sink, &tee_md5);
+    HttpResponse response;
+    response.set_output_stream(&tee);
+    std::string header = "Content-MD5: " + content_md5 + "\r\n";
+    response.write_body(const_cast<char *>("HTTP/1.1 200 OK\r\n"), 17);
+    response.write_body(&header[0], header.size());
+    response.write_body(const_cast<char *>("x-checksum: 0\r\n"), 15);
+    response.write_body(const_cast<char *>("x-goog-hash: crc32c=AAAAAA==, md5=nope\r\n"), 40);
+    response.write_body(const_cast<char *>("\r\n"), 2);
+    for (size_t pos = 0; pos < body.size(); pos += 16384) {
+        size_t size = std::min(static_cast<size_t>(16384), body.size() - pos);
+        CHECK(response.write_body(&body[pos], size) == static_cast<int>(size));
+    }
+    CHECK(received == body);
+
+    std::string digest = tee.finish();
+    CHECK(response.verify_digest("Content-MD5", digest) == RET_OK);
+    CHECK(response.verify_digest("x-checksum", digest) == RET_CHECKSUM_MISMATCH);
+    CHECK(response.verify_digest("x-goog-hash", digest) == RET_CHECKSUM_MISMATCH);
+    CHECK(response.verify_digest("missing", digest) == RET_CHECKSUM_MISSING);
+
+    // hex and name=value lists are accepted too
+    HttpResponse listed;
+    listed.write_body(const_cast<char *>("HTTP/1.1 200 OK\r\n"), 17);
+    std::string line = "x-goog-hash: crc32c=AAAAAA==, md5=" + content_md5 + "\r\n";
+    listed.write_body(&line[0], line.size());
+    line = "x-checksum: " + StringUtil::lower(StringUtil::hex(digest)) + "\r\n";
+    listed.write_body(&line[0], line.size());
+    CHECK(listed.verify_digest("x-goog-hash", digest) == RET_OK);
+    CHECK(listed.verify_digest("x-checksum", digest) == RET_OK);
+
+    // attached with a header the response checks the tee itself
+    Md5 checked_md5;
+    DigestOutputStream checked_tee(&sink, &checked_md5);
+    HttpResponse checked;
+    checked.set_output_stream(&checked_tee, "Content-MD5");
+    CHECK(checked.verify_body_digest() == RET_OK);
+    checked.write_body(const_cast<char *>("HTTP/1.1 200 OK\r\n"), 17);
+    checked.write_body(&header[0], header.size());
+    checked.write_body(const_cast<char *>("\r\n"), 2);
+    checked.write_body(&body[0], body.size());
+    CHECK(checked.verify_body_digest() == RET_OK);
+    checked.write_body(&body[0], 1);
+    CHECK(checked.verify_body_digest() == RET_CHECKSUM_MISMATCH);
+    checked.set_output_stream(&sink);
+    CHECK(checked.verify_body_digest() == RET_OK);
+
+    // a range is only part of the object, its digest header is not checked
+    HttpResponse partial;
+    partial.set_output_stream(&checked_tee, "Content-MD5");
+    partial.write_body(const_cast<char *>("HTTP/1.1 206 Partial Content\r\n"), 30);
+    partial.write_body(&header[0], header.size());
+    partial.write_body(const_cast<char *>("\r\n"), 2);
+    partial.write_body(&body[0], 100);
+    CHECK(partial.get_http_code() == 206 && partial.verify_body_digest() == RET_OK);
+}
+
+END_NAMESPACE
+
+int main(int argc, char ** argv)
+{
+    http4cpp_ns::test_vectors();
+    http4cpp_ns::test_chunked();
+    http4cpp_ns::test_crc32c_hardware();
+    http4cpp_ns::test_tee();
+    std::cout << (http4cpp_ns::s_failures == 0 ? "PASS" : "FAIL") << std::endl;
+    return http4cpp_ns::s_failures == 0 ? 0 : 1;
+}
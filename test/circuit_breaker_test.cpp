@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "common/common.h"
+#include "http/circuit_breaker.h"
+
+BEGIN_NAMESPACE
+
+log_level_t g_log_level = LOG_LEVEL_FATAL;
+bool g_log_behind       = false;
+
+static int s_failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        std::cout << __FILE__ << "(" << __LINE__ << ") check failed: " #cond << std::endl; \
+        ++s_failures; \
+    } \
+} while (0)
+
+void test_consecutive_failures()
+{
+    CircuitBreakerOptions options;
+    options.consecutive_failures = 3;
+    options.error_rate_percent = 0;
+    options.open_ms = 50;
+    options.half_open_probes = 2;
+    CircuitBreaker breaker(options);
+    uint64_t gen = 0;
+
+    for (int i = 0; i < 3; ++i) {
+        CHECK(breaker.allow(&gen));
+        breaker.report(gen, false);
+    }
+    CHECK(breaker.get_state() == BREAKER_STATE_OPEN);
+    CHECK(breaker.get_trip_count() == 1U);
+
+    CHECK(!breaker.allow(&gen));
+    CHECK(breaker.get_rejected_count() == 1U);
+
+    // Half open lets probes through, a failed probe opens it again
+    usleep(60 * 1000);
+    CHECK(breaker.allow(&gen));
+    CHECK(breaker.get_state() == BREAKER_STATE_HALF_OPEN);
+    breaker.report(gen, false);
+    CHECK(breaker.get_state() == BREAKER_STATE_OPEN);
+    CHECK(breaker.get_trip_count() == 2U);
+
+    usleep(60 * 1000);
+    uint64_t probe = 0;
+    CHECK(breaker.allow(&probe));
+    CHECK(breaker.allow(&gen));
+    CHECK(!breaker.allow(&gen));
+    breaker.report(probe, true);
+    breaker.report(gen, true);
+    CHECK(breaker.get_state() == BREAKER_STATE_CLOSED);
+}
+
+void test_error_rate()
+{
+    CircuitBreakerOptions options;
+    options.consecutive_failures = 0;
+    options.error_rate_percent = 50;
+    options.min_requests = 10;
+    CircuitBreaker breaker(options);
+    uint64_t gen = 0;
+
+    for (int i = 0; i < 9; ++i) {
+        CHECK(breaker.allow(&gen));
+        breaker.report(gen, i % 2 == 0);
+    }
+    CHECK(breaker.get_state() == BREAKER_STATE_CLOSED);
+    breaker.report(gen, false);
+    CHECK(breaker.get_state() == BREAKER_STATE_OPEN);
+
+    CircuitBreakerRegistry registry(options);
+    CHECK(registry.get("127.0.0.1:80") == registry.get("127.0.0.1:80"));
+    registry.get("127.0.0.1:81");
+    std::vector<CircuitBreakerStat> stats;
+    registry.get_stats(&stats);
+    CHECK(stats.size() == 2U && stats[0].host == "127.0.0.1:80" && stats[1].host == "127.0.0.1:81");
+    CHECK(stats[0].state == BREAKER_STATE_CLOSED && stats[0].trip_count == 0U);
+}
+
+void test_stale_reports()
+{
+    CircuitBreakerOptions options;
+    options.consecutive_failures = 1;
+    options.error_rate_percent = 0;
+    options.open_ms = 20;
+    options.half_open_probes = 1;
+    CircuitBreaker breaker(options);
+
+    // admitted while closed, finishing after the breaker tripped
+    uint64_t slow = 0;
+    uint64_t failed = 0;
+    CHECK(breaker.allow(&slow));
+    CHECK(breaker.allow(&failed));
+    breaker.report(failed, false);
+    CHECK(breaker.get_state() == BREAKER_STATE_OPEN);
+    breaker.report(slow, true);
+    CHECK(breaker.get_state() == BREAKER_STATE_OPEN);
+
+    // and after it went half open, neither closes it nor frees the probe
+    usleep(30 * 1000);
+    uint64_t probe = 0;
+    CHECK(breaker.allow(&probe));
+    CHECK(breaker.get_state() == BREAKER_STATE_HALF_OPEN);
+    breaker.report(slow, true);
+    CHECK(breaker.get_state() == BREAKER_STATE_HALF_OPEN);
+    uint64_t other = 0;
+    CHECK(!breaker.allow(&other));
+    breaker.report(slow, false);
+    CHECK(breaker.get_state() == BREAKER_STATE_HALF_OPEN);
+
+    breaker.report(probe, true);
+    CHECK(breaker.get_state() == BREAKER_STATE_CLOSED);
+    CHECK(breaker.get_trip_count() == 1U);
+    // a probe reporting twice is stale the second time
+    breaker.report(probe, false);
+    CHECK(breaker.get_state() == BREAKER_STATE_CLOSED);
+}
+
+void test_cancel()
+{
+    CircuitBreakerOptions options;
+    options.consecutive_failures = 1;
+    options.error_rate_percent = 0;
+    options.open_ms = 20;
+    options.half_open_probes = 1;
+    CircuitBreaker breaker(options);
+
+    uint64_t stale = 0;
+    uint64_t gen = 0;
+    CHECK(breaker.allow(&stale));
+    CHECK(breaker.allow(&gen));
+    breaker.cancel(gen);
+    CHECK(breaker.get_state() == BREAKER_STATE_CLOSED);
+    CHECK(breaker.allow(&gen));
+    breaker.report(gen, false);
+    CHECK(breaker.get_state() == BREAKER_STATE_OPEN);
+
+    // a cancelled probe frees its slot and decides nothing, an older request
+    // frees none
+    usleep(30 * 1000);
+    uint64_t probe = 0;
+    CHECK(breaker.allow(&probe));
+    breaker.cancel(stale);
+    CHECK(!breaker.allow(&gen));
+    breaker.cancel(probe);
+    CHECK(breaker.get_state() == BREAKER_STATE_HALF_OPEN);
+    CHECK(breaker.allow(&probe));
+    breaker.report(probe, true);
+    CHECK(breaker.get_state() == BREAKER_STATE_CLOSED);
+}
+
+END_NAMESPACE
+
+int main(int argc, char ** argv)
+{
+    http4cpp_ns::test_consecutive_failures();
+    http4cpp_ns::test_error_rate();
+    http4cpp_ns::test_stale_reports();
+    http4cpp_ns::test_cancel();
+    std::cout << (http4cpp_ns::s_failures == 0 ? "PASS" : "FAIL") << std::endl;
+    return http4cpp_ns::s_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,171 @@
+#include <stdio.h>
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "common/common.h"
+#include "common/util.h"
+#include "http/endpoint_set.h"
+
+BEGIN_NAMESPACE
+
+log_level_t g_log_level = LOG_LEVEL_FATAL;
+bool g_log_behind       = false;
+
+static int s_failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        std::cout << __FILE__ << "(" << __LINE__ << ") check failed: " #cond << std::endl; \
+        ++s_failures; \
+    } \
+} while (0)
+
+void test_p2c()
+{
+    EndpointSet endpoints;
+    endpoints.add_endpoint("http://127.0.0.1:8001");
+    endpoints.add_endpoint("http://127.0.0.1:8002");
+    CHECK(endpoints.add_endpoint("http://127.0.0.1:8002") == RET_ILLEGAL_ARGUMENT);
+    CHECK(endpoints.size() == 2U);
+
+    // The slow endpoint should receive far less traffic once its ewma is known
+    std::map<std::string, int> picks;
+    for (int i = 0; i < 1000; ++i) {
+        Endpoint *e = endpoints.select("");
+        ++picks[e->get_address()];
+        bool slow = e->get_address() == "http://127.0.0.1:8002";
+        endpoints.release(e, true, slow ? 100000 : 1000);
+    }
+    CHECK(picks["http://127.0.0.1:8001"] > 900);
+
+    // Consecutive failures eject the endpoint
+    endpoints.set_ejection(3, 60 * 1000, 60 * 1000);
+    std::vector<const Endpoint *> all;
+    endpoints.get_endpoints(&all);
+    Endpoint *fast = const_cast<Endpoint *>(all[0]);
+    int failures = 0;
+    while (failures < 3) {
+        Endpoint *e = endpoints.select("");
+        bool fail = e == fast;
+        endpoints.release(e, !fail, 1000);
+        failures += fail ? 1 : 0;
+    }
+    CHECK(!fast->is_available(TimeUtil::coarse_monotonic_ms()));
+    for (int i = 0; i < 100; ++i) {
+        Endpoint *e = endpoints.select("");
+        CHECK(e != fast);
+        endpoints.release(e, true, 1000);
+    }
+
+    CHECK(endpoints.remove_endpoint("http://127.0.0.1:8001") == RET_OK);
+    CHECK(endpoints.size() == 1U);
+}
+
+void test_consistent_hash()
+{
+    EndpointSet endpoints(LB_POLICY_CONSISTENT_HASH);
+    endpoints.add_endpoint("http://127.0.0.1:8001");
+    endpoints.add_endpoint("http://127.0.0.1:8002");
+    endpoints.add_endpoint("http://127.0.0.1:8003");
+
+    std::map<std::string, std::string> owners;
+    std::map<std::string, int> counts;
+    char key[32];
+    for (int i = 0; i < 3000; ++i) {
+        snprintf(key, sizeof(key), "/object/%d", i);
+        Endpoint *e = endpoints.select(key);
+        CHECK(endpoints.select(key) == e);
+        owners[key] = e->get_address();
+        ++counts[e->get_address()];
+        endpoints.release(e, true, 1000);
+        endpoints.release(e, true, 1000);
+    }
+    std::map<std::string, int>::iterator it = counts.begin();
+    for (; it != counts.end(); ++it) {
+        CHECK(it->second > 700);
+    }
+
+    // Removing one endpoint only moves the keys it owned
+    endpoints.remove_endpoint("http://127.0.0.1:8002");
+    int moved = 0;
+    for (int i = 0; i < 3000; ++i) {
+        snprintf(key, sizeof(key), "/object/%d", i);
+        Endpoint *e = endpoints.select(key);
+        if (owners[key] != "http://127.0.0.1:8002" && owners[key] != e->get_address()) {
+            ++moved;
+        }
+        endpoints.release(e, true, 1000);
+    }
+    CHECK(moved == 0);
+}
+
+static int64_t ejected_for_ms(EndpointSet *endpoints, bool success)
+{
+    Endpoint *e = endpoints->select("");
+    endpoints->release(e, success, 1000);
+    return e->get_ejected_until_ms() - TimeUtil::coarse_monotonic_ms();
+}
+
+void test_backoff()
+{
+    EndpointSet endpoints;
+    endpoints.add_endpoint("http://127.0.0.1:8001");
+    endpoints.set_ejection(1, 1000, 3500);
+
+    // doubles per ejection in a row up to the cap, a success starts over
+    int64_t expected[] = {1000, 2000, 3500, 3500};
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); ++i) {
+        int64_t ms = ejected_for_ms(&endpoints, false);
+        CHECK(ms > expected[i] - 50 && ms <= expected[i]);
+    }
+    ejected_for_ms(&endpoints, true);
+    int64_t ms = ejected_for_ms(&endpoints, false);
+    CHECK(ms > 950 && ms <= 1000);
+}
+
+void test_churn()
+{
+    EndpointSet endpoints;
+    endpoints.add_endpoint("http://127.0.0.1:8001");
+    Endpoint *first = endpoints.select("");
+    endpoints.release(first, true, 1000);
+
+    // an address that comes back while a request holds it keeps its endpoint
+    Endpoint *held = endpoints.select("");
+    CHECK(endpoints.remove_endpoint("http://127.0.0.1:8001") == RET_OK);
+    CHECK(endpoints.size() == 0U && !held->is_available(TimeUtil::coarse_monotonic_ms()));
+    CHECK(endpoints.add_endpoint("http://127.0.0.1:8001", 2) == RET_OK);
+    Endpoint *again = endpoints.select("");
+    CHECK(again == held && again->get_weight() == 2 && again->get_outstanding() == 2);
+    CHECK(again->get_total_requests() == 1);
+    endpoints.release(held, true, 1000);
+    endpoints.release(again, true, 1000);
+
+    // removed endpoints are freed once idle, even those still in use when
+    // they were removed, a leak checker run on the test finds none left
+    char address[64];
+    for (int i = 0; i < 1000; ++i) {
+        snprintf(address, sizeof(address), "http://10.0.%d.%d:80", i / 256, i % 256);
+        CHECK(endpoints.add_endpoint(address) == RET_OK);
+        Endpoint *e = endpoints.select("");
+        CHECK(endpoints.remove_endpoint(address) == RET_OK);
+        endpoints.release(e, true, 1000);
+    }
+    CHECK(endpoints.remove_endpoint("http://127.0.0.1:8001") == RET_OK);
+    CHECK(endpoints.size() == 0U && endpoints.select("") == NULL);
+}
+
+END_NAMESPACE
+
+int main(int argc, char ** argv)
+{
+    http4cpp_ns::test_p2c();
+    http4cpp_ns::test_consistent_hash();
+    http4cpp_ns::test_backoff();
+    http4cpp_ns::test_churn();
+    std::cout << (http4cpp_ns::s_failures == 0 ? "PASS" : "FAIL") << std::endl;
+    return http4cpp_ns::s_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,205 @@
+#include <unistd.h>
+
+#include <iostream>
+#include <vector>
+
+#include "common/common.h"
+#include "common/util.h"
+#include "http/flow_control.h"
+
+BEGIN_NAMESPACE
+
+log_level_t g_log_level = LOG_LEVEL_FATAL;
+bool g_log_behind       = false;
+
+static int s_failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        std::cout << __FILE__ << "(" << __LINE__ << ") check failed: " #cond << std::endl; \
+        ++s_failures; \
+    } \
+} while (0)
+
+static void test_token_bucket()
+{
+    FlowControlOptions options;
+    options.rate_per_sec = 100;
+    options.burst = 2;
+    FlowController controller(options);
+
+    // the bucket starts full
+    CHECK(controller.acquire(0) == RET_OK);
+    controller.release(true, 100);
+    CHECK(controller.acquire(0) == RET_OK);
+    controller.release(true, 100);
+    CHECK(controller.acquire(0) == RET_RATE_LIMITED);
+
+    // a token comes every 10ms
+    int64_t start_ms = TimeUtil::monotonic_ms();
+    CHECK(controller.acquire(50) == RET_OK);
+    int64_t waited_ms = TimeUtil::monotonic_ms() - start_ms;
+    CHECK(waited_ms >= 5 && waited_ms < 50);
+    controller.release(true, 100);
+
+    // a budget shorter than the next token fails without waiting
+    start_ms = TimeUtil::monotonic_ms();
+    CHECK(controller.acquire(1) == RET_RATE_LIMITED);
+    CHECK(TimeUtil::monotonic_ms() - start_ms < 5);
+
+    // refill stops at the burst
+    usleep(100 * 1000);
+    FlowControlStat stat;
+    CHECK(controller.acquire(0) == RET_OK);
+    controller.release(true, 100);
+    controller.get_stat(&stat);
+    CHECK(stat.tokens <= 1.0 + 1e-9);
+    CHECK(stat.admitted == 4 && stat.rate_limited == 2 && stat.inflight == 0);
+    CHECK(stat.limit == 0);
+
+    // a cancelled request gives its token back, up to the burst
+    CHECK(controller.acquire(0) == RET_OK);
+    controller.cancel();
+    controller.get_stat(&stat);
+    CHECK(stat.tokens > 1.0 - 1e-9 && stat.tokens <= 2.0 + 1e-9);
+    controller.cancel();
+    controller.get_stat(&stat);
+    CHECK(stat.tokens <= 2.0 + 1e-9 && stat.inflight == 0);
+}
+
+static void test_wait_timeout()
+{
+    FlowControlOptions options;
+    options.initial_concurrency = 2;
+    options.max_concurrency = 2;
+    options.max_wait_ms = 30;
+    FlowController controller(options);
+
+    CHECK(controller.acquire() == RET_OK);
+    CHECK(controller.acquire() == RET_OK);
+    int64_t start_ms = TimeUtil::monotonic_ms();
+    CHECK(controller.acquire() == RET_OVERLOADED);
+    int64_t waited_ms = TimeUtil::monotonic_ms() - start_ms;
+    CHECK(waited_ms >= 29 && waited_ms < 500);
+
+    start_ms = TimeUtil::monotonic_ms();
+    CHECK(controller.acquire(0) == RET_OVERLOADED);
+    CHECK(TimeUtil::monotonic_ms() - start_ms < 5);
+
+    // cancel frees the slot and leaves the limit alone
+    controller.cancel();
+    CHECK(controller.acquire(0) == RET_OK);
+    CHECK(controller.get_limit() == 2);
+
+    FlowControlStat stat;
+    controller.get_stat(&stat);
+    CHECK(stat.inflight == 2 && stat.overloaded == 2 && stat.admitted == 3);
+    controller.cancel();
+    controller.cancel();
+    controller.cancel();
+    controller.get_stat(&stat);
+    CHECK(stat.inflight == 0);
+}
+
+static void test_aimd()
+{
+    FlowControlOptions options;
+    options.initial_concurrency = 10;
+    options.min_concurrency = 2;
+    options.max_concurrency = 10;
+    options.latency_threshold_us = 50 * 1000;
+    FlowController controller(options);
+
+    CHECK(controller.acquire(0) == RET_OK);
+    controller.release(false, 1000);
+    CHECK(controller.get_limit() == 9);
+
+    // at most one decrease per smoothed latency
+    CHECK(controller.acquire(0) == RET_OK);
+    controller.release(false, 1000);
+    CHECK(controller.get_limit() == 9);
+
+    usleep(2 * 1000);
+    CHECK(controller.acquire(0) == RET_OK);
+    controller.release(false, 1000);
+    CHECK(controller.get_limit() == 8);
+
+    // completions slower than the threshold count as congestion, the smoothed
+    // latency they push up spaces the decreases further apart
+    usleep(10 * 1000);
+    CHECK(controller.acquire(0) == RET_OK);
+    controller.release(true, 60 * 1000);
+    CHECK(controller.get_limit() == 7);
+
+    // a limit in use grows by about one per limit successes
+    for (int i = 0; i < 4; ++i) {
+        CHECK(controller.acquire(0) == RET_OK);
+    }
+    for (int i = 0; i < 8; ++i) {
+        CHECK(controller.acquire(0) == RET_OK);
+        controller.release(true, 100);
+    }
+    CHECK(controller.get_limit() == 8);
+
+    // an idle limit does not grow
+    for (int i = 0; i < 4; ++i) {
+        controller.cancel();
+    }
+    for (int i = 0; i < 32; ++i) {
+        CHECK(controller.acquire(0) == RET_OK);
+        controller.release(true, 100);
+    }
+    CHECK(controller.get_limit() == 8);
+
+    for (int i = 0; i < 40; ++i) {
+        usleep(1000);
+        CHECK(controller.acquire(0) == RET_OK);
+        controller.release(false, 100);
+    }
+    CHECK(controller.get_limit() == 2);
+}
+
+static void test_max_concurrency()
+{
+    FlowControlOptions options;
+    options.initial_concurrency = 3;
+    options.max_concurrency = 3;
+    FlowController controller(options);
+
+    for (int i = 0; i < 3; ++i) {
+        CHECK(controller.acquire(0) == RET_OK);
+    }
+    for (int i = 0; i < 30; ++i) {
+        controller.release(true, 100);
+        CHECK(controller.acquire(0) == RET_OK);
+    }
+    CHECK(controller.get_limit() == 3);
+    CHECK(controller.acquire(0) == RET_OVERLOADED);
+}
+
+static void test_registry()
+{
+    FlowControlOptions options;
+    options.max_concurrency = 4;
+    FlowControlRegistry registry(options);
+    FlowController *a = registry.get("a.com:80");
+    CHECK(a != NULL && registry.get("a.com:80") == a);
+    CHECK(registry.get("b.com:80") != a);
+
+    std::vector<FlowControlStat> stats;
+    registry.get_stats(&stats);
+    CHECK(stats.size() == 2 && stats[0].host == "a.com:80" && stats[0].limit == 4);
+}
+
+END_NAMESPACE
+
+int main(int argc, char ** argv)
+{
+    http4cpp_ns::test_token_bucket();
+    http4cpp_ns::test_wait_timeout();
+    http4cpp_ns::test_aimd();
+    http4cpp_ns::test_max_concurrency();
+    http4cpp_ns::test_registry();
+    std::cout << (http4cpp_ns::s_failures == 0 ? "PASS" : "FAIL") << std::endl;
+    return http4cpp_ns::s_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,233 @@
+#include <pthread.h>
+#include <stdio.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../bench/mock_server.h"
+#include "common/checksum.h"
+#include "common/common.h"
+#include "common/digest_stream.h"
+#include "common/memory_stream.h"
+#include "common/util.h"
+#include "http/circuit_breaker.h"
+#include "http/endpoint_set.h"
+#include "http/flow_control.h"
+#include "http/http_client.h"
+#include "http_request.h"
+#include "http_response.h"
+
+BEGIN_NAMESPACE
+
+log_level_t g_log_level = LOG_LEVEL_FATAL;
+bool g_log_behind       = false;
+
+static int s_failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        std::cout << __FILE__ << "(" << __LINE__ << ") check failed: " #cond << std::endl; \
+        ++s_failures; \
+    } \
+} while (0)
+
+static std::vector<char> s_body(64 * 1024);
+
+static int get(const std::string &url, int first_byte_timeout, HttpResponse *response)
+{
+    HttpRequest request;
+    request.set_http_method(HTTP_METHOD_GET);
+    request.set_url(url);
+    request.set_timeout(5000);
+    request.set_first_byte_timeout(first_byte_timeout);
+    MemoryOutputStream output(&s_body[0], s_body.size());
+    response->set_output_stream(&output);
+    return HttpClient::request(request, response);
+}
+
+static void test_first_byte_timeout(MockServer *server)
+{
+    // the status line comes after 300ms, the timeout fires long before
+    HttpResponse late;
+    int64_t start_ms = TimeUtil::monotonic_ms();
+    CHECK(get(server->get_url("/?delay_us=300000"), 50, &late) == RET_TIMEOUT);
+    int64_t elapsed_ms = TimeUtil::monotonic_ms() - start_ms;
+    CHECK(elapsed_ms >= 49 && elapsed_ms < 150);
+
+    HttpResponse in_time;
+    CHECK(get(server->get_url("/?delay_us=10000&size=4096"), 200, &in_time) == RET_OK);
+    CHECK(in_time.get_http_code() == 200);
+
+    // once the status line is in the timeout no longer applies to the body
+    HttpResponse chunked;
+    CHECK(get(server->get_url("/?size=65536&chunk=1024"), 50, &chunked) == RET_OK);
+    CHECK(chunked.get_http_code() == 200);
+
+    HttpResponse plain;
+    CHECK(get(server->get_url("/?size=16"), 0, &plain) == RET_OK);
+    CHECK(plain.get_http_code() == 200);
+}
+
+static void * reuse_connections(void *arg)
+{
+    // a first byte timeout runs the transfer on another handle, the connection
+    // cache is the same, a new thread starts with none
+    MockServer *server = reinterpret_cast<MockServer *>(arg);
+    int timeouts[] = {0, 200, 200, 0, 200};
+    for (size_t i = 0; i < sizeof(timeouts) / sizeof(timeouts[0]); ++i) {
+        HttpResponse response;
+        CHECK(get(server->get_url("/?size=16"), timeouts[i], &response) == RET_OK);
+        CHECK(response.get_transfer_info().connection_reused == (i > 0));
+    }
+    return NULL;
+}
+
+static void test_connection_reuse(MockServer *server)
+{
+    pthread_t tid;
+    pthread_create(&tid, NULL, reuse_connections, server);
+    pthread_join(tid, NULL);
+}
+
+static void test_local_rejection(MockServer *server)
+{
+    CircuitBreakerOptions options;
+    options.consecutive_failures = 1;
+    options.error_rate_percent = 0;
+    options.open_ms = 60 * 1000;
+    CircuitBreakerRegistry breakers(options);
+    EndpointSet endpoints;
+    endpoints.add_endpoint(server->get_url(""));
+    HttpClient::register_service("mock", &endpoints);
+    HttpClient::set_circuit_breakers(&breakers);
+
+    HttpRequest request;
+    request.set_http_method(HTTP_METHOD_GET);
+    request.set_service("mock");
+    request.set_url("/?status=500&size=16");
+    HttpResponse failed;
+    MemoryOutputStream output(&s_body[0], s_body.size());
+    failed.set_output_stream(&output);
+    CHECK(HttpClient::request(request, &failed) == RET_OK && failed.get_http_code() == 500);
+
+    std::vector<const Endpoint *> list;
+    endpoints.get_endpoints(&list);
+    CHECK(list.size() == 1);
+    const Endpoint *endpoint = list[0];
+    int64_t ewma_us = endpoint->get_ewma_latency_us();
+    CHECK(endpoint->get_total_requests() == 1 && endpoint->get_total_failures() == 1);
+
+    // the open breaker rejects before the wire, the endpoint records nothing
+    for (int i = 0; i < 3; ++i) {
+        HttpResponse rejected;
+        CHECK(HttpClient::request(request, &rejected) == RET_CIRCUIT_OPEN);
+    }
+    CHECK(endpoint->get_total_requests() == 1 && endpoint->get_total_failures() == 1);
+    CHECK(endpoint->get_ewma_latency_us() == ewma_us && endpoint->get_outstanding() == 0);
+
+    HttpClient::set_circuit_breakers(NULL);
+    HttpClient::unregister_service("mock");
+}
+
+static void test_local_deadline(MockServer *server)
+{
+    CircuitBreakerOptions breaker_options;
+    breaker_options.consecutive_failures = 1;
+    breaker_options.error_rate_percent = 0;
+    CircuitBreakerRegistry breakers(breaker_options);
+    FlowControlOptions flow_options;
+    flow_options.initial_concurrency = 8;
+    flow_options.max_concurrency = 8;
+    flow_options.rate_per_sec = 1000;
+    flow_options.burst = 4;
+    FlowControlRegistry flow_control(flow_options);
+    HttpClient::set_circuit_breakers(&breakers);
+    HttpClient::set_flow_control(&flow_control);
+
+    // out of the caller's time, during and before the transfer
+    HttpRequest request;
+    request.set_http_method(HTTP_METHOD_GET);
+    request.set_url(server->get_url("/?delay_us=300000"));
+    request.set_deadline_after_ms(50);
+    HttpResponse late;
+    CHECK(HttpClient::request(request, &late) == RET_DEADLINE_EXCEEDED);
+    request.set_deadline_ms(TimeUtil::monotonic_ms());
+    HttpResponse expired;
+    CHECK(HttpClient::request(request, &expired) == RET_DEADLINE_EXCEEDED);
+
+    // neither counts against the host
+    std::string host = HttpClient::get_host(server->get_url(""));
+    CircuitBreaker *breaker = breakers.get(host);
+    FlowController *controller = flow_control.get(host);
+    CHECK(breaker->get_state() == BREAKER_STATE_CLOSED && controller->get_limit() == 8);
+    FlowControlStat stat;
+    controller->get_stat(&stat);
+    CHECK(stat.inflight == 0 && stat.tokens > 3.0);
+
+    HttpClient::set_flow_control(NULL);
+    HttpClient::set_circuit_breakers(NULL);
+}
+
+static int get_checked(const std::string &url, std::string *body,
+        http_method_t method = HTTP_METHOD_GET)
+{
+    HttpRequest request;
+    request.set_http_method(method);
+    request.set_url(url);
+    request.set_timeout(5000);
+    StringOutputStream output(body);
+    Xxh3 xxh;
+    DigestOutputStream tee(&output, &xxh);
+    HttpResponse response;
+    response.set_output_stream(&tee, "x-checksum");
+    return HttpClient::request(request, &response);
+}
+
+static void test_body_digest(MockServer *server)
+{
+    std::string body;
+    CHECK(get_checked(server->get_url("/?size=5000&chunk=1000"), &body) == RET_CHECKSUM_MISSING);
+    CHECK(body.size() == 5000);
+    char hex[32];
+    snprintf(hex, sizeof(hex), "%016llx",
+            static_cast<unsigned long long>(Xxh3::hash(body.data(), body.size())));
+
+    body.clear();
+    CHECK(get_checked(server->get_url("/?size=5000&chunk=1000&checksum=") + hex, &body)
+            == RET_OK);
+    body.clear();
+    CHECK(get_checked(server->get_url("/?size=4999&checksum=") + hex, &body)
+            == RET_CHECKSUM_MISMATCH);
+    // the body of an error is not what the digest describes
+    body.clear();
+    CHECK(get_checked(server->get_url("/?size=16&status=404"), &body) == RET_OK);
+    // nor is the empty body of a HEAD
+    body.clear();
+    CHECK(get_checked(server->get_url("/?size=5000&checksum=") + hex, &body, HTTP_METHOD_HEAD)
+            == RET_OK);
+    CHECK(get_checked(server->get_url("/?size=5000"), &body, HTTP_METHOD_HEAD) == RET_OK);
+    CHECK(body.empty());
+}
+
+END_NAMESPACE
+
+int main(int argc, char ** argv)
+{
+    http4cpp_ns::HttpClient::init();
+    http4cpp_ns::MockServerOptions options;
+    http4cpp_ns::MockServer server(options);
+    if (server.start() != http4cpp_ns::RET_OK) {
+        std::cout << "start mock server failed" << std::endl;
+        return 1;
+    }
+    http4cpp_ns::test_first_byte_timeout(&server);
+    http4cpp_ns::test_connection_reuse(&server);
+    http4cpp_ns::test_local_rejection(&server);
+    http4cpp_ns::test_local_deadline(&server);
+    http4cpp_ns::test_body_digest(&server);
+    server.stop();
+    http4cpp_ns::HttpClient::cleanup();
+    std::cout << (http4cpp_ns::s_failures == 0 ? "PASS" : "FAIL") << std::endl;
+    return http4cpp_ns::s_failures == 0 ? 0 : 1;
+}
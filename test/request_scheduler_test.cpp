@@ -0,0 +1,164 @@
+#include <pthread.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <vector>
+
+#include "common/common.h"
+#include "common/util.h"
+#include "http/request_scheduler.h"
+
+BEGIN_NAMESPACE
+
+log_level_t g_log_level = LOG_LEVEL_FATAL;
+bool g_log_behind       = false;
+
+static int s_failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        std::cout << __FILE__ << "(" << __LINE__ << ") check failed: " #cond << std::endl; \
+        ++s_failures; \
+    } \
+} while (0)
+
+struct WaiterArg {
+    RequestScheduler * scheduler;
+    request_priority_t priority;
+    int                ret;
+    int                order;
+};
+
+static int s_order = 0;
+
+static void * acquire_in_order(void *arg)
+{
+    WaiterArg *waiter = reinterpret_cast<WaiterArg *>(arg);
+    SchedulerTicket ticket;
+    waiter->ret = waiter->scheduler->acquire(waiter->priority, 0, &ticket);
+    if (waiter->ret == RET_OK) {
+        waiter->order = __atomic_fetch_add(&s_order, 1, __ATOMIC_SEQ_CST);
+        usleep(5 * 1000);
+        waiter->scheduler->release(ticket);
+    }
+    return NULL;
+}
+
+static void wait_queued(RequestScheduler *scheduler, request_priority_t priority)
+{
+    SchedulerClassStat stat;
+    for (int i = 0; i < 1000; ++i) {
+        scheduler->get_class_stat(priority, &stat);
+        if (stat.waiting > 0) {
+            return;
+        }
+        usleep(1000);
+    }
+}
+
+static void test_priority()
+{
+    RequestScheduler scheduler(1);
+    SchedulerTicket held;
+    CHECK(scheduler.acquire(REQUEST_PRIORITY_NORMAL, 0, &held) == RET_OK);
+
+    // queued first but served last
+    WaiterArg bulk = {&scheduler, REQUEST_PRIORITY_BULK, -1, -1};
+    WaiterArg interactive = {&scheduler, REQUEST_PRIORITY_INTERACTIVE, -1, -1};
+    pthread_t tids[2];
+    pthread_create(&tids[0], NULL, acquire_in_order, &bulk);
+    wait_queued(&scheduler, REQUEST_PRIORITY_BULK);
+    pthread_create(&tids[1], NULL, acquire_in_order, &interactive);
+    wait_queued(&scheduler, REQUEST_PRIORITY_INTERACTIVE);
+
+    scheduler.release(held);
+    pthread_join(tids[0], NULL);
+    pthread_join(tids[1], NULL);
+    CHECK(interactive.ret == RET_OK && interactive.order == 0);
+    CHECK(bulk.ret == RET_OK && bulk.order == 1);
+
+    SchedulerClassStat stat;
+    scheduler.get_class_stat(REQUEST_PRIORITY_BULK, &stat);
+    CHECK(stat.admitted == 1 && stat.inflight == 0 && stat.waiting == 0);
+}
+
+static void test_deadline()
+{
+    RequestScheduler scheduler(1);
+    SchedulerTicket held;
+    CHECK(scheduler.acquire(REQUEST_PRIORITY_NORMAL, 0, &held) == RET_OK);
+
+    SchedulerTicket ticket;
+    int64_t start_ms = TimeUtil::monotonic_ms();
+    CHECK(scheduler.acquire(REQUEST_PRIORITY_INTERACTIVE, start_ms + 30, &ticket)
+            == RET_DEADLINE_EXCEEDED);
+    int64_t waited_ms = TimeUtil::monotonic_ms() - start_ms;
+    CHECK(waited_ms >= 29 && waited_ms < 500);
+    CHECK(scheduler.acquire(REQUEST_PRIORITY_INTERACTIVE, start_ms, &ticket)
+            == RET_DEADLINE_EXCEEDED);
+
+    SchedulerClassStat stat;
+    scheduler.get_class_stat(REQUEST_PRIORITY_INTERACTIVE, &stat);
+    CHECK(stat.expired == 2 && stat.waiting == 0 && stat.admitted == 0);
+
+    // the slot is still free for the next request
+    scheduler.release(held);
+    CHECK(scheduler.acquire(REQUEST_PRIORITY_INTERACTIVE, TimeUtil::monotonic_ms() + 1000,
+            &ticket) == RET_OK);
+    scheduler.release(ticket);
+}
+
+static void check_rate_cap(uint32_t total, uint32_t class_max, int64_t rate)
+{
+    RequestScheduler scheduler(total);
+    SchedulerClassOptions options;
+    options.max_concurrency = class_max;
+    options.max_recv_bytes_per_sec = rate;
+    options.max_send_bytes_per_sec = rate / 2;
+    scheduler.set_class_options(REQUEST_PRIORITY_BULK, options);
+
+    uint32_t slots = class_max == 0 || class_max > total ? total : class_max;
+    std::vector<SchedulerTicket> tickets;
+    int64_t recv_sum = 0;
+    int64_t send_sum = 0;
+    for (uint32_t i = 0; i < slots; ++i) {
+        SchedulerTicket ticket;
+        CHECK(scheduler.acquire(REQUEST_PRIORITY_BULK, 0, &ticket) == RET_OK);
+        CHECK(ticket.max_recv_bytes_per_sec > 0 && ticket.max_send_bytes_per_sec > 0);
+        tickets.push_back(ticket);
+        recv_sum += ticket.max_recv_bytes_per_sec;
+        send_sum += ticket.max_send_bytes_per_sec;
+        CHECK(recv_sum <= rate && send_sum <= rate / 2);
+    }
+    // a class at its limit queues, so the sum can not grow any further
+    SchedulerTicket extra;
+    CHECK(scheduler.acquire(REQUEST_PRIORITY_BULK, TimeUtil::monotonic_ms() + 5, &extra)
+            == RET_DEADLINE_EXCEEDED);
+    for (size_t i = 0; i < tickets.size(); ++i) {
+        scheduler.release(tickets[i]);
+    }
+}
+
+static void test_rate_share()
+{
+    check_rate_cap(8, 0, 1000);
+    check_rate_cap(8, 3, 1000);
+    check_rate_cap(2, 16, 1 << 20);
+
+    RequestScheduler scheduler(4);
+    SchedulerTicket ticket;
+    CHECK(scheduler.acquire(REQUEST_PRIORITY_NORMAL, 0, &ticket) == RET_OK);
+    CHECK(ticket.max_recv_bytes_per_sec == 0 && ticket.max_send_bytes_per_sec == 0);
+    scheduler.release(ticket);
+}
+
+END_NAMESPACE
+
+int main(int argc, char ** argv)
+{
+    http4cpp_ns::test_priority();
+    http4cpp_ns::test_deadline();
+    http4cpp_ns::test_rate_share();
+    std::cout << (http4cpp_ns::s_failures == 0 ? "PASS" : "FAIL") << std::endl;
+    return http4cpp_ns::s_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,186 @@
+#include <stdlib.h>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+#include "common/common.h"
+#include "common/digest_stream.h"
+#include "common/memory_stream.h"
+#include "common/sha.h"
+#include "common/util.h"
+
+BEGIN_NAMESPACE
+
+log_level_t g_log_level = LOG_LEVEL_WARN;
+bool g_log_behind       = false;
+
+static int s_failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        std::cout << __FILE__ << "(" << __LINE__ << ") check failed: " #cond << std::endl; \
+        ++s_failures; \
+    } \
+} while (0)
+
+static std::string lower_hex(const std::string &digest)
+{
+    return StringUtil::lower(StringUtil::hex(digest));
+}
+
+static std::string sha1_hex(const std::string &data)
+{
+    Sha1 sha;
+    sha.update(data);
+    return lower_hex(sha.finish());
+}
+
+static std::string sha256_hex(const std::string &data)
+{
+    Sha256 sha;
+    sha.update(data);
+    return lower_hex(sha.finish());
+}
+
+static std::string hmac_hex(int type, const std::string &key, const std::string &data)
+{
+    std::string result;
+    CHECK(StringUtil::hmac(type, key, data, &result) == RET_OK);
+    return lower_hex(result);
+}
+
+// FIPS 180-2 examples
+void test_digest()
+{
+    CHECK(sha1_hex("") == "da39a3ee5e6b4b0d3255bfef95601890afd80709");
+    CHECK(sha1_hex("abc") == "a9993e364706816aba3e25717850c26c9cd0d89d");
+    CHECK(sha1_hex("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq")
+            == "84983e441c3bd26ebaae4aa1f95129e5e54670f1");
+    CHECK(sha256_hex("")
+            == "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    CHECK(sha256_hex("abc")
+            == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    CHECK(sha256_hex("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq")
+            == "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+
+    std::string million(1000000, 'a');
+    CHECK(sha1_hex(million) == "34aa973cd4c4daa4f61eeb2bdbad27316534016f");
+    CHECK(sha256_hex(million)
+            == "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+}
+
+// RFC 2202 and RFC 4231
+void test_hmac()
+{
+    std::string key(20, '\x0b');
+    CHECK(hmac_hex(HMAC_TYPE_SHA1, key, "Hi There")
+            == "b617318655057264e28bc0b6fb378c8ef146be00");
+    CHECK(hmac_hex(HMAC_TYPE_SHA256, key, "Hi There")
+            == "b0344c61d8db38535ca8afceaf0bf12b881dc200c9833da726e9376c2e32cff7");
+    CHECK(hmac_hex(HMAC_TYPE_SHA1, "Jefe", "what do ya want for nothing?")
+            == "effcdf6ae5eb2fa2d27416d5f184df9c259a7c79");
+    CHECK(StringUtil::sha256hex("what do ya want for nothing?", "Jefe")
+            == "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843");
+
+    // keys longer than a block are hashed first
+    std::string long_key(131, '\xaa');
+    CHECK(StringUtil::sha256hex("Test Using Larger Than Block-Size Key - Hash Key First",
+            long_key) == "60e431591ee0b67f0d8a26aacbf5b77f8e0bc6213728c5140546040f0ee37f54");
+    CHECK(hmac_hex(HMAC_TYPE_SHA1, std::string(80, '\xaa'),
+            "Test Using Larger Than Block-Size Key - Hash Key First")
+            == "aa4ae5e15272d00e95705637ce8a3b55ed402112");
+
+    std::string result = "unchanged";
+    CHECK(StringUtil::hmac(0, "key", "data", &result) == RET_ILLEGAL_ARGUMENT);
+    CHECK(result == "unchanged");
+
+    // a hasher is reusable after finish
+    HmacSha256 hmac(key);
+    hmac.update("Hi ");
+    hmac.update("There");
+    std::string first = hmac.finish();
+    hmac.update("Hi There");
+    CHECK(hmac.finish() == first);
+}
+
+static std::string chunked_digest(Hasher *hasher, const std::string &data, size_t chunk)
+{
+    for (size_t pos = 0; pos < data.size(); pos += chunk) {
+        hasher->update(data.data() + pos, std::min(chunk, data.size() - pos));
+    }
+    return hasher->finish();
+}
+
+// the SHA extensions must match the portable code on every length and split
+void test_hardware()
+{
+    if (Sha256::set_hardware(true) != RET_OK || Sha1::set_hardware(true) != RET_OK) {
+        std::cout << "skip sha extensions" << std::endl;
+        return;
+    }
+    std::string data(300, 'a');
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<char>(rand() & 0xff);
+    }
+    for (size_t size = 0; size <= data.size(); ++size) {
+        std::string text = data.substr(0, size);
+        Sha1 sha1;
+        Sha256 sha256;
+        std::string hw1 = chunked_digest(&sha1, text, 300);
+        std::string hw256 = chunked_digest(&sha256, text, 300);
+        std::string split1 = chunked_digest(&sha1, text, 1 + size % 70);
+        std::string split256 = chunked_digest(&sha256, text, 1 + size % 70);
+        Sha1::set_hardware(false);
+        Sha256::set_hardware(false);
+        CHECK(!Sha1::is_hardware() && !Sha256::is_hardware());
+        CHECK(chunked_digest(&sha1, text, 300) == hw1);
+        CHECK(chunked_digest(&sha256, text, 300) == hw256);
+        CHECK(split1 == hw1);
+        CHECK(split256 == hw256);
+        Sha1::set_hardware(true);
+        Sha256::set_hardware(true);
+    }
+}
+
+void test_digest_stream()
+{
+    std::string body(10000, 'x');
+    for (size_t i = 0; i < body.size(); ++i) {
+        body[i] = static_cast<char>('a' + i % 26);
+    }
+    MemoryInputStream source(body.data(), body.size());
+    Sha256 sha;
+    DigestInputStream stream(&source, &sha);
+    char buffer[1000];
+    std::string part;
+    CHECK(stream.read(buffer, 1000) == 1000);
+    CHECK(stream.read(3000, &part) == 3000);
+    while (stream.read(buffer, sizeof(buffer)) > 0) {
+    }
+    CHECK(stream.is_valid());
+    CHECK(lower_hex(stream.finish()) == sha256_hex(body));
+
+    // a retry rewinds and hashes again
+    CHECK(stream.seek(0) == 0);
+    while (stream.read(buffer, sizeof(buffer)) > 0) {
+    }
+    CHECK(stream.is_valid());
+    CHECK(lower_hex(stream.finish()) == sha256_hex(body));
+
+    CHECK(stream.seek(10) == 10);
+    CHECK(!stream.is_valid());
+    CHECK(stream.get_size() == static_cast<int64_t>(body.size()));
+}
+
+END_NAMESPACE
+
+int main(int argc, char ** argv)
+{
+    http4cpp_ns::test_digest();
+    http4cpp_ns::test_hmac();
+    http4cpp_ns::test_hardware();
+    http4cpp_ns::test_digest_stream();
+    std::cout << (http4cpp_ns::s_failures == 0 ? "PASS" : "FAIL") << std::endl;
+    return http4cpp_ns::s_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "common/common.h"
+#include "common/util.h"
+#include "http/slow_request_sampler.h"
+#include "http_request.h"
+#include "http_response.h"
+
+BEGIN_NAMESPACE
+
+log_level_t g_log_level = LOG_LEVEL_WARN;
+bool g_log_behind       = false;
+
+static int s_failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        std::cout << __FILE__ << "(" << __LINE__ << ") check failed: " #cond << std::endl; \
+        ++s_failures; \
+    } \
+} while (0)
+
+static void make_response(HttpResponse *response)
+{
+    const char *lines[] = {
+        "HTTP/1.1 503 Service Unavailable\r\n",
+        "Retry-After: 3\r\n",
+        "\r\n"
+    };
+    for (size_t i = 0; i < sizeof(lines) / sizeof(lines[0]); ++i) {
+        response->write_body(const_cast<char *>(lines[i]), strlen(lines[i]));
+    }
+}
+
+void test_threshold()
+{
+    SlowRequestSamplerOptions options;
+    options.threshold_ms = 100;
+    options.capacity = 3;
+    options.capture_bytes = 8;
+    SlowRequestSampler sampler(options);
+    CHECK(sampler.get_threshold_us() == 100000);
+
+    HttpRequest request;
+    request.set_http_method(HTTP_METHOD_POST);
+    request.set_url("http://127.0.0.1/slow");
+    request.add_http_header("X-Request-Id", "42");
+    HttpResponse response;
+    make_response(&response);
+    CHECK(response.has_recv_header_line());
+
+    CHECK(!sampler.sample(request, "", response, RET_OK, 99999, "fast"));
+    for (int i = 0; i < 5; ++i) {
+        CHECK(sampler.sample(request, "", response, RET_OK, 100000 + i, "line1\nline2\n"));
+    }
+
+    // the ring keeps the latest records, oldest first
+    std::vector<SlowRequestRecord> records;
+    sampler.get_records(&records);
+    CHECK(records.size() == 3U);
+    CHECK(records[0].seq == 3U && records[2].seq == 5U);
+    CHECK(records[2].latency_us == 100004);
+    CHECK(records[2].http_code == 503);
+    CHECK(records[2].body == "line1\nli");
+    CHECK(records[2].response_headers.size() == 1U);
+
+    std::string dump;
+    sampler.dump(&dump);
+    CHECK(dump.find("slow requests: 3, threshold_us: 100000\n") == 0);
+    CHECK(dump.find("> POST http://127.0.0.1/slow\n") != std::string::npos);
+    CHECK(dump.find("> X-Request-Id:42\n") != std::string::npos);
+    CHECK(dump.find("< HTTP/1.1 503 Service Unavailable\n") != std::string::npos);
+    CHECK(dump.find("< Retry-After: 3\n") != std::string::npos);
+    CHECK(dump.find("body(8): line1\\nli\n") != std::string::npos);
+}
+
+void test_redaction()
+{
+    SlowRequestSamplerOptions options;
+    options.threshold_ms = 1;
+    options.sensitive_headers.push_back("X-Tenant");
+    SlowRequestSampler sampler(options);
+
+    HttpRequest request;
+    request.set_url("http://127.0.0.1/private");
+    request.add_http_header("Authorization", "Bearer secret-1");
+    request.add_http_header("cookie", "sid=secret-2");
+    request.add_http_header("X-Amz-Security-Token", "secret-3");
+    request.add_http_header("X-Api-Key", "secret-4");
+    request.add_http_header("x-tenant", "secret-5");
+    request.add_http_header("X-Request-Id", "42");
+    HttpResponse response;
+    const char *lines[] = {
+        "HTTP/1.1 200 OK\r\n",
+        "Set-Cookie: sid=secret-6\r\n",
+        "Content-Type: text/plain\r\n",
+        "\r\n"
+    };
+    for (size_t i = 0; i < sizeof(lines) / sizeof(lines[0]); ++i) {
+        response.write_body(const_cast<char *>(lines[i]), strlen(lines[i]));
+    }
+    CHECK(sampler.sample(request, "", response, RET_OK, 5000, ""));
+
+    std::string dump;
+    sampler.dump(&dump);
+    CHECK(dump.find("secret") == std::string::npos);
+    CHECK(dump.find("> Authorization:<redacted>\n") != std::string::npos);
+    CHECK(dump.find("> x-tenant:<redacted>\n") != std::string::npos);
+    CHECK(dump.find("< Set-Cookie: <redacted>\n") != std::string::npos);
+    CHECK(dump.find("> X-Request-Id:42\n") != std::string::npos);
+    CHECK(dump.find("< Content-Type: text/plain\n") != std::string::npos);
+
+    CHECK(SlowRequestSampler::is_sensitive_header("PROXY-AUTHORIZATION"));
+    CHECK(SlowRequestSampler::is_sensitive_header("X-Goog-Signature"));
+    CHECK(!SlowRequestSampler::is_sensitive_header("Keep-Alive"));
+    CHECK(!SlowRequestSampler::is_sensitive_header("X-Forwarded-For"));
+
+    options.redact_headers = false;
+    SlowRequestSampler verbatim(options);
+    CHECK(verbatim.sample(request, "", response, RET_OK, 5000, ""));
+    dump.clear();
+    verbatim.dump(&dump);
+    CHECK(dump.find("> Authorization:Bearer secret-1\n") != std::string::npos);
+}
+
+void test_percentile()
+{
+    SlowRequestSamplerOptions options;
+    options.percentile = 99;
+    options.window = 100;
+    SlowRequestSampler sampler(options);
+    HttpRequest request;
+    HttpResponse response;
+
+    // nothing is recorded before the first window closes
+    for (int i = 1; i < 100; ++i) {
+        CHECK(!sampler.sample(request, "http://a/", response, RET_OK, i * 1000, ""));
+    }
+    CHECK(sampler.sample(request, "http://a/", response, RET_OK, 100000, ""));
+    int64_t threshold = sampler.get_threshold_us();
+    CHECK(threshold >= 99000 && threshold <= 100000 * 9 / 8);
+    CHECK(!sampler.sample(request, "http://a/", response, RET_OK, 50000, ""));
+    CHECK(sampler.sample(request, "http://a/", response, RET_OK, 500000, ""));
+
+    // the next window only sees its own latencies
+    for (int i = 0; i < 98; ++i) {
+        sampler.sample(request, "http://a/", response, RET_OK, 1000, "");
+    }
+    threshold = sampler.get_threshold_us();
+    CHECK(threshold >= 50000 && threshold <= 50000 * 9 / 8);
+}
+
+void test_signal()
+{
+    char path[64];
+    strcpy(path, "/tmp/slow_request_sampler_test.XXXXXX");
+    SlowRequestSamplerOptions options;
+    options.threshold_ms = 1;
+    options.dump_fd = mkstemp(path);
+    SlowRequestSampler sampler(options);
+    CHECK(sampler.install_signal_handler(SIGUSR2) == RET_OK);
+    SlowRequestSampler other(options);
+
+    HttpRequest request;
+    HttpResponse response;
+    CHECK(!sampler.poll_dump());
+    sampler.sample(request, "http://a/", response, RET_OK, 5000, "");
+    raise(SIGUSR2);
+    // the dump is written by the next request, not in the handler, and only
+    // the sampler the signal was installed for takes it
+    CHECK(!other.poll_dump());
+    sampler.sample(request, "http://a/", response, RET_OK, 5000, "");
+    CHECK(!sampler.poll_dump());
+
+    // a destroyed sampler gives its slot back
+    std::vector<SlowRequestSampler *> samplers;
+    for (int i = 0; i < 7; ++i) {
+        samplers.push_back(new SlowRequestSampler(options));
+        CHECK(samplers[i]->install_signal_handler(SIGUSR2) == RET_OK);
+    }
+    CHECK(other.install_signal_handler(SIGUSR2) == RET_ILLEGAL_OPERATION);
+    for (int i = 0; i < 7; ++i) {
+        delete samplers[i];
+    }
+    CHECK(other.install_signal_handler(SIGUSR2) == RET_OK);
+
+    off_t size = lseek(options.dump_fd, 0, SEEK_END);
+    close(options.dump_fd);
+    unlink(path);
+    CHECK(size > 0);
+    signal(SIGUSR2, SIG_DFL);
+}
+
+END_NAMESPACE
+
+int main(int argc, char ** argv)
+{
+    http4cpp_ns::test_threshold();
+    http4cpp_ns::test_redaction();
+    http4cpp_ns::test_percentile();
+    http4cpp_ns::test_signal();
+    std::cout << (http4cpp_ns::s_failures == 0 ? "PASS" : "FAIL") << std::endl;
+    return http4cpp_ns::s_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,327 @@
+#include <ctype.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "common/ascii.h"
+#include "common/common.h"
+#include "common/memory_stream.h"
+#include "common/url_codec.h"
+#include "common/util.h"
+#include "http_response.h"
+
+BEGIN_NAMESPACE
+
+log_level_t g_log_level = LOG_LEVEL_FATAL;
+bool g_log_behind       = false;
+
+static int s_failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        std::cout << __FILE__ << "(" << __LINE__ << ") check failed: " #cond << std::endl; \
+        ++s_failures; \
+    } \
+} while (0)
+
+template <typename T>
+static std::string format(T value, int base = 10)
+{
+    std::string output = "";
+    StringUtil::append_num(value, &output, base);
+    return output;
+}
+
+template <typename T>
+static bool parses_to(const char *src, T expected, int base = 10)
+{
+    T value = 0;
+    return StringUtil::parse_num(src, &value, base) == RET_OK && value == expected;
+}
+
+template <typename T>
+static bool rejects(const char *src, int base = 10)
+{
+    T value = 7;
+    return StringUtil::parse_num(src, &value, base) == RET_ILLEGAL_ARGUMENT && value == 7;
+}
+
+void test_format()
+{
+    CHECK(StringUtil::num_to_string(0) == "0");
+    CHECK(StringUtil::num_to_string(-42) == "-42");
+    CHECK(StringUtil::num_to_string(INT_MIN) == "-2147483648");
+    CHECK(format(INT_MAX) == "2147483647");
+    CHECK(format(LLONG_MIN) == "-9223372036854775808");
+    CHECK(format(ULLONG_MAX) == "18446744073709551615");
+    CHECK(format(255U, 16) == "ff");
+    CHECK(format(-255, 16) == "-ff");
+    CHECK(format(8, 8) == "10");
+    CHECK(format(5UL, 2) == "101");
+    CHECK(format(ULLONG_MAX, 2) == std::string(64, '1'));
+    CHECK(format(LLONG_MIN, 2) == "-1" + std::string(63, '0'));
+
+    char buffer[StringUtil::MAX_NUM_SIZE];
+    CHECK(StringUtil::format_num(10, buffer, 3) == 0U);
+
+    // every magnitude against printf
+    char expected[32];
+    for (unsigned long long v = 1; v != 0 && v < ULLONG_MAX / 3; v = v * 3 + 1) {
+        snprintf(expected, sizeof(expected), "%llu", v);
+        CHECK(format(v) == expected);
+        snprintf(expected, sizeof(expected), "%llx", v);
+        CHECK(format(v, 16) == expected);
+        snprintf(expected, sizeof(expected), "%llo", v);
+        CHECK(format(v, 8) == expected);
+        snprintf(expected, sizeof(expected), "%lld", -static_cast<long long>(v));
+        CHECK(format(-static_cast<long long>(v)) == expected);
+    }
+}
+
+void test_parse()
+{
+    CHECK(parses_to("0", 0));
+    CHECK(parses_to("-2147483648", INT_MIN));
+    CHECK(parses_to("+2147483647", INT_MAX));
+    CHECK(rejects<int>("2147483648"));
+    CHECK(rejects<int>("-2147483649"));
+    CHECK(parses_to("65535", static_cast<unsigned short>(65535)));
+    CHECK(rejects<unsigned short>("65536"));
+    CHECK(rejects<short>("-32769"));
+    CHECK(parses_to("18446744073709551615", ULLONG_MAX));
+    CHECK(rejects<unsigned long long>("18446744073709551616"));
+    CHECK(rejects<unsigned long long>("99999999999999999999"));
+    CHECK(parses_to("-9223372036854775808", LLONG_MIN));
+    CHECK(rejects<long long>("9223372036854775808"));
+    CHECK(rejects<unsigned int>("-1"));
+
+    CHECK(parses_to("ff", 255, 16));
+    CHECK(parses_to("0xFF", 255, 16));
+    CHECK(parses_to("-0x10", -16, 16));
+    CHECK(parses_to("ffffffffffffffff", ULLONG_MAX, 16));
+    CHECK(rejects<unsigned long long>("1ffffffffffffffff", 16));
+    CHECK(parses_to("777", 511, 8));
+    CHECK(rejects<int>("8", 8));
+    CHECK(parses_to("101", 5, 2));
+    CHECK(rejects<int>("102", 2));
+
+    CHECK(rejects<int>(""));
+    CHECK(rejects<int>("-"));
+    CHECK(rejects<int>(" 1"));
+    CHECK(rejects<int>("1 "));
+    CHECK(rejects<int>("12a"));
+    CHECK(rejects<int>("0x", 16));
+    CHECK(rejects<int>("1", 7));
+
+    // a view of part of a string
+    std::string text = "Content-Length: 1048576\r\n";
+    long length = 0;
+    CHECK(StringUtil::parse_num(StringPiece(text).substr(16, 7), &length) == RET_OK);
+    CHECK(length == 1048576);
+
+    // round trips
+    for (int i = 0; i < 10000; ++i) {
+        long long v = (static_cast<long long>(rand()) << 33) ^ (static_cast<long long>(rand()) << 2)
+                ^ rand();
+        v = i % 2 == 0 ? v : -v;
+        int bases[] = {2, 8, 10, 16};
+        for (int b = 0; b < 4; ++b) {
+            CHECK(parses_to(format(v, bases[b]).c_str(), v, bases[b]));
+        }
+    }
+}
+
+void test_legacy()
+{
+    std::string number = " 123 ";
+    CHECK(StringUtil::string_to_num(number) == 123U);
+    number = "\t42abc";
+    CHECK(StringUtil::string_to_num(number) == 42U);
+    number = "0x1F";
+    CHECK(StringUtil::string_to_num(number, 16) == 31U);
+    number = "1f";
+    CHECK(StringUtil::string_to_num(number, 16) == 31U);
+    number = "0755";
+    CHECK(StringUtil::string_to_num(number, 8) == 493U);
+    number = "1101";
+    CHECK(StringUtil::string_to_num(number, 2) == 13U);
+    number = "abc";
+    CHECK(StringUtil::string_to_num(number) == 0U);
+    number = "99999999999999999999";
+    CHECK(StringUtil::string_to_num(number) == 0U);
+}
+
+void test_trim()
+{
+    CHECK(StringUtil::trim("  a b \r\n") == "a b");
+    CHECK(StringUtil::ltrim("\t a ") == "a ");
+    CHECK(StringUtil::rtrim(" a \t") == " a");
+    CHECK(StringUtil::trim(" \r\n").empty());
+    CHECK(StringUtil::trim("xxaxx", "x") == "a");
+
+    std::string text = "  Content-Type  ";
+    StringPiece view = StringUtil::trim_view(text);
+    CHECK(view == "Content-Type");
+    CHECK(view.data() == text.data() + 2);
+    CHECK(StringUtil::ltrim_view(text) == "Content-Type  ");
+    CHECK(StringUtil::rtrim_view(text) == "  Content-Type");
+    CHECK(StringUtil::trim_view("   ").empty());
+    CHECK(StringUtil::trim_view("").empty());
+
+    StringUtil::trim_in_place(&text);
+    CHECK(text == "Content-Type");
+    text = "\r\n";
+    StringUtil::trim_in_place(&text);
+    CHECK(text.empty());
+    text = "--a--";
+    StringUtil::trim_in_place(&text, "-");
+    CHECK(text == "a");
+}
+
+void test_split()
+{
+    std::vector<std::string> items;
+    StringUtil::split("a,b,,c", ",", -1, &items);
+    CHECK(items.size() == 4U && items[0] == "a" && items[2] == "" && items[3] == "c");
+    items.clear();
+    StringUtil::split("HTTP/1.1 404 Not Found", " ", 3, &items);
+    CHECK(items.size() == 3U && items[2] == "Not Found");
+    items.clear();
+    StringUtil::split("", ",", -1, &items);
+    CHECK(items.size() == 1U && items[0].empty());
+    items.clear();
+    StringUtil::split("a,b", ",", 0, &items);
+    CHECK(items.size() == 1U && items[0] == "a,b");
+
+    // the delimiter is a string, not a set of characters
+    items.clear();
+    StringUtil::split("a, b,c, d", ", ", -1, &items);
+    CHECK(items.size() == 3U && items[0] == "a" && items[1] == "b,c" && items[2] == "d");
+    items.clear();
+    StringUtil::split("k1=v1&&k2=v2&k3", "&&", -1, &items);
+    CHECK(items.size() == 2U && items[1] == "k2=v2&k3");
+
+    std::string line = "x-goog-hash: crc32c=AAAAAA==, md5=nope";
+    std::vector<StringPiece> views;
+    StringUtil::split(line, ": ", 2, &views);
+    CHECK(views.size() == 2U && views[0] == "x-goog-hash" && views[1].data() == line.data() + 13);
+
+    StringSplitter splitter(line, ",");
+    StringPiece item;
+    CHECK(splitter.next(&item) && item == "x-goog-hash: crc32c=AAAAAA==");
+    CHECK(splitter.next(&item) && StringUtil::trim_view(item) == "md5=nope");
+    CHECK(!splitter.next(&item));
+    StringSplitter whole(line, "");
+    CHECK(whole.next(&item) && item == line && !whole.next(&item));
+
+    CHECK(StringPiece("abcabd").find("abd") == 3U);
+    CHECK(StringPiece("abcab").find("abd") == std::string::npos);
+    CHECK(StringPiece("ab").find("", 2) == 2U);
+}
+
+// every kernel against the scalar reference of the C locale
+void test_case()
+{
+    std::string all(600, '\0');
+    for (size_t i = 0; i < all.size(); ++i) {
+        all[i] = static_cast<char>(i * 7);
+    }
+    std::string lower = all;
+    std::string upper = all;
+    for (size_t i = 0; i < all.size(); ++i) {
+        lower[i] = static_cast<char>(tolower(static_cast<unsigned char>(all[i])));
+        upper[i] = static_cast<char>(toupper(static_cast<unsigned char>(all[i])));
+    }
+    simd_kernel_t kernels[] = {SIMD_KERNEL_SCALAR, SIMD_KERNEL_SSE41, SIMD_KERNEL_AVX2};
+    simd_kernel_t saved = Ascii::get_kernel();
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); ++k) {
+        if (Ascii::set_kernel(kernels[k]) != RET_OK) {
+            std::cout << "skip kernel " << kernels[k] << std::endl;
+            continue;
+        }
+        for (size_t size = 0; size < 100; ++size) {
+            size_t offset = size % 5;
+            std::string src = all.substr(offset, size);
+            CHECK(StringUtil::lower(src) == lower.substr(offset, size));
+            CHECK(StringUtil::upper(src) == upper.substr(offset, size));
+            std::string in_place = src;
+            StringUtil::upper_in_place(&in_place);
+            CHECK(in_place == upper.substr(offset, size));
+            StringUtil::lower_in_place(&in_place);
+            CHECK(in_place == lower.substr(offset, size));
+
+            CHECK(Ascii::equals_ignore_case(lower.substr(offset, size),
+                    upper.substr(offset, size)));
+            CHECK(Ascii::hash_ignore_case(lower.substr(offset, size))
+                    == Ascii::hash_ignore_case(upper.substr(offset, size)));
+            if (size > 0) {
+                std::string other = upper.substr(offset, size);
+                other[size - 1] = static_cast<char>(other[size - 1] + 1);
+                CHECK(!Ascii::equals_ignore_case(src, other));
+            }
+        }
+        std::string a = std::string(70, 'x') + "Content-Length";
+        std::string b = std::string(70, 'X') + "content-type";
+        CHECK(Ascii::compare_ignore_case(a, b) < 0);
+        CHECK(Ascii::compare_ignore_case(b, a) > 0);
+        CHECK(Ascii::compare_ignore_case(a, a.substr(0, 80)) > 0);
+        CHECK(Ascii::compare_ignore_case("", "") == 0);
+        CHECK(Ascii::compare_ignore_case("[", "a") < 0);  // as strcasecmp, '[' < 'a'
+        CHECK(!Ascii::equals_ignore_case("\xc0", "\xe0"));
+    }
+    Ascii::set_kernel(saved);
+    CHECK(Ascii::hash_ignore_case("Content-Length") != Ascii::hash_ignore_case("Content-Type"));
+
+    std::map<std::string, int, IgnoreCaseLess> headers;
+    headers["Content-Length"] = 1;
+    headers["CONTENT-LENGTH"] = 2;
+    CHECK(headers.size() == 1U && headers["content-length"] == 2);
+}
+
+void test_call_sites()
+{
+    HttpResponse response;
+    response.write_body(const_cast<char *>("HTTP/1.1 404 Not Found\r\n"), 24);
+    CHECK(response.get_http_code() == 404);
+    HttpResponse bad;
+    bad.write_body(const_cast<char *>("HTTP/1.1 x0 Odd\r\n"), 17);
+    CHECK(bad.get_http_code() == 0);
+
+    // HTTP/2 gives lowercase header names
+    std::string received;
+    StringOutputStream body(&received);
+    HttpResponse lower_case;
+    lower_case.set_output_stream(&body);
+    lower_case.write_body(const_cast<char *>("HTTP/2 200 \r\n"), 13);
+    lower_case.write_body(const_cast<char *>("content-length:  12 \r\n"), 22);
+    lower_case.write_body(const_cast<char *>("x-checksum:\r\n"), 13);
+    std::string value;
+    CHECK(lower_case.get_http_code() == 200);
+    CHECK(lower_case.get_response_header("Content-Length", &value) == 0 && value == "12");
+    CHECK(lower_case.get_response_header("X-Checksum", &value) == 0 && value.empty());
+    CHECK(lower_case.get_response_header("Content-Type", &value) != 0);
+
+    QueryBuilder query("/list");
+    query.add("max-keys", -1000).add("offset", 9223372036854775807LL);
+    CHECK(query.get_url() == "/list?max-keys=-1000&offset=9223372036854775807");
+}
+
+END_NAMESPACE
+
+int main(int argc, char ** argv)
+{
+    http4cpp_ns::test_format();
+    http4cpp_ns::test_parse();
+    http4cpp_ns::test_legacy();
+    http4cpp_ns::test_trim();
+    http4cpp_ns::test_split();
+    http4cpp_ns::test_case();
+    http4cpp_ns::test_call_sites();
+    std::cout << (http4cpp_ns::s_failures == 0 ? "PASS" : "FAIL") << std::endl;
+    return http4cpp_ns::s_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,220 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <iostream>
+#include <string>
+
+#include "common/common.h"
+#include "common/util.h"
+#include "http_response.h"
+
+BEGIN_NAMESPACE
+
+log_level_t g_log_level = LOG_LEVEL_FATAL;
+bool g_log_behind       = false;
+
+static int s_failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        std::cout << __FILE__ << "(" << __LINE__ << ") check failed: " #cond << std::endl; \
+        ++s_failures; \
+    } \
+} while (0)
+
+static bool http_date_is(const char *src, int64_t expected)
+{
+    int64_t ts = 0;
+    return TimeUtil::parse_http_date(src, &ts) == RET_OK && ts == expected;
+}
+
+static bool rfc3339_is(const char *src, int64_t expected)
+{
+    int64_t ts = 0;
+    return TimeUtil::parse_rfc3339(src, &ts) == RET_OK && ts == expected;
+}
+
+static bool rejects_http_date(const char *src)
+{
+    int64_t ts = 7;
+    return TimeUtil::parse_http_date(src, &ts) == RET_ILLEGAL_ARGUMENT && ts == 7;
+}
+
+static bool rejects_rfc3339(const char *src)
+{
+    int64_t ts = 7;
+    return TimeUtil::parse_rfc3339(src, &ts) == RET_ILLEGAL_ARGUMENT && ts == 7;
+}
+
+// formatting and parsing against gmtime_r and strftime over four centuries
+void test_against_libc()
+{
+    char expected[64];
+    char buffer[64];
+    for (int i = 0; i < 200000; ++i) {
+        int64_t ts = (static_cast<int64_t>(rand()) * 4093 + rand()) % (146097LL * 86400)
+                - 40LL * 365 * 86400;
+        if (i < 1000) {
+            ts = (i - 500) * 86400LL + i;   // around the epoch
+        }
+        time_t t = static_cast<time_t>(ts);
+        struct tm tm_result;
+        gmtime_r(&t, &tm_result);
+
+        strftime(expected, sizeof(expected), TimeUtil::GMT_FORMAT, &tm_result);
+        size_t size = TimeUtil::format_gmttime(ts, buffer);
+        CHECK(size == strlen(expected) && memcmp(buffer, expected, size) == 0);
+        CHECK(http_date_is(expected, ts));
+
+        strftime(expected, sizeof(expected), TimeUtil::UTC_FORMAT, &tm_result);
+        size = TimeUtil::format_utctime(ts, buffer);
+        CHECK(size == strlen(expected) && memcmp(buffer, expected, size) == 0);
+        CHECK(rfc3339_is(expected, ts));
+
+        strftime(expected, sizeof(expected), "%a %b %e %H:%M:%S %Y", &tm_result);
+        CHECK(http_date_is(expected, ts));
+    }
+}
+
+void test_http_date()
+{
+    CHECK(http_date_is("Sun, 06 Nov 1994 08:49:37 GMT", 784111777));
+    CHECK(http_date_is("Sunday, 06-Nov-94 08:49:37 GMT", 784111777));
+    CHECK(http_date_is("Sun Nov  6 08:49:37 1994", 784111777));
+    CHECK(http_date_is("  Thu, 01 Jan 1970 00:00:00 GMT\r\n", 0));
+    CHECK(http_date_is("Wed, 31 Dec 1969 23:59:59 GMT", -1));
+    CHECK(http_date_is("Tue, 29 Feb 2000 12:00:00 GMT", 951825600));
+    CHECK(http_date_is("Fri, 31 Dec 9999 23:59:59 GMT", 253402300799LL));
+    // two digit years up to 50 years ahead of today are in this century
+    CHECK(http_date_is("Tuesday, 01-Jan-70 00:00:00 GMT", 36525LL * 86400));
+
+    CHECK(rejects_http_date(""));
+    CHECK(rejects_http_date("Sun, 06 Nov 1994 08:49:37"));
+    CHECK(rejects_http_date("Sun, 06 Nov 1994 08:49:37 UTC"));
+    CHECK(rejects_http_date("Sun, 6 Nov 1994 08:49:37 GMT"));
+    CHECK(rejects_http_date("Sun, 06 nov 1994 08:49:37 GMT"));
+    CHECK(rejects_http_date("Sun, 31 Nov 1994 08:49:37 GMT"));
+    CHECK(rejects_http_date("Sun, 29 Feb 1900 08:49:37 GMT"));
+    CHECK(rejects_http_date("Sun, 06 Nov 1994 24:00:00 GMT"));
+    CHECK(rejects_http_date("Sun, 06 Nov 1994 08:60:00 GMT"));
+    CHECK(rejects_http_date("Sun, 06 Nov 1994 08:49:37 GMTx"));
+    CHECK(rejects_http_date("Sunday, 06-Nov-1994 08:49:37 GMT"));
+    CHECK(rejects_http_date("Sunxay, 06-Nov-94 08:49:37 GMT"));
+    CHECK(rejects_http_date("Sun Nov  6 08:49:37 1994 GMT"));
+    CHECK(rejects_http_date("0"));
+
+    // what Expires: 0 turns into through the old interface
+    CHECK(TimeUtil::gmttime_to_timestamp("0") == -1);
+    CHECK(TimeUtil::gmttime_to_timestamp("Sun, 06 Nov 1994 08:49:37 GMT") == 784111777);
+}
+
+void test_rfc3339()
+{
+    CHECK(rfc3339_is("1985-04-12T23:20:50.52Z", 482196050));
+    CHECK(rfc3339_is("1996-12-19T16:39:57-08:00", 851042397));
+    CHECK(rfc3339_is("1996-12-20T00:39:57Z", 851042397));
+    CHECK(rfc3339_is("1937-01-01T12:00:27.87+00:20", -1041337173));
+    CHECK(rfc3339_is("1990-12-31t23:59:60z", 662688000));
+    CHECK(rfc3339_is("2016-10-09 08:00:00Z", 1476000000));
+    CHECK(rfc3339_is("0000-01-01T00:00:00Z", -62167219200LL));
+
+    CHECK(rejects_rfc3339("2016-10-09T08:00:00"));
+    CHECK(rejects_rfc3339("2016-10-09T08:00:00.Z"));
+    CHECK(rejects_rfc3339("2016-13-09T08:00:00Z"));
+    CHECK(rejects_rfc3339("2016-00-09T08:00:00Z"));
+    CHECK(rejects_rfc3339("2016-10-09T08:00:00+0800"));
+    CHECK(rejects_rfc3339("2016-10-09T08:00:00+24:00"));
+    CHECK(rejects_rfc3339("16-10-09T08:00:00Z"));
+    CHECK(rejects_rfc3339("2016-10-09T08:00:00Z "));
+
+    CHECK(TimeUtil::utctime_to_timestamp("2016-10-09T08:00:00Z") == 1476000000);
+    CHECK(TimeUtil::utctime_to_timestamp("yesterday") == -1);
+    CHECK(TimeUtil::timestamp_to_utctime(1476000000) == "2016-10-09T08:00:00Z");
+    CHECK(TimeUtil::timestamp_to_gmttime(1476000000) == "Sun, 09 Oct 2016 08:00:00 GMT");
+
+    char buffer[64];
+    CHECK(TimeUtil::format_gmttime(253402300800LL, buffer) == 0U);
+    CHECK(TimeUtil::format_utctime(-62167219201LL, buffer) == 0U);
+}
+
+void test_cached()
+{
+    for (int i = 0; i < 3; ++i) {
+        time_t before = TimeUtil::now();
+        std::string gmt = TimeUtil::cached_gmttime();
+        std::string utc = TimeUtil::cached_utctime();
+        time_t after = TimeUtil::now();
+        CHECK(gmt == TimeUtil::timestamp_to_gmttime(before)
+                || gmt == TimeUtil::timestamp_to_gmttime(after));
+        CHECK(utc == TimeUtil::timestamp_to_utctime(before)
+                || utc == TimeUtil::timestamp_to_utctime(after));
+    }
+
+    HttpResponse response;
+    response.write_body(const_cast<char *>("HTTP/1.1 200 OK\r\n"), 17);
+    std::string line = "Last-Modified: Sun, 06 Nov 1994 08:49:37 GMT\r\n";
+    response.write_body(&line[0], line.size());
+    response.write_body(const_cast<char *>("Expires: 0\r\n"), 12);
+    int64_t ts = 0;
+    CHECK(response.get_response_date("last-modified", &ts) == RET_OK && ts == 784111777);
+    CHECK(response.get_response_date("Expires", &ts) == RET_ILLEGAL_ARGUMENT);
+    CHECK(response.get_response_date("Date", &ts) == RET_ILLEGAL_ARGUMENT);
+}
+
+void test_clocks()
+{
+    int64_t last_ns = TimeUtil::monotonic_ns();
+    for (int i = 0; i < 100000; ++i) {
+        int64_t ns = TimeUtil::monotonic_ns();
+        CHECK(ns >= last_ns);
+        last_ns = ns;
+    }
+    // the coarse clock lags by at most a tick of a few milliseconds
+    int64_t coarse = TimeUtil::coarse_monotonic_ms();
+    int64_t fine = TimeUtil::monotonic_ms();
+    CHECK(coarse <= fine + 1 && fine - coarse < 50);
+    CHECK(TimeUtil::monotonic_us() / 1000 - TimeUtil::monotonic_ms() <= 1);
+
+    int ret = TimeUtil::enable_tsc(20);
+    CHECK(ret == RET_OK || ret == RET_ILLEGAL_OPERATION);
+    CHECK(TimeUtil::is_tsc_enabled() == (ret == RET_OK));
+    int64_t tsc = TimeUtil::tsc_ns();
+    int64_t mono = TimeUtil::monotonic_ns();
+    CHECK(tsc - mono < 5000000 && mono - tsc < 5000000);
+    int64_t last_tsc = TimeUtil::tsc_ns();
+    for (int i = 0; i < 100000; ++i) {
+        int64_t ns = TimeUtil::tsc_ns();
+        CHECK(ns >= last_tsc);
+        last_tsc = ns;
+    }
+
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t cond;
+    TimeUtil::init_cond(&cond);
+    struct timespec ts;
+    int64_t start = TimeUtil::monotonic_ms();
+    TimeUtil::cond_abstime(30 * 1000, &ts);
+    pthread_mutex_lock(&mutex);
+    while (pthread_cond_timedwait(&cond, &mutex, &ts) != ETIMEDOUT) {
+    }
+    pthread_mutex_unlock(&mutex);
+    int64_t waited = TimeUtil::monotonic_ms() - start;
+    CHECK(waited >= 29 && waited < 1000);
+    pthread_cond_destroy(&cond);
+}
+
+END_NAMESPACE
+
+int main(int argc, char ** argv)
+{
+    http4cpp_ns::test_against_libc();
+    http4cpp_ns::test_http_date();
+    http4cpp_ns::test_rfc3339();
+    http4cpp_ns::test_cached();
+    http4cpp_ns::test_clocks();
+    std::cout << (http4cpp_ns::s_failures == 0 ? "PASS" : "FAIL") << std::endl;
+    return http4cpp_ns::s_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "common/common.h"
+#include "common/util.h"
+#include "common/tracer.h"
+
+BEGIN_NAMESPACE
+
+log_level_t g_log_level = LOG_LEVEL_WARN;
+bool g_log_behind       = false;
+
+static int s_failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        std::cout << __FILE__ << "(" << __LINE__ << ") check failed: " #cond << std::endl; \
+        ++s_failures; \
+    } \
+} while (0)
+
+static std::string read_file(const char *path)
+{
+    std::string content;
+    FILE *fp = fopen(path, "r");
+    char buf[4096];
+    size_t n = 0;
+    while (fp != NULL && (n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        content.append(buf, n);
+    }
+    if (fp != NULL) {
+        fclose(fp);
+    }
+    return content;
+}
+
+static size_t count(const std::string &content, const std::string &needle)
+{
+    size_t n = 0;
+    for (size_t pos = content.find(needle); pos != std::string::npos;
+            pos = content.find(needle, pos + needle.size())) {
+        ++n;
+    }
+    return n;
+}
+
+void test_traceparent()
+{
+    const std::string header = "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01";
+    TraceContext ctx;
+    CHECK(TraceContext::parse(header, &ctx) == RET_OK);
+    CHECK(ctx.trace_id_high == 0x4bf92f3577b34da6ULL);
+    CHECK(ctx.trace_id_low == 0xa3ce929d0e0e4736ULL);
+    CHECK(ctx.span_id == 0x00f067aa0ba902b7ULL);
+    CHECK(ctx.sampled);
+    CHECK(ctx.to_traceparent() == header);
+
+    // a later version may carry more fields
+    CHECK(TraceContext::parse(
+            "01-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-00-abc", &ctx) == RET_OK);
+    CHECK(!ctx.sampled);
+
+    const char *invalids[] = {
+        "",
+        "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-0",
+        "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01-",
+        "00-00000000000000000000000000000000-00f067aa0ba902b7-01",
+        "00-4bf92f3577b34da6a3ce929d0e0e4736-0000000000000000-01",
+        "00-4BF92F3577B34DA6A3CE929D0E0E4736-00f067aa0ba902b7-01",
+        "ff-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01",
+        "00_4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01",
+    };
+    for (size_t i = 0; i < sizeof(invalids) / sizeof(invalids[0]); ++i) {
+        TraceContext invalid;
+        CHECK(TraceContext::parse(invalids[i], &invalid) == RET_ILLEGAL_ARGUMENT);
+        CHECK(!invalid.is_valid());
+    }
+}
+
+void test_sampling()
+{
+    TracerOptions options;
+    options.sample_rate = 0;
+    Tracer never(options);
+    options.sample_rate = 1;
+    Tracer always(options);
+
+    TraceContext none;
+    for (int i = 0; i < 1000; ++i) {
+        TraceContext ctx;
+        never.start_trace(none, &ctx);
+        CHECK(ctx.is_valid() && !ctx.sampled);
+        always.start_trace(none, &ctx);
+        CHECK(ctx.is_valid() && ctx.sampled);
+    }
+
+    // a remote parent decides for the whole trace
+    TraceContext parent;
+    TraceContext::parse("00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01", &parent);
+    TraceContext ctx;
+    never.start_trace(parent, &ctx);
+    CHECK(ctx.sampled);
+    CHECK(ctx.trace_id_low == parent.trace_id_low);
+    CHECK(ctx.span_id != parent.span_id);
+
+    TracerStat stat;
+    never.get_stat(&stat);
+    CHECK(stat.sampled == 1U);
+    always.get_stat(&stat);
+    CHECK(stat.sampled == 1000U);
+}
+
+void test_export()
+{
+    char path[64];
+    strcpy(path, "/tmp/tracer_test.XXXXXX");
+    close(mkstemp(path));
+
+    TracerOptions options;
+    options.sample_rate = 1;
+    options.file_name = path;
+    options.max_pending_spans = 4;
+    Tracer tracer(options);
+    CHECK(tracer.start() == RET_OK);
+    CHECK(tracer.start() == RET_ILLEGAL_OPERATION);
+
+    TraceContext ctx;
+    tracer.start_trace(TraceContext(), &ctx);
+    std::vector<Span> spans(3);
+    for (size_t i = 0; i < spans.size(); ++i) {
+        spans[i].name = "step";
+        spans[i].trace_id_high = ctx.trace_id_high;
+        spans[i].trace_id_low = ctx.trace_id_low;
+        spans[i].span_id = Tracer::new_span_id();
+        spans[i].parent_span_id = ctx.span_id;
+        spans[i].start_us = TimeUtil::monotonic_us();
+        spans[i].duration_us = 10;
+        spans[i].tid = Tracer::current_tid();
+    }
+    spans[0].detail = "GET \"http://a/b\"\n";
+    std::vector<Span> dropped = spans;
+    std::vector<Span> later = spans;
+    tracer.record(&spans);
+    CHECK(spans.empty());
+    // beyond the pending limit the whole batch is dropped
+    tracer.record(&dropped);
+    CHECK(dropped.empty());
+    CHECK(tracer.flush() == RET_OK);
+    tracer.record(&later);
+    tracer.stop();
+
+    TracerStat stat;
+    tracer.get_stat(&stat);
+    CHECK(stat.exported == 6U);
+    CHECK(stat.dropped == 3U);
+
+    std::string content = read_file(path);
+    unlink(path);
+    CHECK(content.compare(0, 2, "[\n") == 0);
+    CHECK(content.compare(content.size() - 3, 3, "\n]\n") == 0);
+    CHECK(count(content, "\"ph\":\"X\"") == 6U);
+    CHECK(count(content, "},\n{") == 5U);
+    CHECK(content.find("\"detail\":\"GET \\\"http://a/b\\\"\\u000a\"") != std::string::npos);
+    CHECK(content.find(ctx.to_traceparent().substr(3, 32)) != std::string::npos);
+}
+
+END_NAMESPACE
+
+int main(int argc, char ** argv)
+{
+    http4cpp_ns::test_traceparent();
+    http4cpp_ns::test_sampling();
+    http4cpp_ns::test_export();
+    std::cout << (http4cpp_ns::s_failures == 0 ? "PASS" : "FAIL") << std::endl;
+    return http4cpp_ns::s_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,160 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "common/common.h"
+#include "common/url_codec.h"
+#include "common/util.h"
+#include "http_request.h"
+
+BEGIN_NAMESPACE
+
+log_level_t g_log_level = LOG_LEVEL_WARN;
+bool g_log_behind       = false;
+
+static int s_failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        std::cout << __FILE__ << "(" << __LINE__ << ") check failed: " #cond << std::endl; \
+        ++s_failures; \
+    } \
+} while (0)
+
+static const simd_kernel_t s_kernels[] = {
+    SIMD_KERNEL_SCALAR, SIMD_KERNEL_SSE41, SIMD_KERNEL_AVX2
+};
+
+// the character by character encoding UrlCodec replaced
+static std::string reference_encode(const std::string &src, bool encode_slash)
+{
+    std::string result;
+    for (size_t i = 0; i < src.size(); ++i) {
+        unsigned char c = src[i];
+        if (isalnum(c) || c == '_' || c == '-' || c == '~' || c == '.' || c == '&') {
+            result.push_back(c);
+        } else if (c == '/' && !encode_slash) {
+            result.push_back(c);
+        } else {
+            result.push_back('%');
+            result.append(StringUtil::hex(c));
+        }
+    }
+    return result;
+}
+
+static std::string random_text(size_t size, int escaped_percent)
+{
+    static const char safe[] = "abcXYZ019-._~&/";
+    std::string text(size, 'a');
+    for (size_t i = 0; i < size; ++i) {
+        if (rand() % 100 < escaped_percent) {
+            text[i] = static_cast<char>(rand() & 0xff);
+        } else {
+            text[i] = safe[rand() % (sizeof(safe) - 1)];
+        }
+    }
+    return text;
+}
+
+void test_encode()
+{
+    CHECK(StringUtil::url_encode("a b/c?d=e&f") == "a%20b%2Fc%3Fd%3De&f");
+    CHECK(StringUtil::url_encode("a b/c", false) == "a%20b/c");
+    CHECK(StringUtil::url_encode("\xe4\xb8\xad") == "%E4%B8%AD");
+    CHECK(StringUtil::url_encode("") == "");
+
+    std::string output = "/path?";
+    StringUtil::url_encode("k v", &output);
+    CHECK(output == "/path?k%20v");
+
+    std::string text = "plain-text_with.some~safe&chars";
+    CHECK(UrlCodec::safe_prefix(text.data(), text.size(), URL_CHARSET_DEFAULT) == text.size());
+    CHECK(UrlCodec::safe_prefix(text.data(), text.size(), URL_CHARSET_UNRESERVED) == 25U);
+}
+
+void test_decode()
+{
+    CHECK(StringUtil::url_decode("a%20b%2Fc%3fd") == "a b/c?d");
+    CHECK(StringUtil::url_decode("%E4%B8%AD") == "\xe4\xb8\xad");
+    // malformed escapes are kept
+    CHECK(StringUtil::url_decode("100%") == "100%");
+    CHECK(StringUtil::url_decode("%4") == "%4");
+    CHECK(StringUtil::url_decode("%zz%41") == "%zzA");
+    CHECK(StringUtil::url_decode("a+b") == "a+b");
+
+    std::string output = "x";
+    StringUtil::url_decode("%41", &output);
+    CHECK(output == "xA");
+}
+
+// every kernel must match the reference on all lengths and mixes
+void test_kernels()
+{
+    for (size_t k = 0; k < sizeof(s_kernels) / sizeof(s_kernels[0]); ++k) {
+        if (UrlCodec::set_kernel(s_kernels[k]) != RET_OK) {
+            std::cout << "skip " << CpuFeatures::kernel_name(s_kernels[k]) << std::endl;
+            continue;
+        }
+        for (size_t size = 0; size < 200; ++size) {
+            for (int escaped = 0; escaped <= 50; escaped += 5) {
+                std::string text = random_text(size, escaped);
+                CHECK(StringUtil::url_encode(text) == reference_encode(text, true));
+                CHECK(StringUtil::url_encode(text, false) == reference_encode(text, false));
+                CHECK(StringUtil::url_decode(StringUtil::url_encode(text)) == text);
+            }
+        }
+        // every byte value at every offset of a vector block
+        for (int c = 0; c < 256; ++c) {
+            for (size_t pos = 0; pos < 70; ++pos) {
+                std::string text(70, 'a');
+                text[pos] = static_cast<char>(c);
+                size_t prefix = UrlCodec::safe_prefix(text.data(), text.size(),
+                        URL_CHARSET_DEFAULT);
+                CHECK(prefix == (reference_encode(text.substr(pos, 1), true).size() == 1 ?
+                        text.size() : pos));
+            }
+        }
+    }
+    UrlCodec::set_kernel(CpuFeatures::best_kernel());
+}
+
+void test_query_builder()
+{
+    QueryBuilder query("http://127.0.0.1/bucket/object");
+    query.add("uploadId", "a&b=c d").add("partNumber", 7).add("acl");
+    CHECK(query.get_url() == "http://127.0.0.1/bucket/object?uploadId=a%26b%3Dc%20d"
+            "&partNumber=7&acl");
+
+    query.reset();
+    CHECK(query.get_url() == "http://127.0.0.1/bucket/object");
+    query.add("max-keys", -1);
+    CHECK(query.get_url() == "http://127.0.0.1/bucket/object?max-keys=-1");
+
+    QueryBuilder with_query("/list?");
+    with_query.add("prefix", "a/b");
+    CHECK(with_query.get_url() == "/list?prefix=a%2Fb");
+    QueryBuilder more("/list?v=1");
+    more.add("k", "");
+    CHECK(more.get_url() == "/list?v=1&k=");
+
+    HttpRequest request;
+    request.set_url(query.get_url());
+    CHECK(request.get_url() == query.get_url());
+}
+
+END_NAMESPACE
+
+int main(int argc, char ** argv)
+{
+    http4cpp_ns::test_encode();
+    http4cpp_ns::test_decode();
+    http4cpp_ns::test_kernels();
+    http4cpp_ns::test_query_builder();
+    std::cout << (http4cpp_ns::s_failures == 0 ? "PASS" : "FAIL") << std::endl;
+    return http4cpp_ns::s_failures == 0 ? 0 : 1;
+}
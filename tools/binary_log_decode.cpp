@@ -0,0 +1,59 @@
+/**
+ * A http programming framework implemented by C++ based on libcurl
+ *
+ * Copyright 2016 (c), Oshyn Song (dualyangsong@gmail.com)
+ *
+ * Distributed under the Apache License Version 2.0
+ * http://www.apache.org/licenses/LICENSE-2.0
+ */
+#include <stdio.h>
+
+#include <string>
+
+#include "common/common.h"
+#include "common/util.h"
+#include "common/binary_log.h"
+
+BEGIN_NAMESPACE
+
+log_level_t g_log_level = LOG_LEVEL_WARN;
+bool g_log_behind       = false;
+
+END_NAMESPACE
+
+// Renders binary log files written by BinaryLog as text on stdout.
+int main(int argc, char ** argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <binary log file>...\n", argv[0]);
+        return 2;
+    }
+
+    int ret = 0;
+    for (int i = 1; i < argc; ++i) {
+        FILE *fp = fopen(argv[i], "rb");
+        if (fp == NULL) {
+            fprintf(stderr, "open %s failed\n", argv[i]);
+            ret = 1;
+            continue;
+        }
+        std::string content;
+        char buf[64 * 1024];
+        size_t n = 0;
+        while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+            content.append(buf, n);
+        }
+        fclose(fp);
+
+        std::string text;
+        if (http4cpp_ns::BinaryLog::decode(content.data(), content.size(), &text)
+                != http4cpp_ns::RET_OK) {
+            fprintf(stderr, "%s is not a binary log\n", argv[i]);
+            ret = 1;
+            continue;
+        }
+        fwrite(text.data(), 1, text.size(), stdout);
+    }
+    return ret;
+}
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */